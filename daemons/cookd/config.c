@@ -73,9 +73,13 @@ static json_t* __serialize_config_address(struct config_address* address)
     return root;
 }
 
+#define __DEFAULT_BUILDER_COUNT 1
+
 struct config {
     struct config_address api_address;
     struct config_address cvd_address;
+    int                   builder_count;
+    int                   partition_cpus;
 };
 
 static struct config g_config = { 0 };
@@ -109,6 +113,8 @@ static json_t* __serialize_config(struct config* config)
     
     json_object_set_new(root, "api-address", api_address);
     json_object_set_new(root, "cvd-address", cvd_address);
+    json_object_set_new(root, "builder-count", json_integer(config->builder_count));
+    json_object_set_new(root, "partition-cpus", json_boolean(config->partition_cpus));
     return root;
 }
 
@@ -150,6 +156,16 @@ static int __parse_config(struct config* config, json_t* root)
             return status;
         }
     }
+
+    member = json_object_get(root, "builder-count");
+    if (member != NULL && json_integer_value(member) > 0) {
+        config->builder_count = (int)json_integer_value(member);
+    }
+
+    member = json_object_get(root, "partition-cpus");
+    if (member != NULL) {
+        config->partition_cpus = json_is_true(member);
+    }
     return 0;
 }
 
@@ -175,6 +191,10 @@ static int __load_config(struct config* config, const char* path)
     json_t*      root;
     int          status;
 
+    // defaults for members that older configurations do not have
+    config->builder_count = __DEFAULT_BUILDER_COUNT;
+    config->partition_cpus = 1;
+
     root = json_load_file(path, 0, &error);
     if (root == NULL) {
         if (json_error_code(&error) == json_error_cannot_open_file) {
@@ -229,3 +249,13 @@ void cookd_config_cvd_address(struct cookd_config_address* address)
     address->address = g_config.cvd_address.address;
     address->port = g_config.cvd_address.port;
 }
+
+int cookd_config_builder_count(void)
+{
+    return g_config.builder_count > 0 ? g_config.builder_count : __DEFAULT_BUILDER_COUNT;
+}
+
+int cookd_config_partition_cpus(void)
+{
+    return g_config.partition_cpus;
+}
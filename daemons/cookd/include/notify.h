@@ -21,6 +21,11 @@
 
 #include <gracht/client.h>
 
+/**
+ * @brief Registers the cook with waiterd, announcing how many builds it can run at once.
+ */
+extern int cookd_notify_ready(gracht_client_t* client, int builders);
+
 enum cookd_notify_build_status {
     COOKD_BUILD_STATUS_QUEUED,
     COOKD_BUILD_STATUS_SOURCING,
@@ -45,4 +50,10 @@ enum cookd_notify_artifact_type {
  */
 extern int cookd_notify_artifact_ready(gracht_client_t* client, const char* id, enum cookd_notify_artifact_type type, const char* uri);
 
+/**
+ * @brief Reports the number of builds that are waiting or running, waiterd uses it
+ * to decide when it can hand more builds to the cook.
+ */
+extern int cookd_notify_queue_size(gracht_client_t* client, int queueSize);
+
 #endif //!__COOKD_NOTIFY_H__
@@ -0,0 +1,40 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __COOKD_PARTITION_H__
+#define __COOKD_PARTITION_H__
+
+struct cookd_partition {
+    // cpuset.cpus formatted list of CPUs, e.g. "0-3,8"
+    char cpus[256];
+    // cpuset.mems formatted list of NUMA nodes, empty if the host
+    // topology is unknown
+    char mems[32];
+};
+
+/**
+ * @brief Partitions the host CPUs between the builders. Builders are spread across the
+ * NUMA nodes, and each builder gets an exclusive slice of the CPUs of its node and is bound
+ * to the memory of that node. If there are more builders than CPUs on a node, the CPUs are shared.
+ * @param builderCount The number of builders, and the length of partitions
+ * @param partitions Array of builderCount partitions that are filled in
+ * @return 0 on success, -1 if the CPU topology could not be read
+ */
+extern int cookd_partition_cpus(int builderCount, struct cookd_partition* partitions);
+
+#endif //!__COOKD_PARTITION_H__
@@ -32,19 +32,28 @@ extern int cookd_server_init(gracht_client_t* client, int builderCount);
 extern void cookd_server_cleanup(void);
 
 struct cookd_status {
-    int queue_size;
+    int queue_size; // builds waiting and running
+    int running;
 };
 
 /**
- * @brief
+ * @brief Retrieves the number of builds that have been queued and not finished yet
  */
 extern void cookd_server_status(struct cookd_status* status);
 
+enum cookd_build_priority {
+    COOKD_BUILD_PRIORITY_INTERACTIVE,
+    COOKD_BUILD_PRIORITY_BATCH,
+
+    COOKD_BUILD_PRIORITY_COUNT
+};
+
 struct cookd_build_options {
-    const char* platform;
-    const char* architecture;
-    const char* url;
-    const char* recipe_path;
+    const char*               platform;
+    const char*               architecture;
+    const char*               url;
+    const char*               recipe_path;
+    enum cookd_build_priority priority;
 };
 
 extern int cookd_server_queue_build(const char* id, struct cookd_build_options* options);
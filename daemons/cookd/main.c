@@ -17,6 +17,7 @@
  */
 
 #include <chef/dirs.h>
+#include <notify.h>
 #include <server.h>
 #include <vlog.h>
 
@@ -104,16 +105,14 @@ int main(int argc, char** argv)
     gracht_client_register_protocol(client, &chef_waiterd_cook_client_protocol);
 
     // initialize the server
-    status = cookd_server_init(client, 1 /* needs to be configurable */);
+    status = cookd_server_init(client, cookd_config_builder_count());
     if (status) {
         VLOG_ERROR("cookd", "failed to initialize server subsystem\n");
         goto cleanup;
     }
 
     VLOG_TRACE("cookd", "registering with server\n");
-    status = chef_waiterd_cook_ready(client, NULL, &(struct chef_cook_ready_event) { 
-        .archs = CHEF_BUILD_ARCHITECTURE_X64 
-    });
+    status = cookd_notify_ready(client, cookd_config_builder_count());
 
     VLOG_TRACE("cookd", "entering main message loop\n");
     for (;;) {
@@ -47,6 +47,16 @@ extern void cookd_config_api_address(struct cookd_config_address* address);
  */
 extern void cookd_config_cvd_address(struct cookd_config_address* address);
 
+/**
+ * @brief Returns the number of builders cookd runs concurrently.
+ */
+extern int cookd_config_builder_count(void);
+
+/**
+ * @brief Returns whether the cpus should be partitioned between the builders.
+ */
+extern int cookd_config_partition_cpus(void);
+
 /**
  * @brief
  */
@@ -21,6 +21,16 @@
 #include <server.h>
 #include <vlog.h>
 
+static enum cookd_build_priority __priority(enum chef_build_priority priority)
+{
+    switch (priority) {
+        case CHEF_BUILD_PRIORITY_BATCH:
+            return COOKD_BUILD_PRIORITY_BATCH;
+        default:
+            return COOKD_BUILD_PRIORITY_INTERACTIVE;
+    }
+}
+
 static const char* __architecture(enum chef_build_architecture arch)
 {
     switch (arch) {
@@ -66,7 +76,8 @@ void chef_waiterd_cook_event_build_request_invocation(gracht_client_t* client, c
         .architecture = __architecture(request->arch),
         .platform = request->platform,
         .url = request->url,
-        .recipe_path = request->recipe
+        .recipe_path = request->recipe,
+        .priority = __priority(request->priority)
     });
     if (status) {
         VLOG_ERROR("api", "failed to queue build id %s\n", id);
@@ -20,8 +20,31 @@
 #include "chef_waiterd_cook_service_client.h"
 #include <notify.h>
 #include <server.h>
+#include <threads.h>
 #include <vlog.h>
 
+// Builds report their progress from the builder threads, and the gracht client
+// must not be used by more than one thread at a time, so every event sent by
+// cookd goes through this lock.
+static once_flag g_notifyOnce = ONCE_FLAG_INIT;
+static mtx_t     g_notifyLock;
+
+static void __notify_initialize(void)
+{
+    mtx_init(&g_notifyLock, mtx_plain);
+}
+
+static void __notify_lock(void)
+{
+    call_once(&g_notifyOnce, __notify_initialize);
+    mtx_lock(&g_notifyLock);
+}
+
+static void __notify_unlock(void)
+{
+    mtx_unlock(&g_notifyLock);
+}
+
 enum chef_build_status __to_protocol_status(enum cookd_notify_build_status cstatus)
 {
     switch (cstatus) {
@@ -35,12 +58,30 @@ enum chef_build_status __to_protocol_status(enum cookd_notify_build_status cstat
     }
 }
 
+int cookd_notify_ready(gracht_client_t* client, int builders)
+{
+    int status;
+
+    __notify_lock();
+    status = chef_waiterd_cook_ready(client, NULL, &(struct chef_cook_ready_event) {
+        .archs = CHEF_BUILD_ARCHITECTURE_X64,
+        .builders = builders
+    });
+    __notify_unlock();
+    return status;
+}
+
 int cookd_notify_status_update(gracht_client_t* client, const char* id, enum cookd_notify_build_status status)
 {
-    return chef_waiterd_cook_status(client, NULL, &(struct chef_cook_build_event) {
+    int result;
+
+    __notify_lock();
+    result = chef_waiterd_cook_status(client, NULL, &(struct chef_cook_build_event) {
         .id = (char*)id,
         .status = __to_protocol_status(status)
     });
+    __notify_unlock();
+    return result;
 }
 
 enum chef_artifact_type __to_protocol_atype(enum cookd_notify_artifact_type ctype)
@@ -54,9 +95,26 @@ enum chef_artifact_type __to_protocol_atype(enum cookd_notify_artifact_type ctyp
 
 int cookd_notify_artifact_ready(gracht_client_t* client, const char* id, enum cookd_notify_artifact_type type, const char* uri)
 {
-    return chef_waiterd_cook_artifact(client, NULL, &(struct chef_cook_artifact_event) {
+    int status;
+
+    __notify_lock();
+    status = chef_waiterd_cook_artifact(client, NULL, &(struct chef_cook_artifact_event) {
         .id = (char*)id,
         .type = __to_protocol_atype(type),
         .uri = (char*)uri
     });
-}
\ No newline at end of file
+    __notify_unlock();
+    return status;
+}
+
+int cookd_notify_queue_size(gracht_client_t* client, int queueSize)
+{
+    int status;
+
+    __notify_lock();
+    status = chef_waiterd_cook_update(client, NULL, &(struct chef_cook_update_event) {
+        .queue_size = queueSize
+    });
+    __notify_unlock();
+    return status;
+}
@@ -0,0 +1,246 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <partition.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlog.h>
+
+#ifdef CHEF_ON_LINUX
+#include <dirent.h>
+
+#define __MAX_NODES 64
+#define __MAX_CPUS  1024
+
+struct __numa_node {
+    int id;
+    int cpus[__MAX_CPUS];
+    int cpu_count;
+    // number of builders assigned to the node
+    int builders;
+};
+
+static int __read_line(const char* path, char* buffer, size_t length)
+{
+    FILE* file;
+    int   status = -1;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if (fgets(buffer, (int)length, file) != NULL) {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        status = 0;
+    }
+    fclose(file);
+    return status;
+}
+
+// Parses a kernel cpu list, e.g. "0-3,8-11", into an array of cpu numbers
+static int __parse_cpulist(const char* list, int* cpus, int maxCount)
+{
+    const char* p = list;
+    int         count = 0;
+
+    while (*p != '\0') {
+        char* end;
+        long  first, last;
+
+        first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last && count < maxCount; cpu++) {
+            cpus[count++] = (int)cpu;
+        }
+
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return count;
+}
+
+// Formats the cpus back into a cpu list, consecutive cpus are merged into ranges
+static void __format_cpulist(const int* cpus, int count, char* buffer, size_t length)
+{
+    size_t used = 0;
+
+    buffer[0] = '\0';
+    for (int i = 0; i < count && used < length; ) {
+        int j = i;
+        int written;
+
+        while (j + 1 < count && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+
+        if (j == i) {
+            written = snprintf(&buffer[used], length - used, "%s%d", used ? "," : "", cpus[i]);
+        } else {
+            written = snprintf(&buffer[used], length - used, "%s%d-%d", used ? "," : "", cpus[i], cpus[j]);
+        }
+        if (written < 0) {
+            break;
+        }
+        used += (size_t)written;
+        i = j + 1;
+    }
+}
+
+static int __read_numa_nodes(struct __numa_node* nodes, int maxCount)
+{
+    struct dirent* entry;
+    DIR*           dir;
+    int            count = 0;
+
+    dir = opendir("/sys/devices/system/node");
+    if (dir == NULL) {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL && count < maxCount) {
+        char path[256];
+        char list[1024];
+        int  id;
+
+        if (sscanf(entry->d_name, "node%d", &id) != 1) {
+            continue;
+        }
+
+        snprintf(&path[0], sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+        if (__read_line(&path[0], &list[0], sizeof(list))) {
+            continue;
+        }
+
+        // memory-only nodes have no cpus, and are of no use to the builders
+        nodes[count].id = id;
+        nodes[count].cpu_count = __parse_cpulist(&list[0], &nodes[count].cpus[0], __MAX_CPUS);
+        nodes[count].builders = 0;
+        if (nodes[count].cpu_count > 0) {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// Used when the kernel is built without NUMA support, all online cpus are
+// then treated as one node without any memory binding
+static int __read_online_cpus(struct __numa_node* node)
+{
+    char list[1024];
+
+    if (__read_line("/sys/devices/system/cpu/online", &list[0], sizeof(list))) {
+        return 0;
+    }
+
+    node->id = -1;
+    node->cpu_count = __parse_cpulist(&list[0], &node->cpus[0], __MAX_CPUS);
+    node->builders = 0;
+    return node->cpu_count > 0 ? 1 : 0;
+}
+
+int cookd_partition_cpus(int builderCount, struct cookd_partition* partitions)
+{
+    struct __numa_node* nodes;
+    int                 nodeCount;
+    int*                slots;
+    VLOG_DEBUG("cookd", "cookd_partition_cpus(builders=%i)\n", builderCount);
+
+    if (builderCount <= 0 || partitions == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    nodes = calloc(__MAX_NODES, sizeof(struct __numa_node));
+    slots = calloc((size_t)builderCount, sizeof(int));
+    if (nodes == NULL || slots == NULL) {
+        free(nodes);
+        free(slots);
+        return -1;
+    }
+
+    nodeCount = __read_numa_nodes(nodes, __MAX_NODES);
+    if (nodeCount == 0) {
+        nodeCount = __read_online_cpus(&nodes[0]);
+    }
+    if (nodeCount == 0) {
+        VLOG_WARNING("cookd", "cookd_partition_cpus: failed to read the cpu topology\n");
+        free(nodes);
+        free(slots);
+        errno = ENOENT;
+        return -1;
+    }
+
+    // spread the builders across the nodes first, and remember which slot on
+    // the node each builder got
+    for (int i = 0; i < builderCount; i++) {
+        slots[i] = nodes[i % nodeCount].builders++;
+    }
+
+    for (int i = 0; i < builderCount; i++) {
+        struct __numa_node* node = &nodes[i % nodeCount];
+
+        if (node->builders <= node->cpu_count) {
+            // each builder gets an exclusive and contiguous slice of the cpus
+            int start = (slots[i] * node->cpu_count) / node->builders;
+            int end = ((slots[i] + 1) * node->cpu_count) / node->builders;
+            __format_cpulist(&node->cpus[start], end - start, &partitions[i].cpus[0], sizeof(partitions[i].cpus));
+        } else {
+            // more builders than cpus, builders must share
+            __format_cpulist(&node->cpus[slots[i] % node->cpu_count], 1, &partitions[i].cpus[0], sizeof(partitions[i].cpus));
+        }
+
+        if (node->id >= 0) {
+            snprintf(&partitions[i].mems[0], sizeof(partitions[i].mems), "%d", node->id);
+        } else {
+            partitions[i].mems[0] = '\0';
+        }
+        VLOG_DEBUG("cookd", "cookd_partition_cpus: builder %i => cpus=%s, mems=%s\n",
+            i, &partitions[i].cpus[0], &partitions[i].mems[0]);
+    }
+
+    free(nodes);
+    free(slots);
+    return 0;
+}
+
+#else
+int cookd_partition_cpus(int builderCount, struct cookd_partition* partitions)
+{
+    (void)builderCount;
+    (void)partitions;
+    errno = ENOTSUP;
+    return -1;
+}
+#endif
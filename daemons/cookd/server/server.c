@@ -27,6 +27,7 @@
 #include <chef/store-default.h>
 #include <errno.h>
 #include <notify.h>
+#include <partition.h>
 #include <server.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +36,11 @@
 
 #include "../private.h"
 
+// The number of interactive builds that may be started in a row while batch
+// builds are waiting, after which a batch build goes first. Without it a steady
+// stream of interactive builds would starve the batch builds.
+#define __COOKD_INTERACTIVE_BURST 4
+
 struct __cookd_queue {
     // remember volatility means nothing in terms of memory
     // safety, but rather avoid the compiler optimizing the 
@@ -42,7 +48,9 @@ struct __cookd_queue {
     volatile int active;
     mtx_t        lock;
     cnd_t        signal;
-    struct list  queue;
+    struct list  queues[COOKD_BUILD_PRIORITY_COUNT]; // waiting builds per priority
+    int          running;
+    int          interactive_streak;
 };
 
 struct __cookd_builder_request {
@@ -65,6 +73,7 @@ static struct __cookd_builder_request* __cookd_builder_request_new(const char* i
     request->options.platform = platform_strdup(options->platform);
     request->options.url = platform_strdup(options->url);
     request->options.recipe_path = platform_strdup(options->recipe_path);
+    request->options.priority = options->priority;
     return request;
 }
 
@@ -92,9 +101,14 @@ struct __cookd_builder {
     thrd_t                     builder_id;
     enum __cookd_builder_state state;
     struct __cookd_queue*      queue;
+
+    // the cpus and memory nodes the builds of this builder are confined to,
+    // the limits are empty when the builder is not partitioned
+    struct cookd_partition        partition;
+    struct __bake_resource_limits limits;
 };
 
-static struct __cookd_builder* __cookd_builder_new(struct __cookd_queue* queue)
+static struct __cookd_builder* __cookd_builder_new(struct __cookd_queue* queue, const struct cookd_partition* partition)
 {
     struct __cookd_builder* builder;
 
@@ -104,6 +118,14 @@ static struct __cookd_builder* __cookd_builder_new(struct __cookd_queue* queue)
     }
     builder->state = __COOKD_BUILDER_STATE_CREATED;
     builder->queue = queue;
+
+    if (partition != NULL) {
+        memcpy(&builder->partition, partition, sizeof(struct cookd_partition));
+        builder->limits.cpuset_cpus = &builder->partition.cpus[0];
+        if (builder->partition.mems[0] != '\0') {
+            builder->limits.cpuset_mems = &builder->partition.mems[0];
+        }
+    }
     return builder;
 }
 
@@ -115,7 +137,42 @@ static void __cookd_builder_delete(struct __cookd_builder* builder)
     free(builder);
 }
 
-static void __cookd_server_build(const char* id, struct cookd_build_options* options);
+static void __cookd_server_build(const char* id, struct cookd_build_options* options, const struct __bake_resource_limits* limits);
+static void __cookd_server_queue_changed(void);
+
+static int __cookd_queue_waiting(struct __cookd_queue* queue)
+{
+    int count = 0;
+    for (int i = 0; i < COOKD_BUILD_PRIORITY_COUNT; i++) {
+        count += queue->queues[i].count;
+    }
+    return count;
+}
+
+// Takes the next build off the queue, the queue lock must be held. Interactive
+// builds go first, up to a burst while batch builds are waiting.
+static struct __cookd_builder_request* __cookd_queue_pop(struct __cookd_queue* queue)
+{
+    struct list* interactive = &queue->queues[COOKD_BUILD_PRIORITY_INTERACTIVE];
+    struct list* batch = &queue->queues[COOKD_BUILD_PRIORITY_BATCH];
+    struct list* source = NULL;
+    struct list_item* item;
+
+    if (interactive->count > 0 &&
+        (batch->count == 0 || queue->interactive_streak < __COOKD_INTERACTIVE_BURST)) {
+        source = interactive;
+        queue->interactive_streak++;
+    } else if (batch->count > 0) {
+        source = batch;
+        queue->interactive_streak = 0;
+    } else {
+        return NULL;
+    }
+
+    item = source->head;
+    list_remove(source, item);
+    return (struct __cookd_builder_request*)item;
+}
 
 static int __cookd_builder_main(void* arg)
 {
@@ -129,28 +186,28 @@ static int __cookd_builder_main(void* arg)
     for (;;) {
         mtx_lock(&this->queue->lock);
 
-        // cancellation point, so we can cleanup properly
-        if (!this->queue->active) {
-            mtx_unlock(&this->queue->lock);
-            break;
+        // check for work before waiting, builds queued while every builder
+        // was busy were signalled before anyone was waiting for them. The
+        // queue being stopped is the cancellation point.
+        request = NULL;
+        while (this->queue->active && (request = __cookd_queue_pop(this->queue)) == NULL) {
+            cnd_wait(&this->queue->signal, &this->queue->lock);
         }
 
-        cnd_wait(&this->queue->signal, &this->queue->lock);
-
-        // cancellation point, so we can cleanup properly
-        if (!this->queue->active) {
+        if (request == NULL) {
             mtx_unlock(&this->queue->lock);
             break;
         }
-
-        // pop request
-        request = (struct __cookd_builder_request*)this->queue->queue.head;
-        if (request != NULL) {
-            this->queue->queue.head = request->list_header.next;
-        }
+        this->queue->running++;
         mtx_unlock(&this->queue->lock);
-        __cookd_server_build(request->id, &request->options);
+
+        __cookd_server_build(request->id, &request->options, &this->limits);
         __cookd_builder_request_delete(request);
+
+        mtx_lock(&this->queue->lock);
+        this->queue->running--;
+        mtx_unlock(&this->queue->lock);
+        __cookd_server_queue_changed();
     }
 
     // update state again
@@ -174,6 +231,8 @@ struct __cookd_server {
     struct __cookd_queue queue;
     struct list          builders;
     gracht_client_t*     client;
+    // serializes queue size updates, so waiterd never ends up with a stale one
+    mtx_t                queue_notify_lock;
 };
 
 static struct __cookd_server* __cookd_server_new(gracht_client_t* client)
@@ -186,6 +245,7 @@ static struct __cookd_server* __cookd_server_new(gracht_client_t* client)
     }
 
     mtx_init(&server->queue.lock, mtx_plain);
+    mtx_init(&server->queue_notify_lock, mtx_plain);
     cnd_init(&server->queue.signal);
     server->queue.active = 1;
     server->client = client;
@@ -199,28 +259,63 @@ static void __cookd_server_delete(struct __cookd_server* server)
     }
 
     list_destroy(&server->builders, (void(*)(void*))__cookd_builder_delete);
-    list_destroy(&server->queue.queue, (void(*)(void*))__cookd_builder_request_delete);
+    for (int i = 0; i < COOKD_BUILD_PRIORITY_COUNT; i++) {
+        list_destroy(&server->queue.queues[i], (void(*)(void*))__cookd_builder_request_delete);
+    }
     mtx_destroy(&server->queue.lock);
+    mtx_destroy(&server->queue_notify_lock);
     cnd_destroy(&server->queue.signal);
 }
 
+// With multiple builders, each builder is confined to its own set of cpus and the
+// memory of the NUMA node those belong to, so concurrent builds do not compete for
+// the same cores and caches. A single builder is left to use the entire host.
+static struct cookd_partition* __cookd_server_partition(int builderCount)
+{
+    struct cookd_partition* partitions;
+
+    if (builderCount < 2 || !cookd_config_partition_cpus()) {
+        return NULL;
+    }
+
+    partitions = calloc((size_t)builderCount, sizeof(struct cookd_partition));
+    if (partitions == NULL) {
+        return NULL;
+    }
+
+    if (cookd_partition_cpus(builderCount, partitions)) {
+        VLOG_WARNING("cookd", "failed to partition cpus between builders, builders will share all cpus\n");
+        free(partitions);
+        return NULL;
+    }
+    return partitions;
+}
+
 static int __cookd_server_start(struct __cookd_server* server, int builderCount)
 {
+    struct cookd_partition* partitions;
     VLOG_DEBUG("cookd", "__cookd_server_start(builders=%i)\n", builderCount);
 
+    partitions = __cookd_server_partition(builderCount);
     for (int i = 0; i < builderCount; i++) {
-        struct __cookd_builder* builder = __cookd_builder_new(&server->queue);
+        struct __cookd_builder* builder = __cookd_builder_new(
+            &server->queue,
+            partitions != NULL ? &partitions[i] : NULL
+        );
         if (builder == NULL) {
             VLOG_ERROR("cookd", "failed to allocate memory for builder\n");
+            free(partitions);
             return -1;
         }
         list_add(&server->builders, &builder->list_header);
 
         if (__cookd_builder_start(builder)) {
             VLOG_ERROR("cookd", "failed to start builder %i\n", i);
+            free(partitions);
             return -1;
         }
     }
+    free(partitions);
     return 0;
 }
 
@@ -329,13 +424,33 @@ void cookd_server_status(struct cookd_status* status)
 
     if (g_server == NULL) {
         status->queue_size = 0;
+        status->running = 0;
         return;
     }
 
-    status->queue_size = g_server->queue.queue.count;
+    mtx_lock(&g_server->queue.lock);
+    status->running = g_server->queue.running;
+    status->queue_size = __cookd_queue_waiting(&g_server->queue) + g_server->queue.running;
+    mtx_unlock(&g_server->queue.lock);
+}
+
+// Lets waiterd know how busy we are whenever a build is queued or finishes, so it
+// can hand out the builds it is holding as soon as a builder becomes free. This is
+// invoked from the builder threads, the size is sampled and sent under one lock so
+// updates from different threads cannot arrive out of order.
+static void __cookd_server_queue_changed(void)
+{
+    struct cookd_status status;
+
+    mtx_lock(&g_server->queue_notify_lock);
+    cookd_server_status(&status);
+    if (cookd_notify_queue_size(g_server->client, status.queue_size)) {
+        VLOG_ERROR("cookd", "failed to notify waiterd of the queue size %i\n", status.queue_size);
+    }
+    mtx_unlock(&g_server->queue_notify_lock);
 }
 
-static int __prep_toolchains(struct list* platforms)
+static int __prep_toolchains(struct list* platforms, struct store_package_set* set)
 {
     struct list_item* item;
     VLOG_DEBUG("cookd", "__prep_toolchains()\n");
@@ -352,45 +467,39 @@ static int __prep_toolchains(struct list* platforms)
         
         status = recipe_parse_platform_toolchain(platform->toolchain, &name, &channel, &version);
         if (status) {
-            VLOG_ERROR("cookd", "failed to parse toolchain %s for platform %s", platform->toolchain, platform->name);
+            VLOG_ERROR("cookd", "failed to parse toolchain %s for platform %s\n", platform->toolchain, platform->name);
             return status;
         }
+        free(version);
 
-        status = store_ensure_package(&(struct store_package) {
-            .name = name,
-            .channel = channel,
-            .arch = CHEF_ARCHITECTURE_STR,
-            .platform = CHEF_PLATFORM_STR
-        }, NULL);
-        if (status) {
-            free(name);
+        // keep the parsed strings alive until the packages have been fetched
+        status = store_package_set_own(set, name);
+        if (status == 0) {
+            status = store_package_set_own(set, channel);
+        } else {
             free(channel);
-            free(version);
-            VLOG_ERROR("cookd", "failed to fetch ingredient %s\n", name);
+        }
+        if (status) {
+            return status;
+        }
+
+        status = store_package_set_add(set, name, channel, CHEF_PLATFORM_STR, CHEF_ARCHITECTURE_STR);
+        if (status) {
             return status;
         }
     }
     return 0;
 }
 
-static int __prep_ingredient_list(struct list* list, const char* platform, const char* arch)
+static int __prep_ingredient_list(struct list* list, const char* platform, const char* arch, struct store_package_set* set)
 {
     struct list_item* item;
-    int               status;
     VLOG_DEBUG("cookd", "__prep_ingredient_list(platform=%s, arch=%s)\n", platform, arch);
 
     list_foreach(list, item) {
         struct recipe_ingredient* ingredient = (struct recipe_ingredient*)item;
-
-        status = store_ensure_package(&(struct store_package) {
-            .name = ingredient->name,
-            .channel = ingredient->channel,
-            .arch = arch,
-            .platform = platform
-        }, NULL);
-        if (status) {
-            VLOG_ERROR("cookd", "failed to fetch ingredient %s\n", ingredient->name);
-            return status;
+        if (store_package_set_add(set, ingredient->name, ingredient->channel, platform, arch)) {
+            return -1;
         }
     }
     return 0;
@@ -398,54 +507,53 @@ static int __prep_ingredient_list(struct list* list, const char* platform, const
 
 static int __ensure_ingredients(struct recipe* recipe, const char* platform, const char* arch)
 {
-    int status;
+    struct store_package_set set = { 0 };
+    int                      status;
 
-    if (recipe->platforms.count > 0) {
-        VLOG_TRACE("cookd", "preparing %i platforms\n", recipe->platforms.count);
-        status = __prep_toolchains(
-            &recipe->platforms
-        );
-        if (status) {
-            return status;
-        }
+    // Collect everything the recipe needs up front, so it can all be
+    // fetched concurrently instead of one package at a time.
+    status = __prep_toolchains(&recipe->platforms, &set);
+    if (status == 0) {
+        status = __prep_ingredient_list(&recipe->environment.host.ingredients, CHEF_PLATFORM_STR, CHEF_ARCHITECTURE_STR, &set);
     }
-
-    if (recipe->environment.host.ingredients.count > 0) {
-        VLOG_TRACE("cookd", "preparing %i host ingredients\n", recipe->environment.host.ingredients.count);
-        status = __prep_ingredient_list(
-            &recipe->environment.host.ingredients,
-            CHEF_PLATFORM_STR,
-            CHEF_ARCHITECTURE_STR
-        );
-        if (status) {
-            return status;
-        }
+    if (status == 0) {
+        status = __prep_ingredient_list(&recipe->environment.build.ingredients, platform, arch, &set);
+    }
+    if (status == 0) {
+        status = __prep_ingredient_list(&recipe->environment.runtime.ingredients, platform, arch, &set);
     }
 
-    if (recipe->environment.build.ingredients.count > 0) {
-        VLOG_TRACE("cookd", "preparing %i build ingredients\n", recipe->environment.build.ingredients.count);
-        status = __prep_ingredient_list(
-            &recipe->environment.build.ingredients,
-            platform,
-            arch
-        );
+    if (status == 0 && set.count > 0) {
+        VLOG_TRACE("cookd", "preparing %i ingredients\n", set.count);
+        status = store_ensure_packages(set.packages, set.count, &(struct store_ensure_options) {
+            .verify_proofs = 1
+        }, NULL);
         if (status) {
-            return status;
+            VLOG_ERROR("cookd", "failed to fetch ingredients\n");
         }
     }
 
-    if (recipe->environment.runtime.ingredients.count > 0) {
-        VLOG_TRACE("cookd", "preparing %i runtime ingredients\n", recipe->environment.runtime.ingredients.count);
-        status = __prep_ingredient_list(
-            &recipe->environment.runtime.ingredients,
-            platform,
-            arch
-        );
-        if (status) {
-            return status;
-        }
+    store_package_set_destroy(&set);
+    return status;
+}
+
+// <cache> / chunks / <xx> / <hash>
+static int __restore_sources(const char* manifestPath, const char* projectPath)
+{
+    char* cachePath;
+    int   status;
+
+    // the chunk cache is shared between builds, so sources that did not change
+    // since an earlier build are never downloaded again
+    cachePath = strpathcombine(chef_dirs_cache(), "chunks");
+    if (cachePath == NULL) {
+        VLOG_ERROR("cookd", "__restore_sources: failed to allocate memory for chunk cache path\n");
+        return -1;
     }
-    return 0;
+
+    status = remote_sync_unpack(manifestPath, cachePath, projectPath);
+    free(cachePath);
+    return status;
 }
 
 // <root> / <id> / sources / 
@@ -488,8 +596,13 @@ static int __prepare_sources(const char* id, const char* root, const char* url,
         goto cleanup;
     }
 
-    // unpack it using our unmkvafs tool
-    status = remote_unpack(imagePath, projectPath);
+    // newer clients send a manifest of chunks, older ones an image that
+    // we unpack using our unmkvafs tool
+    if (remote_sync_is_manifest(imagePath)) {
+        status = __restore_sources(imagePath, projectPath);
+    } else {
+        status = remote_unpack(imagePath, projectPath);
+    }
     if (status) {
         VLOG_ERROR("cookd", "__prepare_sources: failed to unpack %s for build id %s\n", imagePath, id);
         goto cleanup;
@@ -613,7 +726,7 @@ static void __notify_status(const char* id, enum cookd_notify_build_status statu
     }
 }
 
-static void __cookd_server_build(const char* id, struct cookd_build_options* options)
+static void __cookd_server_build(const char* id, struct cookd_build_options* options, const struct __bake_resource_limits* limits)
 {
     struct __bake_build_context* context;
     struct build_cache*          cache = NULL;
@@ -678,7 +791,8 @@ static void __cookd_server_build(const char* id, struct cookd_build_options* opt
             .type = cvdAddress.type,
             .address = cvdAddress.address,
             .port = cvdAddress.port
-        }
+        },
+        .limits = limits
     });
     if (status) {
         VLOG_ERROR("cookd", "failed to initialize kitchen area for build id %s\n", id);
@@ -733,14 +847,20 @@ int cookd_server_queue_build(const char* id, struct cookd_build_options* options
     struct __cookd_builder_request* request;
     VLOG_DEBUG("cookd", "cookd_server_queue_build(id=%s, url=%s)\n", id, options->url);
 
+    if (options->priority < 0 || options->priority >= COOKD_BUILD_PRIORITY_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+
     request = __cookd_builder_request_new(id, options);
     if (request == NULL) {
         return -1;
     }
 
     mtx_lock(&g_server->queue.lock);
-    list_add(&g_server->queue.queue, &request->list_header);
+    list_add(&g_server->queue.queues[options->priority], &request->list_header);
     cnd_signal(&g_server->queue.signal);
     mtx_unlock(&g_server->queue.lock);
+    __cookd_server_queue_changed();
     return 0;
 }
@@ -150,12 +150,23 @@ static json_t* __serialize_config_lcow(struct config_lcow* lcow)
     return root;
 }
 
+// The number of network namespaces that are prepared ahead of time for containers
+#define __DEFAULT_NETWORK_POOL_SIZE 4
+
+// The number of output lines that are kept in memory per container
+#define __DEFAULT_LOG_LINES 1000
+
 struct config {
     struct config_address api_address;
     struct config_lcow    lcow;
+    int                   network_pool_size;
+    int                   log_lines;
 };
 
-static struct config g_config = { 0 };
+static struct config g_config = {
+    .network_pool_size = __DEFAULT_NETWORK_POOL_SIZE,
+    .log_lines = __DEFAULT_LOG_LINES
+};
 
 
 static json_t* __serialize_config(struct config* config)
@@ -184,6 +195,8 @@ static json_t* __serialize_config(struct config* config)
         json_object_set_new(root, "lcow", lcow);
     }
 
+    json_object_set_new(root, "network-pool-size", json_integer(config->network_pool_size));
+    json_object_set_new(root, "log-lines", json_integer(config->log_lines));
     return root;
 }
 
@@ -228,6 +241,16 @@ static int __parse_config(struct config* config, json_t* root)
         }
     }
 
+    member = json_object_get(root, "network-pool-size");
+    if (member != NULL) {
+        config->network_pool_size = (int)json_integer_value(member);
+    }
+
+    member = json_object_get(root, "log-lines");
+    if (member != NULL && json_integer_value(member) > 0) {
+        config->log_lines = (int)json_integer_value(member);
+    }
+
     return 0;
 }
 
@@ -299,3 +322,13 @@ void cvd_config_lcow(struct cvd_config_lcow* lcow)
     lcow->initrd_file = g_config.lcow.initrd_file;
     lcow->boot_parameters = g_config.lcow.boot_parameters;
 }
+
+int cvd_config_network_pool_size(void)
+{
+    return g_config.network_pool_size;
+}
+
+int cvd_config_log_lines(void)
+{
+    return g_config.log_lines;
+}
@@ -54,4 +54,65 @@ extern enum chef_status cvd_kill(const char* containerID, const unsigned int pID
  */
 extern enum chef_status cvd_destroy(const char* containerID);
 
+/**
+ * @brief Freezes the writable layer of the container into a VaFS image
+ * stored as /var/chef/snapshots/<key>.pack. The key must be a hex encoded sha256.
+ */
+extern enum chef_status cvd_snapshot(const char* containerID, const char* key);
+
+/**
+ * @brief Retrieves how long the container took to start, per phase. The phases
+ * are allocated by this function, and must be freed by the caller.
+ */
+extern enum chef_status cvd_timing(const char* containerID, struct chef_create_timing* timing);
+
+/**
+ * @brief Collects the stats of all containers. The ids in the returned stats are owned
+ * by the containers, only the array must be freed by the caller.
+ */
+extern enum chef_status cvd_stats(struct chef_container_stats** statsOut, uint32_t* countOut);
+
+struct containerv_container;
+
+/**
+ * @brief The monitor watches the memory events and pressure of all containers, and
+ * raises resource_event for them, so clients do not have to poll for stats.
+ */
+extern int  cvd_monitor_start(void);
+extern void cvd_monitor_stop(void);
+
+/**
+ * @brief Start and stop watching a container, a container must be removed from the
+ * monitor before it is destroyed.
+ */
+extern int  cvd_monitor_add(const char* containerID, struct containerv_container* handle);
+extern void cvd_monitor_remove(const char* containerID);
+
+/**
+ * @brief Reads the stdout and stderr of all containers on a single thread, and keeps the
+ * most recent lines of every container in memory for the logs api.
+ */
+extern int  cvd_logs_start(void);
+extern void cvd_logs_stop(void);
+
+/**
+ * @brief Returns non-zero if the output of new containers should be left to cvd_logs_add,
+ * otherwise containerv reads the output itself.
+ */
+extern int cvd_logs_running(void);
+
+/**
+ * @brief Start and stop capturing the output of a container, a container must be removed
+ * before it is destroyed. Removing a container discards its lines.
+ */
+extern int  cvd_logs_add(const char* containerID, struct containerv_container* handle);
+extern void cvd_logs_remove(const char* containerID);
+
+/**
+ * @brief Retrieves the lines of a container with a sequence number above since, at most
+ * max lines or all kept lines if max is 0. The lines are allocated by this function, and
+ * must be freed by the caller.
+ */
+extern enum chef_status cvd_logs_read(const char* containerID, uint64_t since, uint32_t max, struct chef_log_chunk* chunk);
+
 #endif //!__CVD_SERVER_H__
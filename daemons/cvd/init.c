@@ -17,6 +17,7 @@
  */
 
 #include <chef/platform.h>
+#include <chef/containerv.h>
 #include <chef/containerv/bpf.h>
 #include <gracht/link/socket.h>
 #include <gracht/server.h>
@@ -208,6 +209,25 @@ static void __initialize_bpf(void)
     atexit(containerv_bpf_shutdown);
 }
 
+#ifdef CHEF_ON_LINUX
+static void __initialize_network_pool(void)
+{
+    int size = cvd_config_network_pool_size();
+    VLOG_TRACE("cvd", "Initializing network pool\n");
+
+    if (size <= 0) {
+        VLOG_DEBUG("cvd", "network pool is disabled, containers will set up their own network\n");
+        return;
+    }
+
+    if (containerv_network_pool_start(size)) {
+        VLOG_WARNING("cvd", "Failed to start the network pool, containers will set up their own network\n");
+        return;
+    }
+    atexit(containerv_network_pool_stop);
+}
+#endif
+
 int cvd_initialize_server(struct gracht_server_configuration* config, gracht_server_t** serverOut)
 {
     int status;
@@ -221,6 +241,25 @@ int cvd_initialize_server(struct gracht_server_configuration* config, gracht_ser
     // Initialize BPF manager for eBPF-based security enforcement
     __initialize_bpf();
 
+#ifdef CHEF_ON_LINUX
+    // Prepare network namespaces ahead of time to keep network setup out of container startup
+    __initialize_network_pool();
+#endif
+
+    // Watch container resources to raise resource events
+    if (cvd_monitor_start()) {
+        VLOG_WARNING("cvd", "Failed to start the resource monitor, resource events will not be raised\n");
+    } else {
+        atexit(cvd_monitor_stop);
+    }
+
+    // Capture the output of all containers on one thread, instead of a thread per container
+    if (cvd_logs_start()) {
+        VLOG_WARNING("cvd", "Failed to start the log capture, container output will not be kept\n");
+    } else {
+        atexit(cvd_logs_stop);
+    }
+
     VLOG_TRACE("cvd", "Creating gracht server handler\n");
     status = gracht_server_create(config, serverOut);
     if (status) {
@@ -115,3 +115,8 @@ int main(int argc, char** argv)
     // use the default server loop
     return gracht_server_main_loop(g_server);
 }
+
+gracht_server_t* cvd_gracht_server(void)
+{
+    return g_server;
+}
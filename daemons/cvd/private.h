@@ -60,9 +60,24 @@ extern void cvd_config_api_address(struct cvd_config_address* address);
  */
 extern void cvd_config_lcow(struct cvd_config_lcow* lcow);
 
+/**
+ * @brief Returns the number of network namespaces to keep prepared for containers, 0 disables the pool.
+ */
+extern int cvd_config_network_pool_size(void);
+
+/**
+ * @brief Returns the number of output lines that are kept in memory per container.
+ */
+extern int cvd_config_log_lines(void);
+
 /**
  * @brief
  */
 extern int cvd_initialize_server(struct gracht_server_configuration* config, gracht_server_t** serverOut);
 
+/**
+ * @brief Returns the server instance, used to raise events from outside of the api handlers.
+ */
+extern gracht_server_t* cvd_gracht_server(void);
+
 #endif //!__CVD_PRIVATE_H__
@@ -18,6 +18,7 @@
 
 #include <chef/platform.h>
 #include <server.h>
+#include <stdlib.h>
 #include <vlog.h>
 
 void chef_cvd_create_invocation(struct gracht_message* message, const struct chef_create_parameters* params)
@@ -63,3 +64,43 @@ void chef_cvd_destroy_invocation(struct gracht_message* message, const char* con
     VLOG_DEBUG("api", "destroy(id=%s)\n", container_id);
     chef_cvd_destroy_response(message, cvd_destroy(container_id));
 }
+
+void chef_cvd_snapshot_invocation(struct gracht_message* message, const char* container_id, const char* key)
+{
+    VLOG_DEBUG("api", "snapshot(id=%s, key=%s)\n", container_id, key);
+    chef_cvd_snapshot_response(message, cvd_snapshot(container_id, key));
+}
+
+void chef_cvd_timing_invocation(struct gracht_message* message, const char* container_id)
+{
+    struct chef_create_timing timing = { 0 };
+    enum chef_status          status;
+    VLOG_DEBUG("api", "timing(id=%s)\n", container_id);
+
+    status = cvd_timing(container_id, &timing);
+    chef_cvd_timing_response(message, &timing, status);
+    free(timing.phases);
+}
+
+void chef_cvd_stats_invocation(struct gracht_message* message)
+{
+    struct chef_container_stats* stats = NULL;
+    uint32_t                     count = 0;
+    enum chef_status             status;
+    VLOG_DEBUG("api", "stats()\n");
+
+    status = cvd_stats(&stats, &count);
+    chef_cvd_stats_response(message, stats, count, status);
+    free(stats);
+}
+
+void chef_cvd_logs_invocation(struct gracht_message* message, const char* container_id, const unsigned long long since, const unsigned int max)
+{
+    struct chef_log_chunk chunk;
+    enum chef_status      status;
+    VLOG_DEBUG("api", "logs(id=%s, since=%llu, max=%u)\n", container_id, since, max);
+
+    status = cvd_logs_read(container_id, since, max, &chunk);
+    chef_cvd_logs_response(message, &chunk, status);
+    chef_log_chunk_destroy(&chunk);
+}
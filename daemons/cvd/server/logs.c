@@ -0,0 +1,485 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <server.h>
+#include <string.h>
+#include <vlog.h>
+
+#ifdef CHEF_ON_LINUX
+#include <chef/containerv.h>
+#include <chef/list.h>
+#include <chef/platform.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../private.h"
+
+#define __LOGS_MAX_EVENTS 64
+
+// Every wakeup reads at most this much from a single pipe, so one chatty
+// container can not starve the others
+#define __LOGS_READ_SIZE (64 * 1024)
+
+// Lines longer than this are split into several lines
+#define __LOGS_MAX_LINE_LENGTH 4096
+
+// The epoll key of the eventfd that stops the loop thread, streams start at 1
+#define __LOGS_WAKE_KEY 0
+
+struct __log_line {
+    uint64_t             sequence;
+    uint64_t             timestamp;
+    enum chef_log_stream stream;
+    char*                text;
+};
+
+struct __log_stream {
+    uint64_t             key;
+    int                  fd;
+    enum chef_log_stream type;
+    size_t               length;
+    char                 partial[__LOGS_MAX_LINE_LENGTH + 1];
+};
+
+// The lines of a container are kept in a ring, where the line with sequence
+// number N is stored at lines[N % capacity]
+struct __log {
+    struct list_item    item_header;
+    char*               container_id;
+    struct __log_stream streams[2];
+    struct __log_line*  lines;
+    size_t              capacity;
+    uint64_t            next_sequence;
+};
+
+static struct {
+    mtx_t       lock;
+    thrd_t      tid;
+    int         running;
+    int         epoll_fd;
+    int         wake_fd;
+    uint64_t    next_key;
+    size_t      capacity;
+    struct list logs;
+    char        buffer[__LOGS_READ_SIZE];
+} g_logs = { .epoll_fd = -1, .wake_fd = -1 };
+
+static uint64_t __timestamp_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void __log_delete(void* item)
+{
+    struct __log* log = item;
+    if (log == NULL) {
+        return;
+    }
+
+    // the descriptors are owned by the container
+    if (log->lines != NULL) {
+        for (size_t i = 0; i < log->capacity; i++) {
+            free(log->lines[i].text);
+        }
+        free(log->lines);
+    }
+    free(log->container_id);
+    free(log);
+}
+
+static void __log_commit(struct __log* log, struct __log_stream* stream)
+{
+    struct __log_line* line;
+    char*              text;
+
+    // drop carriage returns of CRLF line endings
+    if (stream->length > 0 && stream->partial[stream->length - 1] == '\r') {
+        stream->length--;
+    }
+    stream->partial[stream->length] = '\0';
+    stream->length = 0;
+
+    text = platform_strdup(&stream->partial[0]);
+    if (text == NULL) {
+        return;
+    }
+
+    line = &log->lines[log->next_sequence % log->capacity];
+    free(line->text);
+    line->sequence = log->next_sequence++;
+    line->timestamp = __timestamp_ns();
+    line->stream = stream->type;
+    line->text = text;
+    VLOG_TRACE("cvd", "[%s] %s\n", log->container_id, text);
+}
+
+// __log_append splits the data into lines, the last line is kept in the stream
+// until its newline arrives
+static void __log_append(struct __log* log, struct __log_stream* stream, const char* data, size_t length)
+{
+    while (length > 0) {
+        const char* newline = memchr(data, '\n', length);
+        size_t      count = newline != NULL ? (size_t)(newline - data) : length;
+        size_t      room = __LOGS_MAX_LINE_LENGTH - stream->length;
+        int         complete = newline != NULL;
+
+        if (count > room) {
+            count = room;
+            complete = 1;
+        }
+
+        memcpy(&stream->partial[stream->length], data, count);
+        stream->length += count;
+        data += count;
+        length -= count;
+
+        if (data == newline) {
+            data++;
+            length--;
+        }
+        if (complete) {
+            __log_commit(log, stream);
+        }
+    }
+}
+
+// __log_read drains a single read from the stream, returns -1 once the stream is closed
+static int __log_read(struct __log* log, struct __log_stream* stream)
+{
+    ssize_t n = read(stream->fd, &g_logs.buffer[0], sizeof(g_logs.buffer));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return 0;
+    }
+    if (n <= 0) {
+        if (stream->length > 0) {
+            __log_commit(log, stream);
+        }
+        return -1;
+    }
+
+    __log_append(log, stream, &g_logs.buffer[0], (size_t)n);
+    return 0;
+}
+
+static void __logs_handle(uint64_t key)
+{
+    struct list_item* i;
+
+    // The stream is looked up by its key, as the container may have been removed
+    // while the event was pending
+    mtx_lock(&g_logs.lock);
+    list_foreach(&g_logs.logs, i) {
+        struct __log* log = (struct __log*)i;
+        for (int j = 0; j < 2; j++) {
+            struct __log_stream* stream = &log->streams[j];
+            if (stream->key != key || stream->fd < 0) {
+                continue;
+            }
+
+            if (__log_read(log, stream)) {
+                (void)epoll_ctl(g_logs.epoll_fd, EPOLL_CTL_DEL, stream->fd, NULL);
+                stream->fd = -1;
+            }
+            mtx_unlock(&g_logs.lock);
+            return;
+        }
+    }
+    mtx_unlock(&g_logs.lock);
+}
+
+static int __logs_main(void* context)
+{
+    struct epoll_event events[__LOGS_MAX_EVENTS];
+    (void)context;
+
+    for (;;) {
+        int count = epoll_wait(g_logs.epoll_fd, &events[0], __LOGS_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_ERROR("cvd", "__logs_main: epoll_wait failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 == __LOGS_WAKE_KEY) {
+                return 0;
+            }
+            __logs_handle(events[i].data.u64);
+        }
+    }
+}
+
+int cvd_logs_start(void)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = __LOGS_WAKE_KEY };
+    VLOG_DEBUG("cvd", "cvd_logs_start()\n");
+
+    g_logs.capacity = (size_t)cvd_config_log_lines();
+    if (g_logs.capacity == 0) {
+        g_logs.capacity = 1;
+    }
+
+    g_logs.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_logs.epoll_fd < 0) {
+        VLOG_ERROR("cvd", "cvd_logs_start: failed to create epoll instance\n");
+        return -1;
+    }
+
+    g_logs.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_logs.wake_fd < 0 || epoll_ctl(g_logs.epoll_fd, EPOLL_CTL_ADD, g_logs.wake_fd, &event)) {
+        VLOG_ERROR("cvd", "cvd_logs_start: failed to create wake event\n");
+        goto error;
+    }
+
+    if (mtx_init(&g_logs.lock, mtx_plain) != thrd_success) {
+        goto error;
+    }
+
+    list_init(&g_logs.logs);
+    g_logs.next_key = __LOGS_WAKE_KEY + 1;
+    if (thrd_create(&g_logs.tid, __logs_main, NULL) != thrd_success) {
+        VLOG_ERROR("cvd", "cvd_logs_start: failed to start log thread\n");
+        mtx_destroy(&g_logs.lock);
+        goto error;
+    }
+    g_logs.running = 1;
+    return 0;
+
+error:
+    if (g_logs.wake_fd >= 0) {
+        close(g_logs.wake_fd);
+        g_logs.wake_fd = -1;
+    }
+    close(g_logs.epoll_fd);
+    g_logs.epoll_fd = -1;
+    return -1;
+}
+
+void cvd_logs_stop(void)
+{
+    uint64_t value = 1;
+
+    if (!g_logs.running) {
+        return;
+    }
+
+    if (write(g_logs.wake_fd, &value, sizeof(value)) == sizeof(value)) {
+        thrd_join(g_logs.tid, NULL);
+    }
+    g_logs.running = 0;
+
+    list_destroy(&g_logs.logs, __log_delete);
+    mtx_destroy(&g_logs.lock);
+    close(g_logs.wake_fd);
+    close(g_logs.epoll_fd);
+    g_logs.wake_fd = -1;
+    g_logs.epoll_fd = -1;
+}
+
+int cvd_logs_running(void)
+{
+    return g_logs.running;
+}
+
+int cvd_logs_add(const char* containerID, struct containerv_container* handle)
+{
+    struct __log* log;
+    int           fds[2];
+    VLOG_DEBUG("cvd", "cvd_logs_add(id=%s)\n", containerID);
+
+    if (!g_logs.running) {
+        return 0;
+    }
+
+    if (containerv_output_fds(handle, &fds[0], &fds[1])) {
+        VLOG_ERROR("cvd", "cvd_logs_add: the output of %s is not available\n", containerID);
+        return -1;
+    }
+
+    log = calloc(1, sizeof(struct __log));
+    if (log == NULL) {
+        return -1;
+    }
+
+    log->container_id = platform_strdup(containerID);
+    log->lines = calloc(g_logs.capacity, sizeof(struct __log_line));
+    if (log->container_id == NULL || log->lines == NULL) {
+        __log_delete(log);
+        return -1;
+    }
+    log->capacity = g_logs.capacity;
+    log->next_sequence = 1;
+    log->streams[0].type = CHEF_LOG_STREAM_STDOUT;
+    log->streams[1].type = CHEF_LOG_STREAM_STDERR;
+
+    mtx_lock(&g_logs.lock);
+    for (int i = 0; i < 2; i++) {
+        struct epoll_event event = { .events = EPOLLIN };
+
+        log->streams[i].fd = fds[i];
+        log->streams[i].key = g_logs.next_key++;
+        event.data.u64 = log->streams[i].key;
+        if (epoll_ctl(g_logs.epoll_fd, EPOLL_CTL_ADD, fds[i], &event)) {
+            VLOG_ERROR("cvd", "cvd_logs_add: failed to watch output of %s\n", containerID);
+            if (i > 0) {
+                (void)epoll_ctl(g_logs.epoll_fd, EPOLL_CTL_DEL, fds[0], NULL);
+            }
+            mtx_unlock(&g_logs.lock);
+            __log_delete(log);
+            return -1;
+        }
+    }
+    list_add(&g_logs.logs, &log->item_header);
+    mtx_unlock(&g_logs.lock);
+    return 0;
+}
+
+void cvd_logs_remove(const char* containerID)
+{
+    struct list_item* i;
+    VLOG_DEBUG("cvd", "cvd_logs_remove(id=%s)\n", containerID);
+
+    if (!g_logs.running) {
+        return;
+    }
+
+    mtx_lock(&g_logs.lock);
+    list_foreach(&g_logs.logs, i) {
+        struct __log* log = (struct __log*)i;
+        if (strcmp(log->container_id, containerID) != 0) {
+            continue;
+        }
+
+        for (int j = 0; j < 2; j++) {
+            if (log->streams[j].fd >= 0) {
+                (void)epoll_ctl(g_logs.epoll_fd, EPOLL_CTL_DEL, log->streams[j].fd, NULL);
+            }
+        }
+        list_remove(&g_logs.logs, i);
+        __log_delete(log);
+        break;
+    }
+    mtx_unlock(&g_logs.lock);
+}
+
+enum chef_status cvd_logs_read(const char* containerID, uint64_t since, uint32_t max, struct chef_log_chunk* chunk)
+{
+    struct list_item* i;
+    struct __log*     log = NULL;
+    uint64_t          first;
+    uint64_t          count;
+    VLOG_DEBUG("cvd", "cvd_logs_read(id=%s, since=%llu)\n", containerID, (unsigned long long)since);
+
+    memset(chunk, 0, sizeof(struct chef_log_chunk));
+    chunk->next = since;
+
+    mtx_lock(&g_logs.lock);
+    list_foreach(&g_logs.logs, i) {
+        if (strcmp(((struct __log*)i)->container_id, containerID) == 0) {
+            log = (struct __log*)i;
+            break;
+        }
+    }
+    if (log == NULL) {
+        mtx_unlock(&g_logs.lock);
+        return CHEF_STATUS_INVALID_CONTAINER_ID;
+    }
+
+    // skip ahead to the oldest line that is still kept
+    first = since + 1;
+    if (log->next_sequence > log->capacity && first < log->next_sequence - log->capacity) {
+        first = log->next_sequence - log->capacity;
+    }
+    count = first < log->next_sequence ? log->next_sequence - first : 0;
+    if (max != 0 && count > max) {
+        count = max;
+    }
+
+    if (count > 0) {
+        chunk->lines = calloc((size_t)count, sizeof(struct chef_log_line));
+        if (chunk->lines == NULL) {
+            mtx_unlock(&g_logs.lock);
+            return CHEF_STATUS_INTERNAL_ERROR;
+        }
+    }
+
+    for (uint64_t j = 0; j < count; j++) {
+        struct __log_line* line = &log->lines[(first + j) % log->capacity];
+        struct chef_log_line* out = &chunk->lines[chunk->lines_count];
+
+        out->text = platform_strdup(line->text);
+        if (out->text == NULL) {
+            break;
+        }
+        out->sequence = line->sequence;
+        out->timestamp = line->timestamp;
+        out->stream = line->stream;
+        chunk->lines_count++;
+        chunk->next = line->sequence;
+    }
+    mtx_unlock(&g_logs.lock);
+    return CHEF_STATUS_SUCCESS;
+}
+#else
+int cvd_logs_start(void)
+{
+    VLOG_DEBUG("cvd", "cvd_logs_start: container output is not captured on this platform\n");
+    return 0;
+}
+
+void cvd_logs_stop(void)
+{
+
+}
+
+int cvd_logs_running(void)
+{
+    return 0;
+}
+
+int cvd_logs_add(const char* containerID, struct containerv_container* handle)
+{
+    (void)containerID;
+    (void)handle;
+    return 0;
+}
+
+void cvd_logs_remove(const char* containerID)
+{
+    (void)containerID;
+}
+
+enum chef_status cvd_logs_read(const char* containerID, uint64_t since, uint32_t max, struct chef_log_chunk* chunk)
+{
+    (void)containerID;
+    (void)max;
+    memset(chunk, 0, sizeof(struct chef_log_chunk));
+    chunk->next = since;
+    return CHEF_STATUS_INVALID_CONTAINER_ID;
+}
+#endif
@@ -0,0 +1,368 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <server.h>
+#include <vlog.h>
+
+#ifdef CHEF_ON_LINUX
+#include <chef/containerv.h>
+#include <chef/list.h>
+#include <chef/platform.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "../private.h"
+
+// Pressure is reported once tasks in a container have been stalled for more
+// than 100ms within a window of 1s
+#define __PRESSURE_STALL_US  100000
+#define __PRESSURE_WINDOW_US 1000000
+
+#define __MONITOR_MAX_EVENTS 32
+
+// The epoll key of the eventfd that stops the monitor thread, watches start at 1
+#define __MONITOR_WAKE_KEY 0
+
+struct __watch {
+    struct list_item                item_header;
+    uint64_t                        key;
+    char*                           container_id;
+    enum containerv_watch_type      type;
+    int                             fd;
+    struct containerv_memory_events last;
+};
+
+static struct {
+    mtx_t       lock;
+    thrd_t      tid;
+    int         running;
+    int         epoll_fd;
+    int         wake_fd;
+    uint64_t    next_key;
+    struct list watches;
+} g_monitor = { .epoll_fd = -1, .wake_fd = -1 };
+
+static void __watch_delete(void* item)
+{
+    struct __watch* watch = item;
+    if (watch == NULL) {
+        return;
+    }
+
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    free(watch->container_id);
+    free(watch);
+}
+
+static enum chef_resource_event_type __pressure_event_type(enum containerv_watch_type type)
+{
+    switch (type) {
+        case CV_WATCH_PRESSURE_CPU:
+            return CHEF_RESOURCE_EVENT_TYPE_PRESSURE_CPU;
+        case CV_WATCH_PRESSURE_MEMORY:
+            return CHEF_RESOURCE_EVENT_TYPE_PRESSURE_MEMORY;
+        default:
+            return CHEF_RESOURCE_EVENT_TYPE_PRESSURE_IO;
+    }
+}
+
+static void __raise_if_increased(
+    struct chef_resource_event*   events,
+    int*                          count,
+    enum chef_resource_event_type type,
+    uint64_t                      previous,
+    uint64_t                      current)
+{
+    if (current > previous) {
+        events[*count].type = type;
+        events[*count].count = current;
+        (*count)++;
+    }
+}
+
+// __watch_process reads the state of a signalled watch, and fills in the events that
+// should be raised for it. Returns -1 if the watch no longer works.
+static int __watch_process(struct __watch* watch, struct chef_resource_event* events, int* count)
+{
+    struct containerv_memory_events current;
+
+    // PSI triggers reset themselves once they have been reported
+    if (watch->type != CV_WATCH_MEMORY_EVENTS) {
+        events[(*count)++].type = __pressure_event_type(watch->type);
+        return 0;
+    }
+
+    // Reading memory.events also acknowledges the notification
+    if (containerv_read_memory_events(watch->fd, &current)) {
+        return -1;
+    }
+
+    __raise_if_increased(events, count, CHEF_RESOURCE_EVENT_TYPE_MEMORY_HIGH, watch->last.high, current.high);
+    __raise_if_increased(events, count, CHEF_RESOURCE_EVENT_TYPE_MEMORY_MAX, watch->last.max, current.max);
+    __raise_if_increased(events, count, CHEF_RESOURCE_EVENT_TYPE_MEMORY_OOM, watch->last.oom, current.oom);
+    __raise_if_increased(events, count, CHEF_RESOURCE_EVENT_TYPE_MEMORY_OOM_KILL, watch->last.oom_kill, current.oom_kill);
+    watch->last = current;
+    return 0;
+}
+
+static void __monitor_handle(uint64_t key)
+{
+    struct chef_resource_event events[4] = { 0 };
+    struct list_item*          i;
+    char*                      containerId = NULL;
+    int                        count = 0;
+    gracht_server_t*           server;
+
+    // The watch is looked up by its key, as it may have been removed while
+    // the event was pending
+    mtx_lock(&g_monitor.lock);
+    list_foreach(&g_monitor.watches, i) {
+        struct __watch* watch = (struct __watch*)i;
+        if (watch->key != key) {
+            continue;
+        }
+
+        if (__watch_process(watch, &events[0], &count)) {
+            VLOG_WARNING("cvd", "__monitor_handle: watch for %s stopped working\n", watch->container_id);
+            (void)epoll_ctl(g_monitor.epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+        } else if (count > 0) {
+            containerId = platform_strdup(watch->container_id);
+        }
+        break;
+    }
+    mtx_unlock(&g_monitor.lock);
+
+    if (containerId == NULL) {
+        return;
+    }
+
+    server = cvd_gracht_server();
+    for (int j = 0; j < count && server != NULL; j++) {
+        VLOG_DEBUG("cvd", "resource event %i for container %s\n", events[j].type, containerId);
+        events[j].container_id = containerId;
+        chef_cvd_event_resource_event_all(server, &events[j]);
+    }
+    free(containerId);
+}
+
+static int __monitor_main(void* context)
+{
+    struct epoll_event events[__MONITOR_MAX_EVENTS];
+    (void)context;
+
+    for (;;) {
+        int count = epoll_wait(g_monitor.epoll_fd, &events[0], __MONITOR_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_ERROR("cvd", "__monitor_main: epoll_wait failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 == __MONITOR_WAKE_KEY) {
+                return 0;
+            }
+            __monitor_handle(events[i].data.u64);
+        }
+    }
+}
+
+int cvd_monitor_start(void)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = __MONITOR_WAKE_KEY };
+    VLOG_DEBUG("cvd", "cvd_monitor_start()\n");
+
+    g_monitor.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_monitor.epoll_fd < 0) {
+        VLOG_ERROR("cvd", "cvd_monitor_start: failed to create epoll instance\n");
+        return -1;
+    }
+
+    g_monitor.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_monitor.wake_fd < 0 || epoll_ctl(g_monitor.epoll_fd, EPOLL_CTL_ADD, g_monitor.wake_fd, &event)) {
+        VLOG_ERROR("cvd", "cvd_monitor_start: failed to create wake event\n");
+        goto error;
+    }
+
+    if (mtx_init(&g_monitor.lock, mtx_plain) != thrd_success) {
+        goto error;
+    }
+
+    list_init(&g_monitor.watches);
+    g_monitor.next_key = __MONITOR_WAKE_KEY + 1;
+    if (thrd_create(&g_monitor.tid, __monitor_main, NULL) != thrd_success) {
+        VLOG_ERROR("cvd", "cvd_monitor_start: failed to start monitor thread\n");
+        mtx_destroy(&g_monitor.lock);
+        goto error;
+    }
+    g_monitor.running = 1;
+    return 0;
+
+error:
+    if (g_monitor.wake_fd >= 0) {
+        close(g_monitor.wake_fd);
+        g_monitor.wake_fd = -1;
+    }
+    close(g_monitor.epoll_fd);
+    g_monitor.epoll_fd = -1;
+    return -1;
+}
+
+void cvd_monitor_stop(void)
+{
+    uint64_t value = 1;
+
+    if (!g_monitor.running) {
+        return;
+    }
+
+    if (write(g_monitor.wake_fd, &value, sizeof(value)) == sizeof(value)) {
+        thrd_join(g_monitor.tid, NULL);
+    }
+    g_monitor.running = 0;
+
+    list_destroy(&g_monitor.watches, __watch_delete);
+    mtx_destroy(&g_monitor.lock);
+    close(g_monitor.wake_fd);
+    close(g_monitor.epoll_fd);
+    g_monitor.wake_fd = -1;
+    g_monitor.epoll_fd = -1;
+}
+
+static int __monitor_add_watch(const char* containerID, struct containerv_container* handle, enum containerv_watch_type type)
+{
+    struct epoll_event event = { .events = EPOLLPRI };
+    struct __watch*    watch;
+
+    watch = calloc(1, sizeof(struct __watch));
+    if (watch == NULL) {
+        return -1;
+    }
+
+    watch->type = type;
+    watch->container_id = platform_strdup(containerID);
+    watch->fd = containerv_watch_open(handle, type, __PRESSURE_STALL_US, __PRESSURE_WINDOW_US);
+    if (watch->container_id == NULL || watch->fd < 0) {
+        __watch_delete(watch);
+        return -1;
+    }
+
+    // only changes from here on should be raised
+    if (type == CV_WATCH_MEMORY_EVENTS) {
+        (void)containerv_read_memory_events(watch->fd, &watch->last);
+    }
+
+    mtx_lock(&g_monitor.lock);
+    watch->key = g_monitor.next_key++;
+    event.data.u64 = watch->key;
+    if (epoll_ctl(g_monitor.epoll_fd, EPOLL_CTL_ADD, watch->fd, &event)) {
+        mtx_unlock(&g_monitor.lock);
+        __watch_delete(watch);
+        return -1;
+    }
+    list_add(&g_monitor.watches, &watch->item_header);
+    mtx_unlock(&g_monitor.lock);
+    return 0;
+}
+
+int cvd_monitor_add(const char* containerID, struct containerv_container* handle)
+{
+    static const enum containerv_watch_type types[] = {
+        CV_WATCH_MEMORY_EVENTS,
+        CV_WATCH_PRESSURE_CPU,
+        CV_WATCH_PRESSURE_MEMORY,
+        CV_WATCH_PRESSURE_IO
+    };
+    int added = 0;
+    VLOG_DEBUG("cvd", "cvd_monitor_add(id=%s)\n", containerID);
+
+    if (!g_monitor.running) {
+        return 0;
+    }
+
+    // Watches are best-effort, containers without cgroups or kernels without
+    // PSI just do not raise the events
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (__monitor_add_watch(containerID, handle, types[i]) == 0) {
+            added++;
+        }
+    }
+
+    if (added == 0) {
+        VLOG_DEBUG("cvd", "cvd_monitor_add: no resource events available for %s\n", containerID);
+    }
+    return 0;
+}
+
+void cvd_monitor_remove(const char* containerID)
+{
+    struct list_item* i;
+    struct list_item* tmp;
+    VLOG_DEBUG("cvd", "cvd_monitor_remove(id=%s)\n", containerID);
+
+    if (!g_monitor.running) {
+        return;
+    }
+
+    mtx_lock(&g_monitor.lock);
+    list_foreach_safe(&g_monitor.watches, i, tmp) {
+        struct __watch* watch = (struct __watch*)i;
+        if (strcmp(watch->container_id, containerID) != 0) {
+            continue;
+        }
+
+        (void)epoll_ctl(g_monitor.epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+        list_remove(&g_monitor.watches, i);
+        __watch_delete(watch);
+    }
+    mtx_unlock(&g_monitor.lock);
+}
+#else
+int cvd_monitor_start(void)
+{
+    VLOG_DEBUG("cvd", "cvd_monitor_start: resource events are not supported on this platform\n");
+    return 0;
+}
+
+void cvd_monitor_stop(void)
+{
+
+}
+
+int cvd_monitor_add(const char* containerID, struct containerv_container* handle)
+{
+    (void)containerID;
+    (void)handle;
+    return 0;
+}
+
+void cvd_monitor_remove(const char* containerID)
+{
+    (void)containerID;
+}
+#endif
@@ -23,15 +23,23 @@
 #include <chef/containerv/policy.h>
 #include <chef/dirs.h>
 #include <chef/package.h>
+#include <chef/package_image.h>
 #include <chef/platform.h>
 #include <chef/environment.h>
 #include <errno.h>
 #include <server.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <vlog.h>
 
+#ifdef CHEF_ON_LINUX
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#endif
+
 #include "../private.h"
 
 struct __container {
@@ -273,6 +281,41 @@ static void __create_container_params_cleanup(struct __create_container_params*
 }
 
 #ifdef CHEF_ON_LINUX
+static int __has_resource_limits(const struct chef_resource_limits* limits)
+{
+    return __is_nonempty(limits->memory_max) || __is_nonempty(limits->memory_high) ||
+        __is_nonempty(limits->cpu_weight) || __is_nonempty(limits->cpu_max) ||
+        __is_nonempty(limits->cpuset_cpus) || __is_nonempty(limits->cpuset_mems) ||
+        __is_nonempty(limits->io_weight) || __is_nonempty(limits->io_max) ||
+        __is_nonempty(limits->pids_max);
+}
+
+#define __LIMIT_OR(value, fallback) (__is_nonempty(value) ? (value) : (fallback))
+
+// Limits that are not specified by the client are left unlimited, instead of
+// falling back to the containerv defaults which are meant for ad-hoc containers.
+static void __apply_resource_limits(struct containerv_options* opts, const struct chef_resource_limits* limits)
+{
+    containerv_options_set_cgroup_limits(
+        opts,
+        __LIMIT_OR(limits->memory_max, "max"),
+        __LIMIT_OR(limits->cpu_weight, NULL),
+        __LIMIT_OR(limits->pids_max, "max")
+    );
+    containerv_options_set_memory_high(opts, __LIMIT_OR(limits->memory_high, NULL));
+    containerv_options_set_cpu_limits(
+        opts,
+        __LIMIT_OR(limits->cpu_max, NULL),
+        __LIMIT_OR(limits->cpuset_cpus, NULL),
+        __LIMIT_OR(limits->cpuset_mems, NULL)
+    );
+    containerv_options_set_io_limits(
+        opts,
+        __LIMIT_OR(limits->io_weight, NULL),
+        __LIMIT_OR(limits->io_max, NULL)
+    );
+}
+
 static enum chef_status __create_linux_container(const struct chef_create_parameters* params, struct __create_container_params* containerParams)
 {
     struct containerv_policy* policy;
@@ -327,7 +370,18 @@ static enum chef_status __create_linux_container(const struct chef_create_parame
         caps |= CV_CAP_NETWORK;
     }
 
+    if (__has_resource_limits(&params->limits)) {
+        VLOG_DEBUG("cvd", "cvd_create: applying resource limits\n");
+        __apply_resource_limits(containerParams->opts, &params->limits);
+        caps |= CV_CAP_CGROUPS;
+    }
+
     containerv_options_set_caps(containerParams->opts, caps);
+    containerv_options_set_exec_helper(
+        containerParams->opts,
+        (params->options & CHEF_CREATE_OPTIONS_EXEC_HELPER) != 0
+    );
+    containerv_options_set_external_output(containerParams->opts, cvd_logs_running());
     
     status = containerv_create(
         containerParams->id,
@@ -684,6 +738,8 @@ enum chef_status cvd_create(const struct chef_create_parameters* params, const c
     _container->layer_context = containerParams.layer_context;
     
     list_add(&g_server.containers, &_container->item_header);
+    (void)cvd_monitor_add(_container->id, _container->handle);
+    (void)cvd_logs_add(_container->id, _container->handle);
     *id = _container->id;
     return CHEF_STATUS_SUCCESS;
 }
@@ -896,6 +952,8 @@ enum chef_status cvd_destroy(const char* containerID)
 
     // Remove from list first
     list_remove(&g_server.containers, &container->item_header);
+    cvd_monitor_remove(container->id);
+    cvd_logs_remove(container->id);
 
     status = containerv_destroy(container->handle);
     if (status) {
@@ -911,3 +969,210 @@ enum chef_status cvd_destroy(const char* containerID)
     __container_delete(container);
     return status == 0 ? CHEF_STATUS_SUCCESS : __chef_status_from_errno();
 }
+
+#define __SNAPSHOT_DIRECTORY  "/var/chef/snapshots"
+#define __SNAPSHOT_KEY_LENGTH 64
+
+// The key ends up in a path written by the daemon, so only accept exactly
+// what the client computes (a hex encoded sha256) and nothing that could
+// be used to escape the snapshot directory.
+static int __snapshot_key_is_valid(const char* key)
+{
+    size_t i;
+
+    if (key == NULL) {
+        return 0;
+    }
+
+    for (i = 0; key[i] != '\0'; i++) {
+        if (!((key[i] >= '0' && key[i] <= '9') || (key[i] >= 'a' && key[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return i == __SNAPSHOT_KEY_LENGTH;
+}
+
+#ifdef CHEF_ON_LINUX
+static int __whiteout_visitor(const char* path, const struct stat* st, int type, struct FTW* ftw)
+{
+    char value[2];
+    (void)ftw;
+
+    // whiteouts are 0:0 character devices, opaque directories are marked by
+    // an xattr, both only make sense on top of the lower layers they hide from
+    if (type == FTW_F && S_ISCHR(st->st_mode) && st->st_rdev == 0) {
+        return 1;
+    }
+    if (type == FTW_D && getxattr(path, "trusted.overlay.opaque", &value[0], sizeof(value)) > 0) {
+        return 1;
+    }
+    return 0;
+}
+
+static int __upperdir_has_whiteouts(const char* upperDir)
+{
+    return nftw(upperDir, __whiteout_visitor, 16, FTW_PHYS) == 1;
+}
+#else
+static int __upperdir_has_whiteouts(const char* upperDir)
+{
+    (void)upperDir;
+    return 0;
+}
+#endif
+
+enum chef_status cvd_snapshot(const char* containerID, const char* key)
+{
+    struct __container* container;
+    const char*         upperDir;
+    char                path[PATH_MAX];
+    char                tmpPath[PATH_MAX];
+    int                 status;
+    VLOG_DEBUG("cvd", "cvd_snapshot(id=%s, key=%s)\n", containerID, key);
+
+    if (!__snapshot_key_is_valid(key)) {
+        VLOG_ERROR("cvd", "cvd_snapshot: invalid snapshot key\n");
+        return CHEF_STATUS_INTERNAL_ERROR;
+    }
+
+    container = __find_container(containerID);
+    if (container == NULL) {
+        VLOG_ERROR("cvd", "cvd_snapshot: failed to find container %s\n", containerID);
+        return CHEF_STATUS_INVALID_CONTAINER_ID;
+    }
+
+    upperDir = containerv_layers_get_upperdir(container->layer_context);
+    if (upperDir == NULL) {
+        VLOG_ERROR("cvd", "cvd_snapshot: container %s has no writable layer\n", containerID);
+        return CHEF_STATUS_INVALID_MOUNTS;
+    }
+
+    // A snapshot is mounted as a plain lower layer, where whiteouts cannot be
+    // represented. Packing the upper layer anyway would bring back whatever the
+    // setup removed, so such workspaces are never snapshotted.
+    if (__upperdir_has_whiteouts(upperDir)) {
+        VLOG_DEBUG("cvd", "cvd_snapshot: %s removes files from lower layers, not snapshotting\n", upperDir);
+        return CHEF_STATUS_FAILED_ROOTFS_SETUP;
+    }
+
+    if (platform_mkdir(__SNAPSHOT_DIRECTORY)) {
+        VLOG_ERROR("cvd", "cvd_snapshot: failed to create %s\n", __SNAPSHOT_DIRECTORY);
+        return __chef_status_from_errno();
+    }
+
+    // Build the image next to the destination, and then move it into place. This
+    // way readers will never observe a partially written snapshot.
+    snprintf(&path[0], sizeof(path), "%s/%s.pack", __SNAPSHOT_DIRECTORY, key);
+    snprintf(&tmpPath[0], sizeof(tmpPath), "%s.tmp", &path[0]);
+    status = chef_package_image_create(&(struct chef_package_image_options) {
+        .input_dir = upperDir,
+        .output_path = &tmpPath[0],
+        .manifest = &(struct chef_package_manifest) {
+            .name = "rootfs-snapshot",
+            .platform = CHEF_PLATFORM_STR,
+            .architecture = CHEF_ARCHITECTURE_STR,
+            .type = CHEF_PACKAGE_TYPE_OSBASE,
+            .summary = containerID
+        }
+    });
+    if (status) {
+        VLOG_ERROR("cvd", "cvd_snapshot: failed to create image from %s\n", upperDir);
+        platform_unlink(&tmpPath[0]);
+        return __chef_status_from_errno();
+    }
+
+    status = rename(&tmpPath[0], &path[0]);
+    if (status) {
+        VLOG_ERROR("cvd", "cvd_snapshot: failed to move snapshot into %s\n", &path[0]);
+        platform_unlink(&tmpPath[0]);
+        return __chef_status_from_errno();
+    }
+    return CHEF_STATUS_SUCCESS;
+}
+
+enum chef_status cvd_timing(const char* containerID, struct chef_create_timing* timing)
+{
+#ifdef CHEF_ON_LINUX
+    struct __container*             container;
+    struct containerv_create_timing cvTiming;
+    VLOG_DEBUG("cvd", "cvd_timing(id=%s)\n", containerID);
+
+    container = __find_container(containerID);
+    if (container == NULL) {
+        VLOG_ERROR("cvd", "cvd_timing: failed to find container %s\n", containerID);
+        return CHEF_STATUS_INVALID_CONTAINER_ID;
+    }
+
+    if (containerv_get_create_timing(container->handle, &cvTiming)) {
+        VLOG_ERROR("cvd", "cvd_timing: failed to get timing of container %s\n", containerID);
+        return __chef_status_from_errno();
+    }
+
+    timing->phases = calloc(CV_CREATE_PHASE_COUNT, sizeof(struct chef_create_phase));
+    if (timing->phases == NULL) {
+        VLOG_ERROR("cvd", "cvd_timing: failed to allocate memory for phases\n");
+        return CHEF_STATUS_INTERNAL_ERROR;
+    }
+
+    for (int i = 0; i < CV_CREATE_PHASE_COUNT; i++) {
+        timing->phases[i].name = (char*)containerv_create_phase_name((enum containerv_create_phase)i);
+        timing->phases[i].duration_us = cvTiming.phases_us[i];
+    }
+    timing->phases_count = CV_CREATE_PHASE_COUNT;
+    timing->total_us = cvTiming.total_us;
+    return CHEF_STATUS_SUCCESS;
+#else
+    VLOG_ERROR("cvd", "cvd_timing: startup timing is not supported on this platform\n");
+    return CHEF_STATUS_INTERNAL_ERROR;
+#endif
+}
+
+enum chef_status cvd_stats(struct chef_container_stats** statsOut, uint32_t* countOut)
+{
+    struct chef_container_stats* stats;
+    struct list_item*            i;
+    uint32_t                     count = 0;
+    VLOG_DEBUG("cvd", "cvd_stats()\n");
+
+    *statsOut = NULL;
+    *countOut = 0;
+    if (g_server.containers.count == 0) {
+        return CHEF_STATUS_SUCCESS;
+    }
+
+    stats = calloc((size_t)g_server.containers.count, sizeof(struct chef_container_stats));
+    if (stats == NULL) {
+        VLOG_ERROR("cvd", "cvd_stats: failed to allocate memory for stats\n");
+        return CHEF_STATUS_INTERNAL_ERROR;
+    }
+
+    list_foreach(&g_server.containers, i) {
+        struct __container*     container = (struct __container*)i;
+        struct containerv_stats cvStats;
+
+        if (containerv_get_stats(container->handle, &cvStats)) {
+            VLOG_WARNING("cvd", "cvd_stats: failed to get stats of container %s\n", container->id);
+            continue;
+        }
+
+        stats[count].id = container->id;
+        stats[count].timestamp = cvStats.timestamp;
+        stats[count].cpu_time_ns = cvStats.cpu_time_ns;
+        stats[count].memory_usage = cvStats.memory_usage;
+        stats[count].memory_peak = cvStats.memory_peak;
+        stats[count].read_bytes = cvStats.read_bytes;
+        stats[count].write_bytes = cvStats.write_bytes;
+        stats[count].read_ops = cvStats.read_ops;
+        stats[count].write_ops = cvStats.write_ops;
+        stats[count].network_rx_bytes = cvStats.network_rx_bytes;
+        stats[count].network_tx_bytes = cvStats.network_tx_bytes;
+        stats[count].network_rx_packets = cvStats.network_rx_packets;
+        stats[count].network_tx_packets = cvStats.network_tx_packets;
+        stats[count].active_processes = cvStats.active_processes;
+        count++;
+    }
+
+    *statsOut = stats;
+    *countOut = count;
+    return CHEF_STATUS_SUCCESS;
+}
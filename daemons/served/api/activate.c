@@ -0,0 +1,99 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <activation.h>
+#include <chef/platform.h>
+#include <errno.h>
+#include <gracht/server.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <vlog.h>
+
+#include "chef_served_service_server.h"
+
+struct __activate_request {
+    char* container_id;
+    void* source;
+};
+
+// Creating the container waits for cvd, which must not stall the served main
+// loop, so the response is deferred and sent from here.
+static int __activate_main(void* context)
+{
+    struct __activate_request* request = context;
+    int                        status = 0;
+
+    if (served_activation_acquire(request->container_id)) {
+        status = errno;
+    }
+    chef_served_activate_response(request->source, status);
+
+    free(request->container_id);
+    free(request->source);
+    free(request);
+    return 0;
+}
+
+void chef_served_activate_invocation(struct gracht_message* message, const char* container_id)
+{
+    struct __activate_request* request;
+    thrd_t                     thread;
+    VLOG_DEBUG("api", "chef_served_activate_invocation(container_id=%s)\n", container_id);
+
+    if (served_activation_try_acquire(container_id) == 0) {
+        chef_served_activate_response(message, 0);
+        return;
+    } else if (errno != EAGAIN) {
+        chef_served_activate_response(message, errno);
+        return;
+    }
+
+    request = calloc(1, sizeof(struct __activate_request));
+    if (request == NULL) {
+        chef_served_activate_response(message, ENOMEM);
+        return;
+    }
+
+    request->container_id = platform_strdup(container_id);
+    request->source = malloc(GRACHT_MESSAGE_DEFERRABLE_SIZE(message));
+    if (request->container_id == NULL || request->source == NULL) {
+        free(request->container_id);
+        free(request->source);
+        free(request);
+        chef_served_activate_response(message, ENOMEM);
+        return;
+    }
+    gracht_server_defer_message(message, request->source);
+
+    if (thrd_create(&thread, __activate_main, request) != thrd_success) {
+        VLOG_ERROR("api", "chef_served_activate_invocation: failed to start activation thread\n");
+        chef_served_activate_response(request->source, EAGAIN);
+        free(request->container_id);
+        free(request->source);
+        free(request);
+        return;
+    }
+    thrd_detach(thread);
+}
+
+void chef_served_deactivate_invocation(struct gracht_message* message, const char* container_id)
+{
+    VLOG_DEBUG("api", "chef_served_deactivate_invocation(container_id=%s)\n", container_id);
+    served_activation_release(container_id);
+    chef_served_deactivate_response(message);
+}
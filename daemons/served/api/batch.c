@@ -0,0 +1,156 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/platform.h>
+#include <gracht/server.h>
+#include <state.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+#include <vlog.h>
+
+#include <transaction/transaction.h>
+
+#include <runner.h>
+#include "api.h"
+#include "chef_served_service_server.h"
+
+struct __batch_member {
+    char name[256];
+    char description[512];
+};
+
+static int __is_valid_package(const char* packageName)
+{
+    char** nameParts;
+
+    if (packageName == NULL || packageName[0] == '\0') {
+        return 0;
+    }
+
+    nameParts = utils_split_package_name(packageName);
+    if (nameParts == NULL) {
+        return 0;
+    }
+    strsplit_free(nameParts);
+    return 1;
+}
+
+static int __is_duplicate(const struct chef_served_install_options* packages, uint32_t index)
+{
+    for (uint32_t i = 0; i < index; i++) {
+        if (strcmp(packages[i].package, packages[index].package) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int __create_batch(const struct chef_served_install_options* packages, uint32_t packagesCount)
+{
+    struct served_transaction_options* options;
+    struct state_transaction*          states;
+    struct __batch_member*             members;
+    unsigned int                       transactionId = 0;
+    char                               nameBuffer[256];
+    char                               descriptionBuffer[512];
+    int                                count = 0;
+
+    options = calloc(packagesCount, sizeof(struct served_transaction_options));
+    states = calloc(packagesCount, sizeof(struct state_transaction));
+    members = calloc(packagesCount, sizeof(struct __batch_member));
+    if (options == NULL || states == NULL || members == NULL) {
+        VLOG_WARNING("api", "failed to allocate memory!\n");
+        goto cleanup;
+    }
+
+    // Whether a package is installed or updated is decided up front, just like
+    // for single packages. Packages requested more than once are only processed
+    // once, and dependencies shared between them are installed once as well.
+    served_state_lock();
+    for (uint32_t i = 0; i < packagesCount; i++) {
+        const struct chef_served_install_options* package = &packages[i];
+        enum served_transaction_type              type;
+        const char*                               label;
+
+        if (__is_duplicate(packages, i)) {
+            VLOG_DEBUG("api", "__create_batch: skipping duplicate package %s\n", package->package);
+            continue;
+        }
+
+        type = served_state_application(package->package) != NULL
+             ? SERVED_TRANSACTION_TYPE_UPDATE
+             : SERVED_TRANSACTION_TYPE_INSTALL;
+        label = (type == SERVED_TRANSACTION_TYPE_UPDATE) ? "Update" : "Install";
+
+        snprintf(&members[count].name[0], sizeof(members[count].name), "%s via API (%s)", label, package->package);
+        snprintf(&members[count].description[0], sizeof(members[count].description),
+                 "%s of package '%s' requested via served API as part of a batch", label, package->package);
+
+        options[count].name = &members[count].name[0];
+        options[count].description = &members[count].description[0];
+        options[count].type = type;
+        states[count].name = package->package;
+        states[count].channel = package->channel;
+        states[count].revision = package->revision;
+        count++;
+    }
+    served_state_unlock();
+
+    snprintf(nameBuffer, sizeof(nameBuffer), "Batch via API (%i packages)", count);
+    snprintf(descriptionBuffer, sizeof(descriptionBuffer),
+             "Install or update of %i packages requested via served API", count);
+
+    transactionId = served_transaction_create_batch(
+        &(struct served_transaction_options){
+            .name = &nameBuffer[0],
+            .description = &descriptionBuffer[0],
+            .type = SERVED_TRANSACTION_TYPE_BATCH,
+        },
+        options, states, count
+    );
+
+cleanup:
+    free(options);
+    free(states);
+    free(members);
+    return transactionId;
+}
+
+void chef_served_install_batch_invocation(struct gracht_message* message, const struct chef_served_install_options* packages, const uint32_t packages_count)
+{
+    VLOG_DEBUG("api", "chef_served_install_batch_invocation(count=%u)\n", packages_count);
+
+    if (packages_count == 0) {
+        chef_served_install_batch_response(message, 0);
+        return;
+    }
+
+    // The batch is refused as a whole if any of the packages are invalid
+    for (uint32_t i = 0; i < packages_count; i++) {
+        if (!__is_valid_package(packages[i].package)) {
+            VLOG_WARNING("api", "invalid package name format: %s\n",
+                         packages[i].package != NULL ? packages[i].package : "(null)");
+            chef_served_install_batch_response(message, 0);
+            return;
+        }
+    }
+
+    chef_served_install_batch_response(message, __create_batch(packages, packages_count));
+}
@@ -0,0 +1,64 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gracht/server.h>
+#include <stdlib.h>
+#include <vlog.h>
+
+#include <transaction/states/load.h>
+
+#include "chef_served_service_server.h"
+
+void chef_served_boot_report_invocation(struct gracht_message* message)
+{
+    struct served_boot_report      report;
+    struct chef_served_boot_report response = { 0 };
+    struct chef_served_boot_entry* entries;
+
+    VLOG_DEBUG("api", "chef_served_boot_report_invocation()\n");
+
+    if (served_boot_report(&report) != 0) {
+        chef_served_boot_report_response(message, &response);
+        return;
+    }
+
+    entries = calloc(report.entries_count > 0 ? report.entries_count : 1, sizeof(struct chef_served_boot_entry));
+    if (entries == NULL) {
+        VLOG_ERROR("api", "failed to allocate memory for boot entries\n");
+        served_boot_report_destroy(&report);
+        chef_served_boot_report_response(message, &response);
+        return;
+    }
+
+    for (int i = 0; i < report.entries_count; i++) {
+        entries[i].package = (char*)report.entries[i].name;
+        entries[i].services = (unsigned int)report.entries[i].services;
+        entries[i].status = report.entries[i].status;
+        entries[i].queued_ms = report.entries[i].queued_ms;
+        entries[i].duration_ms = report.entries[i].duration_ms;
+    }
+
+    response.started = (unsigned long long)report.started;
+    response.duration_ms = report.duration_ms;
+    response.entries = entries;
+    response.entries_count = (uint32_t)report.entries_count;
+    chef_served_boot_report_response(message, &response);
+
+    free(entries);
+    served_boot_report_destroy(&report);
+}
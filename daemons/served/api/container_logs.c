@@ -0,0 +1,130 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/platform.h>
+#include <errno.h>
+#include <gracht/server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <utils.h>
+#include <vlog.h>
+
+#include "chef_served_service_server.h"
+
+struct __container_logs_request {
+    char*    container_id;
+    uint64_t since;
+    uint32_t max;
+    void*    source;
+};
+
+static void __container_logs_request_delete(struct __container_logs_request* request)
+{
+    free(request->container_id);
+    free(request->source);
+    free(request);
+}
+
+// Fetching the lines waits for cvd, which must not stall the served main loop,
+// so the response is deferred and sent from here.
+static int __container_logs_main(void* context)
+{
+    struct __container_logs_request* request = context;
+    struct chef_container_log_chunk  chunk = { 0 };
+    struct container_log_line*       lines = NULL;
+    uint32_t                         count = 0;
+    uint64_t                         next = request->since;
+    int                              status = 0;
+
+    if (container_client_logs(request->container_id, request->since, request->max, &lines, &count, &next)) {
+        status = errno;
+    }
+
+    if (count > 0) {
+        chunk.lines = calloc(count, sizeof(struct chef_container_log_line));
+        if (chunk.lines == NULL) {
+            status = ENOMEM;
+            count = 0;
+        }
+    }
+
+    // the strings are borrowed from lines, which frees them
+    for (uint32_t i = 0; i < count; i++) {
+        chunk.lines[i].sequence = lines[i].sequence;
+        chunk.lines[i].timestamp = lines[i].timestamp;
+        chunk.lines[i].stream = lines[i].error ? CHEF_CONTAINER_LOG_STREAM_STDERR : CHEF_CONTAINER_LOG_STREAM_STDOUT;
+        chunk.lines[i].message = lines[i].text;
+    }
+    chunk.lines_count = count;
+    chunk.next = next;
+
+    chef_served_container_logs_response(request->source, &chunk, status);
+
+    free(chunk.lines);
+    container_client_logs_free(lines, count);
+    __container_logs_request_delete(request);
+    return 0;
+}
+
+void chef_served_container_logs_invocation(struct gracht_message* message, const char* packageName, const unsigned long long since, const unsigned int max)
+{
+    struct chef_container_log_chunk  empty = { 0 };
+    struct __container_logs_request* request;
+    char**                           names;
+    char                             containerId[256];
+    thrd_t                           thread;
+    VLOG_DEBUG("api", "chef_served_container_logs_invocation(package=%s, since=%llu)\n", packageName, since);
+
+    empty.next = since;
+
+    // containers are named after the package, as publisher.package
+    names = utils_split_package_name(packageName);
+    if (names == NULL) {
+        chef_served_container_logs_response(message, &empty, EINVAL);
+        return;
+    }
+    snprintf(&containerId[0], sizeof(containerId), "%s.%s", names[0], names[1]);
+    strsplit_free(names);
+
+    request = calloc(1, sizeof(struct __container_logs_request));
+    if (request == NULL) {
+        chef_served_container_logs_response(message, &empty, ENOMEM);
+        return;
+    }
+
+    request->container_id = platform_strdup(&containerId[0]);
+    request->since = since;
+    request->max = max;
+    request->source = malloc(GRACHT_MESSAGE_DEFERRABLE_SIZE(message));
+    if (request->container_id == NULL || request->source == NULL) {
+        __container_logs_request_delete(request);
+        chef_served_container_logs_response(message, &empty, ENOMEM);
+        return;
+    }
+    gracht_server_defer_message(message, request->source);
+
+    if (thrd_create(&thread, __container_logs_main, request) != thrd_success) {
+        VLOG_ERROR("api", "chef_served_container_logs_invocation: failed to start logs thread\n");
+        chef_served_container_logs_response(request->source, &empty, EAGAIN);
+        __container_logs_request_delete(request);
+        return;
+    }
+    thrd_detach(thread);
+}
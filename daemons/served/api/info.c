@@ -53,44 +53,22 @@ void served_api_cleanup_info(struct chef_served_package* info)
 
 void chef_served_info_invocation(struct gracht_message* message, const char* packageName)
 {
-    struct state_application*   applications;
-    int                         count;
-    struct chef_served_package* info;
-    struct chef_served_package  zero = { 0 };
-    int                         status;
+    struct served_state_snapshot* snapshot;
+    struct state_application*     application;
+    struct chef_served_package    info;
+    struct chef_served_package    zero = { 0 };
     VLOG_DEBUG("api", "chef_served_info_invocation(package=%s)\n", packageName);
 
-    served_state_lock();
-    status = served_state_get_applications(&applications, &count);
-    if (status != 0 || count == 0) {
-        served_state_unlock();
-        VLOG_WARNING("api", "failed to retrieve applications from state\n");
+    snapshot = served_state_snapshot_acquire();
+    application = served_state_snapshot_application(snapshot, packageName);
+    if (application == NULL) {
+        served_state_snapshot_release(snapshot);
         chef_served_info_response(message, &zero);
         return;
     }
 
-    info = (struct chef_served_package*)malloc(sizeof(struct chef_served_package));
-    if (info == NULL) {
-        served_state_unlock();
-        VLOG_WARNING("api", "failed to allocate memory!\n");
-        chef_served_info_response(message, &zero);
-        return;
-    }
-
-    for (int i = 0; i < count; i++) {
-        if (strcmp(applications[i].name, packageName) == 0) {
-            served_api_convert_app_to_info(&applications[i], info);
-            served_state_unlock();
-
-            // this can be done without the lock
-            chef_served_info_response(message, info);
-            served_api_cleanup_info(info);
-            free(info);
-            return;
-        }
-    }
-
-    served_state_unlock();
-    chef_served_info_response(message, &zero);
-    free(info);
+    served_api_convert_app_to_info(application, &info);
+    chef_served_info_response(message, &info);
+    served_api_cleanup_info(&info);
+    served_state_snapshot_release(snapshot);
 }
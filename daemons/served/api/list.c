@@ -27,51 +27,52 @@
 
 void chef_served_listcount_invocation(struct gracht_message* message)
 {
-    struct state_application* applications;
-    int                       count = 0;
+    struct served_state_snapshot* snapshot;
+    int                           count = 0;
     VLOG_DEBUG("api", "chef_served_listcount_invocation()\n");
 
-    served_state_lock();
-    served_state_get_applications(&applications, &count);
-    served_state_unlock();
+    snapshot = served_state_snapshot_acquire();
+    if (snapshot != NULL) {
+        count = snapshot->applications_count;
+        served_state_snapshot_release(snapshot);
+    }
     chef_served_listcount_response(message, (unsigned int)count);
 }
 
 void chef_served_list_invocation(struct gracht_message* message)
 {
-    struct state_application* applications;
-    struct chef_served_package* infos;
-    int                         count;
-    int                         status;
+    struct served_state_snapshot* snapshot;
+    struct chef_served_package*   infos;
+    int                           count;
     VLOG_DEBUG("api", "chef_served_list_invocation()\n");
 
-    served_state_lock();
-    status = served_state_get_applications(&applications, &count);
-    if (status != 0 || count == 0) {
-        served_state_unlock();
-        VLOG_WARNING("api", "failed to retrieve applications from state\n");
+    // The snapshot is not affected by transactions committing in the meantime,
+    // so listing never waits for the state lock
+    snapshot = served_state_snapshot_acquire();
+    if (snapshot == NULL || snapshot->applications_count == 0) {
+        served_state_snapshot_release(snapshot);
         chef_served_list_response(message, NULL, 0);
         return;
     }
 
+    count = snapshot->applications_count;
     infos = (struct chef_served_package*)malloc(sizeof(struct chef_served_package) * count);
     if (infos == NULL) {
-        served_state_unlock();
+        served_state_snapshot_release(snapshot);
         VLOG_WARNING("api", "failed to allocate memory!\n");
         chef_served_list_response(message, NULL, 0);
         return;
     }
 
     for (int i = 0; i < count; i++) {
-        served_api_convert_app_to_info(&applications[i], &infos[i]);
+        served_api_convert_app_to_info(&snapshot->applications[i], &infos[i]);
     }
 
-    // we can unlock from here as we do not need to access the state anymore
-    served_state_unlock();
-
+    // the infos reference the names in the snapshot, so keep it until sent
     chef_served_list_response(message, infos, count);
     for (int i = 0; i < count; i++) {
         served_api_cleanup_info(&infos[i]);
     }
     free(infos);
+    served_state_snapshot_release(snapshot);
 }
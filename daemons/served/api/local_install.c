@@ -198,25 +198,17 @@ static int __validate_package_name(const char* name)
 
 static int __next_local_revision(const char* name)
 {
-    struct state_application* applications;
+    struct state_application* application;
     struct state_transaction* transactions;
-    int                       applicationsCount = 0;
     int                       transactionsCount = 0;
     int                       revision = 0;
 
-    if (served_state_get_applications(&applications, &applicationsCount) == 0) {
-        for (int i = 0; i < applicationsCount; ++i) {
-            struct state_application* application = &applications[i];
-
-            if (application->name == NULL || strcmp(application->name, name) != 0) {
-                continue;
-            }
-
-            for (int j = 0; j < application->revisions_count; ++j) {
-                struct chef_version* version = application->revisions[j].version;
-                if (version != NULL && version->revision < revision) {
-                    revision = version->revision;
-                }
+    application = served_state_application(name);
+    if (application != NULL) {
+        for (int j = 0; j < application->revisions_count; ++j) {
+            struct chef_version* version = application->revisions[j].version;
+            if (version != NULL && version->revision < revision) {
+                revision = version->revision;
             }
         }
     }
@@ -38,9 +38,8 @@ void chef_served_logs_invocation(struct gracht_message* message, unsigned int tr
     
     VLOG_DEBUG("api", "chef_served_logs_invocation(transaction_id=%u)\n", transaction_id);
     
-    served_state_lock();
+    // The logs are copied out without taking the state lock
     if (served_state_transaction_logs(transaction_id, &logs, &count) != 0 || count == 0) {
-        served_state_unlock();
         chef_served_logs_response(message, NULL, 0);
         return;
     }
@@ -48,7 +47,7 @@ void chef_served_logs_invocation(struct gracht_message* message, unsigned int tr
     // Allocate array for response
     entries = calloc(count, sizeof(struct chef_transaction_log_entry));
     if (entries == NULL) {
-        served_state_unlock();
+        free(logs);
         VLOG_ERROR("api", "failed to allocate memory for log entries\n");
         chef_served_logs_response(message, NULL, 0);
         return;
@@ -84,8 +83,7 @@ void chef_served_logs_invocation(struct gracht_message* message, unsigned int tr
         entries[i].state = state;
         entries[i].message = platform_strdup(log->message);
     }
-    
-    served_state_unlock();
+    free(logs);
     
     chef_served_logs_response(message, entries, count);
     
@@ -0,0 +1,71 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SERVED_ACTIVATION_H__
+#define __SERVED_ACTIVATION_H__
+
+#include <state.h>
+
+/**
+ * @brief Applications without services do not get a container when they are loaded, it is
+ * created when serve-exec first runs one of their commands, and destroyed again once no
+ * commands have been running in it for a while.
+ * 
+ * @return int 1 if the container of the application is created on first use, otherwise 0
+ */
+extern int served_activation_is_lazy(struct state_application* application);
+
+/**
+ * @brief Starts the reaper that destroys idle containers of lazily activated applications.
+ * 
+ * @return int 0 on success, -1 on failure
+ */
+extern int served_activation_start(void);
+
+/**
+ * @brief Stops the reaper. Containers that are still active are left running.
+ */
+extern void served_activation_stop(void);
+
+/**
+ * @brief Makes sure the container exists and starts a session in it, which keeps it from
+ * being reaped until the session is released. This must not be called with the state
+ * lock held, as it may wait for cvd to create the container.
+ * 
+ * @param containerId The container to activate, in the form publisher.package
+ * @return int 0 on success, -1 on failure with errno set
+ */
+extern int served_activation_acquire(const char* containerId);
+
+/**
+ * @brief Starts a session in the container if it already exists, without waiting for cvd.
+ * 
+ * @param containerId The container to activate, in the form publisher.package
+ * @return int 0 on success, -1 on failure with errno set to EAGAIN if the container must be
+ * created first by served_activation_acquire
+ */
+extern int served_activation_try_acquire(const char* containerId);
+
+/**
+ * @brief Ends a session started by served_activation_acquire.
+ * 
+ * @param containerId The container that was activated
+ */
+extern void served_activation_release(const char* containerId);
+
+#endif //!__SERVED_ACTIVATION_H__
@@ -45,10 +45,19 @@ extern int served_runner_stop(void);
  */
 extern int served_runner_is_running(void);
 
+/**
+ * @brief Wakes up the runner thread so it processes transactions again. The runner
+ * does not poll, so this must be called whenever something happens that could allow
+ * a transaction to progress. Creating transactions and posting events already does this.
+ */
+extern void served_runner_wakeup(void);
+
 /**
  * @brief Creates a new transaction and registers it with the runner.
  * 
- * The created transaction will be managed and executed by the runner.
+ * The created transaction will be managed and executed by the runner. Transactions
+ * are executed concurrently by a pool of workers, unless they operate on the same
+ * package, in which case they are executed in the order they were created.
  * 
  * @param options Configuration options for the new transaction
  * @param transactionState The state to be attached to the transaction, this is not
@@ -60,18 +69,38 @@ extern unsigned int served_transaction_create(
     struct state_transaction*          transactionState);
 
 /**
- * @brief Creates a new transaction while the caller already holds the runner queue lock.
- *
- * This is intended for state handlers running inside the runner thread that need to
- * schedule child transactions without re-entering the queue mutex.
- *
- * @param options Configuration options for the new transaction
- * @param transactionState State to attach to the transaction, or NULL for ephemeral transactions
- * @return unsigned int The ID of the newly created transaction, or 0 on failure
+ * @brief Creates a batch transaction together with its members, and registers them
+ * with the runner. The members are regular install or update transactions that run
+ * concurrently, but leave the generation of wrappers to the batch, which does it for
+ * all of them in one pass once they are done. The batch fails if any member fails.
+ * 
+ * @param options Configuration options for the batch, the type must be SERVED_TRANSACTION_TYPE_BATCH
+ * @param members Configuration options for each member, the batch_id is set by this call
+ * @param memberStates The state to be attached to each member
+ * @param count The number of members
+ * @return unsigned int The ID of the batch transaction, or 0 on failure
  */
-extern unsigned int served_transaction_create_locked(
+extern unsigned int served_transaction_create_batch(
     struct served_transaction_options* options,
-    struct state_transaction*          transactionState);
+    struct served_transaction_options* members,
+    struct state_transaction*          memberStates,
+    int                                count);
+
+/**
+ * @brief Finds an unfinished install or update transaction of the given package.
+ * 
+ * @param packageName The name of the package
+ * @return unsigned int The ID of the transaction, or 0 if there is none
+ */
+extern unsigned int served_transaction_find_install(const char* packageName);
+
+/**
+ * @brief Finds an unfinished member of the given batch.
+ * 
+ * @param batchId The ID of the batch transaction
+ * @return unsigned int The ID of the member transaction, or 0 if all of them are done
+ */
+extern unsigned int served_transaction_find_batch_member(unsigned int batchId);
 
 /**
  * @brief Maps an internal transaction state to the protocol state enum.
@@ -102,9 +102,24 @@ struct state_application {
 
     // unserialized members
     const char* container_id;                  /**< Container identifier (not persisted) */
+    int         sessions;                      /**< Active serve-exec sessions in the container (not persisted) */
+    time_t      last_used;                     /**< When a session last started or ended (not persisted) */
 };
 
 
+/**
+ * @brief An immutable snapshot of the installed applications.
+ *
+ * Snapshots are published whenever a change to the applications is committed,
+ * and allow readers to access the applications without taking the state lock.
+ * The applications are sorted by name. Runtime members like the container id
+ * are not part of the snapshot.
+ */
+struct served_state_snapshot {
+    struct state_application* applications;       /**< Applications sorted by name */
+    int                       applications_count; /**< Number of applications */
+};
+
 /**
  * @brief Loads the state from disk into memory.
  *
@@ -112,6 +127,12 @@ struct state_application {
  */
 extern int served_state_load(void);
 
+/**
+ * @brief Commits any pending database operations, then closes the state database
+ * and releases the in-memory state.
+ */
+extern void served_state_close(void);
+
 /**
  * @brief Locks the state for exclusive access. This must be called when reading or writing
  * to the state.
@@ -127,13 +148,16 @@ extern void served_state_lock(void);
  * was modified while locked.
  * 
  * When the lock count reaches zero, all deferred database operations are
- * executed atomically within a SQLite transaction. This ensures consistency
- * and batches writes for better performance.
+ * scheduled to be executed atomically within a SQLite transaction. Operations
+ * from unlocks within a short window are committed together, so they may not
+ * be in the database yet when this returns. Use served_state_flush to wait
+ * for them.
  */
 extern void served_state_unlock(void);
 
 /**
- * @brief Saves the current state to disk.
+ * @brief Saves the current state to disk. Commits all pending database operations
+ * and syncs them to disk. This must not be called with the state lock held.
  * 
  * @return int 0 on success, -1 on failure.
  */
@@ -190,6 +214,34 @@ extern int served_state_remove_application(struct state_application* application
  */
 extern int served_state_get_applications(struct state_application** applicationsOut, int* applicationsCount);
 
+/**
+ * @brief Acquires a reference to the most recently published snapshot.
+ *
+ * The snapshot stays valid, and unchanged, until it is released, regardless
+ * of any changes made to the state in the meantime. This does not require
+ * the state lock.
+ *
+ * @return struct served_state_snapshot* The snapshot, or NULL if the state is not loaded
+ */
+extern struct served_state_snapshot* served_state_snapshot_acquire(void);
+
+/**
+ * @brief Releases a snapshot acquired with served_state_snapshot_acquire().
+ *
+ * @param snapshot The snapshot to release
+ */
+extern void served_state_snapshot_release(struct served_state_snapshot* snapshot);
+
+/**
+ * @brief Finds an application by name in a snapshot.
+ *
+ * @param snapshot The snapshot to search
+ * @param name The name of the application
+ * @return struct state_application* The application, or NULL if not found. It is
+ *         valid for as long as the snapshot is held.
+ */
+extern struct state_application* served_state_snapshot_application(struct served_state_snapshot* snapshot, const char* name);
+
 /**
  * @brief Creates a new transaction with the provided options.
  * 
@@ -236,8 +288,9 @@ extern int served_state_transaction_log_add(
 /**
  * @brief Retrieves logs for a transaction.
  * 
- * Returns a pointer to the internal logs array for the transaction.
- * The returned pointer is valid only while the state is locked.
+ * Returns a copy of the logs for the transaction, which must be freed by the
+ * caller. This does not take the state lock, so it is not held up by writers
+ * committing their changes, and must not be called with the state lock held.
  * 
  * @param transaction_id The ID of the transaction
  * @param logs_out Pointer to receive the logs array (must not be NULL)
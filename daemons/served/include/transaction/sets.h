@@ -78,6 +78,17 @@ static const struct served_sm_state* g_stateSetUpdate[] = {
     &g_stateCompleted, &g_stateError, &g_stateCancelled
 };
 
+#include "states/batch.h"
+
+// Batches wait for their member transactions, which are regular install and
+// update transactions, and generate the wrappers of them all at the end
+static const struct served_sm_state* g_stateSetBatch[] = {
+    &g_stateBatch, &g_stateBatchWait,
+    &g_stateGenerateWrappersBatch,
+
+    &g_stateCompleted, &g_stateError, &g_stateCancelled
+};
+
 // Ephemeral transactions for startup and shutdown
 static const struct served_sm_state* g_statesStartup[] = {
     &g_stateLoadAll,
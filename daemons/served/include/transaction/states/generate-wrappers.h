@@ -24,6 +24,7 @@
 
 extern enum sm_action_result served_handle_state_generate_wrappers(void* context);
 extern enum sm_action_result served_handle_state_generate_wrappers_all(void* context);
+extern enum sm_action_result served_handle_state_generate_wrappers_batch(void* context);
 
 static const struct served_sm_state g_stateGenerateWrappers = {
     .state = SERVED_TX_STATE_GENERATE_WRAPPERS,
@@ -47,4 +48,17 @@ static const struct served_sm_state g_stateGenerateWrappersAll = {
     }
 };
 
+// Generates the wrappers of all members of a batch in one pass, and fails the
+// batch if any of its members did not complete.
+static const struct served_sm_state g_stateGenerateWrappersBatch = {
+    .state = SERVED_TX_STATE_GENERATE_WRAPPERS,
+    .action = served_handle_state_generate_wrappers_batch,
+    .transition_count = 3,
+    .transitions = {
+        { SERVED_TX_EVENT_OK,     SERVED_TX_STATE_COMPLETED },
+        { SERVED_TX_EVENT_FAILED, SERVED_TX_STATE_ERROR },
+        { SERVED_TX_EVENT_CANCEL, SERVED_TX_STATE_CANCELLED }
+    }
+};
+
 #endif //!__SERVED_TRANSACTION_STATE_GENERATE_WRAPPERS_H__
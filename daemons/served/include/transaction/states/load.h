@@ -22,9 +22,45 @@
 #include "../sm.h"
 #include "types.h"
 
+#include <time.h>
+
+/**
+ * @brief Timing of a single application loaded during boot.
+ */
+struct served_boot_entry {
+    const char*  name;        /**< Application name */
+    int          services;    /**< Whether the application has services */
+    int          status;      /**< 0 if the container was created, otherwise the errno */
+    unsigned int queued_ms;   /**< Time from the start of the boot until the container was requested */
+    unsigned int duration_ms; /**< Time it took to create the container */
+};
+
+/**
+ * @brief Timing of the containers brought up when served last loaded all applications.
+ */
+struct served_boot_report {
+    time_t                    started;       /**< When loading started */
+    unsigned int              duration_ms;   /**< Time it took to load all applications */
+    struct served_boot_entry* entries;       /**< Applications in the order they were loaded */
+    int                       entries_count; /**< Number of applications */
+};
+
 extern enum sm_action_result served_handle_state_load(void* context);
 extern enum sm_action_result served_handle_state_load_all(void* context);
 
+/**
+ * @brief Retrieves a copy of the boot report, which must be released with
+ * served_boot_report_destroy.
+ *
+ * @return int 0 on success, -1 with errno set to ENOENT if no boot has completed yet
+ */
+extern int served_boot_report(struct served_boot_report* reportOut);
+
+/**
+ * @brief Releases the entries of a boot report.
+ */
+extern void served_boot_report_destroy(struct served_boot_report* report);
+
 static const struct served_sm_state g_stateLoad = {
     .state = SERVED_TX_STATE_LOAD,
     .action = served_handle_state_load,
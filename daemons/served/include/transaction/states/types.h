@@ -40,6 +40,9 @@
 
 #define SERVED_TX_STATE_UPDATE (sm_state_t)17
 
+#define SERVED_TX_STATE_BATCH      (sm_state_t)18
+#define SERVED_TX_STATE_BATCH_WAIT (sm_state_t)19
+
 #define SERVED_TX_STATE_COMPLETED   (sm_state_t)1000
 #define SERVED_TX_STATE_ERROR       (sm_state_t)1001
 #define SERVED_TX_STATE_CANCELLED   (sm_state_t)1002
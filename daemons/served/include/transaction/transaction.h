@@ -29,22 +29,38 @@ enum served_transaction_type {
     SERVED_TRANSACTION_TYPE_UNINSTALL,
     SERVED_TRANSACTION_TYPE_UPDATE,
     SERVED_TRANSACTION_TYPE_ROLLBACK,
-    SERVED_TRANSACTION_TYPE_CONFIGURE
+    SERVED_TRANSACTION_TYPE_CONFIGURE,
+    SERVED_TRANSACTION_TYPE_BATCH
 };
 
 enum served_transaction_wait_type {
     SERVED_TRANSACTION_WAIT_TYPE_NONE,
     SERVED_TRANSACTION_WAIT_TYPE_TRANSACTION,
-    SERVED_TRANSACTION_WAIT_TYPE_REBOOT
+    SERVED_TRANSACTION_WAIT_TYPE_REBOOT,
+    SERVED_TRANSACTION_WAIT_TYPE_TIMER,
+    SERVED_TRANSACTION_WAIT_TYPE_EVENT
+};
+
+enum served_transaction_execution {
+    SERVED_TRANSACTION_EXECUTION_IDLE,
+    SERVED_TRANSACTION_EXECUTION_SCHEDULED,
+    SERVED_TRANSACTION_EXECUTION_RUNNING
 };
 
 struct served_transaction_wait {
     enum served_transaction_wait_type type;
     union {
         unsigned int transaction_id;
+        unsigned int timeout_ms;
     } data;
+
+    // Absolute (TIME_UTC) point in time when a timer wait expires, this
+    // is not persisted, but recalculated from timeout_ms when restored.
+    struct timespec deadline;
 };
 
+#define SERVED_TRANSACTION_DIGEST_SIZE 64
+
 struct served_transaction {
     struct list_item               list_header;
     struct served_sm               sm;
@@ -55,6 +71,23 @@ struct served_transaction {
     struct served_transaction_wait wait;
     time_t                         created_at;
     time_t                         completed_at;
+
+    // Runner bookkeeping. The resource is the package the transaction operates
+    // on, transactions without one affect the entire system and run exclusively.
+    const char*                       resource;
+    enum served_transaction_execution execution;
+    int                               started;
+
+    // The batch transaction this transaction is a member of, members leave the
+    // generation of wrappers to the batch. 0 if not part of a batch.
+    unsigned int                      batch_id;
+
+    // Number of times the current operation has been retried
+    unsigned int                      retry_count;
+
+    // SHA-512 of the package, if it was calculated while downloading it
+    unsigned char                     package_digest[SERVED_TRANSACTION_DIGEST_SIZE];
+    int                               package_digest_valid;
     
     // I/O progress tracking
     struct {
@@ -72,6 +105,9 @@ struct served_transaction_options {
     // optional, can only be used for ephemeral transactions
     struct served_sm_state_set*    stateSet;
 
+    // optional, the batch transaction the new transaction is a member of
+    unsigned int                   batch_id;
+
     // Restoration/initialization fields
     unsigned int                   id;
     int                            initialState;
@@ -86,9 +122,24 @@ extern void                       served_transaction_delete(struct served_transa
  * @brief Make the transaction wait for a condition
  * @param transaction The transaction to make wait
  * @param waitType The type of wait condition
- * @param waitData Additional data for the wait condition
+ * @param waitData Additional data for the wait condition, for timer waits this is
+ *                 the number of milliseconds to wait
  * @return sm_event_t The event to post to the state machine
  */
 extern sm_event_t served_transaction_wait(struct served_transaction* transaction, enum served_transaction_wait_type waitType, unsigned int waitData);
 
+typedef sm_event_t (*served_transaction_job_fn)(struct served_transaction* transaction, void* context);
+
+/**
+ * @brief Runs a job for the transaction on a background thread, so long running I/O does
+ * not occupy a runner worker. The state starting the job must return SM_ACTION_WAIT, and
+ * the event returned by the job is posted to the transaction once it completes, which
+ * then resumes it.
+ * @param transaction The transaction the job belongs to
+ * @param job The function to execute in the background
+ * @param context Passed to the job, the job is responsible for freeing it
+ * @return int 0 if the job was started, -1 otherwise
+ */
+extern int served_transaction_run_job(struct served_transaction* transaction, served_transaction_job_fn job, void* context);
+
 #endif //!__SERVED_TRANSACTION_H__
@@ -20,6 +20,7 @@
 #define __SERVED_UTILS_H__
 
 #include <chef/package.h>
+#include <stdint.h>
 
 typedef struct gracht_server gracht_server_t;
 struct chef_config_address;
@@ -31,9 +32,11 @@ struct chef_config_address;
 extern gracht_server_t* served_gracht_server(void);
 
 /**
- * @brief Verifies the package and it's publisher against the database of proofs.
+ * @brief Verifies the package and it's publisher against the database of proofs. If the
+ * SHA-512 digest of the package is already known, it can be provided to avoid hashing
+ * the package file again, otherwise digest must be NULL.
  */
-extern int utils_verify_package(const char* publisher, const char* package, int revision);
+extern int utils_verify_package(const char* publisher, const char* package, int revision, const unsigned char* digest);
 
 /**
  * @brief Loads a developer proof for a local package.
@@ -94,6 +97,12 @@ extern int  container_client_initialize(struct chef_config_address* config);
 extern void container_client_shutdown(void);
 
 extern int container_client_create_container(struct container_options* options);
+
+// Containers can also be created without waiting for cvd, every request that was
+// sent must be completed by container_client_create_container_wait, which frees it.
+struct container_client_request;
+extern struct container_client_request* container_client_create_container_async(struct container_options* options);
+extern int container_client_create_container_wait(struct container_client_request* request);
 extern int container_client_spawn(
     const char*        id,
     const char* const* environment,
@@ -102,4 +111,22 @@ extern int container_client_spawn(
 extern int container_client_kill(const char*  id, unsigned int pid);
 extern int container_client_destroy_container(const char* id);
 
+struct container_log_line {
+    uint64_t sequence;
+    uint64_t timestamp;
+    int      error; // the line was written to stderr
+    char*    text;
+};
+
+// Retrieves the lines of output that cvd kept for the container, with a sequence
+// number above since. The lines must be freed with container_client_logs_free.
+extern int container_client_logs(
+    const char*                 id,
+    uint64_t                    since,
+    uint32_t                    max,
+    struct container_log_line** linesOut,
+    uint32_t*                   countOut,
+    uint64_t*                   nextOut);
+extern void container_client_logs_free(struct container_log_line* lines, uint32_t count);
+
 #endif //!__SERVED_UTILS_H__
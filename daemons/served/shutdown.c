@@ -16,6 +16,7 @@
  *
  */
 
+#include <activation.h>
 #include <startup.h>
 #include <state.h>
 #include <runner.h>
@@ -29,6 +30,10 @@ void served_shutdown(void)
     int status;
     VLOG_TRACE("shutdown", "served_shutdown()\n");
 
+    // containers are unloaded by the shutdown transaction, the reaper
+    // must not destroy any of them while that is running
+    served_activation_stop();
+
     if (!served_runner_is_running()) {
         VLOG_DEBUG("shutdown", "runner thread not running, skipping shutdown operations\n");
         goto cleanup_state;
@@ -16,6 +16,7 @@
  *
  */
 
+#include <activation.h>
 #include <errno.h>
 #include <chef/platform.h>
 #include <chef/store-default.h>
@@ -176,6 +177,12 @@ int served_startup(void)
         return status;
     }
 
+    status = served_activation_start();
+    if (status != 0) {
+        VLOG_ERROR("startup", "failed to start container activation\n");
+        return status;
+    }
+
     VLOG_TRACE("startup", "initiating startup transaction\n");
     transactionId = served_transaction_create(&(struct served_transaction_options) {
         .name = "system-startup",
@@ -0,0 +1,324 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <activation.h>
+#include <chef/platform.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <utils.h>
+#include <vlog.h>
+
+// Containers of lazily activated applications are destroyed when no sessions
+// have been running in them for this many seconds
+#define SERVED_ACTIVATION_IDLE_TIMEOUT 300
+
+// How often the reaper looks for idle containers, in seconds
+#define SERVED_ACTIVATION_REAP_INTERVAL 30
+
+static struct {
+    // Serializes creating and destroying containers, taken before the state lock
+    mtx_t  lock;
+    mtx_t  reaper_lock;
+    cnd_t  reaper_cond;
+    thrd_t reaper;
+    int    running;
+    int    stop;
+} g_activation = { 0 };
+
+int served_activation_is_lazy(struct state_application* application)
+{
+#if defined(CHEF_ON_LINUX)
+    for (int i = 0; i < application->commands_count; i++) {
+        if (application->commands[i].type == CHEF_COMMAND_TYPE_DAEMON) {
+            return 0;
+        }
+    }
+    return 1;
+#else
+    // serve-exec only keeps sessions on linux, without them the containers
+    // would be reaped while in use
+    (void)application;
+    return 0;
+#endif
+}
+
+// Container ids are the application name with the '/' replaced by a '.', the
+// publisher may contain dots itself, so try each of them. This must be called
+// with the state lock held.
+static struct state_application* __find_application(const char* containerId)
+{
+    struct state_application* application;
+    char                      name[CHEF_PACKAGE_ID_LENGTH_MAX];
+
+    if (strlen(containerId) >= sizeof(name)) {
+        return NULL;
+    }
+    strcpy(&name[0], containerId);
+
+    for (char* p = &name[0]; *p != '\0'; p++) {
+        if (*p != '.') {
+            continue;
+        }
+
+        *p = '/';
+        application = served_state_application(&name[0]);
+        if (application != NULL) {
+            return application;
+        }
+        *p = '.';
+    }
+    return NULL;
+}
+
+static int __create_container(const char* containerId, const char* name, const char* base, int revision)
+{
+    char** names;
+    char*  package;
+    int    status;
+
+    names = utils_split_package_name(name);
+    if (names == NULL) {
+        return -1;
+    }
+
+    package = utils_path_pack(names[0], names[1], revision);
+    strsplit_free(names);
+    if (package == NULL) {
+        return -1;
+    }
+
+    status = container_client_create_container(&(struct container_options){
+        .id = containerId,
+        .pack_id = name,
+        .rootfs = base,
+        .package = package,
+    });
+    free(package);
+    if (status && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+int served_activation_try_acquire(const char* containerId)
+{
+    struct state_application* application;
+    int                       status = 0;
+
+    served_state_lock();
+    application = __find_application(containerId);
+    if (application == NULL) {
+        errno = ENOENT;
+        status = -1;
+    } else if (application->container_id == NULL) {
+        errno = EAGAIN;
+        status = -1;
+    } else {
+        application->sessions++;
+        application->last_used = time(NULL);
+    }
+    served_state_unlock();
+    return status;
+}
+
+int served_activation_acquire(const char* containerId)
+{
+    struct state_application* application;
+    char*                     name = NULL;
+    char*                     base = NULL;
+    int                       revision;
+    int                       status;
+
+    // fast path, the container is already running
+    status = served_activation_try_acquire(containerId);
+    if (status == 0 || errno != EAGAIN) {
+        return status;
+    }
+
+    mtx_lock(&g_activation.lock);
+    served_state_lock();
+    application = __find_application(containerId);
+    if (application == NULL || application->revisions_count == 0) {
+        served_state_unlock();
+        mtx_unlock(&g_activation.lock);
+        errno = ENOENT;
+        return -1;
+    }
+
+    // it may have been activated while waiting for the lock
+    if (application->container_id != NULL) {
+        application->sessions++;
+        application->last_used = time(NULL);
+        served_state_unlock();
+        mtx_unlock(&g_activation.lock);
+        return 0;
+    }
+
+    name = platform_strdup(application->name);
+    base = application->base != NULL ? platform_strdup(application->base) : NULL;
+    revision = application->revisions[application->revisions_count - 1].version->revision;
+    served_state_unlock();
+
+    VLOG_DEBUG("served", "activating container %s\n", containerId);
+    status = name != NULL ? __create_container(containerId, name, base, revision) : -1;
+    if (status) {
+        VLOG_ERROR("served", "failed to activate container %s\n", containerId);
+    }
+
+    served_state_lock();
+    application = __find_application(containerId);
+    if (status == 0 && application == NULL) {
+        errno = ENOENT;
+        status = -1;
+    } else if (status == 0) {
+        application->container_id = platform_strdup(containerId);
+        application->sessions++;
+        application->last_used = time(NULL);
+    }
+    served_state_unlock();
+    mtx_unlock(&g_activation.lock);
+
+    free(name);
+    free(base);
+    return status;
+}
+
+void served_activation_release(const char* containerId)
+{
+    struct state_application* application;
+
+    served_state_lock();
+    application = __find_application(containerId);
+    if (application != NULL && application->sessions > 0) {
+        application->sessions--;
+        application->last_used = time(NULL);
+    }
+    served_state_unlock();
+}
+
+static void __reap_idle_containers(void)
+{
+    struct state_application* applications;
+    char**                    idle = NULL;
+    int                       idleCount = 0;
+    int                       count;
+    time_t                    now = time(NULL);
+
+    mtx_lock(&g_activation.lock);
+    served_state_lock();
+    if (served_state_get_applications(&applications, &count) == 0 && count > 0) {
+        idle = calloc(count, sizeof(char*));
+    }
+
+    for (int i = 0; idle != NULL && i < count; i++) {
+        struct state_application* application = &applications[i];
+
+        if (application->container_id == NULL || application->sessions > 0 ||
+            !served_activation_is_lazy(application) ||
+            now - application->last_used < SERVED_ACTIVATION_IDLE_TIMEOUT) {
+            continue;
+        }
+
+        // the container is considered gone from here, so activations will
+        // wait for the activation lock and create a new one
+        idle[idleCount++] = (char*)application->container_id;
+        application->container_id = NULL;
+    }
+    served_state_unlock();
+
+    for (int i = 0; i < idleCount; i++) {
+        VLOG_DEBUG("served", "reaping idle container %s\n", idle[i]);
+        if (container_client_destroy_container(idle[i]) && errno != ENOENT) {
+            VLOG_WARNING("served", "failed to destroy idle container %s\n", idle[i]);
+        }
+        free(idle[i]);
+    }
+    free(idle);
+    mtx_unlock(&g_activation.lock);
+}
+
+static int __reaper_main(void* context)
+{
+    struct timespec deadline;
+    (void)context;
+
+    mtx_lock(&g_activation.reaper_lock);
+    while (!g_activation.stop) {
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_sec += SERVED_ACTIVATION_REAP_INTERVAL;
+        cnd_timedwait(&g_activation.reaper_cond, &g_activation.reaper_lock, &deadline);
+        if (g_activation.stop) {
+            break;
+        }
+
+        mtx_unlock(&g_activation.reaper_lock);
+        __reap_idle_containers();
+        mtx_lock(&g_activation.reaper_lock);
+    }
+    mtx_unlock(&g_activation.reaper_lock);
+    return 0;
+}
+
+int served_activation_start(void)
+{
+    VLOG_DEBUG("served", "served_activation_start()\n");
+
+    if (mtx_init(&g_activation.lock, mtx_plain) != thrd_success) {
+        return -1;
+    }
+    if (mtx_init(&g_activation.reaper_lock, mtx_plain) != thrd_success) {
+        mtx_destroy(&g_activation.lock);
+        return -1;
+    }
+    if (cnd_init(&g_activation.reaper_cond) != thrd_success) {
+        mtx_destroy(&g_activation.reaper_lock);
+        mtx_destroy(&g_activation.lock);
+        return -1;
+    }
+
+    g_activation.stop = 0;
+    if (thrd_create(&g_activation.reaper, __reaper_main, NULL) != thrd_success) {
+        VLOG_ERROR("served", "served_activation_start: failed to start reaper thread\n");
+        cnd_destroy(&g_activation.reaper_cond);
+        mtx_destroy(&g_activation.reaper_lock);
+        mtx_destroy(&g_activation.lock);
+        return -1;
+    }
+    g_activation.running = 1;
+    return 0;
+}
+
+void served_activation_stop(void)
+{
+    VLOG_DEBUG("served", "served_activation_stop()\n");
+    if (!g_activation.running) {
+        return;
+    }
+
+    mtx_lock(&g_activation.reaper_lock);
+    g_activation.stop = 1;
+    cnd_signal(&g_activation.reaper_cond);
+    mtx_unlock(&g_activation.reaper_lock);
+
+    thrd_join(g_activation.reaper, NULL);
+    g_activation.running = 0;
+}
@@ -18,15 +18,18 @@
 
 #include <chef/platform.h>
 #include <gracht/server.h>
+#include <runner.h>
 #include <stdlib.h>
 #include <state.h>
 #include <stdio.h>
+#include <string.h>
 #include <threads.h>
 #include <time.h>
 #include <utils.h>
 #include <vlog.h>
 
 #include <transaction/transaction.h>
+#include <transaction/logging.h>
 #include <transaction/sets.h>
 #include <transaction/states/types.h>
 
@@ -39,15 +42,32 @@ static mtx_t  g_runner_lock;
 static cnd_t  g_runner_cond;
 static int    g_runner_should_stop = 0;
 static int    g_runner_is_running = 0;
+static int    g_runner_initialized = 0;
+
+// Set by served_runner_wakeup when the runner has to do another pass, this is
+// protected by the runner lock.
+static int    g_runner_signaled = 0;
 
 // Transaction queues
 static mtx_t       g_queue_lock;
 static struct list g_active_transactions = { 0 };
 static struct list g_waiting_transactions = { 0 };
 
-// Runner tick rate (milliseconds between execute cycles)
-#define RUNNER_TICK_S  0
-#define RUNNER_TICK_MS 500
+// Worker pool state, workers wait on g_worker_cond (protected by g_queue_lock)
+// for transactions that the runner has scheduled.
+#define RUNNER_WORKER_COUNT 8
+
+static thrd_t g_worker_threads[RUNNER_WORKER_COUNT];
+static int    g_worker_count = 0;
+static cnd_t  g_worker_cond;
+static int    g_workers_should_stop = 0;
+
+// Background jobs started by served_transaction_run_job, they reference their
+// transaction until they have posted their event, so the runner must not be
+// torn down before all of them have finished. Protected by g_queue_lock.
+static int    g_jobs_running = 0;
+static cnd_t  g_jobs_cond;
+
 
 // Map internal sm_state_t to protocol transaction_state enum
 enum chef_transaction_state served_transaction_map_state(sm_state_t state)
@@ -82,6 +102,9 @@ enum chef_transaction_state served_transaction_map_state(sm_state_t state)
         return CHEF_TRANSACTION_STATE_UNINSTALLING;
     case SERVED_TX_STATE_UPDATE:
         return CHEF_TRANSACTION_STATE_UPDATING;
+    case SERVED_TX_STATE_BATCH:
+    case SERVED_TX_STATE_BATCH_WAIT:
+        return CHEF_TRANSACTION_STATE_INSTALLING;
     case SERVED_TX_STATE_COMPLETED:
         return CHEF_TRANSACTION_STATE_COMPLETED;
     case SERVED_TX_STATE_ERROR:
@@ -163,6 +186,10 @@ static void __state_set_from_type(struct served_sm_state_set* set, enum served_t
         set->states = g_stateSetUpdate;
         set->states_count = sizeof(g_stateSetUpdate) / sizeof(g_stateSetUpdate[0]);
         break;
+    case SERVED_TRANSACTION_TYPE_BATCH:
+        set->states = g_stateSetBatch;
+        set->states_count = sizeof(g_stateSetBatch) / sizeof(g_stateSetBatch[0]);
+        break;
     default:
         VLOG_ERROR("served", "__state_set_from_type: unsupported transaction type: %d\n", type);
         set->states = NULL;
@@ -171,6 +198,14 @@ static void __state_set_from_type(struct served_sm_state_set* set, enum served_t
     }
 }
 
+static int __timespec_before(const struct timespec* a, const struct timespec* b)
+{
+    if (a->tv_sec != b->tv_sec) {
+        return a->tv_sec < b->tv_sec;
+    }
+    return a->tv_nsec < b->tv_nsec;
+}
+
 // Check if a transaction's wait condition is satisfied
 static int __is_wait_satisfied(struct served_transaction* txn)
 {
@@ -202,6 +237,16 @@ static int __is_wait_satisfied(struct served_transaction* txn)
             return 1;
         }
         
+        case SERVED_TRANSACTION_WAIT_TYPE_TIMER: {
+            struct timespec now;
+            timespec_get(&now, TIME_UTC);
+            return !__timespec_before(&now, &txn->wait.deadline);
+        }
+
+        case SERVED_TRANSACTION_WAIT_TYPE_EVENT:
+            // Background jobs post their result while holding the queue lock
+            return txn->sm.event_queue.count > 0;
+
         case SERVED_TRANSACTION_WAIT_TYPE_REBOOT:
             // TODO: Implement reboot detection
             // For now, assume reboot never happens
@@ -214,17 +259,26 @@ static int __is_wait_satisfied(struct served_transaction* txn)
     }
 }
 
-// Check waiting transactions and resume those whose conditions are met
-static void __process_waiting_transactions(void)
+// Check waiting transactions and resume those whose conditions are met. Returns 1 if
+// any of the remaining transactions wait for a timer, in which case the earliest
+// deadline is stored in nextDeadline.
+static int __process_waiting_transactions(struct timespec* nextDeadline)
 {
     struct list_item* i;
     struct list_item* next;
+    int               hasDeadline = 0;
     
     mtx_lock(&g_queue_lock);
     list_foreach_safe(&g_waiting_transactions, i, next) {
         struct served_transaction* txn = (struct served_transaction*)i;
         
-        if (__is_wait_satisfied(txn)) {
+        if (!__is_wait_satisfied(txn)) {
+            if (txn->wait.type == SERVED_TRANSACTION_WAIT_TYPE_TIMER &&
+                (!hasDeadline || __timespec_before(&txn->wait.deadline, nextDeadline))) {
+                *nextDeadline = txn->wait.deadline;
+                hasDeadline = 1;
+            }
+        } else {
             VLOG_DEBUG("served", "Transaction %u wait satisfied, resuming\n", txn->id);
             
             // Move back to active queue
@@ -238,6 +292,31 @@ static void __process_waiting_transactions(void)
         }
     }
     mtx_unlock(&g_queue_lock);
+    return hasDeadline;
+}
+
+static int __transaction_set_resource(struct served_transaction* txn, struct state_transaction* state)
+{
+    char buffer[32];
+
+    // Batches only wait for their members, they must neither hold up the
+    // packages nor each other, so each of them gets a resource of its own.
+    if (txn->type == SERVED_TRANSACTION_TYPE_BATCH) {
+        snprintf(&buffer[0], sizeof(buffer), "batch:%u", txn->id);
+        txn->resource = platform_strdup(&buffer[0]);
+        return txn->resource == NULL ? -1 : 0;
+    }
+
+    if (state == NULL || state->name == NULL) {
+        txn->resource = NULL;
+        return 0;
+    }
+
+    txn->resource = platform_strdup(state->name);
+    if (txn->resource == NULL) {
+        return -1;
+    }
+    return 0;
 }
 
 static int __reconstruct_transactions_from_db(void)
@@ -263,6 +342,7 @@ static int __reconstruct_transactions_from_db(void)
             .name = persisted->name,
             .description = persisted->description,
             .type = persisted->type,
+            .batch_id = persisted->batch_id,
             .initialState = served_sm_current_state(&persisted->sm),
             .wait = persisted->wait
         });
@@ -275,6 +355,30 @@ static int __reconstruct_transactions_from_db(void)
             mtx_unlock(&g_queue_lock);
             return -1;
         }
+
+        // Transactions that were interrupted midway still own their package
+        if (__transaction_set_resource(runtime, served_state_transaction(runtime->id))) {
+            VLOG_ERROR(
+                "served",
+                "__reconstruct_transactions_from_db: failed to restore resource for transaction %u\n",
+                persisted->id
+            );
+            served_transaction_delete(runtime);
+            mtx_unlock(&g_queue_lock);
+            return -1;
+        }
+        runtime->started = served_sm_current_state(&runtime->sm) != runtime->sm.states.states[0]->state;
+
+        // Timer deadlines are not persisted, restart the timer
+        if (runtime->wait.type == SERVED_TRANSACTION_WAIT_TYPE_TIMER) {
+            (void)served_transaction_wait(runtime, SERVED_TRANSACTION_WAIT_TYPE_TIMER, runtime->wait.data.timeout_ms);
+        }
+
+        // Background jobs did not survive the restart, the state that started
+        // it will be executed again and start a new one.
+        if (runtime->wait.type == SERVED_TRANSACTION_WAIT_TYPE_EVENT) {
+            runtime->wait.type = SERVED_TRANSACTION_WAIT_TYPE_NONE;
+        }
         
         // Add to appropriate queue based on wait state
         if (runtime->wait.type == SERVED_TRANSACTION_WAIT_TYPE_NONE) {
@@ -355,9 +459,14 @@ static void __handle_transaction_done(struct served_transaction* txn, enum sm_ac
         served_state_unlock();
     }
     
-    // Remove from active queue
+    // Remove from active queue, this also releases the resource it held
+    mtx_lock(&g_queue_lock);
     list_remove(&g_active_transactions, &txn->list_header);
+    mtx_unlock(&g_queue_lock);
     served_transaction_delete(txn);
+
+    // Others may be waiting for this transaction or its resource
+    served_runner_wakeup();
 }
 
 static void __handle_on_transition(struct served_transaction* txn, sm_state_t newState)
@@ -392,81 +501,249 @@ static void __handle_on_transition(struct served_transaction* txn, sm_state_t ne
     );
 }
 
-void served_runner_execute(void)
+// Transactions conflict when they operate on the same package, or when either of
+// them operates on the entire system.
+static int __transactions_conflict(struct served_transaction* txn, struct served_transaction* other)
+{
+    if (txn->resource == NULL || other->resource == NULL) {
+        return 1;
+    }
+    return strcmp(txn->resource, other->resource) == 0;
+}
+
+// Determines whether a transaction must wait for others before it can be scheduled.
+// Expects the queue lock to be held.
+static int __is_blocked(struct served_transaction* txn)
 {
     struct list_item* i;
-    struct list_item* next;
-    
-    __process_waiting_transactions();
+    int               before = 1;
 
-    if (g_active_transactions.count > 0) {
-        VLOG_DEBUG(
-            "served",
-            "served_runner_execute: processing %d active\n",
-            g_active_transactions.count
-        );
+    list_foreach(&g_active_transactions, i) {
+        struct served_transaction* other = (struct served_transaction*)i;
+        if (other == txn) {
+            before = 0;
+            continue;
+        }
+
+        if (!__transactions_conflict(txn, other)) {
+            continue;
+        }
+
+        // Never run two conflicting transactions at the same time
+        if (other->execution != SERVED_TRANSACTION_EXECUTION_IDLE) {
+            return 1;
+        }
+
+        // A transaction that has already started owns its resource, it only
+        // has to wait for the ones currently executing.
+        if (txn->started) {
+            continue;
+        }
+
+        // Do not overtake a package transaction that started before us, or a
+        // conflicting transaction that was queued before us.
+        if ((other->started && txn->resource != NULL) || before) {
+            return 1;
+        }
     }
-    
-    // Use safe iteration since we may move transactions to waiting queue
-    mtx_lock(&g_queue_lock);
-    list_foreach_safe(&g_active_transactions, i, next) {
+
+    // Package transactions that are waiting still own their package, but system
+    // transactions must not be held up by waits that may never be satisfied.
+    if (txn->started || txn->resource == NULL) {
+        return 0;
+    }
+
+    list_foreach(&g_waiting_transactions, i) {
+        struct served_transaction* other = (struct served_transaction*)i;
+        if (other->resource != NULL && __transactions_conflict(txn, other)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Schedules all active transactions that do not conflict with others, expects the
+// queue lock to be held. Returns the number of transactions scheduled.
+static int __dispatch_transactions(void)
+{
+    struct list_item* i;
+    int               scheduled = 0;
+
+    list_foreach(&g_active_transactions, i) {
         struct served_transaction* txn = (struct served_transaction*)i;
-        sm_state_t                 oldState = served_sm_current_state(&txn->sm);
-        sm_state_t                 newState;
-        enum sm_action_result      result;
+        if (txn->execution != SERVED_TRANSACTION_EXECUTION_IDLE || __is_blocked(txn)) {
+            continue;
+        }
 
-        VLOG_DEBUG("served", "served_runner_execute: processing transaction %u (state=%d)\n", txn->id, oldState);
+        VLOG_DEBUG("served", "served_runner_execute: scheduling transaction %u (resource=%s)\n",
+                   txn->id, txn->resource != NULL ? txn->resource : "system");
+        txn->execution = SERVED_TRANSACTION_EXECUTION_SCHEDULED;
+        txn->started = 1;
+        scheduled++;
+    }
+    return scheduled;
+}
+
+// Executes the state machine of a transaction until it either finishes, needs to wait,
+// or encounters an error. This is invoked by the workers without the queue lock held.
+static enum sm_action_result __execute_transaction(struct served_transaction* txn)
+{
+    sm_state_t            oldState = served_sm_current_state(&txn->sm);
+    sm_state_t            newState;
+    enum sm_action_result result;
 
-        // Is this the first event?
-        if (oldState == 0) {
-            __handle_on_start(txn);
+    VLOG_DEBUG("served", "served_runner_execute: processing transaction %u (state=%d)\n", txn->id, oldState);
+
+    // Is this the first event?
+    if (oldState == 0) {
+        __handle_on_start(txn);
+    }
+
+    do {
+        result = served_sm_execute(&txn->sm);
+
+        // Emit state change event if state transitioned, but we only do so for
+        // transactions that are not ephemeral. Ephemeral transactions are
+        // not created by users, and thus we don't need to notify about their state changes.
+        newState = served_sm_current_state(&txn->sm);
+        if (newState != oldState && txn->type != SERVED_TRANSACTION_TYPE_EPHEMERAL) {
+            __handle_on_transition(txn, newState);
         }
+    } while (result == SM_ACTION_CONTINUE);
+    return result;
+}
 
-        // Execute the state machine until it either finishes, needs to wait, or encounters an error
-        do {
-            result = served_sm_execute(&txn->sm);
+static void __handle_execution_result(struct served_transaction* txn, enum sm_action_result result)
+{
+    if (result == SM_ACTION_DONE || result == SM_ACTION_ABORT) {
+        __handle_transaction_done(txn, result);
+        return;
+    }
 
-            // Emit state change event if state transitioned, but we only do so for
-            // transactions that are not ephemeral. Ephemeral transactions are
-            // not created by users, and thus we don't need to notify about their state changes.
-            newState = served_sm_current_state(&txn->sm);
-            if (newState != oldState && txn->type != SERVED_TRANSACTION_TYPE_EPHEMERAL) {
-                __handle_on_transition(txn, newState);
-            }
-        } while (result == SM_ACTION_CONTINUE);
+    mtx_lock(&g_queue_lock);
+    txn->execution = SERVED_TRANSACTION_EXECUTION_IDLE;
+    if (result == SM_ACTION_WAIT) {
+        VLOG_DEBUG("served", "Transaction %u entering wait state (type=%d)\n", 
+                   txn->id, txn->wait.type);
+        
+        // Move to waiting queue
+        list_remove(&g_active_transactions, &txn->list_header);
+        list_add(&g_waiting_transactions, &txn->list_header);
+    }
+    mtx_unlock(&g_queue_lock);
 
-        if (result == SM_ACTION_WAIT) {
-            VLOG_DEBUG("served", "Transaction %u entering wait state (type=%d)\n", 
-                       txn->id, txn->wait.type);
-            
-            // Move to waiting queue
-            list_remove(&g_active_transactions, &txn->list_header);
-            list_add(&g_waiting_transactions, &txn->list_header);
-            continue;
-        } else if (result == SM_ACTION_DONE || result == SM_ACTION_ABORT) {
-            __handle_transaction_done(txn, result);
+    // The wait might already be satisfied, or another transaction might have
+    // been held back by this one.
+    served_runner_wakeup();
+}
+
+// Expects the queue lock to be held
+static struct served_transaction* __next_scheduled_transaction(void)
+{
+    struct list_item* i;
+
+    list_foreach(&g_active_transactions, i) {
+        struct served_transaction* txn = (struct served_transaction*)i;
+        if (txn->execution == SERVED_TRANSACTION_EXECUTION_SCHEDULED) {
+            return txn;
+        }
+    }
+    return NULL;
+}
+
+static int __worker_thread_main(void* arg)
+{
+    struct served_transaction* txn;
+    enum sm_action_result      result;
+    (void)arg;
+
+    mtx_lock(&g_queue_lock);
+    while (1) {
+        txn = __next_scheduled_transaction();
+        if (txn == NULL) {
+            // Drain everything that was scheduled before stopping
+            if (g_workers_should_stop) {
+                break;
+            }
+            cnd_wait(&g_worker_cond, &g_queue_lock);
             continue;
         }
+
+        txn->execution = SERVED_TRANSACTION_EXECUTION_RUNNING;
+        mtx_unlock(&g_queue_lock);
+
+        result = __execute_transaction(txn);
+        __handle_execution_result(txn, result);
+
+        mtx_lock(&g_queue_lock);
+    }
+    mtx_unlock(&g_queue_lock);
+    return 0;
+}
+
+static int __start_workers(void)
+{
+    g_workers_should_stop = 0;
+    for (g_worker_count = 0; g_worker_count < RUNNER_WORKER_COUNT; g_worker_count++) {
+        if (thrd_create(&g_worker_threads[g_worker_count], __worker_thread_main, NULL) != thrd_success) {
+            VLOG_ERROR("served", "__start_workers: failed to create worker thread %d\n", g_worker_count);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void __stop_workers(void)
+{
+    mtx_lock(&g_queue_lock);
+    g_workers_should_stop = 1;
+    cnd_broadcast(&g_worker_cond);
+    mtx_unlock(&g_queue_lock);
+
+    for (int i = 0; i < g_worker_count; i++) {
+        thrd_join(g_worker_threads[i], NULL);
+    }
+    g_worker_count = 0;
+}
+
+static int __runner_execute(struct timespec* nextDeadline)
+{
+    int hasDeadline;
+    int scheduled;
+
+    hasDeadline = __process_waiting_transactions(nextDeadline);
+
+    // The runner only decides what can run, the transactions themselves
+    // are executed by the worker pool.
+    mtx_lock(&g_queue_lock);
+    scheduled = __dispatch_transactions();
+    if (scheduled > 0) {
+        VLOG_DEBUG(
+            "served",
+            "served_runner_execute: scheduled %d of %d active\n",
+            scheduled, g_active_transactions.count
+        );
+        cnd_broadcast(&g_worker_cond);
     }
     mtx_unlock(&g_queue_lock);
+    return hasDeadline;
 }
 
-static unsigned int __served_transaction_create(
+// Creates the transaction in state and allocates the runtime transaction for it,
+// expects the state lock to be held. The transaction is not queued.
+static struct served_transaction* __transaction_create_locked(
     struct served_transaction_options* options,
-    struct state_transaction*          transactionState,
-    int                                queueLocked)
+    struct state_transaction*          transactionState)
 {
     struct served_transaction* txn;
     unsigned int               transactionId = 0;
-    
+
     // For persistent transactions, create in state first
-    served_state_lock();
     if (options->type != SERVED_TRANSACTION_TYPE_EPHEMERAL) {
         transactionId = served_state_transaction_new(options);
         if (transactionId == 0) {
             VLOG_ERROR("served", "served_transaction_create: failed to create transaction in state\n");
-            served_state_unlock();
-            return 0;
+            return NULL;
         }
     }
     
@@ -474,11 +751,16 @@ static unsigned int __served_transaction_create(
     txn = served_transaction_new(options);
     if (txn == NULL) {
         VLOG_ERROR("served", "served_transaction_create: failed to allocate transaction\n");
-        served_state_unlock();
-        return 0;
+        return NULL;
     }
     
     txn->id = transactionId;
+
+    if (__transaction_set_resource(txn, transactionState)) {
+        VLOG_ERROR("served", "served_transaction_create: failed to allocate transaction resource\n");
+        served_transaction_delete(txn);
+        return NULL;
+    }
     
     // If the transaction state was provided and it's not an ephemeral transaction,
     // then create it in state prior to scheduling it.
@@ -487,37 +769,154 @@ static unsigned int __served_transaction_create(
         if (status) {
             VLOG_ERROR("served", "served_transaction_create: failed to create transaction state\n");
             served_transaction_delete(txn);
-            served_state_unlock();
-            return 0;
+            return NULL;
         }
     }
+    return txn;
+}
+
+unsigned int served_transaction_create(
+    struct served_transaction_options* options,
+    struct state_transaction*          transactionState)
+{
+    struct served_transaction* txn;
+    unsigned int               transactionId;
+    
+    served_state_lock();
+    txn = __transaction_create_locked(options, transactionState);
     served_state_unlock();
+    if (txn == NULL) {
+        return 0;
+    }
+    transactionId = txn->id;
 
     // Add to active queue (new transactions always start active)
-    if (!queueLocked) {
-        mtx_lock(&g_queue_lock);
-    }
+    mtx_lock(&g_queue_lock);
     list_add(&g_active_transactions, &txn->list_header);
-    if (!queueLocked) {
-        mtx_unlock(&g_queue_lock);
-    }
+    mtx_unlock(&g_queue_lock);
+    served_runner_wakeup();
     
     VLOG_DEBUG("served", "served_transaction_create: created transaction %u\n", transactionId);
     return transactionId;
 }
 
-unsigned int served_transaction_create(
+unsigned int served_transaction_create_batch(
     struct served_transaction_options* options,
-    struct state_transaction*          transactionState)
+    struct served_transaction_options* members,
+    struct state_transaction*          memberStates,
+    int                                count)
+{
+    struct served_transaction*  batch;
+    struct served_transaction** txns;
+    int                         created = 0;
+
+    if (options->type != SERVED_TRANSACTION_TYPE_BATCH || count <= 0) {
+        VLOG_ERROR("served", "served_transaction_create_batch: invalid batch\n");
+        return 0;
+    }
+
+    txns = calloc(count, sizeof(struct served_transaction*));
+    if (txns == NULL) {
+        return 0;
+    }
+
+    served_state_lock();
+    batch = __transaction_create_locked(options, NULL);
+    if (batch == NULL) {
+        served_state_unlock();
+        free(txns);
+        return 0;
+    }
+
+    for (; created < count; created++) {
+        members[created].batch_id = batch->id;
+        txns[created] = __transaction_create_locked(&members[created], &memberStates[created]);
+        if (txns[created] == NULL) {
+            break;
+        }
+    }
+    served_state_unlock();
+
+    // The transactions that were created are persisted already, so they are
+    // queued even if not all of them could be created
+    if (created < count) {
+        VLOG_ERROR("served", "served_transaction_create_batch: created %d of %d members\n", created, count);
+        TXLOG_ERROR(batch, "Failed to create %d of the %d packages of the batch", count - created, count);
+    }
+
+    // Queue them all at once, so the batch cannot observe a partial set of members
+    mtx_lock(&g_queue_lock);
+    for (int i = 0; i < created; i++) {
+        list_add(&g_active_transactions, &txns[i]->list_header);
+    }
+    list_add(&g_active_transactions, &batch->list_header);
+    mtx_unlock(&g_queue_lock);
+    served_runner_wakeup();
+
+    VLOG_DEBUG("served", "served_transaction_create_batch: created batch %u with %d members\n", batch->id, created);
+    free(txns);
+    return batch->id;
+}
+
+// Expects the queue lock to be held
+static struct served_transaction* __find_transaction(int (*match)(struct served_transaction*, const void*), const void* context)
+{
+    struct list_item* i;
+
+    list_foreach(&g_active_transactions, i) {
+        struct served_transaction* txn = (struct served_transaction*)i;
+        if (match(txn, context)) {
+            return txn;
+        }
+    }
+
+    list_foreach(&g_waiting_transactions, i) {
+        struct served_transaction* txn = (struct served_transaction*)i;
+        if (match(txn, context)) {
+            return txn;
+        }
+    }
+    return NULL;
+}
+
+static int __match_install(struct served_transaction* txn, const void* context)
 {
-    return __served_transaction_create(options, transactionState, 0);
+    const char* resource = context;
+    return (txn->type == SERVED_TRANSACTION_TYPE_INSTALL || txn->type == SERVED_TRANSACTION_TYPE_UPDATE) &&
+        txn->resource != NULL && strcmp(txn->resource, resource) == 0;
 }
 
-unsigned int served_transaction_create_locked(
-    struct served_transaction_options* options,
-    struct state_transaction*          transactionState)
+static int __match_batch_member(struct served_transaction* txn, const void* context)
+{
+    return txn->batch_id == *(const unsigned int*)context;
+}
+
+unsigned int served_transaction_find_install(const char* packageName)
+{
+    struct served_transaction* txn;
+    unsigned int               transactionId = 0;
+
+    mtx_lock(&g_queue_lock);
+    txn = __find_transaction(__match_install, packageName);
+    if (txn != NULL) {
+        transactionId = txn->id;
+    }
+    mtx_unlock(&g_queue_lock);
+    return transactionId;
+}
+
+unsigned int served_transaction_find_batch_member(unsigned int batchId)
 {
-    return __served_transaction_create(options, transactionState, 1);
+    struct served_transaction* txn;
+    unsigned int               transactionId = 0;
+
+    mtx_lock(&g_queue_lock);
+    txn = __find_transaction(__match_batch_member, &batchId);
+    if (txn != NULL) {
+        transactionId = txn->id;
+    }
+    mtx_unlock(&g_queue_lock);
+    return transactionId;
 }
 
 void served_transaction_construct(struct served_transaction* transaction, struct served_transaction_options* options)
@@ -530,6 +929,7 @@ void served_transaction_construct(struct served_transaction* transaction, struct
     transaction->name = options->name ? platform_strdup(options->name) : NULL;
     transaction->description = options->description ? platform_strdup(options->description) : NULL;
     transaction->type = options->type;
+    transaction->batch_id = options->batch_id;
     transaction->wait = options->wait;
 
     if (options->type == SERVED_TRANSACTION_TYPE_EPHEMERAL) {
@@ -573,6 +973,7 @@ void served_transaction_delete(struct served_transaction* transaction)
     
     free((void*)transaction->name);
     free((void*)transaction->description);
+    free((void*)transaction->resource);
     free(transaction);
 }
 
@@ -587,8 +988,19 @@ sm_event_t served_transaction_wait(struct served_transaction* transaction, enum
             transaction->wait.data.transaction_id = waitData;
             break;
         case SERVED_TRANSACTION_WAIT_TYPE_REBOOT:
+        case SERVED_TRANSACTION_WAIT_TYPE_EVENT:
             // No additional data needed
             break;
+        case SERVED_TRANSACTION_WAIT_TYPE_TIMER:
+            transaction->wait.data.timeout_ms = waitData;
+            timespec_get(&transaction->wait.deadline, TIME_UTC);
+            transaction->wait.deadline.tv_sec += waitData / 1000;
+            transaction->wait.deadline.tv_nsec += (long)(waitData % 1000) * 1000000L;
+            if (transaction->wait.deadline.tv_nsec >= 1000000000L) {
+                transaction->wait.deadline.tv_sec++;
+                transaction->wait.deadline.tv_nsec -= 1000000000L;
+            }
+            break;
         default:
             VLOG_ERROR("served", "served_transaction_wait: unknown wait type %d\n", waitType);
             break;
@@ -597,10 +1009,72 @@ sm_event_t served_transaction_wait(struct served_transaction* transaction, enum
     return SERVED_TX_EVENT_WAIT;
 }
 
+struct __transaction_job {
+    struct served_transaction* transaction;
+    served_transaction_job_fn  job;
+    void*                      context;
+};
+
+static int __job_thread_main(void* arg)
+{
+    struct __transaction_job* job = arg;
+    sm_event_t                event;
+
+    event = job->job(job->transaction, job->context);
+
+    // The transaction may be resumed by the runner as soon as the event is
+    // visible, so it must not be touched after this.
+    mtx_lock(&g_queue_lock);
+    served_sm_post_event(&job->transaction->sm, event);
+    g_jobs_running--;
+    cnd_broadcast(&g_jobs_cond);
+    mtx_unlock(&g_queue_lock);
+
+    free(job);
+    return 0;
+}
+
+int served_transaction_run_job(struct served_transaction* transaction, served_transaction_job_fn job, void* context)
+{
+    struct __transaction_job* transactionJob;
+    thrd_t                    thread;
+
+    transactionJob = malloc(sizeof(struct __transaction_job));
+    if (transactionJob == NULL) {
+        return -1;
+    }
+
+    transactionJob->transaction = transaction;
+    transactionJob->job = job;
+    transactionJob->context = context;
+
+    // Must be set before the job can complete, the wait is satisfied once
+    // the job has posted its event.
+    transaction->wait.type = SERVED_TRANSACTION_WAIT_TYPE_EVENT;
+    transaction->wait.data.transaction_id = 0;
+
+    mtx_lock(&g_queue_lock);
+    g_jobs_running++;
+    mtx_unlock(&g_queue_lock);
+
+    if (thrd_create(&thread, __job_thread_main, transactionJob) != thrd_success) {
+        VLOG_ERROR("served", "served_transaction_run_job: failed to create job thread for transaction %u\n", transaction->id);
+        mtx_lock(&g_queue_lock);
+        g_jobs_running--;
+        mtx_unlock(&g_queue_lock);
+        transaction->wait.type = SERVED_TRANSACTION_WAIT_TYPE_NONE;
+        free(transactionJob);
+        return -1;
+    }
+    thrd_detach(thread);
+    return 0;
+}
+
 // Runner thread main loop
 static int __runner_thread_main(void* arg)
 {
-    struct timespec sleep_time;
+    struct timespec deadline;
+    int             hasDeadline;
     int             status;
     (void)arg;
     
@@ -622,6 +1096,13 @@ static int __runner_thread_main(void* arg)
     }
     served_state_unlock();
 
+    status = __start_workers();
+    if (status) {
+        VLOG_ERROR("served", "__runner_thread_main: failed to start worker pool\n");
+        __stop_workers();
+        return -1;
+    }
+
     mtx_lock(&g_runner_lock);
     g_runner_is_running = 1;
     
@@ -630,22 +1111,42 @@ static int __runner_thread_main(void* arg)
     mtx_unlock(&g_runner_lock);
     
     while (1) {
-        // Check for stop request
+        // Check for stop request, and consume any pending wakeups as this
+        // pass will take care of them.
         mtx_lock(&g_runner_lock);
         if (g_runner_should_stop) {
             mtx_unlock(&g_runner_lock);
             break;
         }
+        g_runner_signaled = 0;
         mtx_unlock(&g_runner_lock);
         
         // Execute transaction runner cycle
-        served_runner_execute();
+        hasDeadline = __runner_execute(&deadline);
         
-        // Sleep for tick interval
-        sleep_time.tv_sec = RUNNER_TICK_S;
-        sleep_time.tv_nsec = RUNNER_TICK_MS * 1000000; // Convert ms to ns
-        thrd_sleep(&sleep_time, NULL);
+        // Sleep until something happens, transactions waiting for a timer
+        // are the only reason to wake up on our own.
+        mtx_lock(&g_runner_lock);
+        while (!g_runner_signaled && !g_runner_should_stop) {
+            if (!hasDeadline) {
+                cnd_wait(&g_runner_cond, &g_runner_lock);
+            } else if (cnd_timedwait(&g_runner_cond, &g_runner_lock, &deadline) == thrd_timedout) {
+                break;
+            }
+        }
+        mtx_unlock(&g_runner_lock);
     }
+
+    // Let the workers finish what they are executing
+    __stop_workers();
+
+    // Jobs are detached, so wait for them to post their events before the
+    // transactions and locks they use go away
+    mtx_lock(&g_queue_lock);
+    while (g_jobs_running > 0) {
+        cnd_wait(&g_jobs_cond, &g_queue_lock);
+    }
+    mtx_unlock(&g_queue_lock);
     
     mtx_lock(&g_runner_lock);
     g_runner_is_running = 0;
@@ -680,15 +1181,38 @@ int served_runner_start(void)
         mtx_destroy(&g_runner_lock);
         return -1;
     }
+
+    if (cnd_init(&g_worker_cond) != thrd_success) {
+        VLOG_ERROR("served", "served_runner_start: failed to initialize worker condition variable\n");
+        mtx_destroy(&g_queue_lock);
+        cnd_destroy(&g_runner_cond);
+        mtx_destroy(&g_runner_lock);
+        return -1;
+    }
+
+    if (cnd_init(&g_jobs_cond) != thrd_success) {
+        VLOG_ERROR("served", "served_runner_start: failed to initialize job condition variable\n");
+        cnd_destroy(&g_worker_cond);
+        mtx_destroy(&g_queue_lock);
+        cnd_destroy(&g_runner_cond);
+        mtx_destroy(&g_runner_lock);
+        return -1;
+    }
     
     // Reset stop flag
     g_runner_should_stop = 0;
     g_runner_is_running = 0;
+    g_runner_signaled = 0;
+    g_jobs_running = 0;
+    g_runner_initialized = 1;
     
     // Create the runner thread
     status = thrd_create(&g_runner_thread, __runner_thread_main, NULL);
     if (status != thrd_success) {
         VLOG_ERROR("served", "served_runner_start: failed to create runner thread\n");
+        g_runner_initialized = 0;
+        cnd_destroy(&g_jobs_cond);
+        cnd_destroy(&g_worker_cond);
         mtx_destroy(&g_queue_lock);
         cnd_destroy(&g_runner_cond);
         mtx_destroy(&g_runner_lock);
@@ -722,6 +1246,7 @@ int served_runner_stop(void)
     
     // Request stop
     g_runner_should_stop = 1;
+    cnd_broadcast(&g_runner_cond);
     mtx_unlock(&g_runner_lock);
     
     VLOG_DEBUG("served", "served_runner_stop: waiting for runner thread to stop...\n");
@@ -740,6 +1265,9 @@ int served_runner_stop(void)
     mtx_unlock(&g_runner_lock);
     
     // Cleanup synchronization primitives
+    g_runner_initialized = 0;
+    cnd_destroy(&g_jobs_cond);
+    cnd_destroy(&g_worker_cond);
     mtx_destroy(&g_queue_lock);
     cnd_destroy(&g_runner_cond);
     mtx_destroy(&g_runner_lock);
@@ -758,3 +1286,17 @@ int served_runner_is_running(void)
     
     return running;
 }
+
+void served_runner_wakeup(void)
+{
+    // Transactions can be created before the runner is started, the
+    // runner will pick those up on its first pass.
+    if (!g_runner_initialized) {
+        return;
+    }
+
+    mtx_lock(&g_runner_lock);
+    g_runner_signaled = 1;
+    cnd_broadcast(&g_runner_cond);
+    mtx_unlock(&g_runner_lock);
+}
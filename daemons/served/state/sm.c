@@ -17,6 +17,7 @@
  */
 
 #include <transaction/sm.h>
+#include <runner.h>
 #include <vlog.h>
 
 #include <stddef.h>
@@ -149,6 +150,9 @@ void served_sm_post_event(struct served_sm* sm, sm_event_t event)
     
     VLOG_DEBUG("served", "served_sm_post_event: queued event %u (queue size: %d)\n", 
                event, sm->event_queue.count);
+
+    // The runner only wakes up when told to
+    served_runner_wakeup();
 }
 
 sm_state_t served_sm_current_state(struct served_sm* sm)
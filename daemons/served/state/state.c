@@ -91,6 +91,7 @@ static const char* g_revisionsTableSQL =
 // - description (TEXT)
 // - wait_type (INTEGER)
 // - wait_data (INTEGER)
+// - batch_id (INTEGER, the batch transaction this transaction belongs to, 0 if none)
 // 
 static const char* g_transactionsTableSQL = 
     "CREATE TABLE IF NOT EXISTS transactions ("
@@ -103,9 +104,15 @@ static const char* g_transactionsTableSQL =
     "wait_type INTEGER DEFAULT 0,"
     "wait_data INTEGER DEFAULT 0,"
     "created_at INTEGER NOT NULL DEFAULT (strftime('%s', 'now')),"
-    "completed_at INTEGER DEFAULT NULL"
+    "completed_at INTEGER DEFAULT NULL,"
+    "batch_id INTEGER DEFAULT 0"
     ");";
 
+// Columns that were added to existing tables after their creation, databases
+// created by older versions are upgraded when opened.
+static const char* g_transactionsBatchColumnSQL =
+    "ALTER TABLE transactions ADD COLUMN batch_id INTEGER DEFAULT 0";
+
 static const char* g_transactionsStateTableSQL = 
     "CREATE TABLE IF NOT EXISTS transactions_state ("
     "id INTEGER PRIMARY KEY,"
@@ -127,6 +134,14 @@ static const char* g_transactionLogsTableSQL =
     "FOREIGN KEY(transaction_id) REFERENCES transactions(id) ON DELETE CASCADE"
     ");";
 
+// Indices for the foreign keys, the per-application and per-transaction
+// queries done during load would otherwise scan the full tables each time.
+static const char* g_indicesSQL =
+    "CREATE INDEX IF NOT EXISTS commands_application_id ON commands(application_id);"
+    "CREATE INDEX IF NOT EXISTS revisions_application_id ON revisions(application_id);"
+    "CREATE INDEX IF NOT EXISTS transactions_state_transaction_id ON transactions_state(transaction_id);"
+    "CREATE INDEX IF NOT EXISTS transaction_logs_transaction_id ON transaction_logs(transaction_id);";
+
 // The state implementation will provide functions to add, remove, and query applications and transactions.
 // The state also will allow for transactional changes to ensure consistency across multiple operations, and
 // to ensure resilience against crashes and restarts
@@ -139,6 +154,7 @@ static const char* g_transactionLogsTableSQL =
 #endif
 #include <chef/platform.h>
 #include <chef/package.h>
+#include <chef/hashindex.h>
 #include <chef/list.h>
 #include <sqlite3.h>
 #include <state.h>
@@ -162,29 +178,34 @@ enum deferred_operation_type {
     DEFERRED_OP_ADD_TRANSACTION_LOG
 };
 
-// Deferred operation entry
+// Deferred operation entry. Operations may be committed after the state lock
+// has been released, so they must not point into the state arrays, which move,
+// or at caller owned objects, which may be gone by then.
 struct deferred_operation {
     struct list_item             list_node;
     enum deferred_operation_type type;
     union {
         struct {
-            struct state_application* application;
+            char* application_name;
         } add_app;
         struct {
             char* application_name;
         } remove_app;
         struct {
-            struct served_transaction* transaction;
+            unsigned int transaction_id;
         } add_tx;
         struct {
-            struct served_transaction* transaction;
+            unsigned int                      transaction_id;
+            enum served_transaction_type      type;
+            sm_state_t                        state;
+            enum served_transaction_wait_type wait_type;
+            unsigned int                      wait_data;
         } update_tx;
         struct {
-            unsigned int              transaction_id;
-            struct state_transaction* transaction;
+            unsigned int transaction_id;
         } add_tx_state;
         struct {
-            struct state_transaction* transaction;
+            unsigned int transaction_id;
         } update_tx_state;
         struct {
             unsigned int transaction_id;
@@ -211,6 +232,63 @@ static struct deferred_operation* __deferred_operation_new(enum deferred_operati
     return op;
 }
 
+// Statements used by the deferred operations, these are prepared once and
+// reused for every commit
+enum __state_statement {
+    STATE_STATEMENT_INSERT_APPLICATION,
+    STATE_STATEMENT_INSERT_REVISION,
+    STATE_STATEMENT_INSERT_COMMAND,
+    STATE_STATEMENT_DELETE_APPLICATION,
+    STATE_STATEMENT_INSERT_TRANSACTION,
+    STATE_STATEMENT_UPDATE_TRANSACTION,
+    STATE_STATEMENT_UPDATE_TRANSACTION_STATE,
+    STATE_STATEMENT_COMPLETE_TRANSACTION,
+    STATE_STATEMENT_INSERT_TRANSACTION_LOG,
+    STATE_STATEMENT_INSERT_TRANSACTION_STATE,
+    STATE_STATEMENT_COUNT
+};
+
+static const char* g_statementsSQL[STATE_STATEMENT_COUNT] = {
+    [STATE_STATEMENT_INSERT_APPLICATION] =
+        "INSERT INTO applications (name) VALUES (?)",
+    [STATE_STATEMENT_INSERT_REVISION] =
+        "INSERT INTO revisions (application_id, channel, major, minor, patch, revision, tag, size, created) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [STATE_STATEMENT_INSERT_COMMAND] =
+        "INSERT INTO commands (application_id, name, path, arguments, type) "
+        "VALUES (?, ?, ?, ?, ?)",
+    [STATE_STATEMENT_DELETE_APPLICATION] =
+        "DELETE FROM applications WHERE name = ?",
+    [STATE_STATEMENT_INSERT_TRANSACTION] =
+        "INSERT INTO transactions (id, type, state, flags, name, description, wait_type, wait_data, batch_id) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [STATE_STATEMENT_UPDATE_TRANSACTION] =
+        "UPDATE transactions SET type = ?, state = ?, flags = ?, wait_type = ?, wait_data = ? WHERE id = ?",
+    [STATE_STATEMENT_UPDATE_TRANSACTION_STATE] =
+        "UPDATE transactions_state SET name = ?, channel = ?, revision = ? WHERE transaction_id = ?",
+    [STATE_STATEMENT_COMPLETE_TRANSACTION] =
+        "UPDATE transactions SET completed_at = strftime('%s', 'now') WHERE id = ?",
+    [STATE_STATEMENT_INSERT_TRANSACTION_LOG] =
+        "INSERT INTO transaction_logs (transaction_id, level, timestamp, state, message) "
+        "VALUES (?, ?, ?, ?, ?)",
+    [STATE_STATEMENT_INSERT_TRANSACTION_STATE] =
+        "INSERT INTO transactions_state (transaction_id, name, channel, revision) "
+        "VALUES (?, ?, ?, ?)"
+};
+
+// Deferred operations from all unlocks within the window are committed together
+// in one database transaction, unless this many operations are pending, which
+// are then committed right away
+#define STATE_GROUP_COMMIT_WINDOW_MS      20
+#define STATE_GROUP_COMMIT_MAX_OPERATIONS 256
+
+// The published snapshot is shared by any number of readers, and is freed
+// when the last reference to it is released.
+struct __state_snapshot {
+    struct served_state_snapshot base;
+    int                          references;
+};
+
 struct __state {
     struct served_transaction* transactions;
     int                        transactions_count;
@@ -219,15 +297,42 @@ struct __state {
     struct state_application*  applications_states;
     int                        applications_states_count;
 
-    sqlite3* database;
-    mtx_t    lock;
-    int      lock_count;
+    // Lookup indices that are maintained alongside the arrays above. The arrays
+    // are moved by realloc, so the indices store the array position + 1.
+    struct hashindex transactions_index;
+    struct hashindex transaction_states_index;
+    struct hashindex applications_index;
+
+    sqlite3*      database;
+    sqlite3_stmt* statements[STATE_STATEMENT_COUNT];
+    mtx_t         lock;
+    int           lock_count;
     
     // Transaction ID management
     unsigned int next_transaction_id;
     
     // Deferred operation queue
     struct list deferred_ops;
+
+    // The committer commits the deferred operations when the group commit
+    // window closes. commit_lock is taken after the state lock, never before.
+    thrd_t          committer;
+    int             committer_running;
+    int             committer_stop;
+    mtx_t           commit_lock;
+    cnd_t           commit_cond;
+    int             commit_pending;
+    struct timespec commit_deadline;
+
+    // Readers of the applications work from an immutable snapshot, which is
+    // republished on unlock when the applications have changed
+    struct __state_snapshot* snapshot;
+    mtx_t                    snapshot_lock;
+    int                      applications_dirty;
+
+    // Protects the transaction states and their logs from readers of the logs,
+    // which do not take the state lock
+    mtx_t logs_lock;
 };
 
 // Database connection and state management
@@ -248,9 +353,122 @@ static struct __state* __state_new(void)
         free((void*)state);
         return NULL;
     }
+    if (mtx_init(&state->snapshot_lock, mtx_plain) != thrd_success) {
+        VLOG_ERROR("served", "__state_new: failed to initialize mutex\n");
+        mtx_destroy(&state->lock);
+        free((void*)state);
+        return NULL;
+    }
+    if (mtx_init(&state->logs_lock, mtx_plain) != thrd_success) {
+        VLOG_ERROR("served", "__state_new: failed to initialize mutex\n");
+        mtx_destroy(&state->snapshot_lock);
+        mtx_destroy(&state->lock);
+        free((void*)state);
+        return NULL;
+    }
     return state;
 }
 
+static int __applications_reindex(struct __state* state)
+{
+    if (hashindex_reset(&state->applications_index, state->applications_states_count)) {
+        return -1;
+    }
+    for (int i = 0; i < state->applications_states_count; i++) {
+        hashindex_insert(&state->applications_index, hashindex_hash_string(state->applications_states[i].name), (uintptr_t)i + 1);
+    }
+    return 0;
+}
+
+static int __transactions_reindex(struct __state* state)
+{
+    if (hashindex_reset(&state->transactions_index, state->transactions_count)) {
+        return -1;
+    }
+    for (int i = 0; i < state->transactions_count; i++) {
+        hashindex_insert(&state->transactions_index, hashindex_hash_uint(state->transactions[i].id), (uintptr_t)i + 1);
+    }
+    return 0;
+}
+
+static int __transaction_states_reindex(struct __state* state)
+{
+    if (hashindex_reset(&state->transaction_states_index, state->transaction_state_count)) {
+        return -1;
+    }
+    for (int i = 0; i < state->transaction_state_count; i++) {
+        hashindex_insert(&state->transaction_states_index, hashindex_hash_uint(state->transaction_states[i].id), (uintptr_t)i + 1);
+    }
+    return 0;
+}
+
+// The following must be called after the entry has been appended to its array
+static int __applications_index_add(struct __state* state, int position)
+{
+    if (hashindex_full(&state->applications_index, state->applications_states_count)) {
+        return __applications_reindex(state);
+    }
+    hashindex_insert(&state->applications_index, hashindex_hash_string(state->applications_states[position].name), (uintptr_t)position + 1);
+    return 0;
+}
+
+static int __transactions_index_add(struct __state* state, int position)
+{
+    if (hashindex_full(&state->transactions_index, state->transactions_count)) {
+        return __transactions_reindex(state);
+    }
+    hashindex_insert(&state->transactions_index, hashindex_hash_uint(state->transactions[position].id), (uintptr_t)position + 1);
+    return 0;
+}
+
+static int __transaction_states_index_add(struct __state* state, int position)
+{
+    if (hashindex_full(&state->transaction_states_index, state->transaction_state_count)) {
+        return __transaction_states_reindex(state);
+    }
+    hashindex_insert(&state->transaction_states_index, hashindex_hash_uint(state->transaction_states[position].id), (uintptr_t)position + 1);
+    return 0;
+}
+
+static int __applications_find(struct __state* state, const char* name)
+{
+    struct hashindex* index = &state->applications_index;
+
+    hashindex_foreach(index, hashindex_hash_string(name), i) {
+        int position = (int)index->slots[i] - 1;
+        if (strcmp(state->applications_states[position].name, name) == 0) {
+            return position;
+        }
+    }
+    return -1;
+}
+
+static struct served_transaction* __transactions_find(struct __state* state, unsigned int id)
+{
+    struct hashindex* index = &state->transactions_index;
+
+    hashindex_foreach(index, hashindex_hash_uint(id), i) {
+        struct served_transaction* transaction = &state->transactions[index->slots[i] - 1];
+        if (transaction->id == id) {
+            return transaction;
+        }
+    }
+    return NULL;
+}
+
+static struct state_transaction* __transaction_states_find(struct __state* state, unsigned int id)
+{
+    struct hashindex* index = &state->transaction_states_index;
+
+    hashindex_foreach(index, hashindex_hash_uint(id), i) {
+        struct state_transaction* transaction = &state->transaction_states[index->slots[i] - 1];
+        if (transaction->id == id) {
+            return transaction;
+        }
+    }
+    return NULL;
+}
+
 // Deferred operation queue management
 static void __deferred_operation_free(struct deferred_operation* op)
 {
@@ -259,9 +477,15 @@ static void __deferred_operation_free(struct deferred_operation* op)
     }
 
     switch (op->type) {
+        case DEFERRED_OP_ADD_APPLICATION:
+            free(op->data.add_app.application_name);
+            break;
         case DEFERRED_OP_REMOVE_APPLICATION:
             free(op->data.remove_app.application_name);
             break;
+        case DEFERRED_OP_ADD_TRANSACTION_LOG:
+            free(op->data.add_log.message);
+            break;
         default:
             // Other operations don't own their data
             break;
@@ -304,6 +528,7 @@ static void __state_application_delete(struct state_application* application)
     }
     free((void*)application->base);
     free((void*)application->name);
+    free((void*)application->container_id);
 }
 
 static void __state_transaction_delete(struct state_transaction* transaction)
@@ -326,6 +551,167 @@ static void __served_transaction_delete(struct served_transaction* transaction)
     free((void*)transaction->description);
 }
 
+static struct chef_version* __version_copy(const struct chef_version* source)
+{
+    struct chef_version* version;
+
+    version = calloc(1, sizeof(struct chef_version));
+    if (version == NULL) {
+        return NULL;
+    }
+
+    *version = *source;
+    version->created = source->created ? platform_strdup(source->created) : NULL;
+    version->tag = source->tag ? platform_strdup(source->tag) : NULL;
+    if ((source->created != NULL && version->created == NULL)
+     || (source->tag != NULL && version->tag == NULL)) {
+        chef_version_free(version);
+        return NULL;
+    }
+    return version;
+}
+
+static int __state_application_copy(struct state_application* destination, const struct state_application* source)
+{
+    memset(destination, 0, sizeof(struct state_application));
+
+    destination->name = platform_strdup(source->name);
+    destination->base = source->base ? platform_strdup(source->base) : NULL;
+    if (destination->name == NULL || (source->base != NULL && destination->base == NULL)) {
+        return -1;
+    }
+
+    if (source->commands_count > 0) {
+        destination->commands = calloc(source->commands_count, sizeof(struct state_application_command));
+        if (destination->commands == NULL) {
+            return -1;
+        }
+        destination->commands_count = source->commands_count;
+
+        for (int i = 0; i < source->commands_count; i++) {
+            const struct state_application_command* command = &source->commands[i];
+
+            destination->commands[i].type = command->type;
+            destination->commands[i].name = command->name ? platform_strdup(command->name) : NULL;
+            destination->commands[i].path = command->path ? platform_strdup(command->path) : NULL;
+            destination->commands[i].arguments = command->arguments ? platform_strdup(command->arguments) : NULL;
+            if ((command->name != NULL && destination->commands[i].name == NULL) ||
+                (command->path != NULL && destination->commands[i].path == NULL) ||
+                (command->arguments != NULL && destination->commands[i].arguments == NULL)) {
+                return -1;
+            }
+        }
+    }
+
+    if (source->revisions_count > 0) {
+        destination->revisions = calloc(source->revisions_count, sizeof(struct state_application_revision));
+        if (destination->revisions == NULL) {
+            return -1;
+        }
+        destination->revisions_count = source->revisions_count;
+
+        for (int i = 0; i < source->revisions_count; i++) {
+            const struct state_application_revision* revision = &source->revisions[i];
+
+            destination->revisions[i].tracking_channel = revision->tracking_channel ? platform_strdup(revision->tracking_channel) : NULL;
+            destination->revisions[i].version = revision->version ? __version_copy(revision->version) : NULL;
+            if ((revision->tracking_channel != NULL && destination->revisions[i].tracking_channel == NULL) ||
+                (revision->version != NULL && destination->revisions[i].version == NULL)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void __snapshot_free(struct __state_snapshot* snapshot)
+{
+    for (int i = 0; i < snapshot->base.applications_count; i++) {
+        __state_application_delete(&snapshot->base.applications[i]);
+    }
+    free(snapshot->base.applications);
+    free(snapshot);
+}
+
+static int __snapshot_compare_applications(const void* lh, const void* rh)
+{
+    return strcmp(((const struct state_application*)lh)->name, ((const struct state_application*)rh)->name);
+}
+
+static struct __state_snapshot* __snapshot_new(struct __state* state)
+{
+    struct __state_snapshot* snapshot;
+
+    snapshot = calloc(1, sizeof(struct __state_snapshot));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    snapshot->references = 1;
+
+    if (state->applications_states_count > 0) {
+        snapshot->base.applications = calloc(state->applications_states_count, sizeof(struct state_application));
+        if (snapshot->base.applications == NULL) {
+            free(snapshot);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < state->applications_states_count; i++) {
+        // count the entry before copying it, so a partial copy is freed too
+        snapshot->base.applications_count++;
+        if (__state_application_copy(&snapshot->base.applications[i], &state->applications_states[i])) {
+            __snapshot_free(snapshot);
+            return NULL;
+        }
+    }
+
+    // sorted by name, so readers can look up applications without an index
+    qsort(
+        snapshot->base.applications,
+        snapshot->base.applications_count,
+        sizeof(struct state_application),
+        __snapshot_compare_applications
+    );
+    return snapshot;
+}
+
+static void __snapshot_release(struct __state* state, struct __state_snapshot* snapshot)
+{
+    int references;
+
+    mtx_lock(&state->snapshot_lock);
+    references = --snapshot->references;
+    mtx_unlock(&state->snapshot_lock);
+
+    if (references == 0) {
+        __snapshot_free(snapshot);
+    }
+}
+
+// Replaces the published snapshot with one built from the current applications.
+// Readers holding the previous snapshot keep it alive until they release it.
+static int __snapshot_publish(struct __state* state)
+{
+    struct __state_snapshot* snapshot;
+    struct __state_snapshot* previous;
+
+    snapshot = __snapshot_new(state);
+    if (snapshot == NULL) {
+        return -1;
+    }
+
+    mtx_lock(&state->snapshot_lock);
+    previous = state->snapshot;
+    state->snapshot = snapshot;
+    mtx_unlock(&state->snapshot_lock);
+
+    if (previous != NULL) {
+        __snapshot_release(state, previous);
+    }
+    state->applications_dirty = 0;
+    return 0;
+}
+
 static void __state_destroy(struct __state* state)
 {
     if (state == NULL) {
@@ -347,11 +733,43 @@ static void __state_destroy(struct __state* state)
     }
     free((void*)state->transaction_states);
 
+    hashindex_destroy(&state->applications_index);
+    hashindex_destroy(&state->transactions_index);
+    hashindex_destroy(&state->transaction_states_index);
+
+    if (state->snapshot != NULL) {
+        __snapshot_release(state, state->snapshot);
+    }
+
     __clear_deferred_operations(state);
+    mtx_destroy(&state->logs_lock);
+    mtx_destroy(&state->snapshot_lock);
     mtx_destroy(&state->lock);
     free((void*)state);
 }
 
+static int __upgrade_transactions_table(sqlite3* db)
+{
+    sqlite3_stmt* stmt;
+    char*         errMsg = NULL;
+    int           status;
+
+    // Preparing a statement that uses the column fails if it does not exist
+    status = sqlite3_prepare_v2(db, "SELECT batch_id FROM transactions LIMIT 0", -1, &stmt, NULL);
+    if (status == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return SQLITE_OK;
+    }
+
+    VLOG_DEBUG("served", "__upgrade_transactions_table: adding batch_id column\n");
+    status = sqlite3_exec(db, g_transactionsBatchColumnSQL, NULL, NULL, &errMsg);
+    if (status != SQLITE_OK) {
+        VLOG_ERROR("served", "__upgrade_transactions_table: failed to add batch_id column: %s\n", errMsg);
+        sqlite3_free(errMsg);
+    }
+    return status;
+}
+
 static int __create_database_schema(sqlite3* db)
 {
     char* errMsg = NULL;
@@ -385,6 +803,11 @@ static int __create_database_schema(sqlite3* db)
         return status;
     }
 
+    status = __upgrade_transactions_table(db);
+    if (status != SQLITE_OK) {
+        return status;
+    }
+
     status = sqlite3_exec(db, g_transactionsStateTableSQL, NULL, NULL, &errMsg);
     if (status != SQLITE_OK) {
         VLOG_ERROR("served", "__create_database_schema: failed to create transactions_state table: %s\n", errMsg);
@@ -399,6 +822,13 @@ static int __create_database_schema(sqlite3* db)
         return status;
     }
 
+    status = sqlite3_exec(db, g_indicesSQL, NULL, NULL, &errMsg);
+    if (status != SQLITE_OK) {
+        VLOG_ERROR("served", "__create_database_schema: failed to create indices: %s\n", errMsg);
+        sqlite3_free(errMsg);
+        return status;
+    }
+
     return 0;
 }
 
@@ -674,7 +1104,7 @@ static int __load_applications_from_db(struct __state* state)
 
     sqlite3_finalize(stmt);
     VLOG_DEBUG("served", "__load_applications_from_db: loaded %d applications\n", state->applications_states_count);
-    return 0;
+    return __applications_reindex(state);
 }
 
 static int __get_transaction_row_count(struct __state* state)
@@ -761,13 +1191,13 @@ static int __load_transaction_states_from_db(struct __state* state)
 
     sqlite3_finalize(stmt);
     VLOG_DEBUG("served", "__load_transaction_states_from_db: loaded %d transactions\n", transaction_count);
-    return 0;
+    return __transaction_states_reindex(state);
 }
 
 static int __load_transactions_from_db(struct __state* state)
 {
     const char* query = 
-        "SELECT id, type, state, flags, name, description, wait_type, wait_data, created_at, completed_at "
+        "SELECT id, type, state, flags, name, description, wait_type, wait_data, created_at, completed_at, batch_id "
         "FROM transactions "
         "ORDER BY id";
 
@@ -814,6 +1244,7 @@ static int __load_transactions_from_db(struct __state* state)
         unsigned int waitData = (unsigned int)sqlite3_column_int(stmt, 7);
         time_t createdAt = (time_t)sqlite3_column_int64(stmt, 8);
         time_t completedAt = sqlite3_column_type(stmt, 9) == SQLITE_NULL ? 0 : (time_t)sqlite3_column_int64(stmt, 9);
+        unsigned int batchId = (unsigned int)sqlite3_column_int(stmt, 10);
 
         served_transaction_construct(&state->transactions[i++], &(struct served_transaction_options) {
             .id = id,
@@ -821,6 +1252,7 @@ static int __load_transactions_from_db(struct __state* state)
             .initialState = storedState,
             .name = name,
             .description = description,
+            .batch_id = batchId,
             .wait = (struct served_transaction_wait) {
                 .type = waitType,
                 .data = {
@@ -836,7 +1268,7 @@ static int __load_transactions_from_db(struct __state* state)
 
     sqlite3_finalize(stmt);
     VLOG_DEBUG("served", "__load_transactions_from_db: loaded %d transactions\n", transaction_count);
-    return 0;
+    return __transactions_reindex(state);
 }
 
 static int __load_transaction_logs_from_db(struct __state* state)
@@ -861,28 +1293,14 @@ static int __load_transaction_logs_from_db(struct __state* state)
         const char* message = (const char*)sqlite3_column_text(stmt, 4);
 
         // Find the transaction this log belongs to
-        struct served_transaction* tx = NULL;
-        for (int i = 0; i < state->transactions_count; i++) {
-            if (state->transactions[i].id == transaction_id) {
-                tx = &state->transactions[i];
-                break;
-            }
-        }
-
+        struct served_transaction* tx = __transactions_find(state, transaction_id);
         if (tx == NULL) {
             VLOG_WARNING("served", "__load_transaction_logs_from_db: log for unknown transaction %u\n", transaction_id);
             continue;
         }
 
         // Find the state_transaction for this runtime transaction
-        struct state_transaction* state_tx = NULL;
-        for (int i = 0; i < state->transaction_state_count; i++) {
-            if (state->transaction_states[i].id == transaction_id) {
-                state_tx = &state->transaction_states[i];
-                break;
-            }
-        }
-
+        struct state_transaction* state_tx = __transaction_states_find(state, transaction_id);
         if (state_tx == NULL) {
             VLOG_WARNING("served", "__load_transaction_logs_from_db: no state for transaction %u\n", transaction_id);
             continue;
@@ -941,102 +1359,74 @@ static int __initialize_transaction_id_counter(struct __state* state)
     return 0;
 }
 
-int served_state_load(void)
+// Returns the cached statement, prepared on first use and reset for reuse
+static sqlite3_stmt* __statement(struct __state* state, enum __state_statement statement)
 {
-    int         status;
-    const char* path = utils_path_state_db();
-    VLOG_DEBUG("served", "served_state_load(path=%s)\n", path);
+    sqlite3_stmt* stmt = state->statements[statement];
+    int           status;
 
-    g_state = __state_new();
-    if (g_state == NULL) {
-        VLOG_ERROR("served", "served_state_load: failed to allocate state\n");
-        return -1;
+    if (stmt != NULL) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return stmt;
     }
 
-    status = sqlite3_open(path, &g_state->database);
+    status = sqlite3_prepare_v2(state->database, g_statementsSQL[statement], -1, &stmt, NULL);
     if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "served_state_load: failed to open database: %s\n", sqlite3_errmsg(g_state->database));
-        __state_destroy(g_state);
-        g_state = NULL;
-        return -1;
-    }
-
-    // Create database schema if it doesn't exist
-    if (__create_database_schema(g_state->database) != 0) {
-        sqlite3_close(g_state->database);
-        __state_destroy(g_state);
-        g_state = NULL;
-        return -1;
-    }
-
-    if (__load_applications_from_db(g_state) != 0 ||
-        __load_transactions_from_db(g_state) != 0 ||
-        __load_transaction_states_from_db(g_state) != 0 ||
-        __load_transaction_logs_from_db(g_state) != 0 ||
-        __initialize_transaction_id_counter(g_state) != 0) {
-        sqlite3_close(g_state->database);
-        __state_destroy(g_state);
-        g_state = NULL;
-        return -1;
+        VLOG_ERROR("served", "__statement: failed to prepare '%s': %s\n", g_statementsSQL[statement], sqlite3_errmsg(state->database));
+        return NULL;
     }
-    
-    return 0;
+    state->statements[statement] = stmt;
+    return stmt;
 }
 
-void served_state_close(void)
+// Steps a cached statement that produces no rows, and resets it so it does not
+// keep the database busy
+static int __statement_execute(sqlite3_stmt* stmt)
 {
-    if (g_state == NULL) {
-        return;
-    }
-
-    if (g_state->database) {
-        sqlite3_close(g_state->database);
-    }
-    
-    __state_destroy(g_state);
-    g_state = NULL;
+    int status = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return status == SQLITE_DONE ? 0 : -1;
 }
 
 // Execute a single deferred operation directly on the database
-static int __execute_add_application_op(struct __state* state, struct state_application* application)
+static int __execute_add_application_op(struct __state* state, const char* application_name)
 {
-    // This is the actual database insertion logic
-    const char* insert_app_query = 
-        "INSERT INTO applications (name) "
-        "VALUES (?)";
+    struct state_application* application;
+    sqlite3_stmt*             stmt;
+    sqlite3_int64             app_id;
+    int                       position;
+
+    // The application is persisted as it is when the operation executes, if it
+    // was removed again before that, then there is nothing to add
+    position = __applications_find(state, application_name);
+    if (position < 0) {
+        VLOG_DEBUG("served", "__execute_add_application_op: application '%s' no longer exists\n", application_name);
+        return 0;
+    }
+    application = &state->applications_states[position];
 
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, insert_app_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_add_application_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    stmt = __statement(state, STATE_STATEMENT_INSERT_APPLICATION);
+    if (stmt == NULL) {
         return -1;
     }
 
     sqlite3_bind_text(stmt, 1, application->name, -1, SQLITE_STATIC);
-
-    status = sqlite3_step(stmt);
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_add_application_op: failed to insert application: %s\n", sqlite3_errmsg(state->database));
-        sqlite3_finalize(stmt);
         return -1;
     }
 
-    int app_id = (int)sqlite3_last_insert_rowid(state->database);
-    sqlite3_finalize(stmt);
+    app_id = sqlite3_last_insert_rowid(state->database);
 
     // Insert revision entry for the application (if revisions exist)
     if (application->revisions_count > 0 && application->revisions != NULL) {
-        const char* insert_rev_query = 
-            "INSERT INTO revisions (application_id, channel, major, minor, patch, revision, tag, size, created) "
-            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
-            
-        status = sqlite3_prepare_v2(state->database, insert_rev_query, -1, &stmt, NULL);
-        if (status != SQLITE_OK) {
-            VLOG_ERROR("served", "__execute_add_application_op: failed to prepare revision statement: %s\n", sqlite3_errmsg(state->database));
+        stmt = __statement(state, STATE_STATEMENT_INSERT_REVISION);
+        if (stmt == NULL) {
             return -1;
         }
 
-        sqlite3_bind_int(stmt, 1, app_id);
+        sqlite3_bind_int64(stmt, 1, app_id);
         sqlite3_bind_text(stmt, 2, application->revisions[0].tracking_channel, -1, SQLITE_STATIC);
         
         if (application->revisions[0].version != NULL) {
@@ -1047,20 +1437,10 @@ static int __execute_add_application_op(struct __state* state, struct state_appl
             sqlite3_bind_text(stmt, 7, application->revisions[0].version->tag, -1, SQLITE_STATIC);
             sqlite3_bind_int64(stmt, 8, application->revisions[0].version->size);
             sqlite3_bind_text(stmt, 9, application->revisions[0].version->created, -1, SQLITE_STATIC);
-        } else {
-            sqlite3_bind_null(stmt, 3);
-            sqlite3_bind_null(stmt, 4);
-            sqlite3_bind_null(stmt, 5);
-            sqlite3_bind_null(stmt, 6);
-            sqlite3_bind_null(stmt, 7);
-            sqlite3_bind_null(stmt, 8);
-            sqlite3_bind_null(stmt, 9);
         }
+        // unbound parameters are NULL
 
-        status = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        
-        if (status != SQLITE_DONE) {
+        if (__statement_execute(stmt)) {
             VLOG_ERROR("served", "__execute_add_application_op: failed to insert revision: %s\n", sqlite3_errmsg(state->database));
             return -1;
         }
@@ -1068,26 +1448,18 @@ static int __execute_add_application_op(struct __state* state, struct state_appl
 
     // Insert commands if any
     for (int i = 0; i < application->commands_count; i++) {
-        const char* insert_cmd_query = 
-            "INSERT INTO commands (application_id, name, path, arguments, type) "
-            "VALUES (?, ?, ?, ?, ?)";
-
-        status = sqlite3_prepare_v2(state->database, insert_cmd_query, -1, &stmt, NULL);
-        if (status != SQLITE_OK) {
-            VLOG_ERROR("served", "__execute_add_application_op: failed to prepare command statement: %s\n", sqlite3_errmsg(state->database));
+        stmt = __statement(state, STATE_STATEMENT_INSERT_COMMAND);
+        if (stmt == NULL) {
             return -1;
         }
 
-        sqlite3_bind_int(stmt, 1, app_id);
+        sqlite3_bind_int64(stmt, 1, app_id);
         sqlite3_bind_text(stmt, 2, application->commands[i].name, -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 3, application->commands[i].path, -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 4, application->commands[i].arguments, -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 5, application->commands[i].type);
 
-        status = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        
-        if (status != SQLITE_DONE) {
+        if (__statement_execute(stmt)) {
             VLOG_ERROR("served", "__execute_add_application_op: failed to insert command: %s\n", sqlite3_errmsg(state->database));
             return -1;
         }
@@ -1098,19 +1470,13 @@ static int __execute_add_application_op(struct __state* state, struct state_appl
 
 static int __execute_remove_application_op(struct __state* state, const char* application_name)
 {
-    const char* delete_query = "DELETE FROM applications WHERE name = ?";
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, delete_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_remove_application_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    sqlite3_stmt* stmt = __statement(state, STATE_STATEMENT_DELETE_APPLICATION);
+    if (stmt == NULL) {
         return -1;
     }
 
     sqlite3_bind_text(stmt, 1, application_name, -1, SQLITE_STATIC);
-    status = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_remove_application_op: failed to delete application: %s\n", sqlite3_errmsg(state->database));
         return -1;
     }
@@ -1118,16 +1484,19 @@ static int __execute_remove_application_op(struct __state* state, const char* ap
     return 0;
 }
 
-static int __execute_add_transaction_op(struct __state* state, struct served_transaction* transaction)
+static int __execute_add_transaction_op(struct __state* state, unsigned int transaction_id)
 {
-    const char* insert_tx_query = 
-        "INSERT INTO transactions (id, type, state, flags, name, description, wait_type, wait_data) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
+    struct served_transaction* transaction;
+    sqlite3_stmt*              stmt;
 
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, insert_tx_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_add_transaction_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    transaction = __transactions_find(state, transaction_id);
+    if (transaction == NULL) {
+        VLOG_WARNING("served", "__execute_add_transaction_op: transaction %u no longer exists\n", transaction_id);
+        return 0;
+    }
+
+    stmt = __statement(state, STATE_STATEMENT_INSERT_TRANSACTION);
+    if (stmt == NULL) {
         return -1;
     }
     VLOG_DEBUG("served", "__execute_add_transaction_op: adding transaction id=%u, type=%d, state=%d\n", transaction->id, transaction->type, served_sm_current_state(&transaction->sm));
@@ -1140,61 +1509,49 @@ static int __execute_add_transaction_op(struct __state* state, struct served_tra
     sqlite3_bind_text(stmt, 6, transaction->description, -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 7, transaction->wait.type);
     sqlite3_bind_int(stmt, 8, transaction->wait.data.transaction_id);
+    sqlite3_bind_int(stmt, 9, transaction->batch_id);
 
-    status = sqlite3_step(stmt);
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_add_transaction_op: failed to insert transaction: %s\n", sqlite3_errmsg(state->database));
-        sqlite3_finalize(stmt);
         return -1;
     }
-
-    sqlite3_finalize(stmt);
     return 0;
 }
 
-static int __execute_update_transaction_op(struct __state* state, struct served_transaction* transaction)
+static int __execute_update_transaction_op(struct __state* state, struct deferred_operation* op)
 {
-    const char* update_tx_query = 
-        "UPDATE transactions SET type = ?, state = ?, flags = ?, name = ?, description = ?, "
-        "wait_type = ?, wait_data = ? WHERE id = ?";
-
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, update_tx_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_update_transaction_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    sqlite3_stmt* stmt = __statement(state, STATE_STATEMENT_UPDATE_TRANSACTION);
+    if (stmt == NULL) {
         return -1;
     }
 
-    sqlite3_bind_int(stmt, 1, transaction->type);
-    sqlite3_bind_int(stmt, 2, served_sm_current_state(&transaction->sm));
+    sqlite3_bind_int(stmt, 1, op->data.update_tx.type);
+    sqlite3_bind_int(stmt, 2, op->data.update_tx.state);
     sqlite3_bind_int(stmt, 3, 0);  // flags - placeholder
-    sqlite3_bind_text(stmt, 4, transaction->name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, transaction->description, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 6, transaction->wait.type);
-    sqlite3_bind_int(stmt, 7, transaction->wait.data.transaction_id);
-    sqlite3_bind_int(stmt, 8, transaction->id);
+    sqlite3_bind_int(stmt, 4, op->data.update_tx.wait_type);
+    sqlite3_bind_int(stmt, 5, op->data.update_tx.wait_data);
+    sqlite3_bind_int(stmt, 6, op->data.update_tx.transaction_id);
 
-    status = sqlite3_step(stmt);
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_update_transaction_op: failed to update transaction: %s\n", sqlite3_errmsg(state->database));
-        sqlite3_finalize(stmt);
         return -1;
     }
-
-    sqlite3_finalize(stmt);
     return 0;
 }
 
-static int __execute_update_tx_state_op(struct __state* state, struct state_transaction* transaction)
+static int __execute_update_tx_state_op(struct __state* state, unsigned int transaction_id)
 {
-    const char* update_tx_state_query = 
-        "UPDATE transactions_state SET name = ?, channel = ?, revision = ? "
-        "WHERE transaction_id = ?";
+    struct state_transaction* transaction;
+    sqlite3_stmt*             stmt;
 
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, update_tx_state_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_update_tx_state_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    transaction = __transaction_states_find(state, transaction_id);
+    if (transaction == NULL) {
+        VLOG_WARNING("served", "__execute_update_tx_state_op: transaction state %u no longer exists\n", transaction_id);
+        return 0;
+    }
+
+    stmt = __statement(state, STATE_STATEMENT_UPDATE_TRANSACTION_STATE);
+    if (stmt == NULL) {
         return -1;
     }
 
@@ -1203,32 +1560,22 @@ static int __execute_update_tx_state_op(struct __state* state, struct state_tran
     sqlite3_bind_int(stmt, 3, transaction->revision);
     sqlite3_bind_int(stmt, 4, transaction->id);
 
-    status = sqlite3_step(stmt);
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_update_tx_state_op: failed to update transaction state: %s\n", sqlite3_errmsg(state->database));
-        sqlite3_finalize(stmt);
         return -1;
     }
-
-    sqlite3_finalize(stmt);
     return 0;
 }
 
 static int __execute_complete_tx_op(struct __state* state, unsigned int transaction_id)
 {
-    const char* complete_tx_query = "UPDATE transactions SET completed_at = strftime('%s', 'now') WHERE id = ?";
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, complete_tx_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_complete_tx_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    sqlite3_stmt* stmt = __statement(state, STATE_STATEMENT_COMPLETE_TRANSACTION);
+    if (stmt == NULL) {
         return -1;
     }
 
     sqlite3_bind_int(stmt, 1, transaction_id);
-    status = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_complete_tx_op: failed to mark transaction complete: %s\n", sqlite3_errmsg(state->database));
         return -1;
     }
@@ -1237,56 +1584,39 @@ static int __execute_complete_tx_op(struct __state* state, unsigned int transact
     return 0;
 }
 
-static int __execute_add_transaction_log_op(struct __state* state, void* log_data)
+static int __execute_add_transaction_log_op(struct __state* state, struct deferred_operation* op)
 {
-    struct {
-        unsigned int                      transaction_id;
-        enum served_transaction_log_level level;
-        time_t                            timestamp;
-        sm_state_t                        txstate;
-        char*                             message;
-    }* data = log_data;
-
-    const char* insert_log_query = 
-        "INSERT INTO transaction_logs (transaction_id, level, timestamp, state, message) "
-        "VALUES (?, ?, ?, ?, ?)";
-
-    sqlite3_stmt* stmt;
-    int status = sqlite3_prepare_v2(state->database, insert_log_query, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_add_transaction_log_op: failed to prepare statement: %s\n", sqlite3_errmsg(state->database));
+    sqlite3_stmt* stmt = __statement(state, STATE_STATEMENT_INSERT_TRANSACTION_LOG);
+    if (stmt == NULL) {
         return -1;
     }
 
-    sqlite3_bind_int(stmt, 1, data->transaction_id);
-    sqlite3_bind_int(stmt, 2, data->level);
-    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)data->timestamp);
-    sqlite3_bind_int(stmt, 4, data->txstate);
-    sqlite3_bind_text(stmt, 5, data->message, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 1, op->data.add_log.transaction_id);
+    sqlite3_bind_int(stmt, 2, op->data.add_log.level);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)op->data.add_log.timestamp);
+    sqlite3_bind_int(stmt, 4, op->data.add_log.state);
+    sqlite3_bind_text(stmt, 5, op->data.add_log.message, -1, SQLITE_STATIC);
 
-    status = sqlite3_step(stmt);
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_add_transaction_log_op: failed to insert log: %s\n", sqlite3_errmsg(state->database));
-        sqlite3_finalize(stmt);
         return -1;
     }
-
-    sqlite3_finalize(stmt);
     return 0;
 }
 
-static int __execute_add_tx_state_op(struct __state* state, unsigned int transactionID, struct state_transaction* transaction)
+static int __execute_add_tx_state_op(struct __state* state, unsigned int transactionID)
 {
-    const char* insertTxStateSQL = 
-        "INSERT INTO transactions_state (transaction_id, name, channel, revision) "
-        "VALUES (?, ?, ?, ?)";
+    struct state_transaction* transaction;
+    sqlite3_stmt*             stmt;
 
-    sqlite3_stmt* stmt;
-    int           status;
+    transaction = __transaction_states_find(state, transactionID);
+    if (transaction == NULL) {
+        VLOG_WARNING("served", "__execute_add_tx_state_op: transaction state %u no longer exists\n", transactionID);
+        return 0;
+    }
 
-    status = sqlite3_prepare_v2(state->database, insertTxStateSQL, -1, &stmt, NULL);
-    if (status != SQLITE_OK) {
-        VLOG_ERROR("served", "__execute_add_tx_state_op: failed to prepare state statement: %s\n", sqlite3_errmsg(state->database));
+    stmt = __statement(state, STATE_STATEMENT_INSERT_TRANSACTION_STATE);
+    if (stmt == NULL) {
         return -1;
     }
 
@@ -1295,18 +1625,15 @@ static int __execute_add_tx_state_op(struct __state* state, unsigned int transac
     sqlite3_bind_text(stmt, 3, transaction->channel, -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 4, transaction->revision);
 
-    status = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (status != SQLITE_DONE) {
+    if (__statement_execute(stmt)) {
         VLOG_ERROR("served", "__execute_add_tx_state_op: failed to insert transaction state: %s\n", sqlite3_errmsg(state->database));
         return -1;
     }
-
     return 0;
 }
 
-// Execute all deferred operations in a single transaction
+// Execute all deferred operations in a single transaction. This must be called
+// with the state lock held.
 static int __execute_deferred_operations(struct __state* state)
 {
     struct list_item* item;
@@ -1314,7 +1641,7 @@ static int __execute_deferred_operations(struct __state* state)
         return 0; // Nothing to do
     }
 
-    VLOG_DEBUG("served", "__execute_deferred_operations: executing deferred operations\n");
+    VLOG_DEBUG("served", "__execute_deferred_operations: executing %i deferred operations\n", state->deferred_ops.count);
 
     char* errMsg = NULL;
     int status = sqlite3_exec(state->database, "BEGIN TRANSACTION", NULL, NULL, &errMsg);
@@ -1330,7 +1657,7 @@ static int __execute_deferred_operations(struct __state* state)
         
         switch (op->type) {
             case DEFERRED_OP_ADD_APPLICATION:
-                result = __execute_add_application_op(state, op->data.add_app.application);
+                result = __execute_add_application_op(state, op->data.add_app.application_name);
                 break;
                 
             case DEFERRED_OP_REMOVE_APPLICATION:
@@ -1338,23 +1665,19 @@ static int __execute_deferred_operations(struct __state* state)
                 break;
                 
             case DEFERRED_OP_ADD_TRANSACTION:
-                result = __execute_add_transaction_op(state, op->data.add_tx.transaction);
+                result = __execute_add_transaction_op(state, op->data.add_tx.transaction_id);
                 break;
                 
             case DEFERRED_OP_UPDATE_TRANSACTION:
-                result = __execute_update_transaction_op(state, op->data.update_tx.transaction);
+                result = __execute_update_transaction_op(state, op);
                 break;
                 
             case DEFERRED_OP_ADD_TRANSACTION_STATE:
-                result = __execute_add_tx_state_op(
-                    state,
-                    op->data.add_tx_state.transaction_id,
-                    op->data.add_tx_state.transaction
-                );
+                result = __execute_add_tx_state_op(state, op->data.add_tx_state.transaction_id);
                 break;
 
             case DEFERRED_OP_UPDATE_TRANSACTION_STATE:
-                result = __execute_update_tx_state_op(state, op->data.update_tx_state.transaction);
+                result = __execute_update_tx_state_op(state, op->data.update_tx_state.transaction_id);
                 break;
 
             case DEFERRED_OP_COMPLETE_TRANSACTION:
@@ -1362,8 +1685,7 @@ static int __execute_deferred_operations(struct __state* state)
                 break;
 
             case DEFERRED_OP_ADD_TRANSACTION_LOG:
-                result = __execute_add_transaction_log_op(state, &op->data.add_log);
-                free(op->data.add_log.message);
+                result = __execute_add_transaction_log_op(state, op);
                 break;
         }
         
@@ -1387,6 +1709,195 @@ static int __execute_deferred_operations(struct __state* state)
     return 0;
 }
 
+// The committer executes the deferred operations once the group commit window
+// has passed, so operations from all unlocks within the window share a single
+// database transaction.
+static int __committer_main(void* context)
+{
+    struct __state* state = context;
+
+    mtx_lock(&state->commit_lock);
+    while (1) {
+        while (!state->commit_pending && !state->committer_stop) {
+            cnd_wait(&state->commit_cond, &state->commit_lock);
+        }
+        if (state->committer_stop) {
+            break;
+        }
+
+        // Wait out the window, unlocks in the meantime join the pending commit
+        while (!state->committer_stop &&
+               cnd_timedwait(&state->commit_cond, &state->commit_lock, &state->commit_deadline) != thrd_timedout) { }
+        state->commit_pending = 0;
+        mtx_unlock(&state->commit_lock);
+
+        mtx_lock(&state->lock);
+        state->lock_count++;
+        if (__execute_deferred_operations(state) != 0) {
+            VLOG_ERROR("served", "__committer_main: failed to execute deferred operations\n");
+        }
+        state->lock_count--;
+        mtx_unlock(&state->lock);
+
+        mtx_lock(&state->commit_lock);
+    }
+    mtx_unlock(&state->commit_lock);
+    return 0;
+}
+
+static int __committer_start(struct __state* state)
+{
+    if (mtx_init(&state->commit_lock, mtx_plain) != thrd_success) {
+        return -1;
+    }
+    if (cnd_init(&state->commit_cond) != thrd_success) {
+        mtx_destroy(&state->commit_lock);
+        return -1;
+    }
+    if (thrd_create(&state->committer, __committer_main, state) != thrd_success) {
+        cnd_destroy(&state->commit_cond);
+        mtx_destroy(&state->commit_lock);
+        return -1;
+    }
+    state->committer_running = 1;
+    return 0;
+}
+
+static void __committer_stop(struct __state* state)
+{
+    if (!state->committer_running) {
+        return;
+    }
+
+    mtx_lock(&state->commit_lock);
+    state->committer_stop = 1;
+    cnd_signal(&state->commit_cond);
+    mtx_unlock(&state->commit_lock);
+
+    thrd_join(state->committer, NULL);
+    cnd_destroy(&state->commit_cond);
+    mtx_destroy(&state->commit_lock);
+    state->committer_running = 0;
+}
+
+// Schedules the deferred operations to be committed when the group commit
+// window closes. Large batches are committed right away. Must be called with
+// the state lock held.
+static void __schedule_commit(struct __state* state)
+{
+    if (!state->committer_running || state->deferred_ops.count >= STATE_GROUP_COMMIT_MAX_OPERATIONS) {
+        if (__execute_deferred_operations(state) != 0) {
+            // the operations are kept on failure and retried with the next commit
+            VLOG_ERROR("served", "__schedule_commit: failed to execute deferred operations\n");
+        }
+        return;
+    }
+
+    mtx_lock(&state->commit_lock);
+    if (!state->commit_pending) {
+        timespec_get(&state->commit_deadline, TIME_UTC);
+        state->commit_deadline.tv_nsec += STATE_GROUP_COMMIT_WINDOW_MS * 1000000L;
+        if (state->commit_deadline.tv_nsec >= 1000000000L) {
+            state->commit_deadline.tv_sec++;
+            state->commit_deadline.tv_nsec -= 1000000000L;
+        }
+        state->commit_pending = 1;
+        cnd_signal(&state->commit_cond);
+    }
+    mtx_unlock(&state->commit_lock);
+}
+
+static void __close_database(struct __state* state)
+{
+    for (int i = 0; i < STATE_STATEMENT_COUNT; i++) {
+        sqlite3_finalize(state->statements[i]);
+        state->statements[i] = NULL;
+    }
+    sqlite3_close(state->database);
+    state->database = NULL;
+}
+
+int served_state_load(void)
+{
+    int         status;
+    const char* path = utils_path_state_db();
+    VLOG_DEBUG("served", "served_state_load(path=%s)\n", path);
+
+    g_state = __state_new();
+    if (g_state == NULL) {
+        VLOG_ERROR("served", "served_state_load: failed to allocate state\n");
+        return -1;
+    }
+
+    status = sqlite3_open(path, &g_state->database);
+    if (status != SQLITE_OK) {
+        VLOG_ERROR("served", "served_state_load: failed to open database: %s\n", sqlite3_errmsg(g_state->database));
+        __close_database(g_state);
+        __state_destroy(g_state);
+        g_state = NULL;
+        return -1;
+    }
+
+    // The write-ahead log lets commits append to the log instead of rewriting
+    // the database, and with synchronous=NORMAL they are only synced to disk
+    // on checkpoints. A commit may then be lost on power failure, but the
+    // database cannot be corrupted.
+    status = sqlite3_exec(g_state->database, "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+    if (status != SQLITE_OK) {
+        VLOG_WARNING("served", "served_state_load: failed to enable write-ahead logging: %s\n", sqlite3_errmsg(g_state->database));
+    }
+
+    // Create database schema if it doesn't exist
+    if (__create_database_schema(g_state->database) != 0) {
+        __close_database(g_state);
+        __state_destroy(g_state);
+        g_state = NULL;
+        return -1;
+    }
+
+    if (__load_applications_from_db(g_state) != 0 ||
+        __load_transactions_from_db(g_state) != 0 ||
+        __load_transaction_states_from_db(g_state) != 0 ||
+        __load_transaction_logs_from_db(g_state) != 0 ||
+        __initialize_transaction_id_counter(g_state) != 0 ||
+        __snapshot_publish(g_state) != 0) {
+        __close_database(g_state);
+        __state_destroy(g_state);
+        g_state = NULL;
+        return -1;
+    }
+
+    // Without the committer, deferred operations are committed on unlock
+    if (__committer_start(g_state) != 0) {
+        VLOG_WARNING("served", "served_state_load: failed to start committer, group commit is disabled\n");
+    }
+    return 0;
+}
+
+void served_state_close(void)
+{
+    if (g_state == NULL) {
+        return;
+    }
+
+    // Commit whatever is still pending before closing the database
+    __committer_stop(g_state);
+    mtx_lock(&g_state->lock);
+    g_state->lock_count++;
+    if (__execute_deferred_operations(g_state) != 0) {
+        VLOG_ERROR("served", "served_state_close: failed to execute deferred operations\n");
+    }
+    g_state->lock_count--;
+    mtx_unlock(&g_state->lock);
+
+    if (g_state->database) {
+        __close_database(g_state);
+    }
+    
+    __state_destroy(g_state);
+    g_state = NULL;
+}
+
 void served_state_lock(void)
 {
     mtx_lock(&g_state->lock);
@@ -1395,17 +1906,17 @@ void served_state_lock(void)
 
 void served_state_unlock(void)
 {
-    // Execute all deferred operations before unlocking
+    // Commit all deferred operations, together with those of other unlocks
+    // in the group commit window
     if (g_state->deferred_ops.count > 0 && g_state->lock_count == 1) {
-        if (__execute_deferred_operations(g_state) != 0) {
-            VLOG_ERROR("served", "served_state_unlock: failed to execute deferred operations\n");
-            // Note: in-memory state may be inconsistent with database now
-            // You may want to reload state from database here
-        }
-        
-        // Save state to database here if needed
-        if (served_state_flush() != 0) {
-            VLOG_ERROR("served", "served_state_unlock: failed to flush dirty state\n");
+        __schedule_commit(g_state);
+    }
+
+    // Publish the changes to readers, on failure readers keep seeing the
+    // previous snapshot and publishing is retried on the next unlock
+    if (g_state->applications_dirty && g_state->lock_count == 1) {
+        if (__snapshot_publish(g_state) != 0) {
+            VLOG_ERROR("served", "served_state_unlock: failed to publish state snapshot\n");
         }
     }
 
@@ -1415,17 +1926,27 @@ void served_state_unlock(void)
 
 int served_state_flush(void)
 {
+    int status;
+
     if (g_state == NULL) {
         VLOG_ERROR("served", "served_state_flush: state not initialized\n");
         return -1;
     }
 
-    // In our SQLite-based implementation, data is already persisted to the database
-    // when applications/transactions are added/modified. This function ensures 
-    // any pending changes are committed and synced.
-    
-    // Flush any pending database operations
-    int status = sqlite3_exec(g_state->database, "PRAGMA synchronous = FULL", NULL, NULL, NULL);
+    // Commit anything still waiting for the group commit window
+    mtx_lock(&g_state->lock);
+    g_state->lock_count++;
+    status = __execute_deferred_operations(g_state);
+    g_state->lock_count--;
+    mtx_unlock(&g_state->lock);
+    if (status) {
+        VLOG_ERROR("served", "served_state_flush: failed to execute deferred operations\n");
+        return -1;
+    }
+
+    // Commits in WAL mode with synchronous=NORMAL are only synced when the log is
+    // checkpointed, so checkpoint it to make sure everything is on disk
+    status = sqlite3_wal_checkpoint_v2(g_state->database, NULL, SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
     if (status != SQLITE_OK) {
         VLOG_ERROR("served", "served_state_flush: failed to sync database: %s\n", sqlite3_errmsg(g_state->database));
         return -1;
@@ -1447,18 +1968,14 @@ struct state_transaction* served_state_transaction(unsigned int id)
         return NULL;
     }
 
-    for (int i = 0; i < g_state->transaction_state_count; i++) {
-        if (g_state->transaction_states[i].id == id) {
-            return &g_state->transaction_states[i];
-        }
-    }
-
-    return NULL;
+    return __transaction_states_find(g_state, id);
 }
 
 // This must be called with the state lock held
 struct state_application* served_state_application(const char* name)
 {
+    int position;
+
     if (g_state == NULL || name == NULL) {
         return NULL;
     }
@@ -1468,14 +1985,11 @@ struct state_application* served_state_application(const char* name)
         return NULL;
     }
 
-    for (int i = 0; i < g_state->applications_states_count; i++) {
-        if (g_state->applications_states[i].name && 
-            strcmp(g_state->applications_states[i].name, name) == 0) {
-            return &g_state->applications_states[i];
-        }
+    position = __applications_find(g_state, name);
+    if (position < 0) {
+        return NULL;
     }
-
-    return NULL;
+    return &g_state->applications_states[position];
 }
 
 // This must be called with the state lock held
@@ -1511,18 +2025,27 @@ int served_state_add_application(struct state_application* application)
     g_state->applications_states[g_state->applications_states_count] = *application;
     g_state->applications_states_count++;
 
-    op = malloc(sizeof(struct deferred_operation));
-    if (!op) {
+    if (__applications_index_add(g_state, g_state->applications_states_count - 1)) {
+        VLOG_ERROR("served", "served_state_add_application: failed to index application\n");
+        g_state->applications_states_count--;
+        return -1;
+    }
+
+    op = __deferred_operation_new(DEFERRED_OP_ADD_APPLICATION);
+    if (op != NULL) {
+        op->data.add_app.application_name = platform_strdup(application->name);
+    }
+    if (op == NULL || op->data.add_app.application_name == NULL) {
         VLOG_ERROR("served", "served_state_add_application: failed to allocate deferred operation\n");
         // Roll back in-memory change
+        free(op);
         g_state->applications_states_count--;
+        __applications_reindex(g_state);
         return -1;
     }
     
-    op->type = DEFERRED_OP_ADD_APPLICATION;
-    op->data.add_app.application = &g_state->applications_states[g_state->applications_states_count - 1];
-    
     __enqueue_deferred_operation(g_state, op);
+    g_state->applications_dirty = 1;
     
     VLOG_DEBUG("served", "served_state_add_application: operation deferred for '%s'\n", application->name);
     return 0;
@@ -1544,14 +2067,7 @@ int served_state_remove_application(struct state_application* application)
     }
 
     // Find and remove from in-memory state first
-    for (int i = 0; i < g_state->applications_states_count; i++) {
-        if (g_state->applications_states[i].name && 
-            strcmp(g_state->applications_states[i].name, application->name) == 0) {
-            found = i;
-            break;
-        }
-    }
-
+    found = __applications_find(g_state, application->name);
     if (found == -1) {
         VLOG_ERROR("served", "served_state_remove_application: application '%s' not found\n", application->name);
         return -1;
@@ -1566,6 +2082,11 @@ int served_state_remove_application(struct state_application* application)
     }
     g_state->applications_states_count--;
 
+    // The remaining applications have moved, this cannot fail as the index
+    // does not need to grow
+    __applications_reindex(g_state);
+    g_state->applications_dirty = 1;
+
     op = __deferred_operation_new(DEFERRED_OP_REMOVE_APPLICATION);
     if (op == NULL) {
         VLOG_ERROR("served", "served_state_remove_application: failed to allocate deferred operation\n");
@@ -1624,18 +2145,27 @@ unsigned int served_state_transaction_new(struct served_transaction_options* opt
     served_transaction_construct(tx, &opts);
     g_state->transactions_count++;
 
+    if (__transactions_index_add(g_state, g_state->transactions_count - 1)) {
+        VLOG_ERROR("served", "served_state_transaction_new: failed to index transaction\n");
+        g_state->transactions_count--;
+        __served_transaction_delete(tx);
+        g_state->next_transaction_id--;
+        return 0;
+    }
+
     // Defer the database operation
     op = __deferred_operation_new(DEFERRED_OP_ADD_TRANSACTION);
     if (op == NULL) {
         VLOG_ERROR("served", "served_state_transaction_new: failed to allocate deferred operation\n");
         // Roll back in-memory change and clean up allocated memory
         g_state->transactions_count--;
+        __transactions_reindex(g_state);
         __served_transaction_delete(tx);
         g_state->next_transaction_id--;
         return 0;
     }
     
-    op->data.add_tx.transaction = tx;
+    op->data.add_tx.transaction_id = transactionID;
     
     __enqueue_deferred_operation(g_state, op);
     
@@ -1647,6 +2177,7 @@ unsigned int served_state_transaction_new(struct served_transaction_options* opt
 int served_state_transaction_update(struct served_transaction* transaction)
 {
     struct deferred_operation* op;
+    struct served_transaction* tx;
 
     if (g_state == NULL || transaction == NULL) {
         return -1;
@@ -1657,15 +2188,27 @@ int served_state_transaction_update(struct served_transaction* transaction)
         return -1;
     }
 
-    // The in-memory transaction is already updated by the caller
-    // We just need to defer the database write
+    // The runtime transaction is a separate copy, keep the in-memory state in
+    // sync with what is persisted so readers see where it got to
+    tx = __transactions_find(g_state, transaction->id);
+    if (tx != NULL && tx != transaction) {
+        tx->sm.state = served_sm_current_state(&transaction->sm);
+        tx->wait = transaction->wait;
+    }
+
     op = __deferred_operation_new(DEFERRED_OP_UPDATE_TRANSACTION);
     if (op == NULL) {
         VLOG_ERROR("served", "served_state_transaction_update: failed to allocate deferred operation\n");
         return -1;
     }
 
-    op->data.update_tx.transaction = transaction;
+    // The transaction is persisted as it is now, the caller may delete it before
+    // the operation is committed
+    op->data.update_tx.transaction_id = transaction->id;
+    op->data.update_tx.type = transaction->type;
+    op->data.update_tx.state = served_sm_current_state(&transaction->sm);
+    op->data.update_tx.wait_type = transaction->wait.type;
+    op->data.update_tx.wait_data = transaction->wait.data.transaction_id;
     
     __enqueue_deferred_operation(g_state, op);
     return 0;
@@ -1691,22 +2234,18 @@ int served_state_transaction_log_add(
     }
 
     // Find the state_transaction for this transaction_id
-    for (int i = 0; i < g_state->transaction_state_count; i++) {
-        if (g_state->transaction_states[i].id == transaction_id) {
-            state_tx = &g_state->transaction_states[i];
-            break;
-        }
-    }
-
+    state_tx = __transaction_states_find(g_state, transaction_id);
     if (state_tx == NULL) {
         VLOG_WARNING("served", "served_state_transaction_log_add: no state for transaction %u\n", transaction_id);
         return -1;
     }
 
     // Add to in-memory state immediately
+    mtx_lock(&g_state->logs_lock);
     struct state_transaction_log* new_logs = realloc(state_tx->logs, 
         sizeof(struct state_transaction_log) * (state_tx->logs_count + 1));
     if (new_logs == NULL) {
+        mtx_unlock(&g_state->logs_lock);
         VLOG_ERROR("served", "served_state_transaction_log_add: failed to allocate log entry\n");
         return -1;
     }
@@ -1718,13 +2257,16 @@ int served_state_transaction_log_add(
     log->state = state;
     strncpy(log->message, message, sizeof(log->message) - 1);
     log->message[sizeof(log->message) - 1] = '\0';
+    mtx_unlock(&g_state->logs_lock);
 
     // Defer database operation
     op = __deferred_operation_new(DEFERRED_OP_ADD_TRANSACTION_LOG);
     if (op == NULL) {
         VLOG_ERROR("served", "served_state_transaction_log_add: failed to allocate deferred operation\n");
         // Roll back in-memory change
+        mtx_lock(&g_state->logs_lock);
         state_tx->logs_count--;
+        mtx_unlock(&g_state->logs_lock);
         return -1;
     }
 
@@ -1733,37 +2275,98 @@ int served_state_transaction_log_add(
     op->data.add_log.timestamp = timestamp;
     op->data.add_log.state = state;
     op->data.add_log.message = platform_strdup(message);
+    if (op->data.add_log.message == NULL) {
+        free(op);
+        mtx_lock(&g_state->logs_lock);
+        state_tx->logs_count--;
+        mtx_unlock(&g_state->logs_lock);
+        return -1;
+    }
 
     __enqueue_deferred_operation(g_state, op);
     return 0;
 }
 
+// This must NOT be called with the state lock held, readers of the logs only
+// synchronize with the writers modifying them
 int served_state_transaction_logs(
     unsigned int transaction_id,
     struct state_transaction_log** logs_out,
     int* count_out)
 {
+    struct state_transaction*     state_tx;
+    struct state_transaction_log* logs = NULL;
+    int                           count = 0;
+
     if (g_state == NULL || logs_out == NULL || count_out == NULL) {
         return -1;
     }
 
-    if (g_state->lock_count == 0) {
-        VLOG_ERROR("served", "served_state_transaction_logs: state lock not held\n");
+    mtx_lock(&g_state->logs_lock);
+    state_tx = __transaction_states_find(g_state, transaction_id);
+    if (state_tx == NULL) {
+        mtx_unlock(&g_state->logs_lock);
+        *logs_out = NULL;
+        *count_out = 0;
         return -1;
     }
 
-    // Find the state_transaction for this transaction_id
-    for (int i = 0; i < g_state->transaction_state_count; i++) {
-        if (g_state->transaction_states[i].id == transaction_id) {
-            *logs_out = g_state->transaction_states[i].logs;
-            *count_out = g_state->transaction_states[i].logs_count;
-            return 0;
+    if (state_tx->logs_count > 0) {
+        logs = malloc(sizeof(struct state_transaction_log) * state_tx->logs_count);
+        if (logs == NULL) {
+            mtx_unlock(&g_state->logs_lock);
+            return -1;
         }
+        memcpy(logs, state_tx->logs, sizeof(struct state_transaction_log) * state_tx->logs_count);
+        count = state_tx->logs_count;
     }
+    mtx_unlock(&g_state->logs_lock);
 
-    *logs_out = NULL;
-    *count_out = 0;
-    return -1;
+    *logs_out = logs;
+    *count_out = count;
+    return 0;
+}
+
+struct served_state_snapshot* served_state_snapshot_acquire(void)
+{
+    struct __state_snapshot* snapshot;
+
+    if (g_state == NULL) {
+        return NULL;
+    }
+
+    mtx_lock(&g_state->snapshot_lock);
+    snapshot = g_state->snapshot;
+    if (snapshot != NULL) {
+        snapshot->references++;
+    }
+    mtx_unlock(&g_state->snapshot_lock);
+    return snapshot != NULL ? &snapshot->base : NULL;
+}
+
+void served_state_snapshot_release(struct served_state_snapshot* snapshot)
+{
+    if (g_state == NULL || snapshot == NULL) {
+        return;
+    }
+    __snapshot_release(g_state, (struct __state_snapshot*)snapshot);
+}
+
+struct state_application* served_state_snapshot_application(struct served_state_snapshot* snapshot, const char* name)
+{
+    struct state_application key = { .name = name };
+
+    if (snapshot == NULL || name == NULL || snapshot->applications_count == 0) {
+        return NULL;
+    }
+
+    return bsearch(
+        &key,
+        snapshot->applications,
+        snapshot->applications_count,
+        sizeof(struct state_application),
+        __snapshot_compare_applications
+    );
 }
 
 // This must be called with the state lock held
@@ -1781,10 +2384,13 @@ int served_state_transaction_state_new(unsigned int id, struct state_transaction
         return -1;
     }
 
-    // Add to in-memory state immediately for read consistency
+    // Add to in-memory state immediately for read consistency. The array may
+    // move, so readers of the logs must be kept out while it is modified
+    mtx_lock(&g_state->logs_lock);
     newStates = realloc(g_state->transaction_states, 
         sizeof(struct state_transaction) * (g_state->transaction_state_count + 1));
     if (!newStates) {
+        mtx_unlock(&g_state->logs_lock);
         VLOG_ERROR("served", "served_state_transaction_state_new: failed to allocate memory\n");
         return -1;
     }
@@ -1800,22 +2406,34 @@ int served_state_transaction_state_new(unsigned int id, struct state_transaction
     if ((state->name != NULL && g_state->transaction_states[g_state->transaction_state_count].name == NULL) ||
         (state->channel != NULL && g_state->transaction_states[g_state->transaction_state_count].channel == NULL)) {
         __state_transaction_delete(&g_state->transaction_states[g_state->transaction_state_count]);
+        mtx_unlock(&g_state->logs_lock);
         return -1;
     }
 
     g_state->transaction_state_count++;
 
+    if (__transaction_states_index_add(g_state, g_state->transaction_state_count - 1)) {
+        VLOG_ERROR("served", "served_state_transaction_state_new: failed to index transaction state\n");
+        g_state->transaction_state_count--;
+        __state_transaction_delete(&g_state->transaction_states[g_state->transaction_state_count]);
+        mtx_unlock(&g_state->logs_lock);
+        return -1;
+    }
+    mtx_unlock(&g_state->logs_lock);
+
     // Defer the database operation
     op = __deferred_operation_new(DEFERRED_OP_ADD_TRANSACTION_STATE);
     if (op == NULL) {
         VLOG_ERROR("served", "served_state_transaction_state_new: failed to allocate deferred operation\n");
         // Roll back in-memory change
+        mtx_lock(&g_state->logs_lock);
         g_state->transaction_state_count--;
+        __transaction_states_reindex(g_state);
+        mtx_unlock(&g_state->logs_lock);
         return -1;
     }
 
     op->data.add_tx_state.transaction_id = id;
-    op->data.add_tx_state.transaction = &g_state->transaction_states[g_state->transaction_state_count - 1];
 
     __enqueue_deferred_operation(g_state, op);
     return 0;
@@ -1843,7 +2461,7 @@ int served_state_transaction_state_update(struct state_transaction* state)
         return -1;
     }
 
-    op->data.update_tx_state.transaction = state;
+    op->data.update_tx_state.transaction_id = state->id;
     
     __enqueue_deferred_operation(g_state, op);
     return 0;
@@ -0,0 +1,52 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <transaction/states/batch.h>
+#include <transaction/transaction.h>
+#include <transaction/logging.h>
+#include <runner.h>
+
+enum sm_action_result served_handle_state_batch(void* context)
+{
+    struct served_transaction* transaction = context;
+    unsigned int               memberId;
+
+    // Members run concurrently, so it does not matter which one we wait for,
+    // we come back here until none of them are left.
+    memberId = served_transaction_find_batch_member(transaction->id);
+    if (memberId != 0) {
+        TXLOG_INFO(transaction, "Waiting for transaction %u of the batch", memberId);
+        served_sm_post_event(
+            &transaction->sm,
+            served_transaction_wait(transaction, SERVED_TRANSACTION_WAIT_TYPE_TRANSACTION, memberId)
+        );
+        return SM_ACTION_WAIT;
+    }
+
+    TXLOG_INFO(transaction, "All packages of the batch have been processed");
+    served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
+    return SM_ACTION_CONTINUE;
+}
+
+enum sm_action_result served_handle_state_batch_wait(void* context)
+{
+    struct served_transaction* transaction = context;
+
+    served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
+    return SM_ACTION_CONTINUE;
+}
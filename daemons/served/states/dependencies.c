@@ -60,11 +60,23 @@ static sm_event_t __ensure_base(struct served_transaction* transaction, const ch
         return SERVED_TX_EVENT_OK;
     }
 
+    // The base may be installed already by another transaction, i.e when it is
+    // a dependency of several packages installed together
+    transactionId = served_transaction_find_install(baseName);
+    if (transactionId != 0) {
+        TXLOG_INFO(
+            transaction,
+            "Base required for %s is being installed by transaction %u",
+            name, transactionId
+        );
+        return served_transaction_wait(transaction, SERVED_TRANSACTION_WAIT_TYPE_TRANSACTION, transactionId);
+    }
+
     // schedule installation
     snprintf(nameBuffer, sizeof(nameBuffer), "Install dependency (%s)", baseName);
     snprintf(descriptionBuffer, sizeof(descriptionBuffer), "Installation of package dependency '%s' requested", baseName);
 
-    transactionId = served_transaction_create_locked(
+    transactionId = served_transaction_create(
         &(struct served_transaction_options){
             .name = &nameBuffer[0],
             .description = &descriptionBuffer[0],
@@ -17,6 +17,8 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gracht/server.h>
 #include <transaction/states/download.h>
 #include <transaction/states/types.h>
@@ -35,6 +37,11 @@
 // Progress reporting threshold (only report every 5% change)
 #define PROGRESS_REPORT_THRESHOLD 5
 
+// Network errors are retried with an exponential backoff starting at
+// 1 second, the download fails after the final retry.
+#define DOWNLOAD_MAX_RETRIES     4
+#define DOWNLOAD_RETRY_DELAY_MS  1000
+
 static void __emit_io_progress(
     unsigned long long bytes_current,
     unsigned long long bytes_total,
@@ -74,85 +81,154 @@ static void __emit_io_progress(
                bytes_current, bytes_total, percentage);
 }
 
+struct __download_job {
+    char* name;
+    char* channel;
+    int   revision;
+};
+
+static void __download_job_delete(struct __download_job* job)
+{
+    free(job->name);
+    free(job->channel);
+    free(job);
+}
+
+// Executed on a background thread, the package is hashed while it streams
+// in, so the verify state does not need to read it again.
+static sm_event_t __download_job(struct served_transaction* transaction, void* context)
+{
+    struct __download_job*      job = context;
+    struct state_transaction*   state;
+    struct store_package_digest digest = { 0 };
+    enum store_package_failure  failure = STORE_PACKAGE_FAILURE_NONE;
+    int                         revision = 0;
+    int                         status;
+
+    status = store_ensure_packages(
+        &(struct store_package) {
+            .name = job->name,
+            .platform = CHEF_PLATFORM_STR, // always host
+            .arch = CHEF_ARCHITECTURE_STR, // always host
+            .channel = job->channel,
+            .revision = job->revision
+        }, 1,
+        &(struct store_ensure_options) {
+            .observer = &(struct chef_observer) {
+                .report = __emit_io_progress,
+                .userData = transaction
+            },
+            .digests = &digest,
+            .failures = &failure
+        },
+        &revision
+    );
+
+    if (status || revision == 0) {
+        if (failure == STORE_PACKAGE_FAILURE_TRANSIENT) {
+            if (transaction->retry_count < DOWNLOAD_MAX_RETRIES) {
+                TXLOG_WARNING(transaction, "Network error while downloading package, retrying");
+                __download_job_delete(job);
+                return SERVED_TX_EVENT_RETRY;
+            }
+            TXLOG_ERROR(transaction, "Network error while downloading package (check connectivity)");
+        } else {
+            TXLOG_ERROR(transaction, "Failed to download package");
+        }
+        __download_job_delete(job);
+        return SERVED_TX_EVENT_FAILED;
+    }
+
+    if (job->revision == 0) {
+        // the revision was resolved from the channel, update it in state
+        served_state_lock();
+        state = served_state_transaction(transaction->id);
+        if (state != NULL) {
+            state->revision = revision;
+            served_state_transaction_state_update(state);
+        }
+        served_state_unlock();
+    }
+
+    transaction->package_digest_valid = digest.valid;
+    if (digest.valid) {
+        memcpy(&transaction->package_digest[0], &digest.digest[0], SERVED_TRANSACTION_DIGEST_SIZE);
+    }
+
+    TXLOG_INFO(transaction, "Package downloaded successfully");
+    transaction->retry_count = 0;
+    __download_job_delete(job);
+    return SERVED_TX_EVENT_OK;
+}
+
 enum sm_action_result served_handle_state_download(void* context)
 {
     struct served_transaction* transaction = context;
     struct state_transaction*  state;
-    struct store_package       package = { NULL };
-    int                        status;
+    struct __download_job*     job;
 
     transaction->io_progress.bytes_current = 0;
     transaction->io_progress.bytes_total = 0;
     transaction->io_progress.last_reported_percentage = 0;
+    transaction->package_digest_valid = 0;
+
+    job = calloc(1, sizeof(struct __download_job));
+    if (job == NULL) {
+        served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
+        return SM_ACTION_CONTINUE;
+    }
 
     served_state_lock();
     state = served_state_transaction(transaction->id);
     if (state == NULL) {
         served_state_unlock();
+        free(job);
         served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
         return SM_ACTION_CONTINUE;
     }
 
-    package.name = state->name;
-    package.platform = CHEF_PLATFORM_STR; // always host
-    package.arch = CHEF_ARCHITECTURE_STR; // always host
-    package.channel = state->channel;
-    package.revision = state->revision;
-    
+    // the job outlives the state lock, so it needs its own copies
+    job->name = platform_strdup(state->name);
+    job->channel = state->channel != NULL ? platform_strdup(state->channel) : NULL;
+    job->revision = state->revision;
     served_state_unlock();
 
+    if (job->name == NULL) {
+        __download_job_delete(job);
+        served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
+        return SM_ACTION_CONTINUE;
+    }
+
     // Handle the case of locally installed packages that just need to be verified without downloading
-    if (package.revision < 0) {
+    if (job->revision < 0) {
         TXLOG_INFO(transaction, "Local package, skipping download and proceeding to verification");
+        __download_job_delete(job);
         served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
         return SM_ACTION_CONTINUE;
     }
 
-    status = store_ensure_package(
-        &package,
-        &(struct chef_observer){
-            .report = __emit_io_progress,
-            .userData = transaction
-        }
-    );
-
-    if (status == 0) {
-        if (errno == ENOSPC) {
-            TXLOG_ERROR(transaction, "Insufficient disk space to download package");
-        } else if (errno == EACCES || errno == EPERM) {
-            TXLOG_ERROR(transaction, "Permission denied while downloading package");
-        } else if (errno == ETIMEDOUT || errno == ENETUNREACH || errno == EHOSTUNREACH) {
-            TXLOG_ERROR(transaction, "Network error while downloading package (check connectivity)");
-        } else if (errno != 0) {
-            TXLOG_ERROR(transaction, "Download failed: %s", strerror(errno));
-        } else {
-            TXLOG_ERROR(transaction, "Failed to download package (unknown error)");
-        }
-        
+    if (served_transaction_run_job(transaction, __download_job, job)) {
+        TXLOG_ERROR(transaction, "Failed to start package download");
+        __download_job_delete(job);
         served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
         return SM_ACTION_CONTINUE;
-    } else if (package.revision == 0) {
-        // update the revision in state
-        served_state_lock();
-        state = served_state_transaction(transaction->id);
-        if (state != NULL) {
-            state->revision = package.revision;
-            served_state_transaction_state_update(state);
-        }
-        served_state_unlock();
     }
-
-    TXLOG_INFO(transaction, "Package downloaded successfully");
-    served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
-    return SM_ACTION_CONTINUE;
+    return SM_ACTION_WAIT;
 }
 
 enum sm_action_result served_handle_state_download_retry(void* context)
 {
     struct served_transaction* transaction = context;
+    unsigned int               delay;
 
-    // TODO: wait for retry, support sleeping in the state machine
+    delay = DOWNLOAD_RETRY_DELAY_MS << transaction->retry_count;
+    transaction->retry_count++;
+    TXLOG_INFO(transaction, "Retrying download in %u seconds (attempt %u of %u)",
+        delay / 1000, transaction->retry_count, DOWNLOAD_MAX_RETRIES);
 
+    // The runner resumes the transaction once the timer expires, and the
+    // queued event then takes it back to the download state.
+    (void)served_transaction_wait(transaction, SERVED_TRANSACTION_WAIT_TYPE_TIMER, delay);
     served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
-    return SM_ACTION_CONTINUE;
+    return SM_ACTION_WAIT;
 }
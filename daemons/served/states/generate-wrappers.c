@@ -18,6 +18,7 @@
 
 #include <transaction/states/generate-wrappers.h>
 #include <transaction/transaction.h>
+#include <transaction/logging.h>
 #include <state.h>
 #include <utils.h>
 
@@ -265,6 +266,14 @@ enum sm_action_result served_handle_state_generate_wrappers(void* context)
     struct served_transaction* transaction = context;
     struct state_transaction*  state;
 
+    // Members of a batch have their wrappers generated by the batch once all
+    // of them are done
+    if (transaction->batch_id != 0) {
+        TXLOG_INFO(transaction, "Wrappers will be generated by batch %u", transaction->batch_id);
+        served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
+        return SM_ACTION_CONTINUE;
+    }
+
     served_state_lock();
     state = served_state_transaction(transaction->id);
     if (state == NULL) {
@@ -309,3 +318,48 @@ cleanup:
     served_sm_post_event(&transaction->sm, event);
     return SM_ACTION_CONTINUE;
 }
+
+enum sm_action_result served_handle_state_generate_wrappers_batch(void* context)
+{
+    struct served_transaction* transaction = context;
+    struct served_transaction* transactions;
+    int                        count;
+    int                        failed = 0;
+    sm_event_t                 event = SERVED_TX_EVENT_FAILED;
+
+    served_state_lock();
+    if (served_state_get_transactions(&transactions, &count)) {
+        served_state_unlock();
+        TXLOG_ERROR(transaction, "Failed to retrieve the members of the batch");
+        goto cleanup;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct state_transaction* state;
+
+        if (transactions[i].batch_id != transaction->id) {
+            continue;
+        }
+
+        if (served_sm_current_state(&transactions[i].sm) != SERVED_TX_STATE_COMPLETED) {
+            failed++;
+            continue;
+        }
+
+        state = served_state_transaction(transactions[i].id);
+        if (state != NULL && state->name != NULL) {
+            (void)__generate_wrappers(state->name);
+        }
+    }
+    served_state_unlock();
+
+    if (failed) {
+        TXLOG_ERROR(transaction, "%i package(s) of the batch failed - check their logs for details", failed);
+        goto cleanup;
+    }
+    event = SERVED_TX_EVENT_OK;
+
+cleanup:
+    served_sm_post_event(&transaction->sm, event);
+    return SM_ACTION_CONTINUE;
+}
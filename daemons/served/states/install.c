@@ -157,11 +157,14 @@ enum sm_action_result served_handle_state_install(void* context)
     struct state_application*  application;
     sm_event_t                 event = SERVED_TX_EVENT_FAILED;
     char*                      storagePath = NULL;
-    const char*                path;
+    const char*                path = NULL;
+    char*                      name = NULL;
     char**                     names = NULL;
     int                        status;
     int                        revision;
 
+    // copy what we need while holding the lock, the transaction state may be
+    // changed by other jobs as soon as it is released
     served_state_lock();
     state = served_state_transaction(transaction->id);
     if (state == NULL) {
@@ -170,10 +173,15 @@ enum sm_action_result served_handle_state_install(void* context)
         return SM_ACTION_CONTINUE;
     }
 
-    names = utils_split_package_name(state->name);
+    name = platform_strdup(state->name);
     revision = state->revision;
     served_state_unlock();
 
+    if (name == NULL) {
+        goto cleanup;
+    }
+
+    names = utils_split_package_name(name);
     if (names == NULL) {
         goto cleanup;
     }
@@ -185,14 +193,14 @@ enum sm_action_result served_handle_state_install(void* context)
         }
     } else {
         status = store_package_path(&(struct store_package) {
-            .name = state->name,
+            .name = name,
             .platform = CHEF_PLATFORM_STR,
             .arch = CHEF_ARCHITECTURE_STR,
             .channel = NULL,
             .revision = revision
         }, &path);
         if (status) {
-            VLOG_ERROR("served", "could not find the revision %i for %s\n", revision, state->name);
+            VLOG_ERROR("served", "could not find the revision %i for %s\n", revision, name);
             goto cleanup;
         }
     }
@@ -208,6 +216,12 @@ enum sm_action_result served_handle_state_install(void* context)
     }
 
     served_state_lock();
+    state = served_state_transaction(transaction->id);
+    if (state == NULL) {
+        served_state_unlock();
+        goto cleanup;
+    }
+
     status = __load_application_package(state, path, &application);
     if (status) {
         served_state_unlock();
@@ -225,10 +239,11 @@ enum sm_action_result served_handle_state_install(void* context)
 
 cleanup:
     strsplit_free(names);
-    if (state != NULL && state->revision < 0) {
+    if (revision < 0) {
         free((void*)path);
     }
     free((void*)storagePath);
+    free(name);
     served_sm_post_event(&transaction->sm, event);
     return SM_ACTION_CONTINUE;
 }
@@ -18,6 +18,7 @@
 
 #include <transaction/states/load.h>
 #include <transaction/transaction.h>
+#include <activation.h>
 #include <state.h>
 #include <utils.h>
 
@@ -25,6 +26,45 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <vlog.h>
+
+// The number of containers that are being created by cvd at once when loading
+// all applications. Creating a container is mostly waiting for its rootfs to
+// be set up, so keeping a few requests in flight hides most of that without
+// flooding cvd.
+#define SERVED_LOAD_MAX_INFLIGHT 8
+
+struct __load_entry {
+    char*                            name;
+    char*                            base;
+    int                              revision;
+    int                              services;
+    char                             container_id[256];
+    struct container_client_request* request;
+    int                              status;
+    struct timespec                  sent;
+    unsigned int                     queued_ms;
+    unsigned int                     duration_ms;
+};
+
+static struct served_boot_report g_bootReport = { 0 };
+static mtx_t                     g_bootReportLock;
+static once_flag                 g_bootReportOnce = ONCE_FLAG_INIT;
+
+static void __boot_report_init(void)
+{
+    if (mtx_init(&g_bootReportLock, mtx_plain) != thrd_success) {
+        VLOG_ERROR("served", "__boot_report_init: failed to initialize mutex\n");
+    }
+}
+
+static unsigned int __elapsed_ms(struct timespec* start, struct timespec* end)
+{
+    return (unsigned int)((end->tv_sec - start->tv_sec) * 1000 + (end->tv_nsec - start->tv_nsec) / 1000000);
+}
 
 static int __load_application(const char* name, int revision)
 {
@@ -33,6 +73,16 @@ static int __load_application(const char* name, int revision)
     char*                     package = NULL;
     char                      containerId[256];
     int                       status;
+
+    application = served_state_application(name);
+    if (application == NULL) {
+        return -1;
+    }
+
+    // the container is created by serve-exec when a command is first run
+    if (served_activation_is_lazy(application)) {
+        return 0;
+    }
     
     names = utils_split_package_name(name);
     if (names == NULL) {
@@ -47,12 +97,6 @@ static int __load_application(const char* name, int revision)
     snprintf(&containerId[0], sizeof(containerId), "%s.%s", names[0], names[1]);
     strsplit_free(names);
 
-    application = served_state_application(name);
-    if (application == NULL) {
-        free(package);
-        return -1;
-    }
-
     status = container_client_create_container(&(struct container_options){
         .id = &containerId[0],
         .pack_id = name,
@@ -64,6 +108,8 @@ static int __load_application(const char* name, int revision)
         return -1;
     }
 
+    // a reload replaces the id of the previous load
+    free((void*)application->container_id);
     application->container_id = platform_strdup(&containerId[0]);
     return 0;
 }
@@ -92,35 +138,267 @@ cleanup:
     return SM_ACTION_CONTINUE;
 }
 
+// Collects the applications to load while holding the state lock, so the
+// containers can be created without it. Applications with services are put
+// first, as the services cannot start before their container exists, and
+// applications without any are left for serve-exec to activate.
+static struct __load_entry* __load_entries(int* countOut)
+{
+    struct state_application* applications;
+    struct __load_entry*      entries;
+    int                       count;
+    int                       index = 0;
+
+    if (served_state_get_applications(&applications, &count)) {
+        return NULL;
+    }
+
+    entries = calloc(count > 0 ? count : 1, sizeof(struct __load_entry));
+    if (entries == NULL) {
+        return NULL;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < count; i++) {
+            struct state_application* app = &applications[i];
+            int                       services = 0;
+
+            if (app->revisions_count == 0 || served_activation_is_lazy(app)) {
+                continue;
+            }
+
+            for (int j = 0; j < app->commands_count; j++) {
+                if (app->commands[j].type == CHEF_COMMAND_TYPE_DAEMON) {
+                    services = 1;
+                    break;
+                }
+            }
+            if (services != (pass == 0)) {
+                continue;
+            }
+
+            entries[index].name = platform_strdup(app->name);
+            entries[index].base = app->base != NULL ? platform_strdup(app->base) : NULL;
+            entries[index].revision = app->revisions[app->revisions_count - 1].version->revision;
+            entries[index].services = services;
+            index++;
+        }
+    }
+
+    *countOut = index;
+    return entries;
+}
+
+static void __load_entries_delete(struct __load_entry* entries, int count)
+{
+    for (int i = 0; i < count; i++) {
+        free(entries[i].name);
+        free(entries[i].base);
+    }
+    free(entries);
+}
+
+static int __load_entry_send(struct __load_entry* entry)
+{
+    char** names;
+    char*  package;
+
+    if (entry->name == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    names = utils_split_package_name(entry->name);
+    if (names == NULL) {
+        return -1;
+    }
+
+    package = utils_path_pack(names[0], names[1], entry->revision);
+    if (package == NULL) {
+        strsplit_free(names);
+        return -1;
+    }
+    snprintf(&entry->container_id[0], sizeof(entry->container_id), "%s.%s", names[0], names[1]);
+    strsplit_free(names);
+
+    entry->request = container_client_create_container_async(&(struct container_options){
+        .id = &entry->container_id[0],
+        .pack_id = entry->name,
+        .rootfs = entry->base,
+        .package = package,
+    });
+    free(package);
+    if (entry->request == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+static void __load_entry_complete(struct __load_entry* entry)
+{
+    struct timespec now;
+
+    if (container_client_create_container_wait(entry->request) && errno != EEXIST) {
+        entry->status = errno;
+    }
+    entry->request = NULL;
+
+    timespec_get(&now, TIME_UTC);
+    entry->duration_ms = __elapsed_ms(&entry->sent, &now);
+}
+
+// Creates the containers for all entries, with at most SERVED_LOAD_MAX_INFLIGHT
+// requests outstanding. Requests complete in the order they were sent.
+static void __load_entries_create(struct __load_entry* entries, int count, struct timespec* started)
+{
+    int sent = 0;
+    int completed = 0;
+
+    while (completed < count) {
+        while (sent < count && sent - completed < SERVED_LOAD_MAX_INFLIGHT) {
+            struct __load_entry* entry = &entries[sent++];
+
+            timespec_get(&entry->sent, TIME_UTC);
+            entry->queued_ms = __elapsed_ms(started, &entry->sent);
+            if (__load_entry_send(entry)) {
+                entry->status = errno != 0 ? errno : EFAULT;
+            }
+        }
+
+        if (entries[completed].request != NULL) {
+            __load_entry_complete(&entries[completed]);
+        }
+        if (entries[completed].status) {
+            VLOG_ERROR("served", "failed to load %s: %s\n", entries[completed].name, strerror(entries[completed].status));
+        }
+        completed++;
+    }
+}
+
+static void __boot_report_update(struct __load_entry* entries, int count, time_t started, unsigned int durationMs)
+{
+    struct served_boot_entry* reportEntries;
+
+    reportEntries = calloc(count > 0 ? count : 1, sizeof(struct served_boot_entry));
+    if (reportEntries == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        reportEntries[i].name = entries[i].name;
+        reportEntries[i].services = entries[i].services;
+        reportEntries[i].status = entries[i].status;
+        reportEntries[i].queued_ms = entries[i].queued_ms;
+        reportEntries[i].duration_ms = entries[i].duration_ms;
+
+        // the report takes over the names
+        entries[i].name = NULL;
+    }
+
+    call_once(&g_bootReportOnce, __boot_report_init);
+    mtx_lock(&g_bootReportLock);
+    served_boot_report_destroy(&g_bootReport);
+    g_bootReport.started = started;
+    g_bootReport.duration_ms = durationMs;
+    g_bootReport.entries = reportEntries;
+    g_bootReport.entries_count = count;
+    mtx_unlock(&g_bootReportLock);
+}
+
 enum sm_action_result served_handle_state_load_all(void* context)
 {
     struct served_transaction* transaction = context;
-    struct state_application*  applications;
-    int                        count;
-    int                        status;
+    struct __load_entry*       entries;
+    int                        count = 0;
+    int                        failed = 0;
+    struct timespec            start, end;
+    time_t                     started = time(NULL);
     sm_event_t                 event = SERVED_TX_EVENT_FAILED;
-    
+
+    timespec_get(&start, TIME_UTC);
+
     served_state_lock();
-    status = served_state_get_applications(&applications, &count);
-    if (status) {
+    entries = __load_entries(&count);
+    served_state_unlock();
+    if (entries == NULL) {
         goto cleanup;
     }
 
+    // The state is not locked while waiting for cvd
+    __load_entries_create(entries, count, &start);
+
+    served_state_lock();
     for (int i = 0; i < count; i++) {
-        struct state_application* app = &applications[i];
-        if (app->revisions_count == 0) {
+        struct state_application* application;
+
+        if (entries[i].status) {
+            failed++;
             continue;
         }
 
-        if (__load_application(app->name, app->revisions[app->revisions_count - 1].version->revision)) {
-            goto cleanup;
+        // the application may have been removed meanwhile
+        application = served_state_application(entries[i].name);
+        if (application == NULL) {
+            continue;
         }
+        free((void*)application->container_id);
+        application->container_id = platform_strdup(&entries[i].container_id[0]);
     }
+    served_state_unlock();
 
-    event = SERVED_TX_EVENT_OK;
+    timespec_get(&end, TIME_UTC);
+    VLOG_DEBUG("served", "loaded %i applications in %u ms, %i failed\n", count, __elapsed_ms(&start, &end), failed);
+    __boot_report_update(entries, count, started, __elapsed_ms(&start, &end));
+    __load_entries_delete(entries, count);
+
+    if (failed == 0) {
+        event = SERVED_TX_EVENT_OK;
+    }
 
 cleanup:
-    served_state_unlock();
     served_sm_post_event(&transaction->sm, event);
     return SM_ACTION_CONTINUE;
 }
+
+int served_boot_report(struct served_boot_report* reportOut)
+{
+    int status = 0;
+
+    call_once(&g_bootReportOnce, __boot_report_init);
+    mtx_lock(&g_bootReportLock);
+    if (g_bootReport.entries == NULL) {
+        errno = ENOENT;
+        status = -1;
+        goto exit;
+    }
+
+    *reportOut = g_bootReport;
+    reportOut->entries = calloc(g_bootReport.entries_count > 0 ? g_bootReport.entries_count : 1, sizeof(struct served_boot_entry));
+    if (reportOut->entries == NULL) {
+        status = -1;
+        goto exit;
+    }
+
+    for (int i = 0; i < g_bootReport.entries_count; i++) {
+        reportOut->entries[i] = g_bootReport.entries[i];
+        reportOut->entries[i].name = platform_strdup(g_bootReport.entries[i].name);
+    }
+
+exit:
+    mtx_unlock(&g_bootReportLock);
+    return status;
+}
+
+void served_boot_report_destroy(struct served_boot_report* report)
+{
+    if (report == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < report->entries_count; i++) {
+        free((void*)report->entries[i].name);
+    }
+    free(report->entries);
+    report->entries = NULL;
+    report->entries_count = 0;
+}
@@ -22,6 +22,8 @@
 #include <utils.h>
 
 #include <chef/platform.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <vlog.h>
 
 static int __unload_application(const char* name)
@@ -38,8 +40,12 @@ static int __unload_application(const char* name)
     snprintf(&containerId[0], sizeof(containerId), "%s.%s", names[0], names[1]);
     strsplit_free(names);
 
+    // containers of applications without services only exist while they
+    // are activated, so a missing container is not an error
     status = container_client_destroy_container(&containerId[0]);
-    if (status) {
+    if (status && errno == ENOENT) {
+        status = 0;
+    } else if (status) {
         VLOG_ERROR("served", "failed to destroy container for package %s\n",
             name
         );
@@ -47,9 +53,17 @@ static int __unload_application(const char* name)
     return status;
 }
 
+// Must be called with the state lock held
+static void __clear_container_id(struct state_application* application)
+{
+    free((void*)application->container_id);
+    application->container_id = NULL;
+}
+
 enum sm_action_result served_handle_state_unload(void* context)
 {
     struct served_transaction* transaction = context;
+    struct state_application*  application;
     int                        status;
 
     // Format name in the form publisher.package
@@ -64,6 +78,13 @@ enum sm_action_result served_handle_state_unload(void* context)
         return SM_ACTION_CONTINUE;
     }
 
+    served_state_lock();
+    application = served_state_application(transaction->name);
+    if (application != NULL) {
+        __clear_container_id(application);
+    }
+    served_state_unlock();
+
     served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_OK);
     return SM_ACTION_CONTINUE;
 }
@@ -88,6 +109,8 @@ enum sm_action_result served_handle_state_unload_all(void* context)
         if (status) {
             VLOG_ERROR("served", "Failed to unload application %s: %d\n", app->name, status);
             // continue
+        } else {
+            __clear_container_id(app);
         }
     }
 
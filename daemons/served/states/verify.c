@@ -19,6 +19,8 @@
 #include <chef/platform.h>
 #include <chef/package.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gracht/server.h>
 #include <transaction/states/verify.h>
 #include <transaction/states/types.h>
@@ -115,14 +117,22 @@ static int __verify_store_package(
     const char*                package,
     int                        revision)
 {
-    int status;
+    const unsigned char* digest = NULL;
+    int                  status;
 
     __emit_verify_progress(transaction, 0, 100);
 
-    status = utils_verify_package(publisher, package, revision);
+    // The package was hashed while it was downloaded, so only the proof
+    // needs to be checked against that.
+    if (transaction->package_digest_valid) {
+        digest = &transaction->package_digest[0];
+    }
+
+    status = utils_verify_package(publisher, package, revision, digest);
     if (status == 0) {
         __emit_verify_progress(transaction, 100, 100);
-        TXLOG_INFO(transaction, "Package verification successful");
+        TXLOG_INFO(transaction, "Package verification successful%s",
+                   digest != NULL ? " (using digest from download)" : "");
     } else if (errno == ENOENT) {
         TXLOG_ERROR(transaction, "Package file not found for verification");
     } else if (errno) {
@@ -133,48 +143,82 @@ static int __verify_store_package(
     return status;
 }
 
+struct __verify_job {
+    char* name;
+    int   revision;
+};
+
+// Executed on a background thread, as verification may need to fetch the
+// proof from the store and hash the entire package.
+static sm_event_t __verify_job(struct served_transaction* transaction, void* context)
+{
+    struct __verify_job* job = context;
+    char**               names;
+    int                  status;
+
+    names = utils_split_package_name(job->name);
+    if (names == NULL) {
+        TXLOG_ERROR(transaction,
+            "Invalid package name format (must be 'publisher/package')");
+        free(job->name);
+        free(job);
+        return SERVED_TX_EVENT_FAILED;
+    }
+
+    if (job->revision < 0) {
+        status = __verify_local_package(transaction, names[0], names[1], job->revision);
+    } else {
+        status = __verify_store_package(transaction, names[0], names[1], job->revision);
+    }
+
+    strsplit_free(names);
+    free(job->name);
+    free(job);
+    return status == 0 ? SERVED_TX_EVENT_OK : SERVED_TX_EVENT_FAILED;
+}
+
 enum sm_action_result served_handle_state_verify(void* context)
 {
     struct served_transaction* transaction = context;
     struct state_transaction*  state;
-    char**                     names = NULL;
-    const char*                name;
-    int                        revision;
-    int                        status;
+    struct __verify_job*       job;
 
     // Reset progress tracking
     transaction->io_progress.bytes_current = 0;
     transaction->io_progress.bytes_total = 0;
     transaction->io_progress.last_reported_percentage = 0;
 
+    job = calloc(1, sizeof(struct __verify_job));
+    if (job == NULL) {
+        served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
+        return SM_ACTION_CONTINUE;
+    }
+
     served_state_lock();
     state = served_state_transaction(transaction->id);
     if (state == NULL) {
         served_state_unlock();
+        free(job);
         served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
         return SM_ACTION_CONTINUE;
     }
 
-    name = state->name;
-    revision = state->revision;
+    job->name = state->name != NULL ? platform_strdup(state->name) : NULL;
+    job->revision = state->revision;
     served_state_unlock();
 
-    names = utils_split_package_name(name);
-    if (names == NULL) {
-        TXLOG_ERROR(transaction,
-            "Invalid package name format (must be 'publisher/package')");
+    if (job->name == NULL) {
+        free(job);
         served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
         return SM_ACTION_CONTINUE;
     }
 
-    if (revision < 0) {
-        status = __verify_local_package(transaction, names[0], names[1], revision);
-    } else {
-        status = __verify_store_package(transaction, names[0], names[1], revision);
+    if (served_transaction_run_job(transaction, __verify_job, job)) {
+        TXLOG_ERROR(transaction, "Failed to start package verification");
+        free(job->name);
+        free(job);
+        served_sm_post_event(&transaction->sm, SERVED_TX_EVENT_FAILED);
+        return SM_ACTION_CONTINUE;
     }
-
-    strsplit_free(names);
-    served_sm_post_event(&transaction->sm,
-        status == 0 ? SERVED_TX_EVENT_OK : SERVED_TX_EVENT_FAILED);
-    return SM_ACTION_CONTINUE;
+    return SM_ACTION_WAIT;
 }
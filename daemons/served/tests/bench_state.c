@@ -0,0 +1,364 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Measures how long served takes to load a large state database, how long
+// the state lookups take once it has been loaded, and how long it takes to
+// log to a transaction. The database is seeded with synthetic applications
+// and transactions in a temporary root.
+
+#include <chef/platform.h>
+#include <gracht/server.h>
+#include <sqlite3.h>
+#include <state.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils.h>
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define BENCH_DEFAULT_APPLICATIONS 10000
+#define BENCH_DEFAULT_TRANSACTIONS 100000
+#define BENCH_DEFAULT_LOOKUPS      1000000
+#define BENCH_DEFAULT_LOGS         10000
+
+// The state runner emits events through the server, which is not running
+// in this benchmark. No transactions are executed, so this is never used.
+gracht_server_t* served_gracht_server(void)
+{
+    return NULL;
+}
+
+static double __elapsed_ms(struct timespec* start, struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1000.0 +
+           (double)(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int __exec(sqlite3* db, const char* sql)
+{
+    char* errMsg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &errMsg) != SQLITE_OK) {
+        fprintf(stderr, "bench: '%s' failed: %s\n", sql, errMsg);
+        sqlite3_free(errMsg);
+        return -1;
+    }
+    return 0;
+}
+
+static int __seed_applications(sqlite3* db, int count)
+{
+    sqlite3_stmt* app;
+    sqlite3_stmt* command;
+    sqlite3_stmt* revision;
+    char          name[64];
+    int           status = 0;
+
+    if (sqlite3_prepare_v2(db, "INSERT INTO applications (id, name) VALUES (?, ?)", -1, &app, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO commands (application_id, name, path, arguments, type) VALUES (?, ?, '/bin/app', '', 0)", -1, &command, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO revisions (application_id, channel, major, minor, patch, revision, tag, size, created) "
+                               "VALUES (?, 'stable', 1, 0, 0, ?, '', 1024, '2025-01-01')", -1, &revision, NULL) != SQLITE_OK) {
+        fprintf(stderr, "bench: failed to prepare application statements: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    for (int i = 1; i <= count && status == 0; i++) {
+        snprintf(&name[0], sizeof(name), "bench-app-%i", i);
+
+        sqlite3_bind_int(app, 1, i);
+        sqlite3_bind_text(app, 2, &name[0], -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(command, 1, i);
+        sqlite3_bind_text(command, 2, &name[0], -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(revision, 1, i);
+        sqlite3_bind_int(revision, 2, i);
+        if (sqlite3_step(app) != SQLITE_DONE || sqlite3_step(command) != SQLITE_DONE ||
+            sqlite3_step(revision) != SQLITE_DONE) {
+            fprintf(stderr, "bench: failed to insert application: %s\n", sqlite3_errmsg(db));
+            status = -1;
+        }
+        sqlite3_reset(app);
+        sqlite3_reset(command);
+        sqlite3_reset(revision);
+    }
+
+    sqlite3_finalize(app);
+    sqlite3_finalize(command);
+    sqlite3_finalize(revision);
+    return status;
+}
+
+static int __seed_transactions(sqlite3* db, int count, int applications)
+{
+    sqlite3_stmt* transaction;
+    sqlite3_stmt* state;
+    sqlite3_stmt* log;
+    char          name[64];
+    int           status = 0;
+
+    if (sqlite3_prepare_v2(db, "INSERT INTO transactions (id, type, flags, state, name, description, completed_at) "
+                               "VALUES (?, ?, 0, 0, ?, 'benchmark', strftime('%s', 'now'))", -1, &transaction, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO transactions_state (transaction_id, name, channel, revision) VALUES (?, ?, 'stable', ?)", -1, &state, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO transaction_logs (transaction_id, level, timestamp, state, message) "
+                               "VALUES (?, 0, strftime('%s', 'now'), 0, 'transaction completed')", -1, &log, NULL) != SQLITE_OK) {
+        fprintf(stderr, "bench: failed to prepare transaction statements: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    for (int i = 1; i <= count && status == 0; i++) {
+        snprintf(&name[0], sizeof(name), "bench-app-%i", (i % applications) + 1);
+
+        sqlite3_bind_int(transaction, 1, i);
+        sqlite3_bind_int(transaction, 2, SERVED_TRANSACTION_TYPE_INSTALL);
+        sqlite3_bind_text(transaction, 3, &name[0], -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(state, 1, i);
+        sqlite3_bind_text(state, 2, &name[0], -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(state, 3, i);
+        sqlite3_bind_int(log, 1, i);
+        if (sqlite3_step(transaction) != SQLITE_DONE || sqlite3_step(state) != SQLITE_DONE ||
+            sqlite3_step(log) != SQLITE_DONE) {
+            fprintf(stderr, "bench: failed to insert transaction: %s\n", sqlite3_errmsg(db));
+            status = -1;
+        }
+        sqlite3_reset(transaction);
+        sqlite3_reset(state);
+        sqlite3_reset(log);
+    }
+
+    sqlite3_finalize(transaction);
+    sqlite3_finalize(state);
+    sqlite3_finalize(log);
+    return status;
+}
+
+static int __seed_database(int applications, int transactions)
+{
+    char*    path;
+    sqlite3* db;
+    int      status;
+
+    // let the state create the schema, so the benchmark always matches it
+    if (served_state_load()) {
+        fprintf(stderr, "bench: failed to create the state database\n");
+        return -1;
+    }
+    served_state_close();
+
+    path = utils_path_state_db();
+    status = sqlite3_open(path, &db);
+    free(path);
+    if (status != SQLITE_OK) {
+        fprintf(stderr, "bench: failed to open the state database\n");
+        return -1;
+    }
+
+    status = __exec(db, "BEGIN TRANSACTION");
+    if (status == 0) {
+        status = __seed_applications(db, applications);
+    }
+    if (status == 0) {
+        status = __seed_transactions(db, transactions, applications);
+    }
+    if (status == 0) {
+        status = __exec(db, "COMMIT");
+    }
+    sqlite3_close(db);
+    return status;
+}
+
+static int __bench_lookups(int applications, int transactions, int lookups)
+{
+    struct timespec start, end;
+    char            name[64];
+    unsigned int    seed = 1;
+    int             missing = 0;
+
+    served_state_lock();
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1103515245u + 12345u;
+        snprintf(&name[0], sizeof(name), "bench-app-%u", (seed >> 8) % (unsigned int)applications + 1);
+        if (served_state_application(&name[0]) == NULL) {
+            missing++;
+        }
+    }
+    timespec_get(&end, TIME_UTC);
+    printf("application lookups: %i in %.2f ms (%.1f ns/lookup)\n",
+        lookups, __elapsed_ms(&start, &end), __elapsed_ms(&start, &end) * 1000000.0 / lookups);
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1103515245u + 12345u;
+        if (served_state_transaction((seed >> 8) % (unsigned int)transactions + 1) == NULL) {
+            missing++;
+        }
+    }
+    timespec_get(&end, TIME_UTC);
+    printf("transaction lookups: %i in %.2f ms (%.1f ns/lookup)\n",
+        lookups, __elapsed_ms(&start, &end), __elapsed_ms(&start, &end) * 1000000.0 / lookups);
+
+    served_state_unlock();
+
+    // readers of the published snapshot do not take the state lock
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < lookups; i++) {
+        struct served_state_snapshot* snapshot = served_state_snapshot_acquire();
+
+        seed = seed * 1103515245u + 12345u;
+        snprintf(&name[0], sizeof(name), "bench-app-%u", (seed >> 8) % (unsigned int)applications + 1);
+        if (served_state_snapshot_application(snapshot, &name[0]) == NULL) {
+            missing++;
+        }
+        served_state_snapshot_release(snapshot);
+    }
+    timespec_get(&end, TIME_UTC);
+    printf("snapshot lookups: %i in %.2f ms (%.1f ns/lookup)\n",
+        lookups, __elapsed_ms(&start, &end), __elapsed_ms(&start, &end) * 1000000.0 / lookups);
+
+    if (missing) {
+        fprintf(stderr, "bench: %i lookups did not find their entry\n", missing);
+        return -1;
+    }
+    return 0;
+}
+
+// Logs a burst of messages to a transaction, each under its own state lock
+// like the runner does when a transaction reports progress
+static int __bench_logs(int logs)
+{
+    struct timespec start, end;
+    int             failed = 0;
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < logs; i++) {
+        served_state_lock();
+        if (served_state_transaction_log_add(1, SERVED_TRANSACTION_LOG_INFO, time(NULL), 0, "benchmark progress")) {
+            failed++;
+        }
+        served_state_unlock();
+    }
+    timespec_get(&end, TIME_UTC);
+    printf("log additions: %i in %.2f ms (%.1f us/log)\n",
+        logs, __elapsed_ms(&start, &end), __elapsed_ms(&start, &end) * 1000.0 / logs);
+
+    timespec_get(&start, TIME_UTC);
+    if (served_state_flush()) {
+        failed++;
+    }
+    timespec_get(&end, TIME_UTC);
+    printf("state flush: %.2f ms\n", __elapsed_ms(&start, &end));
+
+    if (failed) {
+        fprintf(stderr, "bench: %i log additions failed\n", failed);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    struct timespec start, end;
+    int             applications = BENCH_DEFAULT_APPLICATIONS;
+    int             transactions = BENCH_DEFAULT_TRANSACTIONS;
+    int             lookups = BENCH_DEFAULT_LOOKUPS;
+    int             logs = BENCH_DEFAULT_LOGS;
+    char*           tmp;
+    char            root[512];
+    char*           chefDir;
+    int             status;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "--applications")) {
+            applications = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "--transactions")) {
+            transactions = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "--lookups")) {
+            lookups = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "--logs")) {
+            logs = atoi(argv[++i]);
+        } else {
+            printf("Usage: served_state_bench [--applications N] [--transactions N] [--lookups N] [--logs N]\n");
+            return !strcmp(argv[i], "--help") ? 0 : 1;
+        }
+    }
+
+    if (applications <= 0 || transactions <= 0 || lookups <= 0 || logs <= 0) {
+        fprintf(stderr, "bench: counts must be positive\n");
+        return 1;
+    }
+
+    tmp = platform_tmpdir();
+    if (tmp == NULL) {
+        fprintf(stderr, "bench: failed to get the temporary directory\n");
+        return 1;
+    }
+#if defined(_WIN32)
+    snprintf(&root[0], sizeof(root), "%s\\served-bench-%i", tmp, (int)_getpid());
+#else
+    snprintf(&root[0], sizeof(root), "%s/served-bench-%i", tmp, (int)getpid());
+#endif
+    free(tmp);
+
+    utils_path_set_root(&root[0]);
+    chefDir = utils_path_state_db();
+    if (chefDir == NULL) {
+        return 1;
+    }
+    // strip the database name to get the directory containing it
+    for (char* p = chefDir + strlen(chefDir); p > chefDir; p--) {
+        if (*p == '/' || *p == '\\') {
+            *p = '\0';
+            break;
+        }
+    }
+    status = platform_mkdir(chefDir);
+    free(chefDir);
+    if (status) {
+        fprintf(stderr, "bench: failed to create %s\n", &root[0]);
+        return 1;
+    }
+
+    printf("seeding state with %i applications and %i transactions...\n", applications, transactions);
+    status = __seed_database(applications, transactions);
+    if (status) {
+        goto cleanup;
+    }
+
+    timespec_get(&start, TIME_UTC);
+    status = served_state_load();
+    timespec_get(&end, TIME_UTC);
+    if (status) {
+        fprintf(stderr, "bench: failed to load the state database\n");
+        goto cleanup;
+    }
+    printf("state load: %.2f ms\n", __elapsed_ms(&start, &end));
+
+    status = __bench_lookups(applications, transactions, lookups);
+    if (status == 0) {
+        status = __bench_logs(logs);
+    }
+    served_state_close();
+
+cleanup:
+    platform_rmdir(&root[0]);
+    return status ? 1 : 0;
+}
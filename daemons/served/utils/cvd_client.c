@@ -658,19 +658,23 @@ static int __load_pack_capabilities_as_plugins(
     return pluginCount;
 }
 
+struct container_client_request {
+    struct gracht_message_context context;
+};
+
+// Sends the create request, the response is read by __create_container_result, so
+// any number of containers can be created at once
 static enum chef_status __create_container(
-    gracht_client_t* client,
-    const char*      id,
-    const char*      pack_id,
-    const char*      rootfs,
-    const char*      package)
+    gracht_client_t*               client,
+    struct gracht_message_context* context,
+    const char*                    id,
+    const char*                    pack_id,
+    const char*                    rootfs,
+    const char*                    package)
 {
-    struct gracht_message_context context;
     struct chef_create_parameters params;
     struct chef_layer_descriptor* layer;
     int                           status;
-    enum chef_status              chstatus;
-    char                          cvdid[CHEF_PACKAGE_ID_LENGTH_MAX];
     VLOG_DEBUG("served", "__create_container(id=%s)\n", id);
 
     chef_create_parameters_init(&params);
@@ -678,6 +682,9 @@ static enum chef_status __create_container(
     params.id = (char*)id;
     params.gtype = __guest_type_from_base(rootfs);
 
+    // commands of packages are run by serve-exec
+    params.options = CHEF_CREATE_OPTIONS_EXEC_HELPER;
+
 #ifdef _WIN32
     if (__configure_windows_guest_options(&params) != 0) {
         chef_create_parameters_destroy(&params);
@@ -744,28 +751,75 @@ static enum chef_status __create_container(
     layer->type = CHEF_LAYER_TYPE_OVERLAY;
 #endif
     
-    status = chef_cvd_create(client, &context, &params);
+    // the parameters are serialized when sending, so they are not needed
+    // while waiting for the response
+    status = chef_cvd_create(client, context, &params);
+    chef_create_parameters_destroy(&params);
     if (status) {
-        chef_create_parameters_destroy(&params);
         VLOG_ERROR("served", "__create_container failed to create client\n");
         return status;
     }
-    gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
-    chef_cvd_create_result(client, &context, &cvdid[0], sizeof(cvdid) - 1, &chstatus);
-    chef_create_parameters_destroy(&params);
+    return CHEF_STATUS_SUCCESS;
+}
+
+static enum chef_status __create_container_result(
+    gracht_client_t*               client,
+    struct gracht_message_context* context)
+{
+    enum chef_status chstatus;
+    char             cvdid[CHEF_PACKAGE_ID_LENGTH_MAX];
+
+    gracht_client_wait_message(client, context, GRACHT_MESSAGE_BLOCK);
+    chef_cvd_create_result(client, context, &cvdid[0], sizeof(cvdid) - 1, &chstatus);
     return chstatus;
 }
 
-int container_client_create_container(struct container_options* options)
+struct container_client_request* container_client_create_container_async(struct container_options* options)
 {
-    VLOG_DEBUG("served", "container_client_create_container(id=%s, rootfs=%s)\n", options->id, options->rootfs);
-    return __to_errno_code(__create_container(
+    struct container_client_request* request;
+    enum chef_status                 chstatus;
+    VLOG_DEBUG("served", "container_client_create_container_async(id=%s, rootfs=%s)\n", options->id, options->rootfs);
+
+    request = malloc(sizeof(struct container_client_request));
+    if (request == NULL) {
+        return NULL;
+    }
+
+    chstatus = __create_container(
         g_containerClient,
+        &request->context,
         options->id,
         options->pack_id,
         options->rootfs,
         options->package
-    ));
+    );
+    if (chstatus != CHEF_STATUS_SUCCESS) {
+        free(request);
+        (void)__to_errno_code(chstatus);
+        return NULL;
+    }
+    return request;
+}
+
+int container_client_create_container_wait(struct container_client_request* request)
+{
+    enum chef_status chstatus;
+
+    chstatus = __create_container_result(g_containerClient, &request->context);
+    free(request);
+    return __to_errno_code(chstatus);
+}
+
+int container_client_create_container(struct container_options* options)
+{
+    struct container_client_request* request;
+    VLOG_DEBUG("served", "container_client_create_container(id=%s, rootfs=%s)\n", options->id, options->rootfs);
+
+    request = container_client_create_container_async(options);
+    if (request == NULL) {
+        return -1;
+    }
+    return container_client_create_container_wait(request);
 }
 
 static enum chef_status __container_spawn(
@@ -885,3 +939,79 @@ int container_client_destroy_container(const char* id)
         id
     ));
 }
+
+static enum chef_status __container_logs(
+    gracht_client_t*       client,
+    const char*            id,
+    uint64_t               since,
+    uint32_t               max,
+    struct chef_log_chunk* chunk)
+{
+    struct gracht_message_context context;
+    int                           status;
+    enum chef_status              chstatus;
+    VLOG_DEBUG("served", "__container_logs()\n");
+
+    status = chef_cvd_logs(client, &context, id, since, max);
+    if (status != 0) {
+        VLOG_ERROR("served", "__container_logs: failed to invoke logs\n");
+        return status;
+    }
+    gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+    chef_cvd_logs_result(client, &context, chunk, &chstatus);
+    return chstatus;
+}
+
+int container_client_logs(
+    const char*                 id,
+    uint64_t                    since,
+    uint32_t                    max,
+    struct container_log_line** linesOut,
+    uint32_t*                   countOut,
+    uint64_t*                   nextOut)
+{
+    struct chef_log_chunk      chunk = { 0 };
+    struct container_log_line* lines = NULL;
+    enum chef_status           chstatus;
+    VLOG_DEBUG("served", "container_client_logs(id=%s, since=%llu)\n", id, (unsigned long long)since);
+
+    chstatus = __container_logs(g_containerClient, id, since, max, &chunk);
+    if (chstatus != CHEF_STATUS_SUCCESS) {
+        chef_log_chunk_destroy(&chunk);
+        return __to_errno_code(chstatus);
+    }
+
+    if (chunk.lines_count > 0) {
+        lines = calloc(chunk.lines_count, sizeof(struct container_log_line));
+        if (lines == NULL) {
+            chef_log_chunk_destroy(&chunk);
+            return -1;
+        }
+    }
+
+    // take over the strings, so they are not copied again
+    for (uint32_t i = 0; i < chunk.lines_count; i++) {
+        lines[i].sequence = chunk.lines[i].sequence;
+        lines[i].timestamp = chunk.lines[i].timestamp;
+        lines[i].error = chunk.lines[i].stream == CHEF_LOG_STREAM_STDERR;
+        lines[i].text = chunk.lines[i].text;
+        chunk.lines[i].text = NULL;
+    }
+
+    *linesOut = lines;
+    *countOut = chunk.lines_count;
+    *nextOut = chunk.next;
+    chef_log_chunk_destroy(&chunk);
+    return 0;
+}
+
+void container_client_logs_free(struct container_log_line* lines, uint32_t count)
+{
+    if (lines == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        free(lines[i].text);
+    }
+    free(lines);
+}
@@ -24,15 +24,19 @@
 
 void chef_waiterd_cook_ready_invocation(struct gracht_message* message, const struct chef_cook_ready_event* evt)
 {
-    VLOG_DEBUG("api", "cook::ready(arch=%u)\n", evt->archs);
-    waiterd_server_cook_ready(message->client, waiterd_architecture(evt->archs));
+    VLOG_DEBUG("api", "cook::ready(arch=%u, builders=%i)\n", evt->archs, evt->builders);
+    waiterd_server_cook_ready(message->client, waiterd_architecture(evt->archs), evt->builders);
+    waiterd_server_requests_dispatch(message->server);
 }
 
 void chef_waiterd_cook_update_invocation(struct gracht_message* message, const struct chef_cook_update_event* evt)
 {
-    VLOG_DEBUG("api", "cook::update()\n");
-    // stats stuff
-    // TODO
+    VLOG_DEBUG("api", "cook::update(queue_size=%i)\n", evt->queue_size);
+    waiterd_server_cook_update(message->client, evt->queue_size);
+
+    // cooks report their queue size whenever a build finishes, which is
+    // when held builds can be handed out
+    waiterd_server_requests_dispatch(message->server);
 }
 
 void chef_waiterd_cook_status_invocation(struct gracht_message* message, const struct chef_cook_build_event* evt)
@@ -49,11 +53,11 @@ void chef_waiterd_cook_status_invocation(struct gracht_message* message, const s
 
     // Store previous status temporarily
     status = wreq->status;
-    wreq->status = waiterd_build_status(evt->status);
+    waiterd_server_request_status(wreq, message->client, waiterd_build_status(evt->status));
 
     // If it's the first update, then we heard back from the cook
     // whether it started the request. Notify the client of the new status.
-    if (status == WAITERD_BUILD_STATUS_UNKNOWN) {
+    if (status == WAITERD_BUILD_STATUS_UNKNOWN && wreq->source != NULL) {
         chef_waiterd_build_response(wreq->source, CHEF_QUEUE_STATUS_SUCCESS, &wreq->guid[0]);
     }
 }
@@ -71,10 +75,10 @@ void chef_waiterd_cook_artifact_invocation(struct gracht_message* message, const
 
     switch (evt->type) {
         case CHEF_ARTIFACT_TYPE_LOG:
-            wreq->artifacts.log = platform_strdup(evt->uri);
+            waiterd_server_request_artifact(wreq, WAITERD_ARTIFACT_TYPE_LOG, evt->uri);
             break;
         case CHEF_ARTIFACT_TYPE_PACKAGE:
-            wreq->artifacts.package = platform_strdup(evt->uri);
+            waiterd_server_request_artifact(wreq, WAITERD_ARTIFACT_TYPE_PACKAGE, evt->uri);
             break;
     }
 }
@@ -41,14 +41,27 @@ void chef_waiterd_build_invocation(
         return;
     }
 
-    cook = waiterd_server_cook_find(waiterd_architecture(request->arch));
+    cook = waiterd_server_cook_find(waiterd_architecture(request->arch), request->url, request->recipe, 1);
     if (cook == NULL) {
-        VLOG_WARNING("api", "no cook for requested architecture\n");
-        chef_waiterd_build_response(message, CHEF_QUEUE_STATUS_NO_COOK_FOR_ARCHITECTURE, "0");
+        if (waiterd_server_cook_find(waiterd_architecture(request->arch), request->url, request->recipe, 0) == NULL) {
+            VLOG_WARNING("api", "no cook for requested architecture\n");
+            chef_waiterd_build_response(message, CHEF_QUEUE_STATUS_NO_COOK_FOR_ARCHITECTURE, "0");
+            return;
+        }
+
+        // every cook is busy, hold on to the build until one of them
+        // reports a free builder instead of queueing it on a cook now
+        wreq = waiterd_server_request_hold(request);
+        if (wreq == NULL) {
+            VLOG_WARNING("api", "failed to allocate memory for build request!!\n");
+            chef_waiterd_build_response(message, CHEF_QUEUE_STATUS_INTERNAL_ERROR, "0");
+            return;
+        }
+        chef_waiterd_build_response(message, CHEF_QUEUE_STATUS_SUCCESS, &wreq->guid[0]);
         return;
     }
 
-    wreq = waiterd_server_request_new(cook, message);
+    wreq = waiterd_server_request_new(cook, message, waiterd_architecture(request->arch), request->url, request->recipe);
     if (wreq == NULL) {
         VLOG_WARNING("api", "failed to allocate memory for build request!!\n");
         chef_waiterd_build_response(message, CHEF_QUEUE_STATUS_INTERNAL_ERROR, "0");
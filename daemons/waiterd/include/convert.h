@@ -85,4 +85,23 @@ static enum chef_build_status chef_build_status(enum waiterd_build_status status
     return CHEF_BUILD_STATUS_UNKNOWN;
 }
 
+static enum waiterd_build_priority waiterd_build_priority(enum chef_build_priority priority)
+{
+    switch (priority) {
+        case CHEF_BUILD_PRIORITY_INTERACTIVE: return WAITERD_BUILD_PRIORITY_INTERACTIVE;
+        case CHEF_BUILD_PRIORITY_BATCH: return WAITERD_BUILD_PRIORITY_BATCH;
+    }
+    return WAITERD_BUILD_PRIORITY_INTERACTIVE;
+}
+
+static enum chef_build_priority chef_build_priority(enum waiterd_build_priority priority)
+{
+    switch (priority) {
+        case WAITERD_BUILD_PRIORITY_INTERACTIVE: return CHEF_BUILD_PRIORITY_INTERACTIVE;
+        case WAITERD_BUILD_PRIORITY_BATCH: return CHEF_BUILD_PRIORITY_BATCH;
+        default: break;
+    }
+    return CHEF_BUILD_PRIORITY_INTERACTIVE;
+}
+
 #endif //!__API_CONVERT_H__
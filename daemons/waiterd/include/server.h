@@ -21,9 +21,11 @@
 
 #include <gracht/server.h>
 #include <chef/platform.h>
+#include <time.h>
 
 // Forward declarations for protocol types
 struct chef_waiter_agent_info;
+struct chef_waiter_build_request;
 
 enum waiterd_architecture {
     WAITERD_ARCHITECTURE_X86 = 0x1,
@@ -43,11 +45,35 @@ enum waiterd_build_status {
     WAITERD_BUILD_STATUS_FAILED
 };
 
+// number of recently assigned recipes a cook is considered to have cached
+#define WAITERD_COOK_AFFINITY_SLOTS 16
+
+enum waiterd_build_priority {
+    WAITERD_BUILD_PRIORITY_INTERACTIVE,
+    WAITERD_BUILD_PRIORITY_BATCH,
+
+    WAITERD_BUILD_PRIORITY_COUNT
+};
+
+enum waiterd_artifact_type {
+    WAITERD_ARTIFACT_TYPE_LOG,
+    WAITERD_ARTIFACT_TYPE_PACKAGE
+};
+
 struct waiterd_cook {
     struct list_item          list_header;
     gracht_conn_t             client;
     int                       ready;
     enum waiterd_architecture architectures;
+
+    // scheduling state, active is the number of requests assigned to the
+    // cook that have not finished yet, queue_size is the last one it reported
+    int          builders;
+    int          active;
+    int          queue_size;
+    uint64_t     last_assigned;
+    unsigned int recent[WAITERD_COOK_AFFINITY_SLOTS];
+    int          recent_next;
 };
 
 struct waiterd_request {
@@ -58,11 +84,25 @@ struct waiterd_request {
     char                      guid[40];
     enum waiterd_architecture architecture;
     enum waiterd_build_status status;
+    unsigned int              affinity;
+    time_t                    finished;
 
     struct {
         char* package;
         char* log;
     } artifacts;
+
+    // The build is kept while the request is held by waiterd, because no cook
+    // had a free builder when it came in. Held requests are queued by priority.
+    int pending;
+    struct {
+        enum waiterd_build_priority priority;
+        char*                       platform;
+        char*                       url;
+        char*                       patch;
+        char*                       recipe;
+    } build;
+    struct waiterd_request* pending_next;
 };
 
 struct waiterd_config_address {
@@ -73,12 +113,13 @@ struct waiterd_config_address {
 
 struct waiterd_server {
     struct list cooks; // list<waiterd_cook>
-    struct list requests; // list<waiterd_request>
 };
 
 extern int waiterd_config_load(const char* confdir);
 extern void waiterd_config_api_address(struct waiterd_config_address* address);
 extern void waiterd_config_cook_address(struct waiterd_config_address* address);
+extern int waiterd_config_request_retention(void);
+extern int waiterd_config_persist_requests(void);
 
 // callbacks for the server
 extern void waiterd_server_cook_connect(gracht_conn_t client);
@@ -93,24 +134,75 @@ extern int waiterd_initialize_server(struct gracht_server_configuration* config,
  * 
  * @param client 
  * @param arch 
+ * @param builders The number of builds the cook runs in parallel
+ */
+extern void waiterd_server_cook_ready(gracht_conn_t client, enum waiterd_architecture arch, int builders);
+
+/**
+ * @brief Finds a connected cook by its client connection
  */
-extern void waiterd_server_cook_ready(gracht_conn_t client, enum waiterd_architecture arch);
+extern struct waiterd_cook* waiterd_server_cook_find_by_client(gracht_conn_t client);
 
 /**
- * @brief Finds a cook based on the architecture, internal load-balancing
- * may occur
+ * @brief Records the queue size a cook reported
  */
-extern struct waiterd_cook* waiterd_server_cook_find(enum waiterd_architecture arch);
+extern void waiterd_server_cook_update(gracht_conn_t client, int queueSize);
 
 /**
- * @brief
+ * @brief Finds the cook that should build a recipe for the architecture. The
+ * cook with the least load per builder is chosen, preferring cooks that recently
+ * built the same recipe.
+ */
+extern struct waiterd_cook* waiterd_server_cook_find(enum waiterd_architecture arch, const char* url, const char* recipe, int requireFree);
+
+/**
+ * @brief Creates a request for a build assigned to the cook, and defers the message
+ * until the cook has answered.
  */
 extern struct waiterd_request* waiterd_server_request_new(
-    struct waiterd_cook*   cook,
-    struct gracht_message* message);
+    struct waiterd_cook*      cook,
+    struct gracht_message*    message,
+    enum waiterd_architecture arch,
+    const char*               url,
+    const char*               recipe);
+
+/**
+ * @brief Updates the status of a request, the cook is no longer accounted for the
+ * request once it is done or has failed. A request restored from disk is adopted
+ * by the cook reporting on it.
+ */
+extern void waiterd_server_request_status(struct waiterd_request* request, gracht_conn_t client, enum waiterd_build_status status);
+
+/**
+ * @brief Sets the uri of a build artifact of a request
+ */
+extern void waiterd_server_request_artifact(struct waiterd_request* request, enum waiterd_artifact_type type, const char* uri);
+
+/**
+ * @brief Fails all unfinished requests assigned to a cook, used when the cook disconnects
+ */
+extern void waiterd_server_requests_abort(gracht_conn_t client);
+
+/**
+ * @brief Enables persistence of requests to the directory, and restores the requests
+ * that were saved there by the previous run.
+ */
+extern int waiterd_server_requests_load(const char* directory);
+
+/**
+ * @brief Creates a request for a build that is held by waiterd until a cook has a free
+ * builder. The request is reported as queued to the client right away.
+ */
+extern struct waiterd_request* waiterd_server_request_hold(const struct chef_waiter_build_request* build);
+
+/**
+ * @brief Hands held requests to cooks that have a free builder, interactive builds first.
+ * Called whenever a cook may have capacity for more builds.
+ */
+extern void waiterd_server_requests_dispatch(gracht_server_t* server);
 
 /**
- * @brief
+ * @brief Looks up a request by its id
  */
 extern struct waiterd_request* waiterd_server_request_find(const char* id);
 
@@ -132,4 +224,28 @@ extern int waiterd_server_agents_list(enum waiterd_architecture arch_filter, str
  */
 extern int waiterd_server_agent_info(const char* name, struct chef_waiter_agent_info* info);
 
+/**
+ * @brief Computes the key used to match a build against the recipes a cook built recently
+ */
+extern unsigned int waiterd_scheduler_affinity_key(const char* url, const char* recipe);
+
+/**
+ * @brief Selects the ready cook supporting the architecture with the lowest load per
+ * builder. Cooks that recently built the recipe matching the affinity key get a bonus.
+ * 
+ * @param requireFree Only consider cooks that have a free builder
+ * @return The cook, or NULL if no cook supports the architecture
+ */
+extern struct waiterd_cook* waiterd_scheduler_select(struct list* cooks, enum waiterd_architecture arch, unsigned int affinityKey, int requireFree);
+
+/**
+ * @brief Accounts a build assigned to the cook
+ */
+extern void waiterd_scheduler_assigned(struct waiterd_cook* cook, unsigned int affinityKey);
+
+/**
+ * @brief Releases a build previously assigned to the cook
+ */
+extern void waiterd_scheduler_completed(struct waiterd_cook* cook);
+
 #endif //!__WAITERD_PRIVATE_H__
@@ -92,6 +92,16 @@ int main(int argc, char** argv)
         return -1;
     }
 
+    // restore the requests of the previous run, this keeps the queue state
+    // across restarts of waiterd
+    if (waiterd_config_persist_requests()) {
+        status = waiterd_server_requests_load(chef_dirs_store());
+        if (status) {
+            fprintf(stderr, "waiterd: failed to restore requests\n");
+            return -1;
+        }
+    }
+
     // add log file to vlog
     debuglog = chef_dirs_open_temp_file("waiterd", "log", &debuglogPath);
     if (debuglog == NULL) {
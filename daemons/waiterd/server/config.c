@@ -72,9 +72,14 @@ static json_t* __serialize_config_address(struct config_address* address)
     return root;
 }
 
+// finished requests are kept for a day by default
+#define __DEFAULT_REQUEST_RETENTION (24 * 60 * 60)
+
 struct config {
     struct config_address api_address;
     struct config_address cook_address;
+    int                   request_retention; // seconds, 0 keeps them forever
+    int                   persist_requests;
 };
 
 static struct config g_config = { 0 };
@@ -108,6 +113,8 @@ static json_t* __serialize_config(struct config* config)
     
     json_object_set_new(root, "api-address", api_address);
     json_object_set_new(root, "cook-address", cook_address);
+    json_object_set_new(root, "request-retention", json_integer(config->request_retention));
+    json_object_set_new(root, "persist-requests", json_boolean(config->persist_requests));
     return root;
 }
 
@@ -134,6 +141,17 @@ static int __parse_config(struct config* config, json_t* root)
     json_t* member;
     int     status;
 
+    config->request_retention = __DEFAULT_REQUEST_RETENTION;
+    member = json_object_get(root, "request-retention");
+    if (json_is_integer(member) && json_integer_value(member) >= 0) {
+        config->request_retention = (int)json_integer_value(member);
+    }
+
+    member = json_object_get(root, "persist-requests");
+    if (json_is_boolean(member)) {
+        config->persist_requests = json_is_true(member);
+    }
+
     member = json_object_get(root, "api-address");
     if (member == NULL) {
         return 0;
@@ -158,6 +176,9 @@ static int __parse_config(struct config* config, json_t* root)
 
 static int __initialize_config(struct config* config)
 {
+    config->request_retention = __DEFAULT_REQUEST_RETENTION;
+    config->persist_requests = 0;
+
 #ifdef CHEF_ON_LINUX
     config->api_address.type = platform_strdup("local");
     config->api_address.address = platform_strdup("@/chef/waiterd/api");
@@ -225,3 +246,13 @@ void waiterd_config_cook_address(struct waiterd_config_address* address)
     address->address = g_config.cook_address.address;
     address->port = g_config.cook_address.port;
 }
+
+int waiterd_config_request_retention(void)
+{
+    return g_config.request_retention;
+}
+
+int waiterd_config_persist_requests(void)
+{
+    return g_config.persist_requests;
+}
@@ -0,0 +1,757 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/hashindex.h>
+#include <chef/platform.h>
+#include <convert.h>
+#include <errno.h>
+#include <jansson.h>
+#include <server.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <vlog.h>
+
+#include "chef_waiterd_cook_service_server.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// How often, in seconds, finished requests are checked against the retention
+#define __EVICTION_INTERVAL 60
+
+// Requests restored from disk are not assigned to a connected cook until the
+// cook building them reports back
+#define __NO_COOK ((gracht_conn_t)-1)
+
+#define __REQUESTS_FILE "waiterd-requests.json"
+
+// Changes to the requests are written at most this often, a burst of status
+// updates from the cooks is collapsed into a single write
+#define __SAVE_DELAY_MS 250
+
+static const char  g_templateGuid[] = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
+static const char* g_hexValues = "0123456789ABCDEF";
+
+struct __request_queue {
+    struct waiterd_request* head;
+    struct waiterd_request* tail;
+};
+
+static struct {
+    struct list            requests; // list<waiterd_request>
+    struct hashindex       index;    // guid => waiterd_request*, rebuilt after evictions
+    struct __request_queue pending[WAITERD_BUILD_PRIORITY_COUNT];
+    uint64_t               guid_state;
+    time_t                 last_eviction;
+    char*                  path; // NULL when requests are not persisted
+} g_requests = { 0 };
+
+// The requests are serialized on the server thread, and written to disk by the
+// writer thread. Only the most recent state is kept until it has been written.
+static struct {
+    mtx_t  lock;
+    cnd_t  signal;
+    thrd_t thread;
+    char*  pending;
+} g_writer;
+
+static void __request_delete(struct waiterd_request* request)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    free(request->artifacts.log);
+    free(request->artifacts.package);
+    free(request->build.platform);
+    free(request->build.url);
+    free(request->build.patch);
+    free(request->build.recipe);
+    free(request->source);
+    free(request);
+}
+
+static void __pending_push(struct waiterd_request* request)
+{
+    struct __request_queue* queue = &g_requests.pending[request->build.priority];
+
+    request->pending = 1;
+    request->pending_next = NULL;
+    if (queue->tail != NULL) {
+        queue->tail->pending_next = request;
+    } else {
+        queue->head = request;
+    }
+    queue->tail = request;
+}
+
+static void __pending_remove(struct waiterd_request* request, struct waiterd_request* previous)
+{
+    struct __request_queue* queue = &g_requests.pending[request->build.priority];
+
+    if (previous != NULL) {
+        previous->pending_next = request->pending_next;
+    } else {
+        queue->head = request->pending_next;
+    }
+    if (queue->tail == request) {
+        queue->tail = previous;
+    }
+    request->pending = 0;
+    request->pending_next = NULL;
+}
+
+static int __is_finished(enum waiterd_build_status status)
+{
+    return status == WAITERD_BUILD_STATUS_DONE || status == WAITERD_BUILD_STATUS_FAILED;
+}
+
+static int __index_rebuild(void)
+{
+    struct list_item* i;
+
+    // evictions only ever shrink the list, and the index keeps its memory,
+    // so rebuilding after an eviction never fails
+    if (hashindex_reset(&g_requests.index, g_requests.requests.count)) {
+        return -1;
+    }
+
+    list_foreach(&g_requests.requests, i) {
+        struct waiterd_request* request = (struct waiterd_request*)i;
+        hashindex_insert(&g_requests.index, hashindex_hash_string(request->guid), (uintptr_t)request);
+    }
+    return 0;
+}
+
+static int __request_add(struct waiterd_request* request)
+{
+    list_add(&g_requests.requests, &request->list_header);
+    if (hashindex_full(&g_requests.index, g_requests.requests.count)) {
+        if (__index_rebuild()) {
+            list_remove(&g_requests.requests, &request->list_header);
+            return -1;
+        }
+        return 0;
+    }
+    hashindex_insert(&g_requests.index, hashindex_hash_string(request->guid), (uintptr_t)request);
+    return 0;
+}
+
+static uint64_t __guid_next(void)
+{
+    uint64_t z;
+
+    // The generator is seeded once, reseeding it from the clock for every id
+    // handed out the same ids to requests arriving within the same tick.
+    if (g_requests.guid_state == 0) {
+        g_requests.guid_state = ((uint64_t)time(NULL) << 32) ^ ((uint64_t)getpid() << 16) ^
+            (uint64_t)clock() ^ (uint64_t)(uintptr_t)&g_requests;
+    }
+
+    // splitmix64, which maps every step of its counter to a distinct value
+    z = (g_requests.guid_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void __guid_new(char guidBuffer[40])
+{
+    // The first 64 bits of the id never repeat within a run, ids restored from
+    // a previous run are checked against the index.
+    do {
+        uint64_t bits[2] = { __guid_next(), __guid_next() };
+        int      n = 0;
+
+        for (int t = 0; t < (int)(sizeof(g_templateGuid) - 1); t++) {
+            char c = g_templateGuid[t];
+            if (c == 'x' || c == 'y') {
+                unsigned int r = (unsigned int)(bits[n / 16] >> ((n % 16) * 4)) & 0xF;
+                if (c == 'y') {
+                    r = (r & 0x03) | 0x08;
+                }
+                c = g_hexValues[r];
+                n++;
+            }
+            guidBuffer[t] = c;
+        }
+        guidBuffer[sizeof(g_templateGuid) - 1] = 0;
+    } while (waiterd_server_request_find(guidBuffer) != NULL);
+}
+
+static json_t* __serialize_request(struct waiterd_request* request)
+{
+    json_t* root = json_object();
+    if (root == NULL) {
+        return NULL;
+    }
+
+    json_object_set_new(root, "id", json_string(request->guid));
+    json_object_set_new(root, "architecture", json_integer(request->architecture));
+    json_object_set_new(root, "status", json_integer(request->status));
+    json_object_set_new(root, "affinity", json_integer(request->affinity));
+    json_object_set_new(root, "finished", json_integer((json_int_t)request->finished));
+    if (request->artifacts.log != NULL) {
+        json_object_set_new(root, "log", json_string(request->artifacts.log));
+    }
+    if (request->artifacts.package != NULL) {
+        json_object_set_new(root, "package", json_string(request->artifacts.package));
+    }
+
+    // held requests are handed to a cook after the restart
+    if (request->pending) {
+        json_object_set_new(root, "pending", json_true());
+        json_object_set_new(root, "priority", json_integer(request->build.priority));
+        json_object_set_new(root, "platform", json_string(request->build.platform != NULL ? request->build.platform : ""));
+        json_object_set_new(root, "url", json_string(request->build.url != NULL ? request->build.url : ""));
+        json_object_set_new(root, "patch", json_string(request->build.patch != NULL ? request->build.patch : ""));
+        json_object_set_new(root, "recipe", json_string(request->build.recipe != NULL ? request->build.recipe : ""));
+    }
+    return root;
+}
+
+static int __sync_file(FILE* file)
+{
+#if defined(_WIN32)
+    return _commit(_fileno(file));
+#else
+    return fsync(fileno(file));
+#endif
+}
+
+// The rename is only durable once the directory holding the file is synced.
+static int __sync_directory(const char* path)
+{
+#if defined(_WIN32)
+    (void)path;
+    return 0;
+#else
+    char  buffer[PATH_MAX];
+    char* separator;
+    int   fd;
+    int   status;
+
+    snprintf(&buffer[0], sizeof(buffer), "%s", path);
+    separator = strrchr(&buffer[0], CHEF_PATH_SEPARATOR);
+    if (separator == NULL) {
+        return 0;
+    }
+    *separator = '\0';
+
+    fd = open(&buffer[0], O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    status = fsync(fd);
+    close(fd);
+    return status;
+#endif
+}
+
+// The file is written next to the old one, synced and renamed over it, so a
+// crash leaves either the old or the new state behind.
+static void __requests_write(const char* data)
+{
+    char   tmpPath[PATH_MAX];
+    FILE*  file;
+    size_t length = strlen(data);
+    int    status;
+
+    snprintf(&tmpPath[0], sizeof(tmpPath), "%s.tmp", g_requests.path);
+    file = fopen(&tmpPath[0], "wb");
+    if (file == NULL) {
+        VLOG_ERROR("waiter", "__requests_write: failed to open %s: %i\n", &tmpPath[0], errno);
+        return;
+    }
+
+    status = fwrite(data, 1, length, file) != length || fflush(file) != 0 || __sync_file(file) != 0;
+    if (fclose(file) != 0) {
+        status = 1;
+    }
+    if (status) {
+        VLOG_ERROR("waiter", "__requests_write: failed to write %s: %i\n", &tmpPath[0], errno);
+        remove(&tmpPath[0]);
+        return;
+    }
+
+#if defined(_WIN32)
+    // rename does not replace existing files on windows
+    remove(g_requests.path);
+#endif
+    if (rename(&tmpPath[0], g_requests.path)) {
+        VLOG_ERROR("waiter", "__requests_write: failed to replace %s: %i\n", g_requests.path, errno);
+        return;
+    }
+
+    if (__sync_directory(g_requests.path)) {
+        VLOG_WARNING("waiter", "__requests_write: failed to sync the directory of %s: %i\n", g_requests.path, errno);
+    }
+}
+
+static int __writer_main(void* context)
+{
+    char* data;
+    (void)context;
+
+    for (;;) {
+        mtx_lock(&g_writer.lock);
+        while (g_writer.pending == NULL) {
+            cnd_wait(&g_writer.signal, &g_writer.lock);
+        }
+        mtx_unlock(&g_writer.lock);
+
+        // let further changes accumulate before writing
+        thrd_sleep(&(struct timespec) { .tv_sec = 0, .tv_nsec = __SAVE_DELAY_MS * 1000000L }, NULL);
+
+        mtx_lock(&g_writer.lock);
+        data = g_writer.pending;
+        g_writer.pending = NULL;
+        mtx_unlock(&g_writer.lock);
+
+        __requests_write(data);
+        free(data);
+    }
+    return 0;
+}
+
+static int __writer_start(void)
+{
+    if (mtx_init(&g_writer.lock, mtx_plain) != thrd_success) {
+        return -1;
+    }
+    if (cnd_init(&g_writer.signal) != thrd_success) {
+        mtx_destroy(&g_writer.lock);
+        return -1;
+    }
+    if (thrd_create(&g_writer.thread, __writer_main, NULL) != thrd_success) {
+        cnd_destroy(&g_writer.signal);
+        mtx_destroy(&g_writer.lock);
+        return -1;
+    }
+    thrd_detach(g_writer.thread);
+    return 0;
+}
+
+// Serializes all requests if persistence is enabled, and hands them to the
+// writer thread. Only the latest state is written if several saves happen
+// within __SAVE_DELAY_MS.
+static void __requests_save(void)
+{
+    json_t*           root;
+    json_t*           requests;
+    struct list_item* i;
+    char*             data;
+
+    if (g_requests.path == NULL) {
+        return;
+    }
+
+    root = json_object();
+    requests = json_array();
+    if (root == NULL || requests == NULL) {
+        VLOG_ERROR("waiter", "__requests_save: failed to allocate memory\n");
+        json_decref(requests);
+        json_decref(root);
+        return;
+    }
+    json_object_set_new(root, "requests", requests);
+
+    list_foreach(&g_requests.requests, i) {
+        struct waiterd_request* request = (struct waiterd_request*)i;
+        json_t*                 entry;
+
+        // the build was never acknowledged to the client, so there is
+        // nothing for it to come back for
+        if (request->status == WAITERD_BUILD_STATUS_UNKNOWN) {
+            continue;
+        }
+
+        entry = __serialize_request(request);
+        if (entry == NULL) {
+            VLOG_ERROR("waiter", "__requests_save: failed to serialize request %s\n", request->guid);
+            json_decref(root);
+            return;
+        }
+        json_array_append_new(requests, entry);
+    }
+
+    data = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    if (data == NULL) {
+        VLOG_ERROR("waiter", "__requests_save: failed to serialize requests\n");
+        return;
+    }
+
+    mtx_lock(&g_writer.lock);
+    free(g_writer.pending);
+    g_writer.pending = data;
+    cnd_signal(&g_writer.signal);
+    mtx_unlock(&g_writer.lock);
+}
+
+static void __requests_evict(void)
+{
+    struct list_item* i;
+    struct list_item* tmp;
+    time_t            now = time(NULL);
+    int               retention = waiterd_config_request_retention();
+    int               evicted = 0;
+
+    if (retention <= 0 || now - g_requests.last_eviction < __EVICTION_INTERVAL) {
+        return;
+    }
+    g_requests.last_eviction = now;
+
+    list_foreach_safe(&g_requests.requests, i, tmp) {
+        struct waiterd_request* request = (struct waiterd_request*)i;
+        if (__is_finished(request->status) && now - request->finished >= retention) {
+            list_remove(&g_requests.requests, i);
+            __request_delete(request);
+            evicted++;
+        }
+    }
+
+    if (evicted > 0) {
+        VLOG_DEBUG("waiter", "evicted %i finished requests\n", evicted);
+        (void)__index_rebuild();
+        __requests_save();
+    }
+}
+
+static char* __json_string_dup(json_t* root, const char* key)
+{
+    const char* value = json_string_value(json_object_get(root, key));
+    return value != NULL ? platform_strdup(value) : NULL;
+}
+
+static struct waiterd_request* __parse_request(json_t* root)
+{
+    struct waiterd_request* request;
+    const char*             id;
+
+    id = json_string_value(json_object_get(root, "id"));
+    if (id == NULL || strlen(id) != sizeof(g_templateGuid) - 1) {
+        return NULL;
+    }
+
+    request = calloc(1, sizeof(struct waiterd_request));
+    if (request == NULL) {
+        return NULL;
+    }
+
+    strcpy(&request->guid[0], id);
+    request->cook = __NO_COOK;
+    request->architecture = (enum waiterd_architecture)json_integer_value(json_object_get(root, "architecture"));
+    request->status = (enum waiterd_build_status)json_integer_value(json_object_get(root, "status"));
+    request->affinity = (unsigned int)json_integer_value(json_object_get(root, "affinity"));
+    request->finished = (time_t)json_integer_value(json_object_get(root, "finished"));
+
+    request->artifacts.log = __json_string_dup(root, "log");
+    request->artifacts.package = __json_string_dup(root, "package");
+
+    if (json_is_true(json_object_get(root, "pending"))) {
+        request->pending = 1;
+        request->build.priority = (enum waiterd_build_priority)json_integer_value(json_object_get(root, "priority"));
+        if (request->build.priority >= WAITERD_BUILD_PRIORITY_COUNT) {
+            request->build.priority = WAITERD_BUILD_PRIORITY_BATCH;
+        }
+        request->build.platform = __json_string_dup(root, "platform");
+        request->build.url = __json_string_dup(root, "url");
+        request->build.patch = __json_string_dup(root, "patch");
+        request->build.recipe = __json_string_dup(root, "recipe");
+    }
+    return request;
+}
+
+int waiterd_server_requests_load(const char* directory)
+{
+    char         path[PATH_MAX];
+    json_error_t error;
+    json_t*      root;
+    json_t*      requests;
+    size_t       index;
+    json_t*      entry;
+    VLOG_DEBUG("waiter", "waiterd_server_requests_load(directory=%s)\n", directory);
+
+    snprintf(&path[0], sizeof(path), "%s" CHEF_PATH_SEPARATOR_S __REQUESTS_FILE, directory);
+    g_requests.path = platform_strdup(&path[0]);
+    if (g_requests.path == NULL) {
+        return -1;
+    }
+
+    if (__writer_start()) {
+        VLOG_ERROR("waiter", "failed to start the request writer\n");
+        free(g_requests.path);
+        g_requests.path = NULL;
+        return -1;
+    }
+
+    root = json_load_file(&path[0], 0, &error);
+    if (root == NULL) {
+        if (json_error_code(&error) == json_error_cannot_open_file) {
+            return 0;
+        }
+        VLOG_ERROR("waiter", "failed to parse %s: %s\n", &path[0], error.text);
+        return -1;
+    }
+
+    requests = json_object_get(root, "requests");
+    json_array_foreach(requests, index, entry) {
+        struct waiterd_request* request = __parse_request(entry);
+        if (request == NULL) {
+            VLOG_WARNING("waiter", "skipping invalid request entry %zu\n", index);
+            continue;
+        }
+
+        if (waiterd_server_request_find(request->guid) != NULL || __request_add(request)) {
+            __request_delete(request);
+            continue;
+        }
+
+        if (request->pending) {
+            __pending_push(request);
+        }
+    }
+    json_decref(root);
+
+    VLOG_TRACE("waiter", "restored %i requests\n", g_requests.requests.count);
+    return 0;
+}
+
+struct waiterd_request* waiterd_server_request_new(
+    struct waiterd_cook*      cook,
+    struct gracht_message*    message,
+    enum waiterd_architecture arch,
+    const char*               url,
+    const char*               recipe)
+{
+    struct waiterd_request* request;
+
+    // a new request is a good time to get rid of old ones
+    __requests_evict();
+
+    request = calloc(1, sizeof(struct waiterd_request));
+    if (request == NULL) {
+        return NULL;
+    }
+    
+    request->cook = cook->client;
+    request->architecture = arch;
+    request->affinity = waiterd_scheduler_affinity_key(url, recipe);
+    request->source = malloc(GRACHT_MESSAGE_DEFERRABLE_SIZE(message));
+    if (request->source == NULL) {
+        free(request);
+        return NULL;
+    }
+    __guid_new(request->guid);
+
+    if (__request_add(request)) {
+        __request_delete(request);
+        return NULL;
+    }
+    gracht_server_defer_message(message, request->source);
+    waiterd_scheduler_assigned(cook, request->affinity);
+    return request;
+}
+
+struct waiterd_request* waiterd_server_request_find(const char* id)
+{
+    hashindex_foreach(&g_requests.index, hashindex_hash_string(id), i) {
+        struct waiterd_request* request = (struct waiterd_request*)g_requests.index.slots[i];
+        if (!strcmp(request->guid, id)) {
+            return request;
+        }
+    }
+    return NULL;
+}
+
+static void __request_finish(struct waiterd_request* request, enum waiterd_build_status status)
+{
+    struct waiterd_cook* cook;
+
+    if (!__is_finished(request->status) && __is_finished(status)) {
+        cook = waiterd_server_cook_find_by_client(request->cook);
+        if (cook != NULL) {
+            waiterd_scheduler_completed(cook);
+        }
+        request->finished = time(NULL);
+    }
+    request->status = status;
+}
+
+void waiterd_server_request_status(struct waiterd_request* request, gracht_conn_t client, enum waiterd_build_status status)
+{
+    struct waiterd_cook* cook;
+
+    // requests restored after a restart are adopted by the cook that
+    // reports on them, once it has reconnected
+    if (request->cook != client) {
+        request->cook = client;
+        cook = waiterd_server_cook_find_by_client(client);
+        if (cook != NULL && !__is_finished(request->status)) {
+            waiterd_scheduler_assigned(cook, request->affinity);
+        }
+    }
+
+    if (request->status != status) {
+        __request_finish(request, status);
+        __requests_save();
+    }
+}
+
+void waiterd_server_request_artifact(struct waiterd_request* request, enum waiterd_artifact_type type, const char* uri)
+{
+    char** artifact;
+
+    switch (type) {
+        case WAITERD_ARTIFACT_TYPE_LOG:
+            artifact = &request->artifacts.log;
+            break;
+        case WAITERD_ARTIFACT_TYPE_PACKAGE:
+            artifact = &request->artifacts.package;
+            break;
+        default:
+            return;
+    }
+
+    free(*artifact);
+    *artifact = uri != NULL ? platform_strdup(uri) : NULL;
+    __requests_save();
+}
+
+void waiterd_server_requests_abort(gracht_conn_t client)
+{
+    struct list_item* i;
+    int               aborted = 0;
+
+    list_foreach(&g_requests.requests, i) {
+        struct waiterd_request* request = (struct waiterd_request*)i;
+        if (request->cook != client || __is_finished(request->status)) {
+            continue;
+        }
+
+        // set the request to failed for now in the absence
+        // of 'aborted' or 'cancelled'. Requests the cook never
+        // acknowledged are failed as well, the client is left
+        // waiting for its reply.
+        __request_finish(request, WAITERD_BUILD_STATUS_FAILED);
+        request->cook = __NO_COOK;
+        aborted++;
+    }
+
+    if (aborted > 0) {
+        __requests_save();
+    }
+}
+
+static char* __strdup_or_empty(const char* value)
+{
+    return platform_strdup(value != NULL ? value : "");
+}
+
+struct waiterd_request* waiterd_server_request_hold(const struct chef_waiter_build_request* build)
+{
+    struct waiterd_request* request;
+
+    __requests_evict();
+
+    request = calloc(1, sizeof(struct waiterd_request));
+    if (request == NULL) {
+        return NULL;
+    }
+
+    request->cook = __NO_COOK;
+    request->architecture = waiterd_architecture(build->arch);
+    request->status = WAITERD_BUILD_STATUS_QUEUED;
+    request->affinity = waiterd_scheduler_affinity_key(build->url, build->recipe);
+    request->build.priority = waiterd_build_priority(build->priority);
+    request->build.platform = __strdup_or_empty(build->platform);
+    request->build.url = __strdup_or_empty(build->url);
+    request->build.patch = __strdup_or_empty(build->patch);
+    request->build.recipe = __strdup_or_empty(build->recipe);
+    if (request->build.platform == NULL || request->build.url == NULL ||
+        request->build.patch == NULL || request->build.recipe == NULL) {
+        __request_delete(request);
+        return NULL;
+    }
+    __guid_new(request->guid);
+
+    if (__request_add(request)) {
+        __request_delete(request);
+        return NULL;
+    }
+    __pending_push(request);
+    __requests_save();
+    return request;
+}
+
+void waiterd_server_requests_dispatch(gracht_server_t* server)
+{
+    int dispatched = 0;
+
+    for (int p = 0; p < WAITERD_BUILD_PRIORITY_COUNT; p++) {
+        struct waiterd_request* previous = NULL;
+        struct waiterd_request* request = g_requests.pending[p].head;
+
+        while (request != NULL) {
+            struct waiterd_request* next = request->pending_next;
+            struct waiterd_cook*    cook;
+
+            // requests for other architectures may still fit, so keep going
+            // when there is no free builder for this one
+            cook = waiterd_server_cook_find(request->architecture, request->build.url, request->build.recipe, 1);
+            if (cook == NULL) {
+                previous = request;
+                request = next;
+                continue;
+            }
+
+            __pending_remove(request, previous);
+            request->cook = cook->client;
+            waiterd_scheduler_assigned(cook, request->affinity);
+            VLOG_DEBUG("waiter", "dispatching held request %s to cook 0x%x\n", request->guid, cook->client);
+
+            chef_waiterd_cook_event_build_request_single(server, cook->client, &request->guid[0],
+                &(struct chef_waiter_build_request) {
+                    .arch = chef_build_architecture(request->architecture),
+                    .platform = request->build.platform,
+                    .url = request->build.url,
+                    .patch = request->build.patch,
+                    .recipe = request->build.recipe,
+                    .priority = chef_build_priority(request->build.priority)
+                }
+            );
+            dispatched++;
+            request = next;
+        }
+    }
+
+    if (dispatched > 0) {
+        __requests_save();
+    }
+}
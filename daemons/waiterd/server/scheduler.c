@@ -0,0 +1,120 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/hashindex.h>
+#include <server.h>
+#include <stdint.h>
+#include <string.h>
+
+// A cook's load is measured in thousandths of a build per builder, a cook
+// with 4 builders and 2 builds in flight has a load of 500.
+#define __LOAD_SCALE 1000
+
+// How much load a cache hit is worth. A cook that recently built the same
+// recipe is preferred as long as it has a free builder, or the other cooks
+// are at least half a build per builder busier.
+#define __AFFINITY_BONUS (__LOAD_SCALE / 2)
+
+static uint64_t g_assignments = 0;
+
+unsigned int waiterd_scheduler_affinity_key(const char* url, const char* recipe)
+{
+    // the key only has to be good enough to tell recipes apart in the handful
+    // of slots a cook keeps, 0 is reserved for an empty slot
+    unsigned int hash = hashindex_hash_string(url != NULL ? url : "");
+    hash ^= hashindex_hash_string(recipe != NULL ? recipe : "") + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    return hash ? hash : 1;
+}
+
+static int __has_affinity(struct waiterd_cook* cook, unsigned int key)
+{
+    for (int i = 0; i < WAITERD_COOK_AFFINITY_SLOTS; i++) {
+        if (cook->recent[i] == key) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int __cook_builders(struct waiterd_cook* cook)
+{
+    return cook->builders > 0 ? cook->builders : 1;
+}
+
+static int __cook_pending(struct waiterd_cook* cook)
+{
+    // the queue size reported by the cook also includes builds that did not
+    // come through us, but it lags behind our own bookkeeping
+    return cook->queue_size > cook->active ? cook->queue_size : cook->active;
+}
+
+static long __cook_cost(struct waiterd_cook* cook, unsigned int key)
+{
+    long cost = ((long)__cook_pending(cook) * __LOAD_SCALE) / __cook_builders(cook);
+    if (key != 0 && __has_affinity(cook, key)) {
+        cost -= __AFFINITY_BONUS;
+    }
+    return cost;
+}
+
+struct waiterd_cook* waiterd_scheduler_select(struct list* cooks, enum waiterd_architecture arch, unsigned int affinityKey, int requireFree)
+{
+    struct list_item*    i;
+    struct waiterd_cook* best = NULL;
+    long                 bestCost = 0;
+
+    list_foreach(cooks, i) {
+        struct waiterd_cook* cook = (struct waiterd_cook*)i;
+        long                 cost;
+
+        if (!cook->ready || !(cook->architectures & arch)) {
+            continue;
+        }
+        if (requireFree && __cook_pending(cook) >= __cook_builders(cook)) {
+            continue;
+        }
+
+        // ties go to the cook that was least recently given a build, so
+        // idle cooks are used in turn instead of always the first one
+        cost = __cook_cost(cook, affinityKey);
+        if (best == NULL || cost < bestCost ||
+            (cost == bestCost && cook->last_assigned < best->last_assigned)) {
+            best = cook;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+void waiterd_scheduler_assigned(struct waiterd_cook* cook, unsigned int affinityKey)
+{
+    cook->active++;
+    cook->last_assigned = ++g_assignments;
+
+    if (affinityKey != 0 && !__has_affinity(cook, affinityKey)) {
+        cook->recent[cook->recent_next] = affinityKey;
+        cook->recent_next = (cook->recent_next + 1) % WAITERD_COOK_AFFINITY_SLOTS;
+    }
+}
+
+void waiterd_scheduler_completed(struct waiterd_cook* cook)
+{
+    if (cook->active > 0) {
+        cook->active--;
+    }
+}
@@ -21,14 +21,10 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <vlog.h>
 
 #include "chef_waiterd_service.h"
 
-static char g_templateGuid[] = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
-static const char* g_hexValues = "0123456789ABCDEF-";
-
 static struct waiterd_server g_server = { 0 };
 
 static struct waiterd_cook* __waiterd_cook_new(gracht_conn_t client)
@@ -41,6 +37,7 @@ static struct waiterd_cook* __waiterd_cook_new(gracht_conn_t client)
     }
 
     cook->client = client;
+    cook->builders = 1;
     return cook;
 }
 
@@ -50,19 +47,7 @@ static void __waiterd_cook_delete(struct waiterd_cook* cook)
     free(cook);
 }
 
-static void __waiterd_request_delete(struct waiterd_request* request)
-{
-    if (request == NULL) {
-        return;
-    }
-
-    free(request->artifacts.log);
-    free(request->artifacts.package);
-    free(request->source);
-    free(request);
-}
-
-struct waiterd_cook* __find_cook_by_client(gracht_conn_t client)
+struct waiterd_cook* waiterd_server_cook_find_by_client(gracht_conn_t client)
 {
     struct list_item* i;
 
@@ -90,26 +75,9 @@ void waiterd_server_cook_connect(gracht_conn_t client)
     list_add(&g_server.cooks, &cook->list_header);
 }
 
-static void __abort_request(struct waiterd_request* request)
-{
-    if (request->status == WAITERD_BUILD_STATUS_UNKNOWN) {
-        // we should really inform the client here
-    } else if (
-        request->status == WAITERD_BUILD_STATUS_DONE ||
-        request->status == WAITERD_BUILD_STATUS_FAILED) {
-        // If the request already was handled, ignore it
-        return;
-    }
-
-    // set the request to failed for now in the absence
-    // of 'aborted' or 'cancelled'
-    request->status = WAITERD_BUILD_STATUS_FAILED;
-}
-
 void waiterd_server_cook_disconnect(gracht_conn_t client)
 {
-    struct waiterd_cook* cook = __find_cook_by_client(client);
-    struct list_item*    i;
+    struct waiterd_cook* cook = waiterd_server_cook_find_by_client(client);
     VLOG_TRACE("waiter", "cook::disconnect(client=0x%x)\n", client);
 
     // invalid cook?
@@ -122,20 +90,15 @@ void waiterd_server_cook_disconnect(gracht_conn_t client)
     list_remove(&g_server.cooks, &cook->list_header);
 
     // abort any request in flight for waiters
-    list_foreach(&g_server.requests, i) {
-        struct waiterd_request* request = (struct waiterd_request*)i;
-        if (request->cook == client) {
-            __abort_request(request);
-        }
-    }
+    waiterd_server_requests_abort(client);
 
     // cleanup cook
     __waiterd_cook_delete(cook);
 }
 
-void waiterd_server_cook_ready(gracht_conn_t client, enum waiterd_architecture arch)
+void waiterd_server_cook_ready(gracht_conn_t client, enum waiterd_architecture arch, int builders)
 {
-    struct waiterd_cook* cook = __find_cook_by_client(client);
+    struct waiterd_cook* cook = waiterd_server_cook_find_by_client(client);
     VLOG_TRACE("waiter", "cook::ready(client=0x%x)\n", client);
 
     if (cook == NULL) {
@@ -145,95 +108,25 @@ void waiterd_server_cook_ready(gracht_conn_t client, enum waiterd_architecture a
     }
 
     cook->architectures = arch;
+    cook->builders = builders > 0 ? builders : 1;
     cook->ready = 1;
 }
 
-struct waiterd_cook* waiterd_server_cook_find(enum waiterd_architecture arch)
-{
-    struct list_item* i;
-
-    list_foreach(&g_server.cooks, i) {
-        struct waiterd_cook* cook = (struct waiterd_cook*)i;
-        if (cook->architectures & arch) {
-            return cook;
-        }
-    }
-
-    return NULL;
-}
-
-static void __guid_new(char guidBuffer[40])
-{
-    // yes we are well aware that this provides _very_ poor randomness
-    // but we do not require a cryptographically secure guid for this purpose
-    srand(clock());
-    for (int t = 0; t < (sizeof(g_templateGuid) - 1); t++) {
-        int  r = rand() % 16;
-        char c = ' ';
-
-        switch (g_templateGuid[t]) {
-            case 'x' : { c = g_hexValues[r]; } break;
-            case 'y' : { c = g_hexValues[(r & 0x03) | 0x08]; } break;
-            case '-' : { c = '-'; } break;
-            case '4' : { c = '4'; } break;
-        }
-        guidBuffer[t] = c;
-    }
-    guidBuffer[sizeof(g_templateGuid) - 1] = 0;
-}
-
-struct waiterd_request* waiterd_server_request_new(
-    struct waiterd_cook*   cook,
-    struct gracht_message* message)
+void waiterd_server_cook_update(gracht_conn_t client, int queueSize)
 {
-    struct waiterd_request* request;
-
-    request = calloc(1, sizeof(struct waiterd_request));
-    if (request == NULL) {
-        return NULL;
-    }
-    
-    request->cook = cook->client;
-    request->source = malloc(GRACHT_MESSAGE_DEFERRABLE_SIZE(message));
-    if (request->source == NULL) {
-        free(request);
-        return NULL;
-    }
-    gracht_server_defer_message(message, request->source);
-    __guid_new(request->guid);
-    list_add(&g_server.requests, &request->list_header);
-    return request;
-}
+    struct waiterd_cook* cook = waiterd_server_cook_find_by_client(client);
+    VLOG_TRACE("waiter", "cook::update(client=0x%x, queue_size=%i)\n", client, queueSize);
 
-struct waiterd_request* waiterd_server_request_find(const char* id)
-{
-    struct list_item* i;
-    
-    list_foreach(&g_server.requests, i) {
-        struct waiterd_request* request = (struct waiterd_request*)i;
-        if (!strcmp(request->guid, id)) {
-            return request;
-        }
+    if (cook == NULL) {
+        VLOG_ERROR("waiter", "cook::update failed to locate cook by its client id\n");
+        return;
     }
-    
-    return NULL;
+    cook->queue_size = queueSize;
 }
 
-static int __count_requests_for_cook(gracht_conn_t client)
+struct waiterd_cook* waiterd_server_cook_find(enum waiterd_architecture arch, const char* url, const char* recipe, int requireFree)
 {
-    struct list_item* i;
-    int count = 0;
-    
-    list_foreach(&g_server.requests, i) {
-        struct waiterd_request* request = (struct waiterd_request*)i;
-        if (request->cook == client && 
-            request->status != WAITERD_BUILD_STATUS_DONE && 
-            request->status != WAITERD_BUILD_STATUS_FAILED) {
-            count++;
-        }
-    }
-    
-    return count;
+    return waiterd_scheduler_select(&g_server.cooks, arch, waiterd_scheduler_affinity_key(url, recipe), requireFree);
 }
 
 static void __generate_agent_name(gracht_conn_t client, char* buffer, size_t size)
@@ -277,7 +170,7 @@ int waiterd_server_agents_list(enum waiterd_architecture arch_filter, struct che
             agents[idx].name = platform_strdup(name_buffer);
             agents[idx].online = cook->ready;
             agents[idx].architectures = chef_build_architecture(cook->architectures);
-            agents[idx].queue_size = __count_requests_for_cook(cook->client);
+            agents[idx].queue_size = cook->active;
             idx++;
         }
     }
@@ -299,7 +192,7 @@ int waiterd_server_agent_info(const char* name, struct chef_waiter_agent_info* i
             info->name = platform_strdup(name_buffer);
             info->online = cook->ready;
             info->architectures = chef_build_architecture(cook->architectures);
-            info->queue_size = __count_requests_for_cook(cook->client);
+            info->queue_size = cook->active;
             return 0;
         }
     }
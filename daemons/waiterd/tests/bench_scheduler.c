@@ -0,0 +1,359 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Simulates a farm of cooks to show how long builds wait before a builder
+// picks them up. Builds arrive at random, and every build is for one of a set
+// of recipes where a few are much more popular than the rest. Each cook runs
+// as many builds in parallel as it has builders, and queues the rest. A build
+// of a recipe the cook built recently is faster, as its sources and
+// ingredients are still cached.
+//
+// The same builds are run through the old scheduling (first cook supporting
+// the architecture), through the load-only part of the scheduler, and through
+// the full scheduler including cache affinity.
+
+#include <math.h>
+#include <server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_DEFAULT_COOKS       8
+#define SIM_DEFAULT_BUILDS      20000
+#define SIM_DEFAULT_RECIPES     200
+#define SIM_DEFAULT_UTILIZATION 0.8
+
+// build times in seconds, a warm build takes a fraction of a cold one
+#define SIM_BUILD_TIME_COLD 300.0
+#define SIM_WARM_FACTOR     0.4
+#define SIM_COOK_CACHE_SIZE WAITERD_COOK_AFFINITY_SLOTS
+
+enum sim_policy {
+    SIM_POLICY_FIRST,
+    SIM_POLICY_LOAD,
+    SIM_POLICY_SCHEDULER
+};
+
+struct sim_build {
+    int    recipe;
+    double arrival;
+    double duration; // cold build time
+    double queued;   // time spent waiting for a builder
+    int    warm;
+};
+
+struct sim_cook {
+    struct waiterd_cook cook;
+    int                 busy;
+    int*                waiting; // fifo of build indices
+    int                 waiting_head;
+    int                 waiting_count;
+    int                 cache[SIM_COOK_CACHE_SIZE]; // recipes, least recently used first
+    int                 cache_count;
+};
+
+struct sim_event {
+    double time;
+    int    cook;
+    int    build;
+};
+
+struct sim_heap {
+    struct sim_event* events;
+    int               count;
+};
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static double __random(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (double)(g_rng >> 11) / (double)(1ull << 53);
+}
+
+static double __exponential(double mean)
+{
+    return -mean * log(1.0 - __random());
+}
+
+static void __heap_push(struct sim_heap* heap, struct sim_event event)
+{
+    int i = heap->count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap->events[parent].time <= event.time) {
+            break;
+        }
+        heap->events[i] = heap->events[parent];
+        i = parent;
+    }
+    heap->events[i] = event;
+}
+
+static struct sim_event __heap_pop(struct sim_heap* heap)
+{
+    struct sim_event top = heap->events[0];
+    struct sim_event last = heap->events[--heap->count];
+    int              i = 0;
+
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && heap->events[child + 1].time < heap->events[child].time) {
+            child++;
+        }
+        if (last.time <= heap->events[child].time) {
+            break;
+        }
+        heap->events[i] = heap->events[child];
+        i = child;
+    }
+    if (heap->count > 0) {
+        heap->events[i] = last;
+    }
+    return top;
+}
+
+static int __cache_touch(struct sim_cook* cook, int recipe)
+{
+    int hit = 0;
+    int i;
+
+    for (i = 0; i < cook->cache_count; i++) {
+        if (cook->cache[i] == recipe) {
+            hit = 1;
+            break;
+        }
+    }
+
+    if (!hit) {
+        if (cook->cache_count == SIM_COOK_CACHE_SIZE) {
+            i = 0;
+        } else {
+            i = cook->cache_count++;
+            cook->cache[i] = recipe;
+        }
+    }
+    memmove(&cook->cache[i], &cook->cache[i + 1], (cook->cache_count - i - 1) * sizeof(int));
+    cook->cache[cook->cache_count - 1] = recipe;
+    return hit;
+}
+
+static void __start_build(struct sim_cook* cooks, int index, struct sim_build* builds, int build, double now, struct sim_heap* heap)
+{
+    struct sim_cook*  cook = &cooks[index];
+    struct sim_build* b = &builds[build];
+    double            duration = b->duration;
+
+    b->queued = now - b->arrival;
+    b->warm = __cache_touch(cook, b->recipe);
+    if (b->warm) {
+        duration *= SIM_WARM_FACTOR;
+    }
+    cook->busy++;
+    __heap_push(heap, (struct sim_event) { .time = now + duration, .cook = index, .build = build });
+}
+
+static void __report_queue(struct sim_cook* cook)
+{
+    // cookd reports the builds it has not finished yet
+    cook->cook.queue_size = cook->busy + cook->waiting_count;
+}
+
+static void __complete_until(struct sim_cook* cooks, struct sim_build* builds, struct sim_heap* heap, double until)
+{
+    while (heap->count > 0 && heap->events[0].time <= until) {
+        struct sim_event event = __heap_pop(heap);
+        struct sim_cook* cook = &cooks[event.cook];
+
+        cook->busy--;
+        waiterd_scheduler_completed(&cook->cook);
+        if (cook->waiting_count > 0) {
+            int next = cook->waiting[cook->waiting_head];
+            cook->waiting_head++;
+            cook->waiting_count--;
+            __start_build(cooks, event.cook, builds, next, event.time, heap);
+        }
+        __report_queue(cook);
+    }
+}
+
+static struct waiterd_cook* __select_first(struct list* cooks, enum waiterd_architecture arch)
+{
+    struct list_item* i;
+    list_foreach(cooks, i) {
+        struct waiterd_cook* cook = (struct waiterd_cook*)i;
+        if (cook->architectures & arch) {
+            return cook;
+        }
+    }
+    return NULL;
+}
+
+static int __compare_double(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void __simulate(enum sim_policy policy, const char* name, struct sim_build* builds, int buildCount, int cookCount)
+{
+    struct sim_cook* cooks = calloc(cookCount, sizeof(struct sim_cook));
+    struct sim_heap  heap = { .events = calloc(buildCount, sizeof(struct sim_event)) };
+    struct list      list = { 0 };
+    double*          queued = calloc(buildCount, sizeof(double));
+    double           total = 0.0;
+    int              warm = 0;
+    int              idle = 0;
+    char             url[64];
+
+    for (int i = 0; i < cookCount; i++) {
+        cooks[i].cook.ready = 1;
+        cooks[i].cook.architectures = WAITERD_ARCHITECTURE_X64;
+        cooks[i].cook.builders = 1 + (i % 4);
+        cooks[i].waiting = calloc(buildCount, sizeof(int));
+        list_add(&list, &cooks[i].cook.list_header);
+    }
+
+    for (int b = 0; b < buildCount; b++) {
+        struct waiterd_cook* selected;
+        struct sim_cook*     cook;
+        unsigned int         key;
+        int                  index;
+
+        __complete_until(cooks, builds, &heap, builds[b].arrival);
+
+        snprintf(&url[0], sizeof(url), "https://sources.example/recipe-%i.pack", builds[b].recipe);
+        key = waiterd_scheduler_affinity_key(&url[0], "chef/recipe.yaml");
+        switch (policy) {
+            case SIM_POLICY_FIRST:
+                selected = __select_first(&list, WAITERD_ARCHITECTURE_X64);
+                break;
+            case SIM_POLICY_LOAD:
+                selected = waiterd_scheduler_select(&list, WAITERD_ARCHITECTURE_X64, 0, 0);
+                break;
+            default:
+                selected = waiterd_scheduler_select(&list, WAITERD_ARCHITECTURE_X64, key, 0);
+                break;
+        }
+
+        cook = (struct sim_cook*)selected;
+        index = (int)(cook - cooks);
+        waiterd_scheduler_assigned(selected, key);
+        if (cook->busy < cook->cook.builders) {
+            __start_build(cooks, index, builds, b, builds[b].arrival, &heap);
+        } else {
+            cook->waiting[cook->waiting_head + cook->waiting_count++] = b;
+        }
+        __report_queue(cook);
+    }
+    __complete_until(cooks, builds, &heap, INFINITY);
+
+    for (int b = 0; b < buildCount; b++) {
+        queued[b] = builds[b].queued;
+        total += builds[b].queued;
+        warm += builds[b].warm;
+        if (builds[b].queued == 0.0) {
+            idle++;
+        }
+    }
+    qsort(queued, buildCount, sizeof(double), __compare_double);
+
+    printf("%-10s %9.1f %9.1f %9.1f %9.1f %10.1f %7.1f%% %7.1f%%\n", name,
+        total / buildCount,
+        queued[buildCount / 2],
+        queued[(int)(buildCount * 0.9)],
+        queued[(int)(buildCount * 0.99)],
+        queued[buildCount - 1],
+        (idle * 100.0) / buildCount,
+        (warm * 100.0) / buildCount);
+
+    for (int i = 0; i < cookCount; i++) {
+        free(cooks[i].waiting);
+    }
+    free(cooks);
+    free(heap.events);
+    free(queued);
+}
+
+int main(int argc, char** argv)
+{
+    int               cookCount = SIM_DEFAULT_COOKS;
+    int               buildCount = SIM_DEFAULT_BUILDS;
+    int               recipeCount = SIM_DEFAULT_RECIPES;
+    double            utilization = SIM_DEFAULT_UTILIZATION;
+    struct sim_build* builds;
+    double*           popularity;
+    double            now = 0.0;
+    double            interval;
+    int               builders = 0;
+
+    if (argc > 1) cookCount = atoi(argv[1]);
+    if (argc > 2) buildCount = atoi(argv[2]);
+    if (argc > 3) recipeCount = atoi(argv[3]);
+    if (argc > 4) utilization = atof(argv[4]);
+    if (cookCount <= 0 || buildCount <= 0 || recipeCount <= 0 || utilization <= 0.0) {
+        fprintf(stderr, "usage: %s [cooks] [builds] [recipes] [utilization]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < cookCount; i++) {
+        builders += 1 + (i % 4);
+    }
+
+    // zipf distributed recipe popularity, as cumulative weights
+    popularity = calloc(recipeCount, sizeof(double));
+    for (int r = 0; r < recipeCount; r++) {
+        popularity[r] = (r > 0 ? popularity[r - 1] : 0.0) + 1.0 / (r + 1);
+    }
+
+    // arrivals are spaced so the farm is busy the given fraction of the time
+    // if every build was cold
+    interval = SIM_BUILD_TIME_COLD / (builders * utilization);
+    builds = calloc(buildCount, sizeof(struct sim_build));
+    for (int b = 0; b < buildCount; b++) {
+        double pick = __random() * popularity[recipeCount - 1];
+        int    r = 0;
+        while (popularity[r] < pick) {
+            r++;
+        }
+
+        now += __exponential(interval);
+        builds[b].recipe = r;
+        builds[b].arrival = now;
+        builds[b].duration = __exponential(SIM_BUILD_TIME_COLD);
+    }
+
+    printf("%i cooks, %i builders, %i builds of %i recipes, %.0f%% utilization when cold\n",
+        cookCount, builders, buildCount, recipeCount, utilization * 100.0);
+    printf("queue time in seconds, cold builds take %.0fs on average, warm builds %.0f%% of that\n\n",
+        SIM_BUILD_TIME_COLD, SIM_WARM_FACTOR * 100.0);
+    printf("%-10s %9s %9s %9s %9s %10s %8s %8s\n", "policy", "mean", "p50", "p90", "p99", "max", "no-wait", "warm");
+    __simulate(SIM_POLICY_FIRST, "first", builds, buildCount, cookCount);
+    __simulate(SIM_POLICY_LOAD, "load", builds, buildCount, cookCount);
+    __simulate(SIM_POLICY_SCHEDULER, "scheduler", builds, buildCount, cookCount);
+
+    free(builds);
+    free(popularity);
+    return 0;
+}
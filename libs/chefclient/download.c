@@ -13,23 +13,41 @@
  *
  * You should have received a copy of the GNU General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
- * 
+ *
  */
 
 #include <errno.h>
 #include <chef/client.h>
 #include <chef/platform.h>
 #include <chef/api/package.h>
+#include <ctype.h>
 #include <curl/curl.h>
+#include <fcntl.h>
 #include <jansson.h>
+#include <openssl/evp.h>
 #include "private.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <vlog.h>
 
+#if CHEF_ON_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 extern const char* chefclient_api_base_url(void);
 
+// Packages are split into at most __DOWNLOAD_MAX_SEGMENTS ranges that are
+// downloaded in parallel, but a segment is never smaller than the minimum
+// size, as small files are faster to fetch over a single connection.
+#define __DOWNLOAD_MAX_SEGMENTS     4
+#define __DOWNLOAD_SEGMENT_MIN_SIZE (8LL * 1024 * 1024)
+#define __DOWNLOAD_SEGMENT_RETRIES  3
+#define __DOWNLOAD_SYNC_INTERVAL    (16LL * 1024 * 1024)
+#define __DOWNLOAD_HASH_BUFFER_SIZE (256 * 1024)
+
 struct download_context {
     const char*           publisher;
     const char*           package;
@@ -37,21 +55,57 @@ struct download_context {
     struct chef_observer* observer;
 };
 
-static size_t __download_progress_callback(void *clientp,
-    curl_off_t dltotal, curl_off_t dlnow,
-    curl_off_t ultotal, curl_off_t ulnow)
+#if CHEF_ON_WINDOWS
+// All writes to a file happen on the thread driving the transfers, so
+// emulating positional I/O with a seek is safe.
+static long long __file_pwrite(int fd, const void* buffer, size_t length, long long offset)
 {
-    struct download_context* context = (struct download_context*)clientp;
-    if (context->observer == NULL) {
-        return 0;
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
     }
-    context->observer->report(dlnow, dltotal, context->observer->userData);
-    return 0;
+    return _write(fd, buffer, (unsigned int)length);
+}
+
+static long long __file_pread(int fd, void* buffer, size_t length, long long offset)
+{
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _read(fd, buffer, (unsigned int)length);
+}
+
+static int __file_open(const char* path, int truncate)
+{
+    return _open(path, _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+}
+
+static long long __file_size(int fd) { return _lseeki64(fd, 0, SEEK_END); }
+static int       __file_sync(int fd) { return _commit(fd); }
+static int       __file_close(int fd) { return _close(fd); }
+#else
+static long long __file_pwrite(int fd, const void* buffer, size_t length, long long offset)
+{
+    return pwrite(fd, buffer, length, (off_t)offset);
+}
+
+static long long __file_pread(int fd, void* buffer, size_t length, long long offset)
+{
+    return pread(fd, buffer, length, (off_t)offset);
 }
 
+static int __file_open(const char* path, int truncate)
+{
+    return open(path, O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+}
+
+static long long __file_size(int fd) { return lseek(fd, 0, SEEK_END); }
+static int       __file_sync(int fd) { return fdatasync(fd); }
+static int       __file_close(int fd) { return close(fd); }
+#endif
+
 static int __get_revision_url(struct chef_download_params* params, char* urlBuffer, size_t bufferSize)
 {
-    int written = snprintf(urlBuffer, bufferSize - 1, 
+    int written = snprintf(urlBuffer, bufferSize - 1,
         "%s/package/revision?publisher=%s&name=%s&platform=%s&arch=%s&channel=%s",
         chefclient_api_base_url(),
         params->publisher, params->package, params->platform, params->arch, params->channel
@@ -61,7 +115,7 @@ static int __get_revision_url(struct chef_download_params* params, char* urlBuff
 
 static int __get_download_url(struct download_context* context, char* urlBuffer, size_t bufferSize)
 {
-    int written = snprintf(urlBuffer, bufferSize - 1, 
+    int written = snprintf(urlBuffer, bufferSize - 1,
         "%s/package/download?publisher=%s&name=%s&revision=%i",
         chefclient_api_base_url(),
         context->publisher, context->package, context->revision
@@ -121,7 +175,7 @@ int __resolve_revision(struct chef_download_params* params, int* latestRevision)
     curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &httpCode);
     if (httpCode != 200) {
         status = -1;
-        
+
         if (httpCode == 404) {
             VLOG_ERROR("chef-client", "__resolve_revision: package not found\n");
             errno = ENOENT;
@@ -140,99 +194,875 @@ cleanup:
     return status;
 }
 
-static int __download_file(const char* filePath, struct download_context* context)
+struct __download_job;
+
+// A segment is an inclusive byte range [start, end] of the package. If the size of
+// the package is unknown, then the single segment has an end of -1.
+struct __download_segment {
+    struct __download_job* job;
+    struct chef_request*   request;
+    long long              start;
+    long long              end;
+    long long              done;
+    int                    retries;
+    int                    checked;
+    int                    complete;
+};
+
+enum __download_job_state {
+    __DOWNLOAD_JOB_PENDING,
+    __DOWNLOAD_JOB_RUNNING,
+    __DOWNLOAD_JOB_DONE
+};
+
+struct __download_job {
+    struct download_context   context;
+    const char*               path;
+    char*                     progress_path;
+    char                      url[1024];
+    enum __download_job_state state;
+    int                       fd;
+    int                       ranged;
+    long long                 size;
+    struct __download_segment segments[__DOWNLOAD_MAX_SEGMENTS];
+    int                       segment_count;
+    int                       active;
+    int                       failed;
+    int                       permanent;
+    long long                 unsynced;
+    EVP_MD_CTX*               hash;
+    long long                 hashed;
+    unsigned char             digest[CHEF_DOWNLOAD_SHA512_SIZE];
+    int                       status;
+    void*                     user_data;
+};
+
+typedef void (*__download_completed_fn)(struct __download_job* job, void* context);
+
+// Server errors, timeouts and throttling may go away on their own, while the
+// remaining client errors mean the request itself is wrong.
+static int __http_is_transient(long httpCode)
+{
+    return httpCode == 408 || httpCode == 429 || httpCode >= 500;
+}
+
+static long long __segment_length(struct __download_segment* segment)
+{
+    if (segment->end < 0) {
+        return -1;
+    }
+    return segment->end - segment->start + 1;
+}
+
+static int __header_is(const char* data, size_t length, const char* name)
+{
+    size_t nameLength = strlen(name);
+
+    // header names are case-insensitive
+    if (length <= nameLength || data[nameLength] != ':') {
+        return 0;
+    }
+    for (size_t i = 0; i < nameLength; i++) {
+        if (tolower((unsigned char)data[i]) != name[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static size_t __probe_header_callback(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    int*   ranged = userdata;
+    size_t length = size * nmemb;
+    char   value[128];
+
+    // header data is not zero terminated
+    if (__header_is(data, length, "accept-ranges") && length < sizeof(value)) {
+        memcpy(&value[0], data, length);
+        value[length] = '\0';
+        if (strstr(&value[0], "bytes") != NULL) {
+            *ranged = 1;
+        }
+    }
+    return length;
+}
+
+// Asks the server for the size of the package, and whether or not it supports
+// range requests. If it does not, or the probe fails, the package is downloaded
+// as a single stream which cannot be resumed.
+static struct chef_request* __download_job_probe_start(struct __download_job* job, CURLM* multi)
 {
     struct chef_request* request;
-    char                 buffer[1024];
-    FILE*                file;
-    int                  status = -1;
     CURLcode             code;
-    long                 httpCode;
 
-    // initialize a curl session
     request = chef_request_new(CHEF_CLIENT_API_SECURE, 0);
-    if (!request) {
-        VLOG_ERROR("chef-client", "__download_file: failed to create request\n");
+    if (request == NULL) {
+        return NULL;
+    }
+
+    code = curl_easy_setopt(request->curl, CURLOPT_URL, &job->url[0]);
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(request->curl, CURLOPT_NOBODY, 1L);
+    }
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(request->curl, CURLOPT_HEADERFUNCTION, __probe_header_callback);
+    }
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(request->curl, CURLOPT_HEADERDATA, &job->ranged);
+    }
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(request->curl, CURLOPT_PRIVATE, job);
+    }
+    if (code == CURLE_OK && request->headers != NULL) {
+        code = curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
+    }
+    if (code != CURLE_OK || curl_multi_add_handle(multi, request->curl) != CURLM_OK) {
+        chef_request_delete(request);
+        return NULL;
+    }
+    return request;
+}
+
+static void __download_job_probe_done(struct __download_job* job, struct chef_request* request, CURLcode code)
+{
+    curl_off_t length = -1;
+    long       httpCode = 0;
+
+    if (code == CURLE_OK) {
+        curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &httpCode);
+        curl_easy_getinfo(request->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    }
+
+    if (httpCode < 200 || httpCode >= 300 || length <= 0) {
+        VLOG_DEBUG("chef-client", "__download_job_probe_done: server did not report size (http %ld), using a single stream\n", httpCode);
+        job->ranged = 0;
+    } else {
+        job->size = (long long)length;
+    }
+}
+
+// Probes all packages up front and concurrently on the multi handle, so no
+// request blocks the transfers once the downloads are running. Packages that
+// could not be probed are downloaded as a single stream.
+static void __download_jobs_probe(struct __download_job* jobs, int count, CURLM* multi)
+{
+    struct chef_request** requests;
+    int                   active = 0;
+
+    for (int i = 0; i < count; i++) {
+        jobs[i].ranged = 0;
+        jobs[i].size = -1;
+        if (__get_download_url(&jobs[i].context, &jobs[i].url[0], sizeof(jobs[i].url)) != 0) {
+            VLOG_ERROR("chef-client", "__download_jobs_probe: buffer too small for package download link\n");
+            jobs[i].url[0] = '\0';
+        }
+    }
+
+    requests = calloc(count, sizeof(struct chef_request*));
+    if (requests == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].url[0] == '\0') {
+            continue;
+        }
+        requests[i] = __download_job_probe_start(&jobs[i], multi);
+        if (requests[i] != NULL) {
+            active++;
+        }
+    }
+
+    while (active > 0) {
+        CURLMsg*  msg;
+        CURLMcode mcode;
+        int       running;
+        int       queued;
+
+        mcode = curl_multi_perform(multi, &running);
+        if (mcode != CURLM_OK) {
+            VLOG_ERROR("chef-client", "__download_jobs_probe: curl_multi_perform() failed: %s\n", curl_multi_strerror(mcode));
+            break;
+        }
+
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            struct __download_job* job = NULL;
+            int                    index;
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&job);
+            index = (int)(job - jobs);
+            __download_job_probe_done(job, requests[index], msg->data.result);
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            chef_request_delete(requests[index]);
+            requests[index] = NULL;
+            active--;
+        }
+
+        if (active > 0) {
+            mcode = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            if (mcode != CURLM_OK) {
+                VLOG_ERROR("chef-client", "__download_jobs_probe: curl_multi_poll() failed: %s\n", curl_multi_strerror(mcode));
+                break;
+            }
+        }
+    }
+
+    // clean up anything left over from an aborted run
+    for (int i = 0; i < count; i++) {
+        if (requests[i] != NULL) {
+            curl_multi_remove_handle(multi, requests[i]->curl);
+            chef_request_delete(requests[i]);
+            jobs[i].ranged = 0;
+        }
+    }
+    free(requests);
+}
+
+static void __download_job_plan(struct __download_job* job)
+{
+    long long segmentSize;
+    int       count = 1;
+
+    if (job->ranged && job->size > 0) {
+        count = (int)(job->size / __DOWNLOAD_SEGMENT_MIN_SIZE);
+        if (count > __DOWNLOAD_MAX_SEGMENTS) {
+            count = __DOWNLOAD_MAX_SEGMENTS;
+        } else if (count < 1) {
+            count = 1;
+        }
+    }
+
+    memset(&job->segments[0], 0, sizeof(job->segments));
+    job->segment_count = count;
+    if (job->size < 0) {
+        job->segments[0].job = job;
+        job->segments[0].end = -1;
+        return;
+    }
+
+    segmentSize = job->size / count;
+    for (int i = 0; i < count; i++) {
+        job->segments[i].job   = job;
+        job->segments[i].start = (long long)i * segmentSize;
+        job->segments[i].end   = (i == count - 1) ? job->size - 1 : ((long long)(i + 1) * segmentSize) - 1;
+    }
+}
+
+// The progress file next to the package records the ranges and how much of each
+// range has been written, so an interrupted download can continue where it stopped.
+//   chef-download 1
+//   key <publisher>/<package>/<revision>
+//   size <size>
+//   segment <start> <end> <done>
+static int __download_job_save_progress(struct __download_job* job)
+{
+    char  tmpPath[PATH_MAX];
+    FILE* file;
+
+    if (!job->ranged || job->progress_path == NULL) {
+        return 0;
+    }
+
+    // make sure everything recorded as done is actually on disk
+    if (__file_sync(job->fd)) {
+        VLOG_WARNING("chef-client", "__download_job_save_progress: failed to sync %s\n", job->path);
         return -1;
     }
 
-    // initialize the output file
-    file = fopen(filePath, "wb");
-    if (!file) {
-        VLOG_ERROR("chef-client", "__download_file: failed to open file [%s]\n", strerror(errno));
-        goto cleanup;
+    snprintf(&tmpPath[0], sizeof(tmpPath), "%s.tmp", job->progress_path);
+    file = fopen(&tmpPath[0], "w");
+    if (file == NULL) {
+        VLOG_WARNING("chef-client", "__download_job_save_progress: failed to open %s\n", &tmpPath[0]);
+        return -1;
     }
 
-    if (__get_download_url(context, buffer, sizeof(buffer)) != 0) {
-        VLOG_ERROR("chef-client", "__resolve_revision: buffer too small for package download link\n");
-        goto cleanup;
+    fprintf(file, "chef-download 1\n");
+    fprintf(file, "key %s/%s/%i\n", job->context.publisher, job->context.package, job->context.revision);
+    fprintf(file, "size %lld\n", job->size);
+    for (int i = 0; i < job->segment_count; i++) {
+        fprintf(file, "segment %lld %lld %lld\n",
+            job->segments[i].start, job->segments[i].end, job->segments[i].done);
     }
 
-    // reset the writer function/data
-    code = curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, fwrite);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set write function [%s]\n", request->error);
+    if (fclose(file) != 0 || rename(&tmpPath[0], job->progress_path) != 0) {
+        VLOG_WARNING("chef-client", "__download_job_save_progress: failed to write %s\n", job->progress_path);
+        platform_unlink(&tmpPath[0]);
         return -1;
     }
+    job->unsynced = 0;
+    return 0;
+}
 
-    code = curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, file);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set write data [%s]\n", request->error);
-        goto cleanup;
+static int __download_job_load_progress(struct __download_job* job)
+{
+    struct __download_segment segments[__DOWNLOAD_MAX_SEGMENTS] = { 0 };
+    char                      line[512];
+    char                      key[512];
+    long long                 size = -1;
+    long long                 expected = 0;
+    long long                 fileSize;
+    int                       count = 0;
+    int                       version = 0;
+    FILE*                     file;
+
+    file = fopen(job->progress_path, "r");
+    if (file == NULL) {
+        return -1;
     }
 
-    code = curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set http headers [%s]\n", request->error);
-        goto cleanup;
+    snprintf(&key[0], sizeof(key), "key %s/%s/%i", job->context.publisher, job->context.package, job->context.revision);
+    while (fgets(&line[0], sizeof(line), file) != NULL) {
+        struct __download_segment* segment;
+
+        line[strcspn(&line[0], "\r\n")] = '\0';
+        if (sscanf(&line[0], "chef-download %i", &version) == 1) {
+            continue;
+        }
+        if (strncmp(&line[0], "key ", 4) == 0) {
+            if (strcmp(&line[0], &key[0]) != 0) {
+                VLOG_DEBUG("chef-client", "__download_job_load_progress: progress is for a different revision\n");
+                goto invalid;
+            }
+            continue;
+        }
+        if (sscanf(&line[0], "size %lld", &size) == 1) {
+            continue;
+        }
+        if (count == __DOWNLOAD_MAX_SEGMENTS) {
+            goto invalid;
+        }
+
+        segment = &segments[count];
+        if (sscanf(&line[0], "segment %lld %lld %lld", &segment->start, &segment->end, &segment->done) != 3) {
+            goto invalid;
+        }
+
+        // segments must cover the package without gaps
+        if (segment->start != expected || segment->end < segment->start ||
+            segment->done < 0 || segment->done > __segment_length(segment)) {
+            goto invalid;
+        }
+        expected = segment->end + 1;
+        count++;
     }
+    fclose(file);
 
-    code = curl_easy_setopt(request->curl, CURLOPT_NOPROGRESS, 0);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to enable download progress [%s]\n", request->error);
-        goto cleanup;
+    if (version != 1 || size != job->size || count == 0 || expected != job->size) {
+        VLOG_DEBUG("chef-client", "__download_job_load_progress: progress does not match the package\n");
+        return -1;
     }
 
-    code = curl_easy_setopt(request->curl, CURLOPT_XFERINFOFUNCTION, __download_progress_callback);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set download progress callback [%s]\n", request->error);
-        goto cleanup;
+    // never trust progress beyond what actually made it into the file
+    fileSize = __file_size(job->fd);
+    for (int i = 0; i < count; i++) {
+        if (segments[i].start + segments[i].done > fileSize) {
+            VLOG_DEBUG("chef-client", "__download_job_load_progress: package is shorter than the recorded progress\n");
+            return -1;
+        }
     }
 
-    code = curl_easy_setopt(request->curl, CURLOPT_XFERINFODATA, context);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set download progress callback data [%s]\n", request->error);
-        goto cleanup;
+    for (int i = 0; i < count; i++) {
+        job->segments[i] = segments[i];
+        job->segments[i].job = job;
+        job->segments[i].complete = segments[i].done == __segment_length(&segments[i]);
     }
+    job->segment_count = count;
+    return 0;
 
-    code = curl_easy_setopt(request->curl, CURLOPT_URL, &buffer[0]);
-    if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: failed to set url [%s]\n", request->error);
-        goto cleanup;
+invalid:
+    fclose(file);
+    return -1;
+}
+
+static int __download_job_reset_hash(struct __download_job* job)
+{
+    job->hashed = 0;
+    if (EVP_DigestInit_ex(job->hash, EVP_sha512(), NULL) != 1) {
+        VLOG_ERROR("chef-client", "__download_job_reset_hash: failed to initialize SHA512 state\n");
+        return -1;
     }
+    return 0;
+}
 
-    code = chef_request_execute(request);
+// The package is hashed in order while the segments are still being downloaded,
+// by reading back whatever has been written after the hashed part of the file. The
+// first segment is hashed directly from the network buffers.
+static int __download_job_advance_hash(struct __download_job* job)
+{
+    unsigned char* buffer = NULL;
+    int            status = 0;
+
+    for (int i = 0; i < job->segment_count; i++) {
+        struct __download_segment* segment = &job->segments[i];
+        long long                  available = segment->start + segment->done;
+
+        if (job->hashed > segment->end && segment->end >= 0) {
+            continue;
+        }
+
+        while (job->hashed < available) {
+            size_t    chunk = (size_t)(available - job->hashed);
+            long long bytesRead;
+
+            if (buffer == NULL) {
+                buffer = malloc(__DOWNLOAD_HASH_BUFFER_SIZE);
+                if (buffer == NULL) {
+                    return -1;
+                }
+            }
+
+            if (chunk > __DOWNLOAD_HASH_BUFFER_SIZE) {
+                chunk = __DOWNLOAD_HASH_BUFFER_SIZE;
+            }
+
+            bytesRead = __file_pread(job->fd, buffer, chunk, job->hashed);
+            if (bytesRead <= 0) {
+                VLOG_ERROR("chef-client", "__download_job_advance_hash: failed to read back %s\n", job->path);
+                status = -1;
+                goto cleanup;
+            }
+            EVP_DigestUpdate(job->hash, buffer, (size_t)bytesRead);
+            job->hashed += bytesRead;
+        }
+
+        // stop at the first segment that is still in progress
+        if (!segment->complete) {
+            break;
+        }
+    }
+
+cleanup:
+    free(buffer);
+    return status;
+}
+
+static size_t __segment_write_callback(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    struct __download_segment* segment = userdata;
+    struct __download_job*     job = segment->job;
+    size_t                     length = size * nmemb;
+    size_t                     written = 0;
+    long long                  offset = segment->start + segment->done;
+
+    // Verify the response before writing anything, so neither error pages nor the
+    // full package (from a server ignoring the range) end up at the wrong offset.
+    if (!segment->checked) {
+        long httpCode = 0;
+        curl_easy_getinfo(segment->request->curl, CURLINFO_RESPONSE_CODE, &httpCode);
+        if (job->ranged && httpCode != 206 && !(httpCode == 200 && offset == 0 && segment->end == job->size - 1)) {
+            VLOG_ERROR("chef-client", "__segment_write_callback: unexpected response %ld to range request\n", httpCode);
+            return 0;
+        }
+        if (httpCode < 200 || httpCode >= 300) {
+            VLOG_ERROR("chef-client", "__segment_write_callback: http error %ld\n", httpCode);
+            if (!__http_is_transient(httpCode)) {
+                job->permanent = 1;
+            }
+            return 0;
+        }
+        segment->checked = 1;
+    }
+
+    if (segment->end >= 0 && offset + (long long)length > segment->end + 1) {
+        VLOG_ERROR("chef-client", "__segment_write_callback: server sent more data than requested\n");
+        return 0;
+    }
+
+    while (written < length) {
+        long long bytesWritten = __file_pwrite(job->fd, data + written, length - written, offset + written);
+        if (bytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_ERROR("chef-client", "__segment_write_callback: failed to write %s: %s\n", job->path, strerror(errno));
+            job->permanent = 1;
+            return 0;
+        }
+        written += (size_t)bytesWritten;
+    }
+
+    if (offset == job->hashed) {
+        EVP_DigestUpdate(job->hash, data, length);
+        job->hashed += length;
+    }
+
+    segment->done += length;
+    job->unsynced += length;
+    return length;
+}
+
+static int __segment_start(struct __download_segment* segment, CURLM* multi)
+{
+    struct __download_job* job = segment->job;
+    char                   range[64];
+    CURLcode               code;
+
+    segment->request = chef_request_new(CHEF_CLIENT_API_SECURE, 0);
+    if (segment->request == NULL) {
+        VLOG_ERROR("chef-client", "__segment_start: failed to create request\n");
+        return -1;
+    }
+    segment->checked = 0;
+
+    code = curl_easy_setopt(segment->request->curl, CURLOPT_URL, &job->url[0]);
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(segment->request->curl, CURLOPT_WRITEFUNCTION, __segment_write_callback);
+    }
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(segment->request->curl, CURLOPT_WRITEDATA, segment);
+    }
+    if (code == CURLE_OK) {
+        code = curl_easy_setopt(segment->request->curl, CURLOPT_PRIVATE, segment);
+    }
+    if (code == CURLE_OK && segment->request->headers != NULL) {
+        code = curl_easy_setopt(segment->request->curl, CURLOPT_HTTPHEADER, segment->request->headers);
+    }
+    if (code == CURLE_OK && job->ranged) {
+        snprintf(&range[0], sizeof(range), "%lld-%lld", segment->start + segment->done, segment->end);
+        code = curl_easy_setopt(segment->request->curl, CURLOPT_RANGE, &range[0]);
+    }
     if (code != CURLE_OK) {
-        VLOG_ERROR("chef-client", "__download_file: chef_request_execute() failed: %s\n", request->error);
-        goto cleanup;
+        VLOG_ERROR("chef-client", "__segment_start: failed to configure request [%s]\n", segment->request->error);
+        goto error;
     }
-    
-    curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &httpCode);
-    if (httpCode < 200 || httpCode >= 300) {
-        VLOG_ERROR("chef-client", "__download_file: http error %ld\n", httpCode);
-        status = -1;
+
+    if (curl_multi_add_handle(multi, segment->request->curl) != CURLM_OK) {
+        VLOG_ERROR("chef-client", "__segment_start: failed to add request\n");
+        goto error;
     }
+    job->active++;
+    return 0;
 
-    status = 0;
+error:
+    chef_request_delete(segment->request);
+    segment->request = NULL;
+    return -1;
+}
 
-cleanup:
-    if (file) {
-        fclose(file);
+static void __segment_stop(struct __download_segment* segment, CURLM* multi)
+{
+    if (segment->request == NULL) {
+        return;
     }
-    chef_request_delete(request);
+    curl_multi_remove_handle(multi, segment->request->curl);
+    chef_request_delete(segment->request);
+    segment->request = NULL;
+    segment->job->active--;
+}
+
+static void __download_job_abort(struct __download_job* job, CURLM* multi)
+{
+    job->failed = 1;
+    for (int i = 0; i < job->segment_count; i++) {
+        __segment_stop(&job->segments[i], multi);
+    }
+}
+
+static void __segment_done(struct __download_segment* segment, CURLM* multi, CURLcode code)
+{
+    struct __download_job* job = segment->job;
+    long long              length = __segment_length(segment);
+
+    __segment_stop(segment, multi);
+    if (code == CURLE_OK && (length < 0 || segment->done == length)) {
+        segment->complete = 1;
+        if (length < 0) {
+            // the size was unknown, now we know
+            segment->end = segment->done - 1;
+            job->size = segment->done;
+        }
+        return;
+    }
+
+    if (code == CURLE_OK) {
+        VLOG_WARNING("chef-client", "download of %s/%s ended early (%lld of %lld bytes)\n",
+            job->context.publisher, job->context.package, segment->done, length);
+    } else {
+        VLOG_WARNING("chef-client", "download of %s/%s failed: %s\n",
+            job->context.publisher, job->context.package, curl_easy_strerror(code));
+    }
+
+    if (segment->retries++ >= __DOWNLOAD_SEGMENT_RETRIES) {
+        VLOG_ERROR("chef-client", "giving up on %s/%s after %i retries\n",
+            job->context.publisher, job->context.package, __DOWNLOAD_SEGMENT_RETRIES);
+        __download_job_abort(job, multi);
+        return;
+    }
+
+    // A single stream cannot continue from the middle of the file
+    if (!job->ranged) {
+        segment->done = 0;
+        if (__download_job_reset_hash(job)) {
+            __download_job_abort(job, multi);
+            return;
+        }
+    }
+
+    if (__segment_start(segment, multi)) {
+        __download_job_abort(job, multi);
+    }
+}
+
+static void __download_job_report(struct __download_job* job)
+{
+    long long done = 0;
+
+    if (job->context.observer == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < job->segment_count; i++) {
+        done += job->segments[i].done;
+    }
+    job->context.observer->report(done, job->size < 0 ? 0 : job->size, job->context.observer->userData);
+}
+
+static int __download_job_start(struct __download_job* job, CURLM* multi)
+{
+    int resumed = 0;
+
+    job->fd = -1;
+    job->state = __DOWNLOAD_JOB_RUNNING;
+    if (job->url[0] == '\0') {
+        return -1;
+    }
+
+    job->progress_path = malloc(strlen(job->path) + 10);
+    if (job->progress_path == NULL) {
+        return -1;
+    }
+    sprintf(job->progress_path, "%s.progress", job->path);
+
+    job->hash = EVP_MD_CTX_new();
+    if (job->hash == NULL || __download_job_reset_hash(job)) {
+        return -1;
+    }
+
+    job->fd = __file_open(job->path, 0);
+    if (job->fd < 0) {
+        VLOG_ERROR("chef-client", "__download_job_start: failed to open file [%s]\n", strerror(errno));
+        return -1;
+    }
+
+    if (job->ranged && __download_job_load_progress(job) == 0) {
+        resumed = 1;
+        VLOG_DEBUG("chef-client", "__download_job_start: resuming download of %s/%s\n",
+            job->context.publisher, job->context.package);
+    } else {
+        // start over, discarding whatever was in the file
+        __file_close(job->fd);
+        job->fd = __file_open(job->path, 1);
+        if (job->fd < 0) {
+            VLOG_ERROR("chef-client", "__download_job_start: failed to truncate file [%s]\n", strerror(errno));
+            return -1;
+        }
+        platform_unlink(job->progress_path);
+        __download_job_plan(job);
+    }
+
+    // catch up the hash with data from a previous attempt
+    if (resumed && __download_job_advance_hash(job)) {
+        return -1;
+    }
+
+    for (int i = 0; i < job->segment_count; i++) {
+        if (job->segments[i].complete) {
+            continue;
+        }
+        if (__segment_start(&job->segments[i], multi)) {
+            __download_job_abort(job, multi);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void __download_job_finish(struct __download_job* job)
+{
+    unsigned int digestLength = 0;
+
+    job->state = __DOWNLOAD_JOB_DONE;
+    job->status = -1;
+
+    for (int i = 0; !job->failed && i < job->segment_count; i++) {
+        if (!job->segments[i].complete) {
+            job->failed = 1;
+        }
+    }
+
+    if (!job->failed && job->fd >= 0) {
+        if (__download_job_advance_hash(job) == 0 && job->hashed == job->size &&
+            EVP_DigestFinal_ex(job->hash, &job->digest[0], &digestLength) == 1 &&
+            digestLength == CHEF_DOWNLOAD_SHA512_SIZE) {
+            job->status = 0;
+        } else {
+            VLOG_ERROR("chef-client", "__download_job_finish: failed to calculate SHA512 of %s\n", job->path);
+            job->permanent = 1;
+        }
+    }
+
+    if (job->status == 0) {
+        __download_job_report(job);
+        if (job->progress_path != NULL) {
+            platform_unlink(job->progress_path);
+        }
+    } else if (job->fd >= 0) {
+        // keep what we have so the next attempt can resume
+        __download_job_save_progress(job);
+    }
+
+    if (job->fd >= 0) {
+        __file_close(job->fd);
+        job->fd = -1;
+    }
+    EVP_MD_CTX_free(job->hash);
+    job->hash = NULL;
+    free(job->progress_path);
+    job->progress_path = NULL;
+}
+
+// Runs the downloads on a single multi handle, with at most maxConcurrent packages
+// in flight. Connections are kept by the multi handle, and reused between segments
+// and packages. The completed callback is invoked as each package finishes.
+static int __run_downloads(
+    struct __download_job*  jobs,
+    int                     count,
+    int                     maxConcurrent,
+    __download_completed_fn completed,
+    void*                   context)
+{
+    CURLM* multi;
+    int    next = 0;
+    int    running = 0;
+    int    status = 0;
+
+    multi = curl_multi_init();
+    if (multi == NULL) {
+        return -1;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)(maxConcurrent * __DOWNLOAD_MAX_SEGMENTS));
+
+    __download_jobs_probe(jobs, count, multi);
+
+    while (next < count || running > 0) {
+        CURLMsg*  msg;
+        CURLMcode mcode;
+        int       stillRunning;
+        int       queued;
+
+        while (running < maxConcurrent && next < count) {
+            struct __download_job* job = &jobs[next++];
+            if (__download_job_start(job, multi)) {
+                // the local setup failed, retrying will not change that
+                job->permanent = 1;
+            }
+            if (job->permanent || job->active == 0) {
+                // either failed to start, or was already completed by a previous attempt
+                __download_job_finish(job);
+                if (completed != NULL) {
+                    completed(job, context);
+                }
+                continue;
+            }
+            running++;
+        }
+
+        if (running == 0) {
+            continue;
+        }
+
+        mcode = curl_multi_perform(multi, &stillRunning);
+        if (mcode != CURLM_OK) {
+            VLOG_ERROR("chef-client", "__run_downloads: curl_multi_perform() failed: %s\n", curl_multi_strerror(mcode));
+            status = -1;
+            break;
+        }
+
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            struct __download_segment* segment = NULL;
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&segment);
+            __segment_done(segment, multi, msg->data.result);
+            if (segment->job->active == 0) {
+                __download_job_finish(segment->job);
+                running--;
+                if (completed != NULL) {
+                    completed(segment->job, context);
+                }
+            }
+        }
+
+        for (int i = 0; i < next; i++) {
+            if (jobs[i].state != __DOWNLOAD_JOB_RUNNING) {
+                continue;
+            }
+            if (__download_job_advance_hash(&jobs[i])) {
+                jobs[i].permanent = 1;
+                __download_job_abort(&jobs[i], multi);
+                continue;
+            }
+            if (jobs[i].unsynced >= __DOWNLOAD_SYNC_INTERVAL) {
+                __download_job_save_progress(&jobs[i]);
+            }
+            __download_job_report(&jobs[i]);
+        }
+
+        // jobs aborted above have no active segments left
+        for (int i = 0; i < next; i++) {
+            if (jobs[i].state == __DOWNLOAD_JOB_RUNNING && jobs[i].active == 0) {
+                __download_job_finish(&jobs[i]);
+                running--;
+                if (completed != NULL) {
+                    completed(&jobs[i], context);
+                }
+            }
+        }
+
+        if (running > 0) {
+            mcode = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            if (mcode != CURLM_OK) {
+                VLOG_ERROR("chef-client", "__run_downloads: curl_multi_poll() failed: %s\n", curl_multi_strerror(mcode));
+                status = -1;
+                break;
+            }
+        }
+    }
+
+    // clean up anything left over from an aborted run
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].state == __DOWNLOAD_JOB_RUNNING) {
+            __download_job_abort(&jobs[i], multi);
+            __download_job_finish(&jobs[i]);
+            if (completed != NULL) {
+                completed(&jobs[i], context);
+            }
+        }
+    }
+
+    curl_multi_cleanup(multi);
     return status;
 }
 
+static int __download_file(const char* filePath, struct download_context* context, unsigned char* digest)
+{
+    struct __download_job job = { 0 };
+
+    job.context = *context;
+    job.path    = filePath;
+    if (__run_downloads(&job, 1, 1, NULL, NULL) != 0 || job.status != 0) {
+        errno = EIO;
+        return -1;
+    }
+    memcpy(digest, &job.digest[0], CHEF_DOWNLOAD_SHA512_SIZE);
+    return 0;
+}
+
 int chefclient_pack_download(struct chef_download_params* params, const char* path)
 {
     struct download_context downloadContext = { 0 };
@@ -241,6 +1071,7 @@ int chefclient_pack_download(struct chef_download_params* params, const char* pa
     VLOG_TRACE("chef-client", "download(name=%s/%s, revision=%i)\n",
         params->publisher, params->package, params->revision);
 
+    params->sha512_valid = 0;
     if (params->revision == 0) {
         VLOG_DEBUG("chef-client", "download: resolving latest revision for %s\n", params->package);
         status = __resolve_revision(params, &revision);
@@ -260,12 +1091,276 @@ int chefclient_pack_download(struct chef_download_params* params, const char* pa
     downloadContext.observer  = params->observer;
 
     // start download
-    status = __download_file(path, &downloadContext);
+    status = __download_file(path, &downloadContext, &params->sha512[0]);
     if (status != 0) {
         VLOG_ERROR("chef-client", "chefclient_pack_download: failed to download package [%s]\n", strerror(errno));
         return status;
     }
 
     params->revision = revision;
+    params->sha512_valid = 1;
+    return status;
+}
+
+struct __batch_transfer {
+    struct chef_download_batch_item* item;
+    struct chef_request*             request;
+};
+
+struct __batch_state {
+    chef_download_completed_fn completed;
+    void*                      context;
+};
+
+typedef int  (*__transfer_prepare_fn)(struct __batch_transfer* transfer);
+typedef void (*__transfer_done_fn)(struct __batch_transfer* transfer, CURLcode code, struct __batch_state* state);
+
+static int __prepare_revision_transfer(struct __batch_transfer* transfer)
+{
+    char     buffer[1024];
+    CURLcode code;
+
+    transfer->request = chef_request_new(CHEF_CLIENT_API_SECURE, 0);
+    if (transfer->request == NULL) {
+        VLOG_ERROR("chef-client", "__prepare_revision_transfer: failed to create request\n");
+        return -1;
+    }
+
+    if (__get_revision_url(&transfer->item->params, buffer, sizeof(buffer)) != 0) {
+        VLOG_ERROR("chef-client", "__prepare_revision_transfer: buffer too small for package revision link\n");
+        return -1;
+    }
+
+    code = curl_easy_setopt(transfer->request->curl, CURLOPT_URL, &buffer[0]);
+    if (code != CURLE_OK) {
+        VLOG_ERROR("chef-client", "__prepare_revision_transfer: failed to set url [%s]\n", transfer->request->error);
+        return -1;
+    }
+    return 0;
+}
+
+static void __revision_transfer_done(struct __batch_transfer* transfer, CURLcode code, struct __batch_state* state)
+{
+    long httpCode = 0;
+    (void)state;
+
+    transfer->item->status = -1;
+    transfer->item->transient = 0;
+    if (transfer->request == NULL) {
+        return;
+    }
+
+    if (code == CURLE_OK) {
+        curl_easy_getinfo(transfer->request->curl, CURLINFO_RESPONSE_CODE, &httpCode);
+        if (httpCode == 200) {
+            transfer->item->status = __parse_revision_response(transfer->request->response, &transfer->item->params.revision);
+        } else {
+            VLOG_ERROR("chef-client", "failed to resolve revision of %s/%s: http error %ld\n",
+                transfer->item->params.publisher, transfer->item->params.package, httpCode);
+            transfer->item->transient = __http_is_transient(httpCode);
+        }
+    } else {
+        VLOG_ERROR("chef-client", "failed to resolve revision of %s/%s: %s\n",
+            transfer->item->params.publisher, transfer->item->params.package, curl_easy_strerror(code));
+        transfer->item->transient = code != CURLE_FAILED_INIT;
+    }
+
+    chef_request_delete(transfer->request);
+    transfer->request = NULL;
+}
+
+// Runs the transfers on the multi handle, keeping at most maxConcurrent transfers
+// in flight. Connections are kept by the multi handle, and reused between transfers
+// to the same host.
+static int __run_transfers(
+    CURLM*                   multi,
+    struct __batch_transfer* transfers,
+    int                      count,
+    int                      maxConcurrent,
+    __transfer_prepare_fn    prepare,
+    __transfer_done_fn       done,
+    struct __batch_state*    state)
+{
+    int next = 0;
+    int active = 0;
+
+    while (next < count || active > 0) {
+        CURLMsg*  msg;
+        CURLMcode mcode;
+        int       running;
+        int       queued;
+
+        while (active < maxConcurrent && next < count) {
+            struct __batch_transfer* transfer = &transfers[next++];
+
+            if (prepare(transfer)) {
+                done(transfer, CURLE_FAILED_INIT, state);
+                continue;
+            }
+
+            curl_easy_setopt(transfer->request->curl, CURLOPT_PRIVATE, transfer);
+            if (transfer->request->headers != NULL) {
+                curl_easy_setopt(transfer->request->curl, CURLOPT_HTTPHEADER, transfer->request->headers);
+            }
+
+            if (curl_multi_add_handle(multi, transfer->request->curl) != CURLM_OK) {
+                done(transfer, CURLE_FAILED_INIT, state);
+                continue;
+            }
+            active++;
+        }
+
+        mcode = curl_multi_perform(multi, &running);
+        if (mcode != CURLM_OK) {
+            VLOG_ERROR("chef-client", "__run_transfers: curl_multi_perform() failed: %s\n", curl_multi_strerror(mcode));
+            return -1;
+        }
+
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            struct __batch_transfer* transfer = NULL;
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&transfer);
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            active--;
+            done(transfer, msg->data.result, state);
+        }
+
+        if (active > 0) {
+            mcode = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            if (mcode != CURLM_OK) {
+                VLOG_ERROR("chef-client", "__run_transfers: curl_multi_poll() failed: %s\n", curl_multi_strerror(mcode));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int __resolve_revisions(struct chef_download_batch_item* items, int count, int maxConcurrent)
+{
+    struct __batch_state     state = { 0 };
+    struct __batch_transfer* transfers;
+    int                      transferCount = 0;
+    CURLM*                   multi;
+    int                      status;
+
+    transfers = calloc(count, sizeof(struct __batch_transfer));
+    if (transfers == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (items[i].params.revision == 0) {
+            transfers[transferCount++].item = &items[i];
+        }
+    }
+
+    if (transferCount == 0) {
+        free(transfers);
+        return 0;
+    }
+
+    multi = curl_multi_init();
+    if (multi == NULL) {
+        free(transfers);
+        return -1;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxConcurrent);
+
+    status = __run_transfers(multi, transfers, transferCount, maxConcurrent,
+        __prepare_revision_transfer, __revision_transfer_done, &state);
+
+    // clean up anything left over from an aborted run
+    for (int i = 0; i < transferCount; i++) {
+        if (transfers[i].request != NULL) {
+            curl_multi_remove_handle(multi, transfers[i].request->curl);
+            chef_request_delete(transfers[i].request);
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    free(transfers);
+    return status;
+}
+
+static void __batch_download_completed(struct __download_job* job, void* context)
+{
+    struct __batch_state*            state = context;
+    struct chef_download_batch_item* item = job->user_data;
+
+    item->status = job->status;
+    item->transient = job->status != 0 && !job->permanent;
+    if (job->status == 0) {
+        memcpy(&item->params.sha512[0], &job->digest[0], CHEF_DOWNLOAD_SHA512_SIZE);
+        item->params.sha512_valid = 1;
+    } else {
+        VLOG_ERROR("chef-client", "failed to download %s/%s\n", item->params.publisher, item->params.package);
+    }
+
+    if (state->completed != NULL) {
+        state->completed(item, state->context);
+    }
+}
+
+int chefclient_pack_download_batch(
+    struct chef_download_batch_item* items,
+    int                              count,
+    int                              maxConcurrent,
+    chef_download_completed_fn       completed,
+    void*                            context)
+{
+    struct __batch_state   state = { .completed = completed, .context = context };
+    struct __download_job* jobs;
+    int                    jobCount = 0;
+    int                    status;
+    VLOG_DEBUG("chef-client", "chefclient_pack_download_batch(count=%i, concurrency=%i)\n", count, maxConcurrent);
+
+    if (items == NULL || count <= 0 || maxConcurrent <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    jobs = calloc(count, sizeof(struct __download_job));
+    if (jobs == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        items[i].status = 0;
+        items[i].transient = 0;
+        items[i].params.sha512_valid = 0;
+    }
+
+    // resolve all revisions first, then download everything
+    status = __resolve_revisions(items, count, maxConcurrent);
+    if (status) {
+        free(jobs);
+        return status;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (items[i].status != 0) {
+            if (completed != NULL) {
+                completed(&items[i], context);
+            }
+            continue;
+        }
+
+        jobs[jobCount].context.publisher = items[i].params.publisher;
+        jobs[jobCount].context.package   = items[i].params.package;
+        jobs[jobCount].context.revision  = items[i].params.revision;
+        jobs[jobCount].context.observer  = items[i].params.observer;
+        jobs[jobCount].path              = items[i].path;
+        jobs[jobCount].user_data         = &items[i];
+        jobCount++;
+    }
+
+    if (jobCount > 0) {
+        status = __run_downloads(jobs, jobCount, maxConcurrent, __batch_download_completed, &state);
+    }
+    free(jobs);
     return status;
 }
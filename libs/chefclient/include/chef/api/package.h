@@ -23,6 +23,8 @@
 #include <chef/observer.h>
 #include <stdio.h>
 
+#define CHEF_DOWNLOAD_SHA512_SIZE 64
+
 /**
  * @brief Parameters for retrieving package information.
  */
@@ -65,8 +67,25 @@ struct chef_download_params {
 
     // this will be updated to the revision downloaded if 0
     int                   revision;     /**< The specific revision to download. If 0, downloads the latest and updates this field */
+
+    // the package is hashed while it is being downloaded
+    unsigned char         sha512[CHEF_DOWNLOAD_SHA512_SIZE]; /**< SHA-512 of the downloaded package */
+    int                   sha512_valid; /**< Set if sha512 was calculated by the download */
 };
 
+/**
+ * @brief A single package download in a batch of downloads.
+ */
+struct chef_download_batch_item {
+    struct chef_download_params params; /**< The package to download, revision is updated if 0 */
+    const char*                 path;   /**< The local file path where the package should be saved */
+    int                         status; /**< The result of the download, 0 on success */
+    int                         transient; /**< Set on failure if retrying the download may succeed */
+    void*                       user_data;
+};
+
+typedef void (*chef_download_completed_fn)(struct chef_download_batch_item* item, void* context);
+
 /**
  * @brief Parameters for retrieving package proof/verification.
  */
@@ -95,12 +114,38 @@ struct chef_find_result {
  * If the revision is set to 0, it will download the latest available revision and update
  * the revision field in the params structure.
  * 
+ * Large packages are downloaded as parallel byte ranges if the server supports it, and
+ * progress is kept in '<path>.progress' so an interrupted download resumes on the next
+ * call with the same path. The SHA-512 of the package is calculated while downloading.
+ * 
  * @param[In]  params A pointer to the download parameters specifying which package to download
  * @param[In]  path   The local file path where the downloaded package should be saved
  * @return int        Returns 0 on success, -1 on error. Errno will be set accordingly.
  */
 extern int chefclient_pack_download(struct chef_download_params* params, const char* path);
 
+/**
+ * @brief Downloads multiple packages concurrently over a shared connection pool.
+ * 
+ * All revisions that are not specified are resolved first, after which the packages
+ * are downloaded with at most maxConcurrent downloads in flight. The completed callback
+ * is invoked for each item as soon as its download has finished (or failed), and before
+ * this function returns.
+ * 
+ * @param[In] items         The packages to download
+ * @param[In] count         The number of items
+ * @param[In] maxConcurrent The maximum number of concurrent transfers
+ * @param[In] completed     Optional callback invoked for each finished item
+ * @param[In] context       Context passed to the completed callback
+ * @return int              Returns 0 if the batch ran, -1 on error. Consult the status of each item.
+ */
+extern int chefclient_pack_download_batch(
+    struct chef_download_batch_item* items,
+    int                              count,
+    int                              maxConcurrent,
+    chef_download_completed_fn       completed,
+    void*                            context);
+
 /**
  * @brief Retrieves cryptographic proof/verification data for a package revision.
  * 
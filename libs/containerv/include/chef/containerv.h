@@ -270,6 +270,63 @@ extern void containerv_options_set_cgroup_limits(
     const char*                pids_max
 );
 
+/**
+ * @brief Configure the memory.high threshold of the container cgroup, above which the
+ * container is throttled and reclaimed from instead of being killed.
+ * @param options The container options to configure
+ * @param memory_high Threshold (e.g., "768M"), or NULL to leave it unset
+ */
+extern void containerv_options_set_memory_high(
+    struct containerv_options* options,
+    const char*                memory_high
+);
+
+/**
+ * @brief Configure CPU bandwidth and placement of the container. Requires the cgroup limits
+ * to be enabled with CV_CAP_CGROUPS.
+ * @param options The container options to configure
+ * @param cpu_max Bandwidth as "<quota> <period>" in microseconds (e.g., "200000 100000" for
+ *                two CPUs), or NULL to leave it unset
+ * @param cpuset_cpus The CPUs the container may run on (e.g., "0-3,8"), or NULL for all
+ * @param cpuset_mems The NUMA nodes the container may allocate memory from (e.g., "0"), or NULL for all
+ */
+extern void containerv_options_set_cpu_limits(
+    struct containerv_options* options,
+    const char*                cpu_max,
+    const char*                cpuset_cpus,
+    const char*                cpuset_mems
+);
+
+/**
+ * @brief Configure the I/O weight and limits of the container.
+ * @param options The container options to configure
+ * @param io_weight Weight (1-10000, default 100) for all devices, or "<major>:<minor> <weight>"
+ *                  for a single device, or NULL to leave it unset
+ * @param io_max Limits in the format of io.max (e.g., "8:0 rbps=1048576 wiops=120"), or NULL
+ */
+extern void containerv_options_set_io_limits(
+    struct containerv_options* options,
+    const char*                io_weight,
+    const char*                io_max
+);
+
+/**
+ * @brief Start an exec helper in the container, which runs commands for containerv_exec
+ * without the caller having to join the container namespaces first.
+ * @param options The container options to configure
+ * @param enable Non-zero to start the helper
+ */
+extern void containerv_options_set_exec_helper(struct containerv_options* options, int enable);
+
+/**
+ * @brief Leave reading the stdout and stderr of the container to the caller, instead of
+ * containerv reading them on a thread per container. The pipes are retrieved with
+ * containerv_output_fds once the container has been created.
+ * @param options The container options to configure
+ * @param enable Non-zero to read the output externally
+ */
+extern void containerv_options_set_external_output(struct containerv_options* options, int enable);
+
 #endif
 
 /**
@@ -380,6 +437,140 @@ extern int containerv_join(
     const char*                     commandPath,
     struct containerv_join_options* options);
 
+#if defined(__linux__)
+/**
+ * @brief Execute a command in a container through its exec helper, and wait for it to exit.
+ *
+ * The command is forked by the helper that runs inside the container, and is passed the
+ * stdin, stdout and stderr of the caller. Signals like SIGINT that are received while
+ * waiting are forwarded to the command.
+ *
+ * @param containerId The unique identifier of the container.
+ * @param commandPath Path to the executable inside the container.
+ * @param options The same options as for containerv_join, `cwd` may be NULL.
+ * @param exitCodeOut Receives the exit code of the command, or 128 + the signal that killed it.
+ * @return 0 on success, -1 on error. Errno is set to ENOTSUP if the container has no exec
+ * helper, in which case containerv_join can be used instead.
+ */
+extern int containerv_exec(
+    const char*                     containerId,
+    const char*                     commandPath,
+    struct containerv_join_options* options,
+    int*                            exitCodeOut);
+
+/**
+ * @brief The phases of containerv_create that are timed. Phases that are not
+ * relevant for the container configuration are reported as 0.
+ */
+enum containerv_create_phase {
+    CV_CREATE_PHASE_PREPARE,     // runtime directory, pipes and the cgroup
+    CV_CREATE_PHASE_SPAWN,       // forking the container process
+    CV_CREATE_PHASE_NAMESPACES,  // unshare, user namespace maps and hostname
+    CV_CREATE_PHASE_CGROUPS,     // moving the container into its cgroup
+    CV_CREATE_PHASE_ROOTFS,      // layer mounts and changing root
+    CV_CREATE_PHASE_MOUNTS,      // standard filesystems and /dev
+    CV_CREATE_PHASE_NETWORK,     // veth setup and interfaces
+    CV_CREATE_PHASE_POLICY,      // waiting for the BPF policy to be populated
+    CV_CREATE_PHASE_FINALIZE,    // capabilities, init, seccomp and exec helper
+
+    CV_CREATE_PHASE_COUNT
+};
+
+/**
+ * @brief Time spent in containerv_create, in microseconds.
+ */
+struct containerv_create_timing {
+    uint64_t phases_us[CV_CREATE_PHASE_COUNT];
+    uint64_t total_us;
+};
+
+/**
+ * @brief Retrieve how long the container took to start, broken down per phase.
+ * @param container The container to query.
+ * @param timing Receives the timing recorded during containerv_create.
+ * @return 0 on success, -1 on error.
+ */
+extern int containerv_get_create_timing(struct containerv_container* container, struct containerv_create_timing* timing);
+
+/**
+ * @brief Returns a short name for the given phase, e.g. "mounts".
+ */
+extern const char* containerv_create_phase_name(enum containerv_create_phase phase);
+
+/**
+ * @brief Start keeping a pool of network namespaces that are prepared ahead of time, each
+ * with loopback up and a veth pair attached to the host. Containers created with CV_CAP_NETWORK
+ * adopt a namespace from the pool instead of setting one up during containerv_create, and the
+ * pool is refilled in the background. When the pool is empty containers fall back to setting
+ * up their network themselves.
+ * @param size The number of namespaces to keep prepared, 0 leaves the pool disabled.
+ * @return 0 on success, -1 on error.
+ */
+extern int containerv_network_pool_start(int size);
+
+/**
+ * @brief Stop refilling the network pool and destroy the namespaces that were not adopted.
+ */
+extern void containerv_network_pool_stop(void);
+
+/**
+ * @brief The resource events that can be watched for a container instead of polling its stats.
+ */
+enum containerv_watch_type {
+    CV_WATCH_MEMORY_EVENTS,      // any of the memory.events counters changed
+    CV_WATCH_PRESSURE_CPU,       // PSI trigger on cpu.pressure
+    CV_WATCH_PRESSURE_MEMORY,    // PSI trigger on memory.pressure
+    CV_WATCH_PRESSURE_IO         // PSI trigger on io.pressure
+};
+
+/**
+ * @brief Counters from the memory.events file of a container cgroup.
+ */
+struct containerv_memory_events {
+    uint64_t low;       // times memory was reclaimed while below memory.low
+    uint64_t high;      // times memory went above memory.high and was throttled
+    uint64_t max;       // times memory was about to go above memory.max
+    uint64_t oom;       // times the memory limit was hit and allocations failed
+    uint64_t oom_kill;  // processes killed by the OOM killer
+};
+
+/**
+ * @brief Open a file descriptor that signals POLLPRI when the watched event occurs, it
+ * can be added to poll or epoll together with the watches of other containers.
+ *
+ * For CV_WATCH_MEMORY_EVENTS the descriptor is signalled whenever a memory.events counter
+ * changes, and stays signalled until the counters are read with containerv_read_memory_events.
+ * For the pressure watches a PSI trigger is registered, and the descriptor is signalled once
+ * some tasks in the container have been stalled for more than stallUs within windowUs.
+ *
+ * @param container The container to watch, it must have been created with CV_CAP_CGROUPS.
+ * @param type What to watch.
+ * @param stallUs The stall threshold for pressure watches, in microseconds.
+ * @param windowUs The window for pressure watches, in microseconds (500ms to 10s).
+ * @return The file descriptor, which is owned by the caller, or -1 on error.
+ */
+extern int containerv_watch_open(
+    struct containerv_container* container,
+    enum containerv_watch_type   type,
+    uint32_t                     stallUs,
+    uint32_t                     windowUs);
+
+/**
+ * @brief Read the memory.events counters through a descriptor from containerv_watch_open.
+ * @return 0 on success, -1 on error.
+ */
+extern int containerv_read_memory_events(int fd, struct containerv_memory_events* events);
+
+/**
+ * @brief Retrieve the read ends of the stdout and stderr pipes of a container that was
+ * created with containerv_options_set_external_output. The descriptors are non-blocking and
+ * stay owned by the container, they must be removed from any poll set before the container
+ * is destroyed.
+ * @return 0 on success, -1 on error. Errno is set to ENOTSUP if the output is read by containerv.
+ */
+extern int containerv_output_fds(struct containerv_container* container, int* stdoutFd, int* stderrFd);
+#endif
+
 /**
  * @brief Returns the container ID of the given container.
  * @param container The container to get the ID from.
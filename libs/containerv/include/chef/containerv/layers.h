@@ -140,6 +140,19 @@ extern const char* containerv_layers_get_rootfs(
     struct containerv_layer_context* context
 );
 
+/**
+ * @brief Get the writable (upper) directory of the layer context
+ * 
+ * Only layer contexts composed with an OVERLAY layer have a writable
+ * directory. All changes made inside the container end up here.
+ * 
+ * @param context Layer context
+ * @return Path to the upper directory, or NULL if the context is read-only
+ */
+extern const char* containerv_layers_get_upperdir(
+    struct containerv_layer_context* context
+);
+
 /**
  * @brief Clean up and destroy layer context
  * 
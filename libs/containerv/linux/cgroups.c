@@ -32,37 +32,74 @@
 #define CGROUPS_DEFAULT_CPU_WEIGHT "100"
 #define CGROUPS_DEFAULT_PIDS_MAX "256"
 #define CGROUPS_CGROUP_PROCS "cgroup.procs"
-enum { CGROUPS_CONTROL_FIELD_SIZE = 256 };
+#define CGROUPS_ROOT "/sys/fs/cgroup"
 
 // This struct is used to store cgroups settings.
 struct cgroups_setting {
-  char name[CGROUPS_CONTROL_FIELD_SIZE];
-  char value[CGROUPS_CONTROL_FIELD_SIZE];
+  const char* name;
+  const char* value;
 };
 
+// Settings are opened relative to the cgroup directory, which spares a full
+// path lookup per setting.
+static int __write_setting(int cgroup_fd, const char* name, const char* value) {
+  int fd;
+
+  VLOG_TRACE("containerv", "cgroups: setting %s to %s...\n", name, value);
+  if ((fd = openat(cgroup_fd, name, O_WRONLY | O_CLOEXEC)) == -1) {
+    VLOG_ERROR("containerv", "cgroups: failed to open %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+
+  if (write(fd, value, strlen(value)) == -1) {
+    VLOG_ERROR("containerv", "cgroups: failed to write %s: %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if (close(fd)) {
+    VLOG_ERROR("containerv", "cgroups: failed to close %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// The cpuset and io controllers are not enabled for child cgroups on most
+// systems, so they are enabled in the root before a setting that needs them
+// is written. This is best effort, if it fails the write of the setting itself
+// reports the problem.
+static void __enable_controller(const char* controller) {
+  char value[32];
+  int  fd;
+
+  fd = open(CGROUPS_ROOT "/cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    VLOG_WARNING("containerv", "cgroups: failed to open subtree_control: %s\n", strerror(errno));
+    return;
+  }
+
+  snprintf(value, sizeof(value), "+%s", controller);
+  if (write(fd, value, strlen(value)) == -1) {
+    VLOG_WARNING("containerv", "cgroups: failed to enable controller %s: %s\n", controller, strerror(errno));
+  }
+  close(fd);
+}
+
 // cgroups settings are written to the cgroups v2 filesystem as follows:
 // - create a directory for the new cgroup
 // - settings files are created automatically
 // - write the settings to the corresponding files
-int cgroups_init(const char* hostname, pid_t pid, const struct containerv_cgroup_limits* limits) {
+// This is done before the container process exists, so the process can be
+// moved into a fully configured cgroup before it creates its namespaces.
+int cgroups_prepare(const char* hostname, const struct containerv_cgroup_limits* limits) {
   char cgroup_dir[PATH_MAX] = {0};
+  int  cgroup_fd;
 
   // Use provided limits or defaults
   const char* memory_max = limits && limits->memory_max ? limits->memory_max : CGROUPS_DEFAULT_MEMORY_MAX;
   const char* cpu_weight = limits && limits->cpu_weight ? limits->cpu_weight : CGROUPS_DEFAULT_CPU_WEIGHT;
   const char* pids_max = limits && limits->pids_max ? limits->pids_max : CGROUPS_DEFAULT_PIDS_MAX;
 
-  // The "cgroup.procs" setting is used to add a process to a cgroup.
-  // It is prepared here with the pid of the calling process, so that it can be
-  // added to the cgroup later.
-  struct cgroups_setting *procs_setting =
-      &(struct cgroups_setting){.name = CGROUPS_CGROUP_PROCS, .value = ""};
-  ;
-  if (snprintf(procs_setting->value, CGROUPS_CONTROL_FIELD_SIZE, "%d", pid) ==
-      -1) {
-    VLOG_ERROR("containerv", "cgroups_init: failed to setup cgroup.procs setting: %s\n", strerror(errno));
-    return -1;
-  }
   // Cgroups let us limit resources allocated to a process to prevent it from
   // denying services to the rest of the system. The cgroups must be created
   // before the process enters a cgroups namespace. The following settings are
@@ -70,76 +107,78 @@ int cgroups_init(const char* hostname, pid_t pid, const struct containerv_cgroup
   // - memory.max: process memory limit (default 1GB)
   // - cpu.weight: CPU time weight (1-10000, default 100)
   // - pids.max: max number of processes (default 256)
-  // - cgroup.procs: the calling process is added to the cgroup
-  struct cgroups_setting *cgroups_setting_list[] = {
-      &(struct cgroups_setting){.name = "memory.max",
-                                .value = ""},
-      &(struct cgroups_setting){.name = "cpu.weight",
-                                .value = ""},
-      &(struct cgroups_setting){.name = "pids.max", .value = ""},
-      procs_setting, NULL};
-
-  // Copy the limit values and ensure null termination
-  strncpy(cgroups_setting_list[0]->value, memory_max, CGROUPS_CONTROL_FIELD_SIZE - 1);
-  cgroups_setting_list[0]->value[CGROUPS_CONTROL_FIELD_SIZE - 1] = '\0';
-  
-  strncpy(cgroups_setting_list[1]->value, cpu_weight, CGROUPS_CONTROL_FIELD_SIZE - 1);
-  cgroups_setting_list[1]->value[CGROUPS_CONTROL_FIELD_SIZE - 1] = '\0';
-  
-  strncpy(cgroups_setting_list[2]->value, pids_max, CGROUPS_CONTROL_FIELD_SIZE - 1);
-  cgroups_setting_list[2]->value[CGROUPS_CONTROL_FIELD_SIZE - 1] = '\0';
-
-  VLOG_DEBUG("containerv", "cgroups_init: setting cgroups for %s...\n", hostname);
+  // The remaining settings have no default and are skipped when not set:
+  // - memory.high: throttling threshold below memory.max
+  // - cpu.max: CPU bandwidth as "<quota> <period>"
+  // - cpuset.cpus/cpuset.mems: CPUs and NUMA nodes the container may use,
+  //   when left unset the cgroup uses the effective sets of its parent
+  // - io.weight/io.max: proportional and absolute I/O limits
+  const struct cgroups_setting cgroups_setting_list[] = {
+      {.name = "memory.max", .value = memory_max},
+      {.name = "memory.high", .value = limits ? limits->memory_high : NULL},
+      {.name = "cpu.weight", .value = cpu_weight},
+      {.name = "cpu.max", .value = limits ? limits->cpu_max : NULL},
+      {.name = "cpuset.cpus", .value = limits ? limits->cpuset_cpus : NULL},
+      {.name = "cpuset.mems", .value = limits ? limits->cpuset_mems : NULL},
+      {.name = "io.weight", .value = limits ? limits->io_weight : NULL},
+      {.name = "io.max", .value = limits ? limits->io_max : NULL},
+      {.name = "pids.max", .value = pids_max},
+      {.name = NULL, .value = NULL}};
+
+  VLOG_DEBUG("containerv", "cgroups_prepare: setting cgroups for %s...\n", hostname);
+
+  if (limits && (limits->cpuset_cpus || limits->cpuset_mems)) {
+    __enable_controller("cpuset");
+  }
+  if (limits && (limits->io_weight || limits->io_max)) {
+    __enable_controller("io");
+  }
 
   // Create the cgroup directory.
-  if (snprintf(cgroup_dir, sizeof(cgroup_dir), "/sys/fs/cgroup/%s", hostname) ==
+  if (snprintf(cgroup_dir, sizeof(cgroup_dir), CGROUPS_ROOT "/%s", hostname) ==
       -1) {
-    VLOG_ERROR("containerv", "cgroups_init: failed to setup path: %s\n", strerror(errno));
+    VLOG_ERROR("containerv", "cgroups_prepare: failed to setup path: %s\n", strerror(errno));
     return -1;
   }
 
-  VLOG_DEBUG("containerv", "cgroups_init: creating %s...\n", cgroup_dir);
+  VLOG_DEBUG("containerv", "cgroups_prepare: creating %s...\n", cgroup_dir);
   if (mkdir(cgroup_dir, S_IRUSR | S_IWUSR | S_IXUSR)) {
-    VLOG_ERROR("containerv", "cgroups_init: failed to mkdir %s: %s\n", cgroup_dir, strerror(errno));
+    VLOG_ERROR("containerv", "cgroups_prepare: failed to mkdir %s: %s\n", cgroup_dir, strerror(errno));
+    return -1;
+  }
+
+  cgroup_fd = open(cgroup_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cgroup_fd == -1) {
+    VLOG_ERROR("containerv", "cgroups_prepare: failed to open %s: %s\n", cgroup_dir, strerror(errno));
+    rmdir(cgroup_dir);
     return -1;
   }
 
   // Loop through and write settings to the corresponding files in the cgroup
   // directory.
-  for (struct cgroups_setting **setting = cgroups_setting_list; *setting;
-       setting++) {
-    char setting_dir[PATH_MAX] = {0};
-    int fd = 0;
-
-    VLOG_DEBUG("containerv", "cgroups_init: setting %s to %s...\n", (*setting)->name, (*setting)->value);
-    if (snprintf(setting_dir, sizeof(setting_dir), "%s/%s", cgroup_dir,
-                 (*setting)->name) == -1) {
-      VLOG_ERROR("containerv", "cgroups_init: failed to setup path: %s\n", strerror(errno));
-      return -1;
+  for (const struct cgroups_setting* setting = &cgroups_setting_list[0];
+       setting->name != NULL; setting++) {
+    if (setting->value == NULL || setting->value[0] == '\0') {
+      continue;
     }
-
-    VLOG_TRACE("containerv", "cgroups_init: opening %s...\n", setting_dir);
-    if ((fd = open(setting_dir, O_WRONLY)) == -1) {
-      VLOG_ERROR("containerv", "cgroups_init: failed to open %s: %s\n", setting_dir, strerror(errno));
+    if (__write_setting(cgroup_fd, setting->name, setting->value)) {
+      close(cgroup_fd);
+      rmdir(cgroup_dir);
       return -1;
     }
+  }
 
-    VLOG_TRACE("containerv", "cgroups_init: writing %s to setting\n", (*setting)->value);
-    if (write(fd, (*setting)->value, strlen((*setting)->value)) == -1) {
-      VLOG_ERROR("containerv", "cgroups_init: failed to write %s: %s\n", setting_dir, strerror(errno));
-      close(fd);
-      return -1;
-    }
+  VLOG_DEBUG("containerv", "cgroups_prepare: cgroups set successfully\n");
+  return cgroup_fd;
+}
 
-    VLOG_TRACE("containerv", "cgroups_init: closing %s...\n", setting_dir);
-    if (close(fd)) {
-      VLOG_ERROR("containerv", "cgroups_init: failed to close %s: %s\n", setting_dir, strerror(errno));
-      return -1;
-    }
-  }
+// The "cgroup.procs" setting is used to add a process to a cgroup, writing 0
+// adds the calling process.
+int cgroups_attach(int cgroup_fd, pid_t pid) {
+  char value[32];
 
-  VLOG_DEBUG("containerv", "cgroups_init: cgroups set successfully\n");
-  return 0;
+  snprintf(value, sizeof(value), "%d", pid);
+  return __write_setting(cgroup_fd, CGROUPS_CGROUP_PROCS, value);
 }
 
 // Clean up the cgroups for the process. Since we write the PID of the child
@@ -150,7 +189,7 @@ int cgroups_free(const char* hostname) {
 
   VLOG_DEBUG("containerv", "cgroups_free: freeing cgroups for %s...\n", hostname);
 
-  if (snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", hostname) == -1) {
+  if (snprintf(dir, sizeof(dir), CGROUPS_ROOT "/%s", hostname) == -1) {
     VLOG_ERROR("containerv", "cgroups_free: failed to setup paths: %s\n", strerror(errno));
     return -1;
   }
@@ -26,16 +26,32 @@ struct containerv_cgroup_limits {
     const char* cpu_weight;      // 1-10000, default is 100
     const char* pids_max;        // maximum number of processes, or "max"
     int         enable_devices;  // whether to enable device control
+
+    // Optional limits, these are only written when set
+    const char* memory_high;     // throttling threshold, e.g. "768M"
+    const char* cpu_max;         // "<quota> <period>" in microseconds, e.g. "200000 100000"
+    const char* cpuset_cpus;     // CPUs the container may run on, e.g. "0-3,8"
+    const char* cpuset_mems;     // NUMA nodes the container may allocate from, e.g. "0"
+    const char* io_weight;       // 1-10000, or "<major>:<minor> <weight>" for a device
+    const char* io_max;          // e.g. "8:0 rbps=1048576 wiops=120"
 };
 
 /**
- * @brief Initialize cgroups for a container process
+ * @brief Create the cgroup for a container and apply its resource limits. This is
+ * done before the container process is started, so it is born into a configured cgroup.
  * @param hostname The hostname/name for the cgroup
- * @param pid The process ID to add to the cgroup
  * @param limits The resource limits to apply, or NULL for defaults
+ * @return A descriptor for the cgroup directory on success, -1 on failure
+ */
+extern int cgroups_prepare(const char* hostname, const struct containerv_cgroup_limits* limits);
+
+/**
+ * @brief Move a process into a cgroup created by cgroups_prepare
+ * @param cgroupFd The descriptor returned by cgroups_prepare
+ * @param pid The process ID to add to the cgroup, or 0 for the calling process
  * @return 0 on success, -1 on failure
  */
-extern int cgroups_init(const char* hostname, pid_t pid, const struct containerv_cgroup_limits* limits);
+extern int cgroups_attach(int cgroupFd, pid_t pid);
 
 /**
  * @brief Clean up cgroups for a container
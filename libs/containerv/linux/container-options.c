@@ -78,6 +78,33 @@ void containerv_options_set_cgroup_limits(
     options->cgroup.pids_max = pids_max;
 }
 
+void containerv_options_set_memory_high(
+    struct containerv_options* options,
+    const char*                memory_high)
+{
+    options->cgroup.memory_high = memory_high;
+}
+
+void containerv_options_set_cpu_limits(
+    struct containerv_options* options,
+    const char*                cpu_max,
+    const char*                cpuset_cpus,
+    const char*                cpuset_mems)
+{
+    options->cgroup.cpu_max = cpu_max;
+    options->cgroup.cpuset_cpus = cpuset_cpus;
+    options->cgroup.cpuset_mems = cpuset_mems;
+}
+
+void containerv_options_set_io_limits(
+    struct containerv_options* options,
+    const char*                io_weight,
+    const char*                io_max)
+{
+    options->cgroup.io_weight = io_weight;
+    options->cgroup.io_max = io_max;
+}
+
 void containerv_options_set_network(
     struct containerv_options* options,
     const char*                container_ip,
@@ -116,3 +143,13 @@ void containerv_options_set_network_ex(
     options->network.gateway_ip = gateway_ip;
     options->network.dns = dns;
 }
+
+void containerv_options_set_exec_helper(struct containerv_options* options, int enable)
+{
+    options->exec_helper = enable;
+}
+
+void containerv_options_set_external_output(struct containerv_options* options, int enable)
+{
+    options->external_output = enable;
+}
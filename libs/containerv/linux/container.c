@@ -30,6 +30,7 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <time.h>
 
 // mount and pid stuff
 #include <sys/mount.h>
@@ -37,6 +38,7 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h> // makedev
+#include <sys/syscall.h>
 
 #include <unistd.h>
 #include <pid1_common.h>
@@ -54,6 +56,15 @@
 #define __CONTAINER_VETH_HOST_OFFSET 0    // Use full ID for host-side veth
 #define __CONTAINER_VETH_CONT_OFFSET 4    // Use partial ID for container-side veth
 
+// The new mount API (fsopen/fsconfig/fsmount/move_mount) has no glibc wrappers on
+// older systems, so the constants we need are defined here.
+#define __FSOPEN_CLOEXEC          0x00000001
+#define __FSCONFIG_SET_STRING     1
+#define __FSCONFIG_CMD_CREATE     6
+#define __FSMOUNT_CLOEXEC         0x00000001
+#define __MOUNT_ATTR_RDONLY       0x00000001
+#define __MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+
 struct __child_mount {
     const char*                 what;
     const char*                 where;
@@ -174,9 +185,14 @@ static struct containerv_container* __container_new(const char* containerId)
 
     container->pid = -1;
     container->socket_fd = -1;
+    container->cgroup_fd = -1;
+    container->netns_fd = -1;
     for (int i = 0; i < CV_NS_COUNT; i++) {
         container->ns_fds[i] = -1;
     }
+    for (int i = 0; i < CV_STAT_COUNT; i++) {
+        container->stat_fds[i] = -1;
+    }
 
     return container;
 }
@@ -195,6 +211,9 @@ static void __container_delete(struct containerv_container* container)
     for (int i = 0; i < CV_NS_COUNT; i++) {
         __close_safe(&container->ns_fds[i]);
     }
+    for (int i = 0; i < CV_STAT_COUNT; i++) {
+        __close_safe(&container->stat_fds[i]);
+    }
 
     __close_safe(&container->host[0]);
     __close_safe(&container->host[1]);
@@ -205,6 +224,8 @@ static void __container_delete(struct containerv_container* container)
     __close_safe(&container->stderr[0]);
     __close_safe(&container->stderr[1]);
     __close_safe(&container->socket_fd);
+    __close_safe(&container->cgroup_fd);
+    __close_safe(&container->netns_fd);
     free(container->hostname);
     free(container->runtime_dir);
     free(container->rootfs);
@@ -213,9 +234,9 @@ static void __container_delete(struct containerv_container* container)
 
 enum containerv_event_type {
     CV_CONTAINER_WAITING_FOR_NS_SETUP,
-    CV_CONTAINER_WAITING_FOR_CGROUPS_SETUP,
     CV_CONTAINER_WAITING_FOR_NETWORK_SETUP,
     CV_CONTAINER_WAITING_FOR_POLICY_SETUP,
+    CV_CONTAINER_PHASE_DONE,
     CV_CONTAINER_UP,
     CV_CONTAINER_DOWN
 };
@@ -223,6 +244,9 @@ enum containerv_event_type {
 struct containerv_event {
     enum containerv_event_type type;
     int                        status;
+    // only used by CV_CONTAINER_PHASE_DONE
+    int                        phase;
+    uint64_t                   duration_us;
 };
 
 static void __send_container_event(int fds[2], enum containerv_event_type type, int status)
@@ -236,6 +260,33 @@ static void __send_container_event(int fds[2], enum containerv_event_type type,
     }
 }
 
+static uint64_t __timestamp_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+// __report_phase tells the host how long the child spent in the given phase,
+// and restarts the clock for the next phase. The host does not ack these.
+static void __report_phase(
+    struct containerv_container* container,
+    enum containerv_create_phase phase,
+    uint64_t*                    phaseStart)
+{
+    uint64_t                now = __timestamp_us();
+    struct containerv_event event = {
+        .type = CV_CONTAINER_PHASE_DONE,
+        .status = 0,
+        .phase = (int)phase,
+        .duration_us = now - *phaseStart
+    };
+    if (write(container->child[__FD_WRITE], &event, sizeof(struct containerv_event)) != sizeof(struct containerv_event)) {
+        // timing is best-effort
+    }
+    *phaseStart = now;
+}
+
 static int __wait_for_container_event(int fds[2], struct containerv_event* event)
 {
     int bytesRead;
@@ -249,9 +300,9 @@ static int __wait_for_container_event(int fds[2], struct containerv_event* event
 
 static void __print(const char* line, int error) {
     if (error) {
-        VLOG_ERROR("containerv[child]", line);
+        VLOG_ERROR("containerv[child]", "%s", line);
     } else {
-        VLOG_TRACE("containerv[child]", line);
+        VLOG_TRACE("containerv[child]", "%s", line);
     }
 }
 
@@ -284,42 +335,108 @@ static void __report(char* line, int error)
     }
 }
 
-// 0 => stdout
-// 1 => stderr
+// Output is read in chunks of this size, and lines longer than it are split
+#define __OUTPUT_BUFFER_SIZE (64 * 1024)
+
+struct __output_stream {
+    int    fd;
+    int    error;
+    size_t length;
+    char   buffer[__OUTPUT_BUFFER_SIZE + 1];
+};
+
+// __drain_output reads what is available on the stream and prints every complete
+// line. A partial line is kept until the rest of it arrives, unless it fills the
+// buffer. Returns -1 once the stream has been closed.
+static int __drain_output(struct __output_stream* stream)
+{
+    char*   start;
+    char*   end;
+    char*   newline;
+    ssize_t n;
+
+    n = read(stream->fd, &stream->buffer[stream->length], __OUTPUT_BUFFER_SIZE - stream->length);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return 0;
+    }
+    if (n <= 0) {
+        if (stream->length > 0) {
+            stream->buffer[stream->length] = '\0';
+            __print(&stream->buffer[0], stream->error);
+            stream->length = 0;
+        }
+        return -1;
+    }
+
+    start = &stream->buffer[0];
+    end = &stream->buffer[stream->length + (size_t)n];
+    while ((newline = memchr(start, '\n', (size_t)(end - start))) != NULL) {
+        // the byte after the newline is within the buffer, as it has room for a terminator
+        char saved = newline[1];
+        newline[1] = '\0';
+        __print(start, stream->error);
+        newline[1] = saved;
+        start = newline + 1;
+    }
+
+    stream->length = (size_t)(end - start);
+    if (stream->length == __OUTPUT_BUFFER_SIZE) {
+        stream->buffer[__OUTPUT_BUFFER_SIZE] = '\0';
+        __print(&stream->buffer[0], stream->error);
+        stream->length = 0;
+    } else if (start != &stream->buffer[0]) {
+        memmove(&stream->buffer[0], start, stream->length);
+    }
+    return 0;
+}
+
+// Reads the stdout and stderr of the container until both are closed, this is only
+// used when the output is not read externally.
 static int __wait_and_read_stds(void* context)
 {
     struct containerv_container* container = context;
-    char line[2048];
-    
-    struct pollfd fds[2] = { 
-        { 
-            .fd = container->stdout[0],
-            .events = POLLIN
-        },
-        {
-            .fd = container->stderr[0],
-            .events = POLLIN
-        }
-    };
+    struct __output_stream*      streams;
+    struct pollfd                fds[2];
+    int                          remaining = 2;
+
+    streams = calloc(2, sizeof(struct __output_stream));
+    if (streams == NULL) {
+        container->log_running = 0;
+        return -1;
+    }
+    streams[0].fd = container->stdout[__FD_READ];
+    streams[1].fd = container->stderr[__FD_READ];
+    streams[1].error = 1;
 
     container->log_running = 1;
-    while (container->log_running == 1) {
-        int status = poll(fds, 2, -1);
-        if (status <= 0) {
-            return -1;
+    while (container->log_running == 1 && remaining > 0) {
+        for (int i = 0; i < 2; i++) {
+            fds[i].fd = streams[i].fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
         }
-        if (fds[0].revents & POLLIN) {
-            status = read(fds[0].fd, &line[0], sizeof(line));
-            line[status] = 0;
-            __report(&line[0], 0);
-        } else if (fds[1].revents & POLLIN) {
-            status = read(fds[1].fd, &line[0], sizeof(line));
-            line[status] = 0;
-            __report(&line[0], 1);
-        } else {
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             break;
         }
+
+        // both streams are handled on the same wakeup, so a busy stdout does not
+        // hold back stderr
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (__drain_output(&streams[i])) {
+                streams[i].fd = -1;
+                remaining--;
+            }
+        }
     }
+
+    free(streams);
     container->log_running = 0;
     return 0;
 }
@@ -514,10 +631,146 @@ static int __container_map_mounts(
     return status;
 }
 
+static int __populate_minimal_dev(int devFd)
+{
+    int    status = 0;
+    mode_t um;
+    VLOG_DEBUG("containerv[child]", "__populate_minimal_dev()\n");
+
+    struct {
+        const char* path;
+        mode_t      mod;
+        dev_t       dev;
+    } devices[] = {
+        { "null", S_IFCHR | 0666, makedev(1, 3) },
+        { "zero", S_IFCHR | 0666, makedev(1, 5) },
+        { "random", S_IFCHR | 0666, makedev(1, 8) },
+        { "urandom", S_IFCHR | 0666, makedev(1, 9) },
+        { NULL, 0, 0 },
+    };
+
+    um = umask(0);
+
+    for (int i = 0; devices[i].path != NULL; i++) {
+        status = mknodat(devFd, devices[i].path, devices[i].mod, devices[i].dev);
+        if (status) {
+            VLOG_ERROR("containerv[child]", "__populate_minimal_dev: failed to create /dev/%s\n", devices[i].path);
+            break;
+        }
+    }
+
+    umask(um);
+    return status;
+}
+
+#if defined(__NR_fsopen) && defined(__NR_fsconfig) && defined(__NR_fsmount) && defined(__NR_move_mount)
+// __mount_detached creates a mount that is not yet attached anywhere, so it can
+// be prepared before it becomes visible in the filesystem.
+static int __mount_detached(const char* what, const char* fstype, enum containerv_mount_flags flags)
+{
+    int fsFd, mountFd;
+
+    fsFd = (int)syscall(__NR_fsopen, fstype, __FSOPEN_CLOEXEC);
+    if (fsFd < 0) {
+        return -1;
+    }
+
+    if (syscall(__NR_fsconfig, fsFd, __FSCONFIG_SET_STRING, "source", what, 0) ||
+        syscall(__NR_fsconfig, fsFd, __FSCONFIG_CMD_CREATE, NULL, NULL, 0)) {
+        close(fsFd);
+        return -1;
+    }
+
+    mountFd = (int)syscall(
+        __NR_fsmount,
+        fsFd,
+        __FSMOUNT_CLOEXEC,
+        (flags & CV_MOUNT_READONLY) ? __MOUNT_ATTR_RDONLY : 0
+    );
+    close(fsFd);
+    return mountFd;
+}
+
+static int __move_mount(int mountFd, const char* where)
+{
+    return (int)syscall(__NR_move_mount, mountFd, "", AT_FDCWD, where, __MOVE_MOUNT_F_EMPTY_PATH);
+}
+
+// __container_map_mounts_detached mounts the standard filesystems with the new mount API. The
+// /dev tmpfs is populated while it is still detached, so it is attached fully built. Returns -1
+// with errno set to ENOSYS, without having mounted anything, if the kernel does not support it.
+static int __container_map_mounts_detached(
+    const struct __child_mount* mounts,
+    int                         mountsCount,
+    int*                        devPopulated)
+{
+    VLOG_DEBUG("containerv[child]", "__container_map_mounts_detached()\n");
+
+    for (int i = 0; i < mountsCount; i++) {
+        int mountFd;
+        int status;
+
+        VLOG_DEBUG("containerv[child]", "__container_map_mounts_detached: mapping %s => %s (%s)\n",
+            mounts[i].what, mounts[i].where, mounts[i].fstype);
+        if (mounts[i].flags & CV_MOUNT_CREATE) {
+            status = containerv_mkdir("", mounts[i].where, 0755);
+            if (status) {
+                VLOG_ERROR("containerv[child]", "__container_map_mounts_detached: could not create %s\n", mounts[i].where);
+                return -1;
+            }
+        }
+
+        mountFd = __mount_detached(mounts[i].what, mounts[i].fstype, mounts[i].flags);
+        if (mountFd < 0) {
+            if (errno == ENOSYS && i == 0) {
+                return -1;
+            }
+            VLOG_ERROR("containerv[child]", "__container_map_mounts_detached: failed to create mount for %s\n", mounts[i].where);
+            if (errno == ENOSYS) {
+                // the fallback must not run on top of what has already been mounted
+                errno = EIO;
+            }
+            return -1;
+        }
+
+        if (strcmp(mounts[i].where, "/dev") == 0) {
+            status = __populate_minimal_dev(mountFd);
+            if (status) {
+                close(mountFd);
+                return status;
+            }
+            *devPopulated = 1;
+        }
+
+        status = __move_mount(mountFd, mounts[i].where);
+        close(mountFd);
+        if (status) {
+            VLOG_ERROR("containerv[child]", "__container_map_mounts_detached: failed to attach %s\n", mounts[i].where);
+            return status;
+        }
+    }
+    return 0;
+}
+#else
+static int __container_map_mounts_detached(
+    const struct __child_mount* mounts,
+    int                         mountsCount,
+    int*                        devPopulated)
+{
+    (void)mounts;
+    (void)mountsCount;
+    (void)devPopulated;
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
 static int __container_map_standard_filesystem_mounts(void)
 {
     struct __child_mount mnts[16];
     int count = 0;
+    int devPopulated = 0;
+    int status;
 
     for (const char* const* mp = containerv_standard_linux_mountpoints(); mp != NULL && *mp != NULL; ++mp) {
         const struct __std_mount_spec* s = __find_standard_mount_spec(*mp);
@@ -545,7 +798,27 @@ static int __container_map_standard_filesystem_mounts(void)
         };
     }
 
-    return __container_map_mounts("", &mnts[0], count);
+    status = __container_map_mounts_detached(&mnts[0], count, &devPopulated);
+    if (status && errno == ENOSYS) {
+        VLOG_DEBUG("containerv[child]", "__container_map_standard_filesystem_mounts: new mount API not supported, using mount(2)\n");
+        status = __container_map_mounts("", &mnts[0], count);
+    }
+    if (status) {
+        return status;
+    }
+
+    // we could use devtmpfs here, but that requires kernel support, which it most likely
+    // already is, but just to be sure we populate a minimal /dev, to have more control
+    if (!devPopulated) {
+        int devFd = open("/dev", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (devFd < 0) {
+            VLOG_ERROR("containerv[child]", "__container_map_standard_filesystem_mounts: failed to open /dev\n");
+            return -1;
+        }
+        status = __populate_minimal_dev(devFd);
+        close(devFd);
+    }
+    return status;
 }
 
 static int __write_user_namespace_maps(
@@ -632,44 +905,9 @@ static int __container_open_ns_fds(
     return 0;
 }
 
-static int __populate_minimal_dev(void)
+static int __container_wants_network(struct containerv_options* options)
 {
-    int    status;
-    char   tmp[PATH_MAX];
-    mode_t um;
-    VLOG_DEBUG("cvd", "__fixup_dev()\n");
-
-    struct {
-        const char* path;
-        mode_t      mod;
-        dev_t       dev;
-    } devices[] = {
-        { "null", S_IFCHR | 0666, makedev(1, 3) },
-        { "zero", S_IFCHR | 0666, makedev(1, 5) },
-        { "random", S_IFCHR | 0666, makedev(1, 8) },
-        { "urandom", S_IFCHR | 0666, makedev(1, 9) },
-        { NULL, 0, 0 },
-    };
-
-    um = umask(0);
-
-    for (int i = 0; devices[i].path != NULL; i++) {
-        snprintf(
-            &tmp[0],
-            sizeof(tmp),
-            "/dev/%s", 
-            devices[i].path
-        );
-
-        status = mknod(&tmp[0], devices[i].mod, devices[i].dev);
-        if (status) {
-            VLOG_ERROR("cvd", "__fixup_dev: failed to create %s\n", &tmp[0]);
-            return status;
-        }
-    }
-
-    umask(um);
-    return 0;
+    return (options->capabilities & CV_CAP_NETWORK) && options->network.enable && options->network.container_ip != NULL;
 }
 
 static int __container_run(
@@ -677,8 +915,9 @@ static int __container_run(
     struct containerv_options*   options,
     uid_t                        realUid)
 {
-    int status;
-    int flags = CLONE_NEWUTS;
+    int      status;
+    int      flags = CLONE_NEWUTS;
+    uint64_t phaseStart = __timestamp_us();
     VLOG_DEBUG("containerv[child]", "__container_run()\n");
 
     // immediately switch to real root for the rest of the cycle, but
@@ -697,14 +936,44 @@ static int __container_run(
         }
     }
 
-    if (options->capabilities & CV_CAP_FILESYSTEM) {
-        flags |= CLONE_NEWNS;
+    // The host has prepared the cgroup with all its limits before we were forked,
+    // so we move ourselves into it before any namespaces are created. This also makes
+    // it the root of the cgroup namespace, and saves a round-trip to the host.
+    if (container->cgroup_fd >= 0) {
+        status = cgroups_attach(container->cgroup_fd, 0);
+        if (status) {
+            VLOG_ERROR("containerv[child]", "__container_run: failed to join the container cgroup\n");
+            return status;
+        }
+        __close_safe(&container->cgroup_fd);
     }
+    __report_phase(container, CV_CREATE_PHASE_CGROUPS, &phaseStart);
+
+    // A network namespace adopted from the pool already has loopback up and the container
+    // end of the veth pair inside it. It is joined while we still have our capabilities
+    // in the initial user namespace, which owns it, so the interface is configured here.
+    if (container->netns_fd >= 0) {
+        status = setns(container->netns_fd, CLONE_NEWNET);
+        if (status) {
+            VLOG_ERROR("containerv[child]", "__container_run: failed to join the network namespace\n");
+            return status;
+        }
+        __close_safe(&container->netns_fd);
 
-    if (options->capabilities & CV_CAP_NETWORK) {
+        VLOG_DEBUG("containerv[child]", "__container_run: bringing up container network interface %s\n", container->container_veth);
+        status = if_up(container->container_veth, (char*)options->network.container_ip, (char*)options->network.container_netmask);
+        if (status) {
+            VLOG_ERROR("containerv[child]", "__container_run: failed to bring up container veth interface\n");
+            return status;
+        }
+    } else if (options->capabilities & CV_CAP_NETWORK) {
         flags |= CLONE_NEWNET;
     }
 
+    if (options->capabilities & CV_CAP_FILESYSTEM) {
+        flags |= CLONE_NEWNS;
+    }
+
     if (options->capabilities & CV_CAP_PROCESS_CONTROL) {
         flags |= CLONE_NEWPID;
     }
@@ -757,27 +1026,7 @@ static int __container_run(
         return status;
     }
 
-    // Sync with host that we are ready to have cgroups setup
-    if (options->capabilities & CV_CAP_CGROUPS) {
-        struct containerv_event event;
-
-        // notify the host that we need cgroups setup
-        VLOG_DEBUG("containerv[child]", "notifying host that we need external assistance\n");
-        __send_container_event(container->child, CV_CONTAINER_WAITING_FOR_CGROUPS_SETUP, 0);
-
-        // wait for ack
-        status = __wait_for_container_event(container->host, &event);
-        if (status) {
-            VLOG_ERROR("containerv[child]", "__container_run: failed to receive ack from cgroups setup\n");
-            return status;
-        }
-
-        // check status
-        if (event.status) {
-            VLOG_ERROR("containerv[child]", "__container_run: host failed to setup cgroups, aborting\n");
-            return event.status;
-        }
-    }
+    __report_phase(container, CV_CREATE_PHASE_NAMESPACES, &phaseStart);
 
     // MS_PRIVATE makes the bind mount invisible outside of the namespace
     // MS_REC makes the mount recursive
@@ -853,21 +1102,15 @@ static int __container_run(
         return status;
     }
 
-    // After the chroot we can do now do special mounts
+    __report_phase(container, CV_CREATE_PHASE_ROOTFS, &phaseStart);
+
+    // After the chroot we can do now do special mounts, this also populates /dev
     if (options->capabilities & CV_CAP_FILESYSTEM) {
         status = __container_map_standard_filesystem_mounts();
         if (status) {
             VLOG_ERROR("containerv[child]", "__container_run: failed to map system mounts\n");
             return status;
         }
-
-        // we could use devtmpfs here, but that requires kernel support, which it most likely
-        // already is, but just to be sure we populate a minimal /dev, to have more control
-        status = __populate_minimal_dev();
-        if (status) {
-            VLOG_ERROR("containerv[child]", "__container_run: failed to populate /dev\n");
-            return status;
-        }
     }
 
     // Open the public communication channel after chroot
@@ -882,9 +1125,10 @@ static int __container_run(
         VLOG_ERROR("containerv[child]", "__container_run: failed to get a handle on NS file descriptors\n");
         return status;
     }
-    
-    // Setup network interface inside container if enabled
-    if (options->capabilities & CV_CAP_NETWORK && options->network.enable && options->network.container_ip) {
+    __report_phase(container, CV_CREATE_PHASE_MOUNTS, &phaseStart);
+
+    // Setup network interface inside container if enabled, unless it was adopted from the pool
+    if (__container_wants_network(options) && container->container_veth[0] == '\0') {
         struct containerv_event event;
         char                    container_veth[16];
 
@@ -922,6 +1166,7 @@ static int __container_run(
             return status;
         }
     }
+    __report_phase(container, CV_CREATE_PHASE_NETWORK, &phaseStart);
 
     // Apply eBPF policy (needs caps, so do it before dropping)
     if (options->policy != NULL) {
@@ -947,6 +1192,7 @@ static int __container_run(
     } else {
         VLOG_DEBUG("containerv[child]", "__container_run: no security policy configured\n");
     }
+    __report_phase(container, CV_CREATE_PHASE_POLICY, &phaseStart);
 
     // Drop capabilities that we no longer need
     status = containerv_drop_capabilities();
@@ -970,6 +1216,18 @@ static int __container_run(
         return status;
     }
 
+    // The helper is forked once the container setup is finished, but before the
+    // seccomp filter is applied. The filter is written for the workload, and may
+    // not allow what the helper needs to switch users and supervise commands.
+    // Its commands are then treated like commands that join the container, which
+    // are not descendants of init and never inherited the filter either.
+    if (options->exec_helper) {
+        status = containerv_exec_helper_start(container);
+        if (status) {
+            VLOG_WARNING("containerv[child]", "__container_run: failed to start exec helper, commands must join instead\n");
+        }
+    }
+
     // Apply seccomp-bpf for syscall filtering.
     // This must happen after capability dropping and other prctl-based setup,
     // otherwise the filter can block those operations and break container bring-up.
@@ -982,6 +1240,7 @@ static int __container_run(
     }
 
     // Container is now up and running
+    __report_phase(container, CV_CREATE_PHASE_FINALIZE, &phaseStart);
     __send_container_event(container->child, CV_CONTAINER_UP, 0);
     return __container_idle_loop(container);
 }
@@ -1015,12 +1274,130 @@ static void __container_entry(
     _Exit(status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
+// The BPF policy only needs the cgroup of the container and the host path of the
+// rootfs, so it is populated on a separate thread while the container sets up its
+// rootfs, instead of when the container asks for it.
+struct __policy_job {
+    thrd_t                    tid;
+    int                       started;
+    int                       status;
+    const char*               container_id;
+    const char*               rootfs;
+    struct containerv_policy* policy;
+};
+
+static int __policy_job_main(void* context)
+{
+    struct __policy_job* job = context;
+
+    VLOG_DEBUG("containerv[host]", "populating BPF policy for container %s\n", job->container_id);
+    job->status = containerv_bpf_populate_policy(job->container_id, job->rootfs, job->policy);
+    if (job->status < 0) {
+        VLOG_ERROR("containerv[host]", "failed to populate BPF policy for %s\n", job->container_id);
+    }
+    return 0;
+}
+
+static void __policy_job_start(
+    struct __policy_job*         job,
+    struct containerv_container* container,
+    struct containerv_options*   options)
+{
+    if (containerv_bpf_is_available() != CV_BPF_AVAILABLE || options->policy == NULL) {
+        return;
+    }
+
+    job->container_id = container->id;
+    job->rootfs = containerv_layers_get_rootfs(options->layers);
+    job->policy = options->policy;
+    if (thrd_create(&job->tid, __policy_job_main, job) != thrd_success) {
+        VLOG_WARNING("containerv[host]", "failed to spawn thread for the BPF policy, populating it now\n");
+        __policy_job_main(job);
+        return;
+    }
+    job->started = 1;
+}
+
+// __policy_job_finish waits for the policy to be populated, and returns the result
+static int __policy_job_finish(struct __policy_job* job)
+{
+    if (job->started) {
+        thrd_join(job->tid, NULL);
+        job->started = 0;
+    }
+    return job->status;
+}
+
+// __container_create_abort cleans up after a container that failed to start, the
+// container process has either exited or is about to.
+static void __container_create_abort(
+    struct containerv_container* container,
+    struct __policy_job*         policyJob,
+    int                          cgroupPrepared)
+{
+    (void)__policy_job_finish(policyJob);
+
+    // Best-effort cleanup of any BPF policy entries that may have been populated.
+    // This ensures containerv does not rely on external callers to clean per-container policy state.
+    if (containerv_bpf_is_available() == CV_BPF_AVAILABLE) {
+        (void)containerv_bpf_cleanup_policy(container->id);
+    }
+
+    // The cgroup can only be removed once the container process is gone
+    if (cgroupPrepared) {
+        if (container->pid > 0) {
+            (void)waitpid(container->pid, NULL, 0);
+        }
+        (void)cgroups_free(container->hostname);
+    }
+    __container_delete(container);
+}
+
+static void __adopt_pooled_network(
+    struct containerv_container* container,
+    struct containerv_options*   options)
+{
+    struct network_pool_entry entry;
+
+    if (network_pool_take(&entry)) {
+        VLOG_DEBUG("containerv[host]", "no prepared network namespace available for %s\n", container->hostname);
+        return;
+    }
+
+    if (options->network.host_ip) {
+        if (if_up(entry.host_veth, (char*)options->network.host_ip, (char*)options->network.container_netmask)) {
+            VLOG_WARNING("containerv[host]", "failed to bring up pooled interface %s, falling back\n", entry.host_veth);
+            close(entry.netns_fd);
+            return;
+        }
+    }
+
+    VLOG_DEBUG("containerv[host]", "adopting network namespace with %s for %s\n", entry.host_veth, container->hostname);
+    container->netns_fd = entry.netns_fd;
+    memcpy(container->host_veth, entry.host_veth, sizeof(entry.host_veth));
+    memcpy(container->container_veth, entry.container_veth, sizeof(entry.container_veth));
+}
+
+static void __record_host_phase(
+    struct containerv_container* container,
+    enum containerv_create_phase phase,
+    uint64_t*                    phaseStart)
+{
+    uint64_t now = __timestamp_us();
+    container->timing.phases_us[phase] = now - *phaseStart;
+    *phaseStart = now;
+}
+
 int containerv_create(
     const char*                   containerId,
     struct containerv_options*    options,
     struct containerv_container** containerOut)
 {
     struct containerv_container* container;
+    struct __policy_job          policyJob = { 0 };
+    uint64_t                     createStart = __timestamp_us();
+    uint64_t                     phaseStart = createStart;
+    int                          cgroupPrepared = 0;
     int                          status;
     VLOG_DEBUG("containerv[host]", "containerv_create(caps=0x%x)\n", options->capabilities);
 
@@ -1037,12 +1414,49 @@ int containerv_create(
         return -1;
     }
     
+    // The cgroup is created and configured before the container process exists, so the
+    // process can move itself into it before it creates any namespaces.
+    if (options->capabilities & CV_CAP_CGROUPS) {
+        struct containerv_cgroup_limits limits = {
+            .memory_max = options->cgroup.memory_max,
+            .cpu_weight = options->cgroup.cpu_weight,
+            .pids_max = options->cgroup.pids_max,
+            .enable_devices = 0,
+            .memory_high = options->cgroup.memory_high,
+            .cpu_max = options->cgroup.cpu_max,
+            .cpuset_cpus = options->cgroup.cpuset_cpus,
+            .cpuset_mems = options->cgroup.cpuset_mems,
+            .io_weight = options->cgroup.io_weight,
+            .io_max = options->cgroup.io_max
+        };
+
+        VLOG_DEBUG("containerv[host]", "setting up cgroups for %s\n", container->hostname);
+        container->cgroup_fd = cgroups_prepare(container->hostname, &limits);
+        if (container->cgroup_fd < 0) {
+            VLOG_ERROR("containerv[host]", "containerv_create: failed to setup cgroups\n");
+            __container_delete(container);
+            return -1;
+        }
+        cgroupPrepared = 1;
+    }
+
+    // Adopt a prepared network namespace if one is available, this leaves only the
+    // addresses to be configured. Otherwise the network is set up once the child has
+    // created its own namespace.
+    if (__container_wants_network(options)) {
+        __adopt_pooled_network(container, options);
+    }
+
     container->layers = options->layers;
+    __record_host_phase(container, CV_CREATE_PHASE_PREPARE, &phaseStart);
+
     container->pid = fork();
     if (container->pid == (pid_t)-1) {
         VLOG_ERROR("containerv[host]", "containerv_create: failed to fork container process\n");
+        __container_create_abort(container, &policyJob, cgroupPrepared);
         return -1;
     } else if (container->pid) {
+        __record_host_phase(container, CV_CREATE_PHASE_SPAWN, &phaseStart);
         VLOG_DEBUG("containerv[host]", "cleaning up and waiting for container to get up and running\n");
         
         // cleanup the fds we don't use
@@ -1050,9 +1464,19 @@ int containerv_create(
         __close_safe(&container->child[__FD_WRITE]);
         __close_safe(&container->stdout[__FD_WRITE]);
         __close_safe(&container->stderr[__FD_WRITE]);
-
-        // spawn log thread
-        if (thrd_create(&container->log_tid, __wait_and_read_stds, container) != thrd_success) {
+        __close_safe(&container->cgroup_fd);
+        __close_safe(&container->netns_fd);
+
+        // the cgroup exists at this point, so the policy can be populated while
+        // the container is busy setting up its rootfs
+        __policy_job_start(&policyJob, container, options);
+
+        // the output is either read by the caller, or by a thread of our own
+        if (options->external_output) {
+            container->external_output = 1;
+            (void)fcntl(container->stdout[__FD_READ], F_SETFL, O_NONBLOCK);
+            (void)fcntl(container->stderr[__FD_READ], F_SETFL, O_NONBLOCK);
+        } else if (thrd_create(&container->log_tid, __wait_and_read_stds, container) != thrd_success) {
             VLOG_ERROR("containerv[host]", "failed to spawn thread for log monitoring\n");
         }
         
@@ -1062,7 +1486,7 @@ int containerv_create(
             status = __wait_for_container_event(container->child, &event);
             if (status) {
                 VLOG_ERROR("containerv[host]", "containerv_create: failed to read container event: %i\n", status);
-                __container_delete(container);
+                __container_create_abort(container, &policyJob, cgroupPrepared);
                 return status;
             }
 
@@ -1077,23 +1501,6 @@ int containerv_create(
                     __send_container_event(container->host, CV_CONTAINER_WAITING_FOR_NS_SETUP, status);
                 } break;
 
-                case CV_CONTAINER_WAITING_FOR_CGROUPS_SETUP:
-                    struct containerv_cgroup_limits limits = {
-                        .memory_max = options->cgroup.memory_max,
-                        .cpu_weight = options->cgroup.cpu_weight,
-                        .pids_max = options->cgroup.pids_max,
-                        .enable_devices = 0
-                    };
-                    
-                    VLOG_DEBUG("containerv[host]", "setting up cgroups for %s (pid=%d)\n", container->hostname, container->pid);
-                    status = cgroups_init(container->hostname, container->pid, &limits);
-                    if (status) {
-                        VLOG_ERROR("containerv[host]", "containerv_create: failed to setup cgroups: %i\n", status);
-                    }
-                    
-                    __send_container_event(container->host, CV_CONTAINER_WAITING_FOR_CGROUPS_SETUP, status);
-                    break;
-
                 case CV_CONTAINER_WAITING_FOR_NETWORK_SETUP: {
                     char host_veth[16];
                     char container_veth[16];
@@ -1104,6 +1511,7 @@ int containerv_create(
                     // Host side uses full ID, container side uses partial ID for brevity
                     snprintf(host_veth, sizeof(host_veth), "veth%s", &container->id[__CONTAINER_VETH_HOST_OFFSET]);
                     snprintf(container_veth, sizeof(container_veth), "veth%sc", &container->id[__CONTAINER_VETH_CONT_OFFSET]);
+                    memcpy(container->host_veth, host_veth, sizeof(host_veth));
                     
                     VLOG_DEBUG("containerv[host]", "setting up network for %s\n", container->hostname);
                     
@@ -1156,27 +1564,19 @@ int containerv_create(
                 } break;
 
                 case CV_CONTAINER_WAITING_FOR_POLICY_SETUP: {
-                    // Populate BPF policy if BPF manager is available
-                    if (containerv_bpf_is_available() == CV_BPF_AVAILABLE && options->policy != NULL) {
-                        const char* rootfs = containerv_layers_get_rootfs(options->layers);
-                        VLOG_DEBUG("containerv[host]", "populating BPF policy for container %s\n", container->id);
-                        status = containerv_bpf_populate_policy(container->id, rootfs, options->policy);
-                        if (status < 0) {
-                            VLOG_ERROR("containerv[host]", "failed to populate BPF policy for %s\n", container->id);
-                        }
-                    }
-
+                    status = __policy_job_finish(&policyJob);
                     __send_container_event(container->host, CV_CONTAINER_WAITING_FOR_POLICY_SETUP, status);
                 } break;
 
+                case CV_CONTAINER_PHASE_DONE: {
+                    if (event.phase >= 0 && event.phase < CV_CREATE_PHASE_COUNT) {
+                        container->timing.phases_us[event.phase] = event.duration_us;
+                    }
+                } break;
+
                 case CV_CONTAINER_DOWN: {
                     VLOG_ERROR("containerv[host]", "containerv_create: child reported error: %i\n", event.status);
-                    // Best-effort cleanup of any BPF policy entries that may have been populated.
-                    // This ensures containerv does not rely on external callers to clean per-container policy state.
-                    if (containerv_bpf_is_available() == CV_BPF_AVAILABLE) {
-                        (void)containerv_bpf_cleanup_policy(container->id);
-                    }
-                    __container_delete(container);
+                    __container_create_abort(container, &policyJob, cgroupPrepared);
                     return event.status;
                 } break;
 
@@ -1186,6 +1586,13 @@ int containerv_create(
                 } break;
             }
         }
+
+        // The policy is always requested by the container when one is configured, but
+        // make sure the job is done before returning.
+        (void)__policy_job_finish(&policyJob);
+        container->timing.total_us = __timestamp_us() - createStart;
+        VLOG_DEBUG("containerv[host]", "container %s started in %llu us\n",
+            container->id, (unsigned long long)container->timing.total_us);
         *containerOut = container;
         return 0;
     }
@@ -1548,3 +1955,48 @@ const char* containerv_id(struct containerv_container* container)
     }
     return container->id;
 }
+
+int containerv_output_fds(struct containerv_container* container, int* stdoutFd, int* stderrFd)
+{
+    if (container == NULL || stdoutFd == NULL || stderrFd == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!container->external_output) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    *stdoutFd = container->stdout[__FD_READ];
+    *stderrFd = container->stderr[__FD_READ];
+    return 0;
+}
+
+int containerv_get_create_timing(struct containerv_container* container, struct containerv_create_timing* timing)
+{
+    if (container == NULL || timing == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(timing, &container->timing, sizeof(struct containerv_create_timing));
+    return 0;
+}
+
+const char* containerv_create_phase_name(enum containerv_create_phase phase)
+{
+    static const char* names[CV_CREATE_PHASE_COUNT] = {
+        [CV_CREATE_PHASE_PREPARE]    = "prepare",
+        [CV_CREATE_PHASE_SPAWN]      = "spawn",
+        [CV_CREATE_PHASE_NAMESPACES] = "namespaces",
+        [CV_CREATE_PHASE_CGROUPS]    = "cgroups",
+        [CV_CREATE_PHASE_ROOTFS]     = "rootfs",
+        [CV_CREATE_PHASE_MOUNTS]     = "mounts",
+        [CV_CREATE_PHASE_NETWORK]    = "network",
+        [CV_CREATE_PHASE_POLICY]     = "policy",
+        [CV_CREATE_PHASE_FINALIZE]   = "finalize",
+    };
+
+    if ((int)phase < 0 || phase >= CV_CREATE_PHASE_COUNT) {
+        return "unknown";
+    }
+    return names[phase];
+}
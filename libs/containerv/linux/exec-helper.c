@@ -0,0 +1,637 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <chef/containerv.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "private.h"
+#include <vlog.h>
+
+// The exec helper is a process that is forked from the container init once the
+// container is up, so it already runs inside the namespaces and the rootfs of the
+// container with the capabilities dropped. Joining the container costs a round-trip
+// to the control socket, a setns per namespace and a chroot for each command, the
+// helper only needs to fork. Commands are requested on a stream socket next to
+// the control socket, and run as the user that connected.
+
+#define __EXEC_HELPER_MAX_PAYLOAD (1024 * 1024)
+
+// stdin, stdout and stderr of the caller are passed with the request
+#define __EXEC_HELPER_FD_COUNT 3
+
+enum __exec_message_type {
+    __EXEC_MESSAGE_STARTED,
+    __EXEC_MESSAGE_EXITED,
+    __EXEC_MESSAGE_SIGNAL
+};
+
+struct __exec_request {
+    // lengths include zero terminators
+    uint32_t path_length;
+    uint32_t cwd_length;
+    uint32_t argument_count;
+    uint32_t argument_length;
+    uint32_t environment_count;
+    uint32_t environment_length;
+};
+
+struct __exec_message {
+    enum __exec_message_type type;
+    // STARTED: 0 or the errno of the failed exec, EXITED: the exit code,
+    // SIGNAL: the signal to deliver to the command
+    int value;
+};
+
+static char* __get_exec_socket_path(const char* runtimeDir, char* buffer, size_t length)
+{
+    snprintf(buffer, length, "%s/exec", runtimeDir);
+    return buffer;
+}
+
+static int __write_full(int fd, const void* buffer, size_t length)
+{
+    const char* data = buffer;
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int __read_full(int fd, void* buffer, size_t length)
+{
+    char* data = buffer;
+    while (length > 0) {
+        ssize_t bytesRead = read(fd, data, length);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        } else if (bytesRead == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        data += bytesRead;
+        length -= (size_t)bytesRead;
+    }
+    return 0;
+}
+
+static int __send_message(int fd, enum __exec_message_type type, int value)
+{
+    struct __exec_message message = { .type = type, .value = value };
+    return __write_full(fd, &message, sizeof(message));
+}
+
+// Strings are packed back to back with their zero terminators, which unlike
+// environment_flatten keeps empty arguments intact.
+static size_t __strings_length(const char* const* strings, uint32_t* countOut)
+{
+    size_t   length = 0;
+    uint32_t count = 0;
+
+    for (; strings != NULL && strings[count] != NULL; count++) {
+        length += strlen(strings[count]) + 1;
+    }
+    *countOut = count;
+    return length;
+}
+
+static char* __strings_pack(const char* const* strings, char* data)
+{
+    for (int i = 0; strings != NULL && strings[i] != NULL; i++) {
+        size_t length = strlen(strings[i]) + 1;
+        memcpy(data, strings[i], length);
+        data += length;
+    }
+    return data;
+}
+
+static char** __strings_unpack(char* data, size_t length, uint32_t count)
+{
+    char** strings;
+    char*  end = data + length;
+
+    strings = calloc(count + 1, sizeof(char*));
+    if (strings == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        char* terminator = memchr(data, '\0', (size_t)(end - data));
+        if (data >= end || terminator == NULL) {
+            free(strings);
+            errno = EINVAL;
+            return NULL;
+        }
+        strings[i] = data;
+        data = terminator + 1;
+    }
+    return strings;
+}
+
+static int __receive_request(int fd, struct __exec_request* request, int fds[__EXEC_HELPER_FD_COUNT])
+{
+    char            control[CMSG_SPACE(sizeof(int) * __EXEC_HELPER_FD_COUNT)] = { 0 };
+    struct iovec    io = { .iov_base = request, .iov_len = sizeof(struct __exec_request) };
+    struct msghdr   msg = { 0 };
+    struct cmsghdr* cmsg;
+    ssize_t         status;
+    int             count = 0;
+
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    status = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    if (status != (ssize_t)sizeof(struct __exec_request)) {
+        VLOG_ERROR("containerv[exec]", "__receive_request: failed to read request\n");
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * (count > __EXEC_HELPER_FD_COUNT ? __EXEC_HELPER_FD_COUNT : count));
+        }
+    }
+
+    if (count != __EXEC_HELPER_FD_COUNT) {
+        VLOG_ERROR("containerv[exec]", "__receive_request: expected %i descriptors, got %i\n", __EXEC_HELPER_FD_COUNT, count);
+        for (int i = 0; i < count && i < __EXEC_HELPER_FD_COUNT; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static int __set_groups(struct ucred* cred)
+{
+    struct passwd* user = getpwuid(cred->uid);
+    if (user == NULL) {
+        return setgroups(0, NULL);
+    }
+    return initgroups(user->pw_name, cred->gid);
+}
+
+static void __exec_command(
+    int                    fds[__EXEC_HELPER_FD_COUNT],
+    int                    errorFd,
+    struct ucred*          cred,
+    const char*            path,
+    const char*            cwd,
+    char* const*           argv,
+    char* const*           envp)
+{
+    sigset_t mask;
+    int      error;
+
+    // restore the signal state that the helper changed
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    for (int i = 0; i < __EXEC_HELPER_FD_COUNT; i++) {
+        if (dup2(fds[i], i) < 0) {
+            goto failed;
+        }
+    }
+
+    // drop the supplementary groups of the helper before switching, the
+    // command gets the groups of the caller from the container instead
+    if (cred->uid != getuid() && __set_groups(cred)) {
+        goto failed;
+    }
+    if (cred->gid != getgid() && setgid(cred->gid)) {
+        goto failed;
+    }
+    if (cred->uid != getuid() && setuid(cred->uid)) {
+        goto failed;
+    }
+
+    if (cwd[0] != '\0' && chdir(cwd)) {
+        goto failed;
+    }
+
+    execve(path, argv, envp);
+
+failed:
+    error = errno;
+    (void)__write_full(errorFd, &error, sizeof(error));
+    _exit(127);
+}
+
+static int __exit_code(int status)
+{
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+// Relays signals from the caller to the command until it exits. If the caller
+// goes away the command is hung up, like it would be by a closing terminal.
+static int __supervise_command(int fd, int signalFd, pid_t pid)
+{
+    struct pollfd fds[2] = {
+        { .fd = signalFd, .events = POLLIN },
+        { .fd = fd, .events = POLLIN }
+    };
+
+    for (;;) {
+        struct signalfd_siginfo info;
+        struct __exec_message   message;
+        int                     status;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            (void)read(signalFd, &info, sizeof(info));
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                return __send_message(fd, __EXEC_MESSAGE_EXITED, __exit_code(status));
+            }
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (__read_full(fd, &message, sizeof(message))) {
+                kill(pid, SIGHUP);
+                fds[1].fd = -1;
+            } else if (message.type == __EXEC_MESSAGE_SIGNAL) {
+                kill(pid, message.value);
+            }
+        }
+    }
+}
+
+static void __handle_connection(int fd)
+{
+    struct __exec_request request;
+    struct ucred          cred;
+    socklen_t             credLength = sizeof(cred);
+    sigset_t              mask;
+    char*                 payload = NULL;
+    char**                argv = NULL;
+    char**                envp = NULL;
+    size_t                payloadLength;
+    pid_t                 pid;
+    int                   fds[__EXEC_HELPER_FD_COUNT];
+    int                   errorPipe[2];
+    int                   signalFd;
+    int                   error = 0;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLength)) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: failed to read peer credentials\n");
+        return;
+    }
+
+    if (__receive_request(fd, &request, fds)) {
+        return;
+    }
+
+    payloadLength = (size_t)request.path_length + request.cwd_length +
+        request.argument_length + request.environment_length;
+    if (request.path_length == 0 || request.cwd_length == 0 || payloadLength > __EXEC_HELPER_MAX_PAYLOAD) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: invalid request\n");
+        goto cleanup;
+    }
+
+    payload = malloc(payloadLength);
+    if (payload == NULL || __read_full(fd, payload, payloadLength)) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: failed to read request payload\n");
+        goto cleanup;
+    }
+
+    argv = __strings_unpack(&payload[request.path_length + request.cwd_length], request.argument_length, request.argument_count);
+    envp = __strings_unpack(&payload[request.path_length + request.cwd_length + request.argument_length],
+        request.environment_length, request.environment_count);
+    if (argv == NULL || envp == NULL ||
+        payload[request.path_length - 1] != '\0' ||
+        payload[request.path_length + request.cwd_length - 1] != '\0') {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: malformed request payload\n");
+        goto cleanup;
+    }
+
+    // exits of the command are read through a signalfd, so it can be waited
+    // for while also listening for signals from the caller
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signalFd < 0) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: failed to prepare for %s\n", &payload[0]);
+        goto cleanup;
+    }
+    if (pipe2(errorPipe, O_CLOEXEC)) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: failed to prepare for %s\n", &payload[0]);
+        close(signalFd);
+        goto cleanup;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        close(errorPipe[0]);
+        __exec_command(fds, errorPipe[1], &cred, &payload[0], &payload[request.path_length], argv, envp);
+    }
+    close(errorPipe[1]);
+
+    if (pid < 0) {
+        error = errno;
+    } else if (__read_full(errorPipe[0], &error, sizeof(error))) {
+        // the pipe was closed by a successful exec
+        error = 0;
+    }
+    close(errorPipe[0]);
+
+    // the command holds the only references to the callers stdio now
+    for (int i = 0; i < __EXEC_HELPER_FD_COUNT; i++) {
+        close(fds[i]);
+        fds[i] = -1;
+    }
+
+    if (__send_message(fd, __EXEC_MESSAGE_STARTED, error) || error) {
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    } else if (__supervise_command(fd, signalFd, pid)) {
+        VLOG_ERROR("containerv[exec]", "__handle_connection: lost track of %s\n", &payload[0]);
+    }
+    close(signalFd);
+
+cleanup:
+    for (int i = 0; i < __EXEC_HELPER_FD_COUNT; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(envp);
+    free(argv);
+    free(payload);
+}
+
+static void __helper_main(int listenFd)
+{
+    // connections are handled by a process each, which are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        pid_t pid;
+        int   fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            VLOG_ERROR("containerv[exec]", "__helper_main: failed to accept connection\n");
+            _exit(EXIT_FAILURE);
+        }
+
+        pid = fork();
+        if (pid == 0) {
+            close(listenFd);
+            signal(SIGCHLD, SIG_DFL);
+            __handle_connection(fd);
+            _exit(EXIT_SUCCESS);
+        }
+        close(fd);
+    }
+}
+
+int containerv_exec_helper_start(struct containerv_container* container)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    pid_t              pid;
+    int                fd;
+    VLOG_DEBUG("containerv[child]", "containerv_exec_helper_start()\n");
+
+    __get_exec_socket_path(container->runtime_dir, &address.sun_path[0], sizeof(address.sun_path));
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        VLOG_ERROR("containerv[child]", "containerv_exec_helper_start: failed to create socket\n");
+        return -1;
+    }
+
+    // the helper runs commands as the user that connects, but only the owner
+    // and the group of the socket may connect
+    if (bind(fd, (struct sockaddr*)&address, sizeof(struct sockaddr_un)) ||
+        chmod(&address.sun_path[0], 0660) || listen(fd, 16)) {
+        VLOG_ERROR("containerv[child]", "containerv_exec_helper_start: failed to listen on %s\n", &address.sun_path[0]);
+        close(fd);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        VLOG_ERROR("containerv[child]", "containerv_exec_helper_start: failed to start helper\n");
+        close(fd);
+        return -1;
+    } else if (pid == 0) {
+        // the helper must not hold on to anything of the init process
+        __close_safe(&container->socket_fd);
+        for (int i = 0; i < CV_NS_COUNT; i++) {
+            __close_safe(&container->ns_fds[i]);
+        }
+        __close_safe(&container->child[1]);
+        __helper_main(fd);
+    }
+
+    close(fd);
+    return 0;
+}
+
+static volatile sig_atomic_t g_execFd = -1;
+
+static void __forward_signal(int signo)
+{
+    struct __exec_message message = { .type = __EXEC_MESSAGE_SIGNAL, .value = signo };
+    int                   savedErrno = errno;
+
+    if (g_execFd >= 0) {
+        (void)!write(g_execFd, &message, sizeof(message));
+    }
+    errno = savedErrno;
+}
+
+static int __send_request(int fd, const char* commandPath, struct containerv_join_options* options)
+{
+    static const int      stdFds[__EXEC_HELPER_FD_COUNT] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char                  control[CMSG_SPACE(sizeof(stdFds))] = { 0 };
+    struct __exec_request request = { 0 };
+    const char*           cwd = (options->cwd != NULL) ? options->cwd : "";
+    struct iovec          io = { .iov_base = &request, .iov_len = sizeof(request) };
+    struct msghdr         msg = { 0 };
+    struct cmsghdr*       cmsg;
+    size_t                payloadLength;
+    char*                 payload;
+    char*                 p;
+    int                   status;
+
+    request.path_length = (uint32_t)strlen(commandPath) + 1;
+    request.cwd_length = (uint32_t)strlen(cwd) + 1;
+    request.argument_length = (uint32_t)__strings_length(options->argv, &request.argument_count);
+    request.environment_length = (uint32_t)__strings_length(options->envp, &request.environment_count);
+
+    payloadLength = (size_t)request.path_length + request.cwd_length +
+        request.argument_length + request.environment_length;
+    if (payloadLength > __EXEC_HELPER_MAX_PAYLOAD) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    payload = malloc(payloadLength);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    memcpy(payload, commandPath, request.path_length);
+    memcpy(&payload[request.path_length], cwd, request.cwd_length);
+    p = __strings_pack(options->argv, &payload[request.path_length + request.cwd_length]);
+    (void)__strings_pack(options->envp, p);
+
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(stdFds));
+    memcpy(CMSG_DATA(cmsg), stdFds, sizeof(stdFds));
+
+    status = sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(request) ? 0 : -1;
+    if (status == 0) {
+        status = __write_full(fd, payload, payloadLength);
+    }
+    free(payload);
+    return status;
+}
+
+int containerv_exec(
+    const char*                     containerId,
+    const char*                     commandPath,
+    struct containerv_join_options* options,
+    int*                            exitCodeOut)
+{
+    static const int      forwardedSignals[] = { SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGWINCH };
+    struct sigaction      previous[sizeof(forwardedSignals) / sizeof(int)];
+    struct sockaddr_un    address = { .sun_family = AF_UNIX };
+    struct __exec_message message;
+    char                  runtimeDir[PATH_MAX];
+    int                   status;
+    int                   fd;
+    VLOG_DEBUG("containerv[host]", "containerv_exec(containerId=%s, commandPath=%s)\n", containerId, commandPath);
+
+    snprintf(&runtimeDir[0], sizeof(runtimeDir), __CONTAINER_SOCKET_RUNTIME_BASE "/%s", containerId);
+    __get_exec_socket_path(&runtimeDir[0], &address.sun_path[0], sizeof(address.sun_path));
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // tell a missing helper apart from a command that could not be executed,
+    // any other failure to reach the helper is reported as is
+    if (connect(fd, (struct sockaddr*)&address, sizeof(struct sockaddr_un))) {
+        status = errno;
+        close(fd);
+        if (status == ENOENT || status == ECONNREFUSED) {
+            VLOG_DEBUG("containerv[host]", "containerv_exec: no exec helper at %s\n", &address.sun_path[0]);
+            errno = ENOTSUP;
+        } else {
+            VLOG_ERROR("containerv[host]", "containerv_exec: failed to connect to %s: %s\n", &address.sun_path[0], strerror(status));
+            errno = status;
+        }
+        return -1;
+    }
+
+    if (__send_request(fd, commandPath, options) || __read_full(fd, &message, sizeof(message))) {
+        VLOG_ERROR("containerv[host]", "containerv_exec: failed to send request to the exec helper\n");
+        close(fd);
+        errno = EPIPE;
+        return -1;
+    }
+
+    if (message.type != __EXEC_MESSAGE_STARTED || message.value != 0) {
+        VLOG_ERROR("containerv[host]", "containerv_exec: failed to execute %s\n", commandPath);
+        close(fd);
+        errno = message.value != 0 ? message.value : EPROTO;
+        return -1;
+    }
+
+    // the command is not in our process group, so signals that are meant for
+    // it, like interrupts from the terminal, must be passed on
+    g_execFd = fd;
+    for (size_t i = 0; i < sizeof(forwardedSignals) / sizeof(int); i++) {
+        struct sigaction action = { .sa_handler = __forward_signal, .sa_flags = SA_RESTART };
+        sigemptyset(&action.sa_mask);
+        sigaction(forwardedSignals[i], &action, &previous[i]);
+    }
+
+    status = __read_full(fd, &message, sizeof(message));
+
+    for (size_t i = 0; i < sizeof(forwardedSignals) / sizeof(int); i++) {
+        sigaction(forwardedSignals[i], &previous[i], NULL);
+    }
+    g_execFd = -1;
+    close(fd);
+
+    if (status || message.type != __EXEC_MESSAGE_EXITED) {
+        VLOG_ERROR("containerv[host]", "containerv_exec: lost connection to the exec helper\n");
+        errno = EPIPE;
+        return -1;
+    }
+
+    if (exitCodeOut != NULL) {
+        *exitCodeOut = message.value;
+    }
+    return 0;
+}
@@ -743,6 +743,15 @@ const char* containerv_layers_get_rootfs(struct containerv_layer_context* contex
     return context->composed_rootfs;
 }
 
+const char* containerv_layers_get_upperdir(struct containerv_layer_context* context)
+{
+    if (context == NULL || context->readonly) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return context->upper_dir;
+}
+
 int containerv_layers_iterate(
     struct containerv_layer_context* context,
     enum containerv_layer_type       layerType,
@@ -19,6 +19,7 @@
 #include "private.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,9 +29,6 @@
 
 #include <vlog.h>
 
-#define __CONTAINER_VETH_HOST_OFFSET 0
-#define __CONTAINER_VETH_CONT_OFFSET 4
-
 static uint64_t __now_realtime_ns(void)
 {
     struct timespec ts;
@@ -40,38 +38,77 @@ static uint64_t __now_realtime_ns(void)
     return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-static int __read_file_to_string(const char* path, char* buffer, size_t buffer_len)
+// Files that do not exist for the container, e.g. memory.peak on older kernels or
+// the veth statistics of a container without network, are only tried once
+#define __STAT_FD_UNAVAILABLE -2
+
+static const char* __g_stat_files[CV_STAT_COUNT] = {
+    [CV_STAT_CPU]            = "cpu.stat",
+    [CV_STAT_MEMORY_CURRENT] = "memory.current",
+    [CV_STAT_MEMORY_PEAK]    = "memory.peak",
+    [CV_STAT_IO]             = "io.stat",
+    [CV_STAT_PIDS]           = "pids.current",
+    [CV_STAT_NET_RX_BYTES]   = "rx_bytes",
+    [CV_STAT_NET_TX_BYTES]   = "tx_bytes",
+    [CV_STAT_NET_RX_PACKETS] = "rx_packets",
+    [CV_STAT_NET_TX_PACKETS] = "tx_packets"
+};
+
+static int __stat_fd(struct containerv_container* container, enum containerv_stat_file file)
 {
-    FILE* f;
-    size_t n;
+    char path[PATH_MAX];
+    int  fd;
 
-    if (!path || !buffer || buffer_len == 0) {
-        errno = EINVAL;
-        return -1;
+    if (container->stat_fds[file] != -1) {
+        return container->stat_fds[file];
+    }
+
+    if (file >= CV_STAT_NET_RX_BYTES) {
+        // The host side stays in the host netns, it is named during containerv_create
+        // and is either derived from the container id or taken from the network pool
+        if (container->host_veth[0] == '\0') {
+            return -1;
+        }
+        snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", container->host_veth, __g_stat_files[file]);
+    } else {
+        // cgroup v2 base directory is created by cgroups_prepare as /sys/fs/cgroup/<hostname>
+        if (container->hostname == NULL || container->hostname[0] == '\0') {
+            return -1;
+        }
+        snprintf(path, sizeof(path), "/sys/fs/cgroup/%s/%s", container->hostname, __g_stat_files[file]);
     }
 
-    f = fopen(path, "rb");
-    if (!f) {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    container->stat_fds[file] = fd >= 0 ? fd : __STAT_FD_UNAVAILABLE;
+    return fd;
+}
+
+// __read_stat reads the current contents of a stat file. The files are kept open, and
+// reading from offset 0 makes cgroupfs and sysfs generate them again.
+static int __read_stat(struct containerv_container* container, enum containerv_stat_file file, char* buffer, size_t buffer_len)
+{
+    ssize_t n;
+    int     fd;
+
+    fd = __stat_fd(container, file);
+    if (fd < 0) {
         return -1;
     }
 
-    n = fread(buffer, 1, buffer_len - 1, f);
+    n = pread(fd, buffer, buffer_len - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
     buffer[n] = '\0';
-    fclose(f);
     return 0;
 }
 
-static int __read_file_u64(const char* path, uint64_t* value_out)
+static int __read_stat_u64(struct containerv_container* container, enum containerv_stat_file file, uint64_t* value_out)
 {
-    char buf[256];
+    char buf[64];
     char* endptr;
 
-    if (!value_out) {
-        errno = EINVAL;
-        return -1;
-    }
-
-    if (__read_file_to_string(path, buf, sizeof(buf)) != 0) {
+    if (__read_stat(container, file, buf, sizeof(buf)) != 0) {
         return -1;
     }
 
@@ -84,35 +121,6 @@ static int __read_file_u64(const char* path, uint64_t* value_out)
     return 0;
 }
 
-static void __read_network_stats(const char* container_id,
-                                 uint64_t* rx_bytes, uint64_t* tx_bytes,
-                                 uint64_t* rx_packets, uint64_t* tx_packets)
-{
-    char host_veth[16];
-    char path[PATH_MAX];
-
-    *rx_bytes = *tx_bytes = *rx_packets = *tx_packets = 0;
-
-    if (!container_id || strlen(container_id) < 5) {
-        return;
-    }
-
-    // Match naming in linux/container.c (host side stays in host netns)
-    snprintf(host_veth, sizeof(host_veth), "veth%s", &container_id[__CONTAINER_VETH_HOST_OFFSET]);
-
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_bytes", host_veth);
-    (void)__read_file_u64(path, rx_bytes);
-
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_bytes", host_veth);
-    (void)__read_file_u64(path, tx_bytes);
-
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_packets", host_veth);
-    (void)__read_file_u64(path, rx_packets);
-
-    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_packets", host_veth);
-    (void)__read_file_u64(path, tx_packets);
-}
-
 static void __parse_cpu_stat(const char* cpu_stat_contents, uint64_t* cpu_time_ns_out)
 {
     // cgroup v2 cpu.stat contains e.g.:
@@ -207,9 +215,6 @@ static void __parse_io_stat(const char* io_stat_contents,
 
 int containerv_get_stats(struct containerv_container* container, struct containerv_stats* stats)
 {
-    char cgroup_base[PATH_MAX];
-    char path[PATH_MAX];
-
     if (!container || !stats) {
         errno = EINVAL;
         return -1;
@@ -219,55 +224,45 @@ int containerv_get_stats(struct containerv_container* container, struct containe
 
     stats->timestamp = __now_realtime_ns();
 
-    // cgroup v2 base directory is created by cgroups_init as /sys/fs/cgroup/<hostname>
-    if (container->hostname && container->hostname[0]) {
-        snprintf(cgroup_base, sizeof(cgroup_base), "/sys/fs/cgroup/%s", container->hostname);
-
-        // CPU
-        {
-            char cpu_buf[1024];
-            snprintf(path, sizeof(path), "%s/cpu.stat", cgroup_base);
-            if (__read_file_to_string(path, cpu_buf, sizeof(cpu_buf)) == 0) {
-                __parse_cpu_stat(cpu_buf, &stats->cpu_time_ns);
-            }
+    // CPU
+    {
+        char cpu_buf[1024];
+        if (__read_stat(container, CV_STAT_CPU, cpu_buf, sizeof(cpu_buf)) == 0) {
+            __parse_cpu_stat(cpu_buf, &stats->cpu_time_ns);
         }
+    }
 
-        // Memory
-        snprintf(path, sizeof(path), "%s/memory.current", cgroup_base);
-        (void)__read_file_u64(path, &stats->memory_usage);
-
-        snprintf(path, sizeof(path), "%s/memory.peak", cgroup_base);
-        (void)__read_file_u64(path, &stats->memory_peak);
+    // Memory
+    (void)__read_stat_u64(container, CV_STAT_MEMORY_CURRENT, &stats->memory_usage);
+    (void)__read_stat_u64(container, CV_STAT_MEMORY_PEAK, &stats->memory_peak);
 
-        // I/O
-        {
-            char io_buf[4096];
-            snprintf(path, sizeof(path), "%s/io.stat", cgroup_base);
-            if (__read_file_to_string(path, io_buf, sizeof(io_buf)) == 0) {
-                __parse_io_stat(io_buf, &stats->read_bytes, &stats->write_bytes, &stats->read_ops, &stats->write_ops);
-            }
+    // I/O
+    {
+        char io_buf[4096];
+        if (__read_stat(container, CV_STAT_IO, io_buf, sizeof(io_buf)) == 0) {
+            __parse_io_stat(io_buf, &stats->read_bytes, &stats->write_bytes, &stats->read_ops, &stats->write_ops);
         }
+    }
 
-        // PIDs
-        {
-            uint64_t pids_current = 0;
-            snprintf(path, sizeof(path), "%s/pids.current", cgroup_base);
-            if (__read_file_u64(path, &pids_current) == 0) {
-                if (pids_current > UINT32_MAX) {
-                    pids_current = UINT32_MAX;
-                }
-                stats->active_processes = (uint32_t)pids_current;
+    // PIDs
+    {
+        uint64_t pids_current = 0;
+        if (__read_stat_u64(container, CV_STAT_PIDS, &pids_current) == 0) {
+            if (pids_current > UINT32_MAX) {
+                pids_current = UINT32_MAX;
             }
+            stats->active_processes = (uint32_t)pids_current;
         }
-
-        // Total processes created is not available directly via cgroup v2.
-        stats->total_processes = 0;
     }
 
+    // Total processes created is not available directly via cgroup v2.
+    stats->total_processes = 0;
+
     // Network (host-side veth interface stats)
-    __read_network_stats(container->id,
-                         &stats->network_rx_bytes, &stats->network_tx_bytes,
-                         &stats->network_rx_packets, &stats->network_tx_packets);
+    (void)__read_stat_u64(container, CV_STAT_NET_RX_BYTES, &stats->network_rx_bytes);
+    (void)__read_stat_u64(container, CV_STAT_NET_TX_BYTES, &stats->network_tx_bytes);
+    (void)__read_stat_u64(container, CV_STAT_NET_RX_PACKETS, &stats->network_rx_packets);
+    (void)__read_stat_u64(container, CV_STAT_NET_TX_PACKETS, &stats->network_tx_packets);
 
     // CPU percentage based on per-container deltas
     if (container->last_stats_timestamp_ns > 0 && stats->timestamp > container->last_stats_timestamp_ns) {
@@ -369,3 +364,100 @@ int containerv_get_processes(
     VLOG_DEBUG("containerv", "found %d processes in container %s\n", count, container->id);
     return count;
 }
+
+static const char* __g_pressure_files[] = {
+    [CV_WATCH_PRESSURE_CPU]    = "cpu.pressure",
+    [CV_WATCH_PRESSURE_MEMORY] = "memory.pressure",
+    [CV_WATCH_PRESSURE_IO]     = "io.pressure"
+};
+
+int containerv_watch_open(
+    struct containerv_container* container,
+    enum containerv_watch_type   type,
+    uint32_t                     stallUs,
+    uint32_t                     windowUs)
+{
+    char path[PATH_MAX];
+    char trigger[64];
+    int  length;
+    int  fd;
+
+    if (container == NULL || container->hostname == NULL || type > CV_WATCH_PRESSURE_IO) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // memory.events generates a modified event whenever one of its counters change,
+    // which wakes up pollers with POLLPRI until the file is read again
+    if (type == CV_WATCH_MEMORY_EVENTS) {
+        snprintf(path, sizeof(path), "/sys/fs/cgroup/%s/memory.events", container->hostname);
+        return open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    // PSI triggers are registered by writing them to the pressure file, they stay
+    // active for as long as the fd is open
+    snprintf(path, sizeof(path), "/sys/fs/cgroup/%s/%s", container->hostname, __g_pressure_files[type]);
+    fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    length = snprintf(trigger, sizeof(trigger), "some %u %u", stallUs, windowUs);
+    if (write(fd, trigger, (size_t)length + 1) < 0) {
+        VLOG_ERROR("containerv", "containerv_watch_open: failed to register trigger in %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int containerv_read_memory_events(int fd, struct containerv_memory_events* events)
+{
+    char        buffer[512];
+    const char* p = buffer;
+    ssize_t     n;
+
+    if (fd < 0 || events == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buffer[n] = '\0';
+
+    // memory.events contains e.g.:
+    // low 0
+    // high 12
+    // max 3
+    // oom 0
+    // oom_kill 0
+    memset(events, 0, sizeof(*events));
+    while (*p) {
+        char               key[32];
+        unsigned long long value;
+
+        if (sscanf(p, "%31s %llu", key, &value) == 2) {
+            if (strcmp(key, "low") == 0) {
+                events->low = (uint64_t)value;
+            } else if (strcmp(key, "high") == 0) {
+                events->high = (uint64_t)value;
+            } else if (strcmp(key, "max") == 0) {
+                events->max = (uint64_t)value;
+            } else if (strcmp(key, "oom") == 0) {
+                events->oom = (uint64_t)value;
+            } else if (strcmp(key, "oom_kill") == 0) {
+                events->oom_kill = (uint64_t)value;
+            }
+        }
+
+        p = strchr(p, '\n');
+        if (p == NULL) {
+            break;
+        }
+        p++;
+    }
+    return 0;
+}
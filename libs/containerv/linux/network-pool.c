@@ -0,0 +1,274 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <chef/containerv.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#include <vlog.h>
+
+#include "network.h"
+
+// The pool is capped to keep the number of idle namespaces reasonable
+#define __POOL_MAX_SIZE 64
+
+// How many names are tried before giving up, names can be taken by containers that
+// outlived a previous instance of the pool
+#define __POOL_NAME_ATTEMPTS 16
+
+// How long to wait before retrying after failing to prepare a namespace
+#define __POOL_RETRY_DELAY_S 1
+
+struct __network_pool {
+    mtx_t                     lock;
+    cnd_t                     signal;
+    thrd_t                    tid;
+    int                       started;
+    int                       running;
+    int                       size;
+    int                       count;
+    unsigned int              next_id;
+    int                       host_netns_fd;
+    struct network_pool_entry entries[__POOL_MAX_SIZE];
+};
+
+static struct __network_pool g_pool = { .host_netns_fd = -1 };
+
+// __create_netns creates a new network namespace with loopback up, and returns an
+// fd for it. The calling thread is returned to the host namespace before returning,
+// if that fails the pool can no longer be used, which is reported through <broken>.
+static int __create_netns(int* broken)
+{
+    int netnsFd;
+
+    // unshare only affects the calling thread, so this is safe to do in
+    // a multi-threaded process
+    if (unshare(CLONE_NEWNET)) {
+        VLOG_ERROR("containerv", "__create_netns: failed to create network namespace: %s\n", strerror(errno));
+        return -1;
+    }
+
+    netnsFd = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (netnsFd < 0) {
+        VLOG_ERROR("containerv", "__create_netns: failed to open network namespace: %s\n", strerror(errno));
+    } else if (if_up("lo", "127.0.0.1", "255.0.0.0")) {
+        VLOG_ERROR("containerv", "__create_netns: failed to bring up loopback interface\n");
+        close(netnsFd);
+        netnsFd = -1;
+    }
+
+    if (setns(g_pool.host_netns_fd, CLONE_NEWNET)) {
+        VLOG_ERROR("containerv", "__create_netns: failed to return to host network namespace: %s\n", strerror(errno));
+        if (netnsFd >= 0) {
+            close(netnsFd);
+        }
+        *broken = 1;
+        return -1;
+    }
+    return netnsFd;
+}
+
+static int __prepare_entry(int sockFd, struct network_pool_entry* entry, int* broken)
+{
+    int status = -1;
+
+    entry->netns_fd = __create_netns(broken);
+    if (entry->netns_fd < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < __POOL_NAME_ATTEMPTS; i++) {
+        unsigned int id = g_pool.next_id++;
+
+        snprintf(entry->host_veth, sizeof(entry->host_veth), "cvp%u", id);
+        snprintf(entry->container_veth, sizeof(entry->container_veth), "cvp%uc", id);
+        status = create_veth(sockFd, entry->host_veth, entry->container_veth);
+        if (status == 0 || errno != EEXIST) {
+            break;
+        }
+    }
+
+    if (status) {
+        VLOG_ERROR("containerv", "__prepare_entry: failed to create veth pair\n");
+        close(entry->netns_fd);
+        return -1;
+    }
+
+    status = move_if_to_pid_netns(sockFd, entry->container_veth, entry->netns_fd);
+    if (status) {
+        VLOG_ERROR("containerv", "__prepare_entry: failed to move %s to network namespace\n", entry->container_veth);
+        (void)delete_if(sockFd, entry->host_veth);
+        close(entry->netns_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int __network_pool_worker(void* context)
+{
+    int sockFd;
+    int broken = 0;
+    (void)context;
+
+    sockFd = create_socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sockFd < 0) {
+        VLOG_ERROR("containerv", "__network_pool_worker: failed to create netlink socket\n");
+        return -1;
+    }
+
+    mtx_lock(&g_pool.lock);
+    while (g_pool.running) {
+        struct network_pool_entry entry;
+        int                       status;
+
+        if (g_pool.count >= g_pool.size) {
+            cnd_wait(&g_pool.signal, &g_pool.lock);
+            continue;
+        }
+
+        // namespaces are prepared without holding the lock, so containers can
+        // take entries while the pool is being refilled
+        mtx_unlock(&g_pool.lock);
+        status = __prepare_entry(sockFd, &entry, &broken);
+        mtx_lock(&g_pool.lock);
+
+        if (status) {
+            struct timespec deadline;
+            if (broken) {
+                VLOG_ERROR("containerv", "__network_pool_worker: network pool disabled\n");
+                break;
+            }
+
+            // avoid spinning on persistent errors like missing privileges
+            timespec_get(&deadline, TIME_UTC);
+            deadline.tv_sec += __POOL_RETRY_DELAY_S;
+            (void)cnd_timedwait(&g_pool.signal, &g_pool.lock, &deadline);
+            continue;
+        }
+        g_pool.entries[g_pool.count++] = entry;
+    }
+    mtx_unlock(&g_pool.lock);
+
+    close(sockFd);
+    return 0;
+}
+
+int containerv_network_pool_start(int size)
+{
+    VLOG_DEBUG("containerv", "containerv_network_pool_start(size=%i)\n", size);
+
+    if (size <= 0) {
+        return 0;
+    }
+
+    if (g_pool.started) {
+        errno = EALREADY;
+        return -1;
+    }
+
+    if (size > __POOL_MAX_SIZE) {
+        VLOG_WARNING("containerv", "containerv_network_pool_start: limiting pool size to %i\n", __POOL_MAX_SIZE);
+        size = __POOL_MAX_SIZE;
+    }
+
+    g_pool.host_netns_fd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (g_pool.host_netns_fd < 0) {
+        VLOG_ERROR("containerv", "containerv_network_pool_start: failed to open host network namespace\n");
+        return -1;
+    }
+
+    if (mtx_init(&g_pool.lock, mtx_plain) != thrd_success) {
+        close(g_pool.host_netns_fd);
+        g_pool.host_netns_fd = -1;
+        return -1;
+    }
+
+    if (cnd_init(&g_pool.signal) != thrd_success) {
+        mtx_destroy(&g_pool.lock);
+        close(g_pool.host_netns_fd);
+        g_pool.host_netns_fd = -1;
+        return -1;
+    }
+
+    g_pool.size = size;
+    g_pool.count = 0;
+    g_pool.running = 1;
+    if (thrd_create(&g_pool.tid, __network_pool_worker, NULL) != thrd_success) {
+        VLOG_ERROR("containerv", "containerv_network_pool_start: failed to start pool thread\n");
+        cnd_destroy(&g_pool.signal);
+        mtx_destroy(&g_pool.lock);
+        close(g_pool.host_netns_fd);
+        g_pool.host_netns_fd = -1;
+        g_pool.running = 0;
+        return -1;
+    }
+    g_pool.started = 1;
+    return 0;
+}
+
+void containerv_network_pool_stop(void)
+{
+    if (!g_pool.started) {
+        return;
+    }
+
+    mtx_lock(&g_pool.lock);
+    g_pool.running = 0;
+    cnd_signal(&g_pool.signal);
+    mtx_unlock(&g_pool.lock);
+    thrd_join(g_pool.tid, NULL);
+
+    // the veth pairs are destroyed together with their namespaces
+    for (int i = 0; i < g_pool.count; i++) {
+        close(g_pool.entries[i].netns_fd);
+    }
+    g_pool.count = 0;
+
+    cnd_destroy(&g_pool.signal);
+    mtx_destroy(&g_pool.lock);
+    close(g_pool.host_netns_fd);
+    g_pool.host_netns_fd = -1;
+    g_pool.started = 0;
+}
+
+int network_pool_take(struct network_pool_entry* entry)
+{
+    int status = -1;
+
+    if (!g_pool.started) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    mtx_lock(&g_pool.lock);
+    if (g_pool.count > 0) {
+        *entry = g_pool.entries[--g_pool.count];
+        cnd_signal(&g_pool.signal);
+        status = 0;
+    } else {
+        errno = EAGAIN;
+    }
+    mtx_unlock(&g_pool.lock);
+    return status;
+}
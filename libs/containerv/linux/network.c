@@ -303,3 +303,20 @@ int move_if_to_pid_netns(int sock_fd, char *ifname, int netns)
     }
     return send_nlmsg(sock_fd, &req.n);
 }
+
+int delete_if(int sock_fd, char *ifname)
+{
+    // ip link delete veth1
+    struct nl_req req = {
+            .n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+            .n.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK,
+            .n.nlmsg_type = RTM_DELLINK,
+            .i.ifi_family = PF_NETLINK,
+    };
+
+    if (addattr_l(&req.n, sizeof(req), IFLA_IFNAME,
+              ifname, strlen(ifname) + 1) != 0) {
+        return -1;
+    }
+    return send_nlmsg(sock_fd, &req.n);
+}
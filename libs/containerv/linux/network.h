@@ -52,10 +52,35 @@ int create_veth(int sock_fd, char *ifname, char *peername);
  */
 int move_if_to_pid_netns(int sock_fd, char *ifname, int netns);
 
+/**
+ * @brief Delete a network interface, deleting one end of a veth pair deletes both
+ * @return 0 on success, -1 on failure
+ */
+int delete_if(int sock_fd, char *ifname);
+
 /**
  * @brief Get the file descriptor for a process's network namespace
  * @return file descriptor on success, -1 on failure
  */
 int get_netns_fd(int pid);
 
+/**
+ * @brief A network namespace that has been prepared by the network pool. The namespace
+ * has its loopback interface up, and contains container_veth, whose peer host_veth is
+ * left in the host namespace.
+ */
+struct network_pool_entry {
+    int  netns_fd;
+    char host_veth[16];
+    char container_veth[16];
+};
+
+/**
+ * @brief Take a prepared network namespace from the pool, the pool is replenished in the
+ * background. The caller owns entry->netns_fd, closing the last reference to the namespace
+ * destroys it together with the veth pair.
+ * @return 0 on success, -1 if the pool is not running or is empty
+ */
+int network_pool_take(struct network_pool_entry* entry);
+
 #endif //ISOLATE_NETNS_H
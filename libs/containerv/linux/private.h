@@ -43,6 +43,20 @@ enum containerv_namespace_type {
     CV_NS_COUNT
 };
 
+enum containerv_stat_file {
+    CV_STAT_CPU = 0,
+    CV_STAT_MEMORY_CURRENT,
+    CV_STAT_MEMORY_PEAK,
+    CV_STAT_IO,
+    CV_STAT_PIDS,
+    CV_STAT_NET_RX_BYTES,
+    CV_STAT_NET_TX_BYTES,
+    CV_STAT_NET_RX_PACKETS,
+    CV_STAT_NET_TX_PACKETS,
+
+    CV_STAT_COUNT
+};
+
 struct containerv_options_user_range {
     unsigned int host_start;
     unsigned int child_start;
@@ -60,7 +74,13 @@ struct containerv_options_network {
 
 struct containerv_options_cgroup {
     const char* memory_max;      // e.g., "1G", "512M", or "max" for no limit
+    const char* memory_high;     // memory throttling threshold, or NULL
     const char* cpu_weight;      // 1-10000, default is 100
+    const char* cpu_max;         // "<quota> <period>", or NULL
+    const char* cpuset_cpus;     // e.g. "0-3", or NULL
+    const char* cpuset_mems;     // e.g. "0", or NULL
+    const char* io_weight;       // 1-10000, or NULL
+    const char* io_max;          // e.g. "8:0 rbps=1048576", or NULL
     const char* pids_max;        // maximum number of processes, or "max"
 };
 
@@ -73,6 +93,8 @@ struct containerv_options {
     struct containerv_options_user_range   gid_range;
     struct containerv_options_network      network;
     struct containerv_options_cgroup       cgroup;
+    int                                    exec_helper;
+    int                                    external_output;
 };
 
 struct containerv_container {
@@ -80,14 +102,25 @@ struct containerv_container {
     pid_t        pid;
     thrd_t       log_tid;
     volatile int log_running;
+    int          external_output; // stdout/stderr are read by the caller
     char*        hostname;        // hostname for cgroups/network
 
-    // stats (host)
+    // stats (host), the files are opened on first use and kept open
+    int      stat_fds[CV_STAT_COUNT];
     uint64_t last_stats_timestamp_ns;
     uint64_t last_stats_cpu_time_ns;
 
+    // startup timing (host)
+    struct containerv_create_timing timing;
+
+    // network (host), host_veth is the name of the host side of the veth pair
+    char host_veth[16];
+
     // child
     char*       rootfs;
+    int         cgroup_fd;       // prepared cgroup, the child moves itself into it
+    int         netns_fd;        // network namespace adopted from the pool, the child joins it
+    char        container_veth[16];
     int         socket_fd;
     int         ns_fds[CV_NS_COUNT];
     struct list processes;
@@ -193,6 +226,12 @@ extern int __containerv_spawn(struct containerv_container* container, struct __c
 extern int __containerv_kill(struct containerv_container* container, pid_t processId);
 extern void __containerv_destroy(struct containerv_container* container);
 
+/**
+ * @brief Forks the exec helper from the container init process, it must be called
+ * once the container has been fully set up.
+ */
+extern int containerv_exec_helper_start(struct containerv_container* container);
+
 extern int policy_seccomp_apply(struct containerv_policy* policy);
 
 #endif //!__PRIVATE_H__
\ No newline at end of file
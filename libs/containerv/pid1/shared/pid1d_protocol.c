@@ -0,0 +1,261 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pid1d_protocol.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void __write_u16(uint8_t* out, uint16_t value)
+{
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)((value >> 8) & 0xFF);
+}
+
+static void __write_u32(uint8_t* out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static void __write_u64(uint8_t* out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static uint16_t __read_u16(const uint8_t* in)
+{
+    return (uint16_t)(in[0] | ((uint16_t)in[1] << 8));
+}
+
+static uint32_t __read_u32(const uint8_t* in)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t)in[i] << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t __read_u64(const uint8_t* in)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)in[i] << (i * 8);
+    }
+    return value;
+}
+
+void pid1d_frame_header_encode(const pid1d_frame_header_t* header, uint8_t out[PID1D_FRAME_HEADER_SIZE])
+{
+    __write_u16(&out[0], PID1D_FRAME_MAGIC);
+    out[2] = header->op;
+    out[3] = header->flags;
+    __write_u32(&out[4], header->tag);
+    __write_u32(&out[8], header->length);
+    __write_u32(&out[12], (uint32_t)header->status);
+}
+
+int pid1d_frame_header_decode(const uint8_t in[PID1D_FRAME_HEADER_SIZE], pid1d_frame_header_t* header)
+{
+    if (__read_u16(&in[0]) != PID1D_FRAME_MAGIC) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    header->op = in[2];
+    header->flags = in[3];
+    header->tag = __read_u32(&in[4]);
+    header->length = __read_u32(&in[8]);
+    header->status = (int32_t)__read_u32(&in[12]);
+    if (header->length > PID1D_FRAME_MAX_PAYLOAD) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void pid1d_buffer_init(pid1d_buffer_t* buffer)
+{
+    memset(buffer, 0, sizeof(pid1d_buffer_t));
+    buffer->owned = 1;
+}
+
+void pid1d_buffer_wrap(pid1d_buffer_t* buffer, const void* data, size_t length)
+{
+    memset(buffer, 0, sizeof(pid1d_buffer_t));
+    buffer->data = (uint8_t*)data;
+    buffer->length = length;
+    buffer->capacity = length;
+}
+
+void pid1d_buffer_reset(pid1d_buffer_t* buffer)
+{
+    buffer->length = 0;
+    buffer->offset = 0;
+    buffer->error = 0;
+}
+
+void pid1d_buffer_free(pid1d_buffer_t* buffer)
+{
+    if (buffer->owned) {
+        free(buffer->data);
+    }
+    memset(buffer, 0, sizeof(pid1d_buffer_t));
+}
+
+void* pid1d_buffer_extend(pid1d_buffer_t* buffer, size_t length)
+{
+    void* start;
+
+    if (buffer->error || !buffer->owned) {
+        buffer->error = 1;
+        return NULL;
+    }
+
+    if (buffer->length + length > buffer->capacity) {
+        size_t   capacity = buffer->capacity ? buffer->capacity : 256;
+        uint8_t* data;
+
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+
+        data = realloc(buffer->data, capacity);
+        if (data == NULL) {
+            buffer->error = 1;
+            errno = ENOMEM;
+            return NULL;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+
+    start = &buffer->data[buffer->length];
+    buffer->length += length;
+    return start;
+}
+
+void pid1d_put_u8(pid1d_buffer_t* buffer, uint8_t value)
+{
+    uint8_t* out = pid1d_buffer_extend(buffer, 1);
+    if (out != NULL) {
+        out[0] = value;
+    }
+}
+
+void pid1d_put_u32(pid1d_buffer_t* buffer, uint32_t value)
+{
+    uint8_t* out = pid1d_buffer_extend(buffer, 4);
+    if (out != NULL) {
+        __write_u32(out, value);
+    }
+}
+
+void pid1d_put_u64(pid1d_buffer_t* buffer, uint64_t value)
+{
+    uint8_t* out = pid1d_buffer_extend(buffer, 8);
+    if (out != NULL) {
+        __write_u64(out, value);
+    }
+}
+
+void pid1d_put_bytes(pid1d_buffer_t* buffer, const void* data, size_t length)
+{
+    uint8_t* out;
+
+    if (length == 0) {
+        return;
+    }
+    out = pid1d_buffer_extend(buffer, length);
+    if (out != NULL) {
+        memcpy(out, data, length);
+    }
+}
+
+void pid1d_put_string(pid1d_buffer_t* buffer, const char* value)
+{
+    size_t length = value != NULL ? strlen(value) : 0;
+
+    pid1d_put_u32(buffer, (uint32_t)length);
+    pid1d_put_bytes(buffer, value, length);
+    pid1d_put_u8(buffer, 0);
+}
+
+static const uint8_t* __consume(pid1d_buffer_t* buffer, size_t length)
+{
+    const uint8_t* start;
+
+    if (buffer->error || buffer->length - buffer->offset < length) {
+        buffer->error = 1;
+        return NULL;
+    }
+    start = &buffer->data[buffer->offset];
+    buffer->offset += length;
+    return start;
+}
+
+uint8_t pid1d_get_u8(pid1d_buffer_t* buffer)
+{
+    const uint8_t* in = __consume(buffer, 1);
+    return in != NULL ? in[0] : 0;
+}
+
+uint32_t pid1d_get_u32(pid1d_buffer_t* buffer)
+{
+    const uint8_t* in = __consume(buffer, 4);
+    return in != NULL ? __read_u32(in) : 0;
+}
+
+uint64_t pid1d_get_u64(pid1d_buffer_t* buffer)
+{
+    const uint8_t* in = __consume(buffer, 8);
+    return in != NULL ? __read_u64(in) : 0;
+}
+
+const char* pid1d_get_string(pid1d_buffer_t* buffer)
+{
+    uint32_t       length = pid1d_get_u32(buffer);
+    const uint8_t* in;
+
+    if (buffer->error || length == UINT32_MAX) {
+        buffer->error = 1;
+        return NULL;
+    }
+
+    in = __consume(buffer, (size_t)length + 1);
+    if (in == NULL || in[length] != 0) {
+        buffer->error = 1;
+        return NULL;
+    }
+    return (const char*)in;
+}
+
+const uint8_t* pid1d_get_remaining(pid1d_buffer_t* buffer, size_t* length_out)
+{
+    size_t length = buffer->error ? 0 : buffer->length - buffer->offset;
+
+    *length_out = length;
+    if (buffer->error) {
+        return NULL;
+    }
+    return __consume(buffer, length);
+}
@@ -0,0 +1,156 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PID1D_PROTOCOL_H__
+#define __PID1D_PROTOCOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * pid1d speaks newline-delimited JSON when it starts. A client that sends
+ * {"op":"hello","protocol":"binary","version":1} and receives a response with
+ * "protocol":"binary" switches both directions to length-prefixed frames for
+ * the rest of the session. Clients that never ask, or pid1d versions that do
+ * not know the hello op, stay on JSON.
+ *
+ * Every frame is a 16 byte little-endian header followed by the payload:
+ *
+ *   uint16 magic, uint8 op, uint8 flags, uint32 tag, uint32 length, int32 status
+ *
+ * Responses carry the tag of their request and are sent in request order, so a
+ * client may send several requests before it reads the responses. On errors the
+ * response has PID1D_FRAME_ERROR set, status is the errno and the payload is the
+ * error message.
+ */
+#define PID1D_PROTOCOL_VERSION  1
+#define PID1D_FRAME_MAGIC       0x4450
+#define PID1D_FRAME_HEADER_SIZE 16
+
+// Frames with a larger payload are rejected by both sides
+#define PID1D_FRAME_MAX_PAYLOAD (4 * 1024 * 1024)
+
+// The largest file chunk that is moved by a single FILE_WRITE or FILE_READ
+#define PID1D_FILE_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * @brief Request payloads, fields are in this order:
+ * PING:       (empty)                    => string service, uint32 version
+ * SPAWN:      string command, string cwd, uint8 wait, uint32 argc, string[argc] args,
+ *             uint32 envc, string[envc] env => uint64 id
+ * WAIT:       uint64 id                  => int32 exit_code
+ * KILL:       uint64 id, uint8 reap      => (empty)
+ * FILE_WRITE: string path, uint8 flags, raw data until the end of the frame => uint64 bytes
+ * FILE_READ:  string path, uint64 offset, uint32 max_bytes => uint8 eof, raw data until the end
+ * An empty cwd means the default directory, and argc/envc of 0 means the defaults.
+ */
+typedef enum pid1d_op {
+    PID1D_OP_PING = 1,
+    PID1D_OP_SPAWN,
+    PID1D_OP_WAIT,
+    PID1D_OP_KILL,
+    PID1D_OP_FILE_WRITE,
+    PID1D_OP_FILE_READ
+} pid1d_op_t;
+
+#define PID1D_FRAME_RESPONSE 0x1
+#define PID1D_FRAME_ERROR    0x2
+
+#define PID1D_FILE_APPEND 0x1
+#define PID1D_FILE_MKDIRS 0x2
+
+typedef struct pid1d_frame_header {
+    uint8_t  op;
+    uint8_t  flags;
+    uint32_t tag;
+    uint32_t length;
+    int32_t  status;
+} pid1d_frame_header_t;
+
+/**
+ * @brief Growable buffer used to build payloads, and to read them back. Put
+ * functions append to the buffer, get functions consume from offset. Errors are
+ * sticky, so a sequence of calls only needs to be checked once at the end.
+ */
+typedef struct pid1d_buffer {
+    uint8_t* data;
+    size_t   length;
+    size_t   capacity;
+    size_t   offset;
+    int      error;
+    int      owned;
+} pid1d_buffer_t;
+
+/**
+ * @brief Encode a frame header into its wire format.
+ */
+extern void pid1d_frame_header_encode(const pid1d_frame_header_t* header, uint8_t out[PID1D_FRAME_HEADER_SIZE]);
+
+/**
+ * @brief Decode a frame header from its wire format.
+ * @return 0 on success, -1 if the magic or length is invalid (errno is set to EPROTO)
+ */
+extern int pid1d_frame_header_decode(const uint8_t in[PID1D_FRAME_HEADER_SIZE], pid1d_frame_header_t* header);
+
+extern void pid1d_buffer_init(pid1d_buffer_t* buffer);
+
+/**
+ * @brief Initialize a buffer for reading existing data, the data is not copied and
+ * must outlive the buffer.
+ */
+extern void pid1d_buffer_wrap(pid1d_buffer_t* buffer, const void* data, size_t length);
+
+/**
+ * @brief Clears the contents but keeps the allocation, so the buffer can be reused.
+ */
+extern void pid1d_buffer_reset(pid1d_buffer_t* buffer);
+extern void pid1d_buffer_free(pid1d_buffer_t* buffer);
+
+/**
+ * @brief Make room for length bytes at the end of the buffer, and return a pointer to
+ * them. The caller must fill them in, they are already counted in the length.
+ */
+extern void* pid1d_buffer_extend(pid1d_buffer_t* buffer, size_t length);
+
+extern void pid1d_put_u8(pid1d_buffer_t* buffer, uint8_t value);
+extern void pid1d_put_u32(pid1d_buffer_t* buffer, uint32_t value);
+extern void pid1d_put_u64(pid1d_buffer_t* buffer, uint64_t value);
+extern void pid1d_put_bytes(pid1d_buffer_t* buffer, const void* data, size_t length);
+
+/**
+ * @brief Strings are encoded as a uint32 length followed by the characters and a
+ * terminating zero, which lets the reader return them without copying. NULL is
+ * encoded as an empty string.
+ */
+extern void pid1d_put_string(pid1d_buffer_t* buffer, const char* value);
+
+extern uint8_t  pid1d_get_u8(pid1d_buffer_t* buffer);
+extern uint32_t pid1d_get_u32(pid1d_buffer_t* buffer);
+extern uint64_t pid1d_get_u64(pid1d_buffer_t* buffer);
+
+/**
+ * @brief Returns a pointer to the string inside the buffer, or NULL on errors.
+ */
+extern const char* pid1d_get_string(pid1d_buffer_t* buffer);
+
+/**
+ * @brief Consumes the rest of the buffer and returns a pointer to it.
+ */
+extern const uint8_t* pid1d_get_remaining(pid1d_buffer_t* buffer, size_t* length_out);
+
+#endif //!__PID1D_PROTOCOL_H__
@@ -13,10 +13,13 @@
 #include <jansson.h>
 
 #include <pid1_common.h>
+#include <pid1d_protocol.h>
 #include <logging.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #endif
 
 typedef struct proc_entry {
@@ -391,39 +394,17 @@ static void __free_string_array(const char** arr)
     free((void*)arr);
 }
 
-static int __handle_ping(void)
-{
-    json_t* extra = json_object();
-    if (extra == NULL) {
-        return __respond_ok(NULL);
-    }
-    json_object_set_new(extra, "service", json_string("pid1d"));
-    json_object_set_new(extra, "version", json_integer(1));
-    int rc = __respond_ok(extra);
-    json_decref(extra);
-    return rc;
-}
+// The operations below are shared by the JSON and the binary protocol. They
+// return NULL on success, or a message describing the failure with errno set.
 
-static int __handle_spawn(json_t* req)
+static const char* __op_spawn(
+    const char*        command,
+    const char* const* args,
+    const char* const* env,
+    const char*        cwd,
+    int                wait,
+    uint64_t*          id_out)
 {
-    const char* command = __json_get_string(req, "command");
-    const char* cwd = __json_get_string(req, "cwd");
-
-    json_t* args_json = json_object_get(req, "args");
-    json_t* env_json = json_object_get(req, "env");
-
-    const char** args = NULL;
-    const char** env = NULL;
-
-    if (command == NULL) {
-        errno = EINVAL;
-        return __respond_err("missing command");
-    }
-
-    if (__json_to_string_array(args_json, &args) != 0) {
-        return __respond_err("invalid args");
-    }
-
     // Default args: [command]
     const char* default_args_buf[2] = {0};
     const char* const* effective_args = args;
@@ -433,11 +414,6 @@ static int __handle_spawn(json_t* req)
         effective_args = default_args_buf;
     }
 
-    if (__json_to_string_array(env_json, &env) != 0) {
-        __free_string_array(args);
-        return __respond_err("invalid env");
-    }
-
     pid1_process_options_t opts;
     memset(&opts, 0, sizeof(opts));
     opts.command = command;
@@ -445,14 +421,12 @@ static int __handle_spawn(json_t* req)
     opts.environment = env;
     opts.working_directory = cwd;
     opts.log_path = NULL;
-    opts.wait_for_exit = __json_get_bool(req, "wait", 0);
+    opts.wait_for_exit = wait;
     opts.forward_signals = 1;
 
     pid1_process_handle_t handle;
     if (pid1_spawn_process(&opts, &handle) != 0) {
-        __free_string_array(args);
-        __free_string_array(env);
-        return __respond_err("spawn failed");
+        return "spawn failed";
     }
 
     proc_entry_t* e = calloc(1, sizeof(proc_entry_t));
@@ -464,10 +438,8 @@ static int __handle_spawn(json_t* req)
             CloseHandle(handle);
         }
 #endif
-        __free_string_array(args);
-        __free_string_array(env);
         errno = ENOMEM;
-        return __respond_err("oom");
+        return "oom";
     }
 
     e->id = g_next_id++;
@@ -475,17 +447,167 @@ static int __handle_spawn(json_t* req)
     e->next = g_procs;
     g_procs = e;
 
+    *id_out = e->id;
+    return NULL;
+}
+
+static const char* __op_wait(uint64_t id, int* exit_code_out)
+{
+    proc_entry_t* e = __procs_find(id);
+    if (e == NULL) {
+        errno = ESRCH;
+        return "unknown id";
+    }
+
+    *exit_code_out = 0;
+    if (pid1_wait_process(e->handle, exit_code_out) != 0) {
+        return "wait failed";
+    }
+
+    __procs_remove(id);
+    return NULL;
+}
+
+static const char* __op_kill(uint64_t id, int reap)
+{
+    proc_entry_t* e = __procs_find(id);
+    if (e == NULL) {
+        errno = ESRCH;
+        return "unknown id";
+    }
+
+    if (pid1_kill_process(e->handle) != 0) {
+        return "kill failed";
+    }
+
+    if (reap) {
+        (void)pid1_wait_process(e->handle, NULL);
+        __procs_remove(id);
+    }
+
+    // Caller may still want to wait; keep it tracked unless reaped.
+    return NULL;
+}
+
+static const char* __op_file_write(const char* path, const void* data, size_t length, int append, int mkdirs)
+{
+    if (mkdirs) {
+        (void)__mkdirs_for_file(path);
+    }
+
+    FILE* f = fopen(path, append ? "ab" : "wb");
+    if (f == NULL) {
+        return "open failed";
+    }
+
+    if (length > 0 && fwrite(data, 1, length, f) != length) {
+        fclose(f);
+        errno = EIO;
+        return "write failed";
+    }
+
+    fclose(f);
+    return NULL;
+}
+
+static const char* __op_file_read(const char* path, uint64_t offset, void* buffer, size_t max_bytes, size_t* read_out, int* eof_out)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return "open failed";
+    }
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    if (_fseeki64(f, (long long)offset, SEEK_SET) != 0) {
+#else
+    if (fseeko(f, (off_t)offset, SEEK_SET) != 0) {
+#endif
+        fclose(f);
+        return "seek failed";
+    }
+
+    *read_out = fread(buffer, 1, max_bytes, f);
+    *eof_out = feof(f) ? 1 : 0;
+    fclose(f);
+    return NULL;
+}
+
+static int __handle_ping(void)
+{
     json_t* extra = json_object();
-    if (extra != NULL) {
-        json_object_set_new(extra, "id", json_integer((json_int_t)e->id));
+    if (extra == NULL) {
+        return __respond_ok(NULL);
     }
+    json_object_set_new(extra, "service", json_string("pid1d"));
+    json_object_set_new(extra, "version", json_integer(1));
     int rc = __respond_ok(extra);
-    if (extra != NULL) {
-        json_decref(extra);
+    json_decref(extra);
+    return rc;
+}
+
+// Negotiates the protocol for the rest of the session. Anything but a request
+// for a binary protocol version we speak keeps the session on JSON.
+static int __handle_hello(json_t* req, int* binary_out)
+{
+    const char* protocol = __json_get_string(req, "protocol");
+    json_t*     versionv = json_object_get(req, "version");
+
+    *binary_out = protocol != NULL && strcmp(protocol, "binary") == 0 &&
+        json_is_integer(versionv) && json_integer_value(versionv) == PID1D_PROTOCOL_VERSION;
+
+    json_t* extra = json_object();
+    if (extra == NULL) {
+        *binary_out = 0;
+        return __respond_ok(NULL);
+    }
+    json_object_set_new(extra, "protocol", json_string(*binary_out ? "binary" : "json"));
+    json_object_set_new(extra, "version", json_integer(PID1D_PROTOCOL_VERSION));
+    int rc = __respond_ok(extra);
+    json_decref(extra);
+    return rc;
+}
+
+static int __handle_spawn(json_t* req)
+{
+    const char* command = __json_get_string(req, "command");
+    const char* cwd = __json_get_string(req, "cwd");
+
+    json_t* args_json = json_object_get(req, "args");
+    json_t* env_json = json_object_get(req, "env");
+
+    const char** args = NULL;
+    const char** env = NULL;
+
+    if (command == NULL) {
+        errno = EINVAL;
+        return __respond_err("missing command");
+    }
+
+    if (__json_to_string_array(args_json, &args) != 0) {
+        return __respond_err("invalid args");
     }
 
+    if (__json_to_string_array(env_json, &env) != 0) {
+        __free_string_array(args);
+        return __respond_err("invalid env");
+    }
+
+    uint64_t    id = 0;
+    const char* err = __op_spawn(command, args, env, cwd, __json_get_bool(req, "wait", 0), &id);
     __free_string_array(args);
     __free_string_array(env);
+    if (err != NULL) {
+        return __respond_err(err);
+    }
+
+    json_t* extra = json_object();
+    if (extra != NULL) {
+        json_object_set_new(extra, "id", json_integer((json_int_t)id));
+    }
+    int rc = __respond_ok(extra);
+    if (extra != NULL) {
+        json_decref(extra);
+    }
     return rc;
 }
 
@@ -497,20 +619,12 @@ static int __handle_wait(json_t* req)
         return __respond_err("missing id");
     }
 
-    uint64_t id = (uint64_t)json_integer_value(idv);
-    proc_entry_t* e = __procs_find(id);
-    if (e == NULL) {
-        errno = ESRCH;
-        return __respond_err("unknown id");
-    }
-
-    int exit_code = 0;
-    if (pid1_wait_process(e->handle, &exit_code) != 0) {
-        return __respond_err("wait failed");
+    int         exit_code = 0;
+    const char* err = __op_wait((uint64_t)json_integer_value(idv), &exit_code);
+    if (err != NULL) {
+        return __respond_err(err);
     }
 
-    __procs_remove(id);
-
     json_t* extra = json_object();
     if (extra != NULL) {
         json_object_set_new(extra, "exit_code", json_integer(exit_code));
@@ -530,25 +644,10 @@ static int __handle_kill(json_t* req)
         return __respond_err("missing id");
     }
 
-    int reap = __json_get_bool(req, "reap", 0);
-
-    uint64_t id = (uint64_t)json_integer_value(idv);
-    proc_entry_t* e = __procs_find(id);
-    if (e == NULL) {
-        errno = ESRCH;
-        return __respond_err("unknown id");
+    const char* err = __op_kill((uint64_t)json_integer_value(idv), __json_get_bool(req, "reap", 0));
+    if (err != NULL) {
+        return __respond_err(err);
     }
-
-    if (pid1_kill_process(e->handle) != 0) {
-        return __respond_err("kill failed");
-    }
-
-    if (reap) {
-        (void)pid1_wait_process(e->handle, NULL);
-        __procs_remove(id);
-    }
-
-    // Caller may still want to wait; keep it tracked unless reaped.
     return __respond_ok(NULL);
 }
 
@@ -564,10 +663,6 @@ static int __handle_file_write_b64(json_t* req)
         return __respond_err("missing path/data");
     }
 
-    if (mkdirs) {
-        (void)__mkdirs_for_file(path);
-    }
-
     size_t data_len = strlen(data);
     size_t decoded_len = 0;
     unsigned char* decoded = __base64_decode_alloc(data, data_len, &decoded_len);
@@ -575,29 +670,15 @@ static int __handle_file_write_b64(json_t* req)
         return __respond_err("base64 decode failed");
     }
 
-    FILE* f = fopen(path, append ? "ab" : "wb");
-    if (f == NULL) {
-        free(decoded);
-        return __respond_err("open failed");
-    }
-
-    size_t written = 0;
-    if (decoded_len > 0) {
-        written = fwrite(decoded, 1, decoded_len, f);
-        if (written != decoded_len) {
-            fclose(f);
-            free(decoded);
-            errno = EIO;
-            return __respond_err("write failed");
-        }
-    }
-
-    fclose(f);
+    const char* err = __op_file_write(path, decoded, decoded_len, append, mkdirs);
     free(decoded);
+    if (err != NULL) {
+        return __respond_err(err);
+    }
 
     json_t* extra = json_object();
     if (extra != NULL) {
-        json_object_set_new(extra, "bytes", json_integer((json_int_t)written));
+        json_object_set_new(extra, "bytes", json_integer((json_int_t)decoded_len));
     }
     int rc = __respond_ok(extra);
     if (extra != NULL) {
@@ -624,30 +705,19 @@ static int __handle_file_read_b64(json_t* req)
         return __respond_err("invalid max_bytes");
     }
 
-    FILE* f = fopen(path, "rb");
-    if (f == NULL) {
-        return __respond_err("open failed");
-    }
-
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-    if (_fseeki64(f, (long long)offset, SEEK_SET) != 0) {
-#else
-    if (fseeko(f, (off_t)offset, SEEK_SET) != 0) {
-#endif
-        fclose(f);
-        return __respond_err("seek failed");
-    }
-
     unsigned char* buf = malloc((size_t)max_bytes);
     if (buf == NULL) {
-        fclose(f);
         errno = ENOMEM;
         return __respond_err("oom");
     }
 
-    size_t nread = fread(buf, 1, (size_t)max_bytes, f);
-    int eof = feof(f) ? 1 : 0;
-    fclose(f);
+    size_t      nread = 0;
+    int         eof = 0;
+    const char* err = __op_file_read(path, offset, buf, (size_t)max_bytes, &nread, &eof);
+    if (err != NULL) {
+        free(buf);
+        return __respond_err(err);
+    }
 
     size_t b64_len = 0;
     char* b64 = __base64_encode_alloc(buf, nread, &b64_len);
@@ -671,7 +741,7 @@ static int __handle_file_read_b64(json_t* req)
     return rc;
 }
 
-static int __dispatch(json_t* req)
+static int __dispatch(json_t* req, int* binary_out)
 {
     const char* op = __json_get_string(req, "op");
     if (op == NULL) {
@@ -682,6 +752,9 @@ static int __dispatch(json_t* req)
     if (strcmp(op, "ping") == 0) {
         return __handle_ping();
     }
+    if (strcmp(op, "hello") == 0) {
+        return __handle_hello(req, binary_out);
+    }
     if (strcmp(op, "spawn") == 0) {
         return __handle_spawn(req);
     }
@@ -702,19 +775,10 @@ static int __dispatch(json_t* req)
     return __respond_err("unknown op");
 }
 
-int main(int argc, char** argv)
+// Reads the JSON session until the client disconnects, or negotiates the binary
+// protocol, in which case 1 is returned.
+static int __serve_json(void)
 {
-    (void)argc;
-    (void)argv;
-
-    // pid1 logging is optional; keep it on stderr.
-    (void)pid1_log_init(NULL, PID1_LOG_INFO);
-
-    if (pid1_init() != 0) {
-        (void)__respond_err("pid1_init failed");
-        return 1;
-    }
-
     char line[64 * 1024];
     while (fgets(line, (int)sizeof(line), stdin) != NULL) {
         // Trim trailing newline(s)
@@ -739,8 +803,284 @@ int main(int argc, char** argv)
             continue;
         }
 
-        (void)__dispatch(req);
+        int binary = 0;
+        (void)__dispatch(req, &binary);
         json_decref(req);
+        if (binary) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int __write_frame(const pid1d_frame_header_t* header, const void* payload)
+{
+    uint8_t raw[PID1D_FRAME_HEADER_SIZE];
+
+    pid1d_frame_header_encode(header, raw);
+    if (fwrite(raw, 1, sizeof(raw), stdout) != sizeof(raw)) {
+        return -1;
+    }
+    if (header->length > 0 && fwrite(payload, 1, header->length, stdout) != header->length) {
+        return -1;
+    }
+    return fflush(stdout) == 0 ? 0 : -1;
+}
+
+static int __frame_respond(const pid1d_frame_header_t* req, pid1d_buffer_t* payload)
+{
+    if (payload->error) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return __write_frame(&(pid1d_frame_header_t) {
+        .op = req->op,
+        .flags = PID1D_FRAME_RESPONSE,
+        .tag = req->tag,
+        .length = (uint32_t)payload->length,
+        .status = 0
+    }, payload->data);
+}
+
+static int __frame_respond_err(const pid1d_frame_header_t* req, const char* msg)
+{
+    int status = errno != 0 ? errno : EINVAL;
+    msg = msg ? msg : "error";
+    return __write_frame(&(pid1d_frame_header_t) {
+        .op = req->op,
+        .flags = PID1D_FRAME_RESPONSE | PID1D_FRAME_ERROR,
+        .tag = req->tag,
+        .length = (uint32_t)strlen(msg),
+        .status = status
+    }, msg);
+}
+
+// Strings arrays are sent as a count followed by the strings, and are
+// returned NULL terminated. The strings point into the request payload.
+static const char** __frame_get_string_array(pid1d_buffer_t* req)
+{
+    uint32_t count = pid1d_get_u32(req);
+    if (req->error || count == 0) {
+        return NULL;
+    }
+    if (count > req->length - req->offset) {
+        req->error = 1;
+        return NULL;
+    }
+
+    const char** v = calloc((size_t)count + 1, sizeof(char*));
+    if (v == NULL) {
+        req->error = 1;
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        v[i] = pid1d_get_string(req);
+    }
+    if (req->error) {
+        free(v);
+        return NULL;
+    }
+    return v;
+}
+
+static int __frame_handle_spawn(const pid1d_frame_header_t* header, pid1d_buffer_t* req, pid1d_buffer_t* resp)
+{
+    const char* command = pid1d_get_string(req);
+    const char* cwd = pid1d_get_string(req);
+    int         wait = pid1d_get_u8(req);
+    const char** args = __frame_get_string_array(req);
+    const char** env = __frame_get_string_array(req);
+
+    if (req->error || command == NULL || command[0] == '\0') {
+        __free_string_array(args);
+        __free_string_array(env);
+        errno = EINVAL;
+        return __frame_respond_err(header, "invalid spawn request");
+    }
+
+    uint64_t    id = 0;
+    const char* err = __op_spawn(command, args, env, cwd[0] != '\0' ? cwd : NULL, wait, &id);
+    __free_string_array(args);
+    __free_string_array(env);
+    if (err != NULL) {
+        return __frame_respond_err(header, err);
+    }
+
+    pid1d_put_u64(resp, id);
+    return __frame_respond(header, resp);
+}
+
+static int __frame_handle_file_write(const pid1d_frame_header_t* header, pid1d_buffer_t* req, pid1d_buffer_t* resp)
+{
+    const char*    path = pid1d_get_string(req);
+    uint8_t        flags = pid1d_get_u8(req);
+    size_t         length = 0;
+    const uint8_t* data = pid1d_get_remaining(req, &length);
+
+    if (req->error || path == NULL || path[0] == '\0') {
+        errno = EINVAL;
+        return __frame_respond_err(header, "invalid file write request");
+    }
+
+    const char* err = __op_file_write(path, data, length,
+        (flags & PID1D_FILE_APPEND) != 0, (flags & PID1D_FILE_MKDIRS) != 0);
+    if (err != NULL) {
+        return __frame_respond_err(header, err);
+    }
+
+    pid1d_put_u64(resp, (uint64_t)length);
+    return __frame_respond(header, resp);
+}
+
+static int __frame_handle_file_read(const pid1d_frame_header_t* header, pid1d_buffer_t* req, pid1d_buffer_t* resp)
+{
+    const char* path = pid1d_get_string(req);
+    uint64_t    offset = pid1d_get_u64(req);
+    uint32_t    max_bytes = pid1d_get_u32(req);
+
+    if (req->error || path == NULL || max_bytes == 0 || max_bytes > PID1D_FILE_CHUNK_SIZE) {
+        errno = EINVAL;
+        return __frame_respond_err(header, "invalid file read request");
+    }
+
+    // Read straight into the response, after the eof marker, and trim it
+    // to the bytes actually read.
+    pid1d_put_u8(resp, 0);
+    uint8_t* data = pid1d_buffer_extend(resp, max_bytes);
+    if (data == NULL) {
+        errno = ENOMEM;
+        return __frame_respond_err(header, "oom");
+    }
+
+    size_t      nread = 0;
+    int         eof = 0;
+    const char* err = __op_file_read(path, offset, data, max_bytes, &nread, &eof);
+    if (err != NULL) {
+        return __frame_respond_err(header, err);
+    }
+
+    resp->data[0] = (uint8_t)eof;
+    resp->length = 1 + nread;
+    return __frame_respond(header, resp);
+}
+
+static int __frame_dispatch(const pid1d_frame_header_t* header, pid1d_buffer_t* req, pid1d_buffer_t* resp)
+{
+    const char* err;
+    int         exit_code;
+    uint64_t    id;
+
+    errno = 0;
+    switch (header->op) {
+        case PID1D_OP_PING:
+            pid1d_put_string(resp, "pid1d");
+            pid1d_put_u32(resp, PID1D_PROTOCOL_VERSION);
+            return __frame_respond(header, resp);
+
+        case PID1D_OP_SPAWN:
+            return __frame_handle_spawn(header, req, resp);
+
+        case PID1D_OP_WAIT:
+            id = pid1d_get_u64(req);
+            if (req->error) {
+                errno = EINVAL;
+                return __frame_respond_err(header, "missing id");
+            }
+            err = __op_wait(id, &exit_code);
+            if (err != NULL) {
+                return __frame_respond_err(header, err);
+            }
+            pid1d_put_u32(resp, (uint32_t)exit_code);
+            return __frame_respond(header, resp);
+
+        case PID1D_OP_KILL:
+            id = pid1d_get_u64(req);
+            exit_code = pid1d_get_u8(req);
+            if (req->error) {
+                errno = EINVAL;
+                return __frame_respond_err(header, "missing id");
+            }
+            err = __op_kill(id, exit_code);
+            if (err != NULL) {
+                return __frame_respond_err(header, err);
+            }
+            return __frame_respond(header, resp);
+
+        case PID1D_OP_FILE_WRITE:
+            return __frame_handle_file_write(header, req, resp);
+
+        case PID1D_OP_FILE_READ:
+            return __frame_handle_file_read(header, req, resp);
+
+        default:
+            errno = EINVAL;
+            return __frame_respond_err(header, "unknown op");
+    }
+}
+
+// Reads frames until the client disconnects. Requests are handled in the order
+// they arrive, so clients can pipeline them and match responses by their tag.
+static int __serve_binary(void)
+{
+    pid1d_buffer_t request;
+    pid1d_buffer_t response;
+    int            status = 0;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    // frames must not go through newline translation
+    (void)_setmode(_fileno(stdin), _O_BINARY);
+    (void)_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    pid1d_buffer_init(&request);
+    pid1d_buffer_init(&response);
+    for (;;) {
+        uint8_t              raw[PID1D_FRAME_HEADER_SIZE];
+        pid1d_frame_header_t header;
+
+        if (fread(raw, 1, sizeof(raw), stdin) != sizeof(raw)) {
+            break;
+        }
+        if (pid1d_frame_header_decode(raw, &header) != 0) {
+            // the stream can not be resynchronized
+            PID1_ERROR("pid1d: invalid frame header, closing session");
+            status = -1;
+            break;
+        }
+
+        pid1d_buffer_reset(&request);
+        uint8_t* payload = pid1d_buffer_extend(&request, header.length);
+        if (header.length > 0 && (payload == NULL || fread(payload, 1, header.length, stdin) != header.length)) {
+            status = -1;
+            break;
+        }
+
+        pid1d_buffer_reset(&response);
+        if (__frame_dispatch(&header, &request, &response) != 0) {
+            status = -1;
+            break;
+        }
+    }
+    pid1d_buffer_free(&request);
+    pid1d_buffer_free(&response);
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    // pid1 logging is optional; keep it on stderr.
+    (void)pid1_log_init(NULL, PID1_LOG_INFO);
+
+    if (pid1_init() != 0) {
+        (void)__respond_err("pid1_init failed");
+        return 1;
+    }
+
+    if (__serve_json()) {
+        (void)__serve_binary();
     }
 
     __procs_free_all();
@@ -0,0 +1,615 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Measures the throughput of pid1d for file transfers and spawn RPCs, over the
+// JSON protocol with base64 payloads and over the binary frame protocol. pid1d
+// is started as a child process and driven through its stdin/stdout, like the
+// host does through the HCS process pipes.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pid1d_protocol.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_RUNS     200
+#define BENCH_DEFAULT_SIZE_MB  64
+#define BENCH_JSON_CHUNK_SIZE  (32 * 1024)
+#define BENCH_JSON_READ_SIZE   (64 * 1024)
+#define BENCH_PIPELINE_DEPTH   8
+
+extern char** environ;
+
+struct bench_session {
+    pid_t    pid;
+    int      in_fd;   // pid1d stdin
+    int      out_fd;  // pid1d stdout
+    uint32_t next_tag;
+    char     line[256 * 1024];
+    size_t   line_length;
+    char     rbuf[64 * 1024]; // read-ahead for JSON responses
+    size_t   rpos;
+    size_t   rlen;
+};
+
+static const char g_b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static double __now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+}
+
+static int __compare_double(const void* a, const void* b)
+{
+    double lhs = *(const double*)a;
+    double rhs = *(const double*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static size_t __b64_encode(const unsigned char* in, size_t length, char* out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        unsigned v = (unsigned)in[i] << 16;
+        if (i + 1 < length) v |= (unsigned)in[i + 1] << 8;
+        if (i + 2 < length) v |= in[i + 2];
+        out[o++] = g_b64[(v >> 18) & 0x3F];
+        out[o++] = g_b64[(v >> 12) & 0x3F];
+        out[o++] = i + 1 < length ? g_b64[(v >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < length ? g_b64[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+static size_t __b64_decode(const char* in, size_t length, unsigned char* out)
+{
+    static signed char table[256];
+    size_t o = 0;
+    unsigned v = 0;
+    int      bits = 0;
+
+    if (table['B'] == 0) {
+        memset(table, -1, sizeof(table));
+        for (int i = 0; i < 64; i++) {
+            table[(unsigned char)g_b64[i]] = (signed char)i;
+        }
+    }
+
+    for (size_t i = 0; i < length && in[i] != '='; i++) {
+        if (table[(unsigned char)in[i]] < 0) {
+            continue;
+        }
+        v = (v << 6) | (unsigned)table[(unsigned char)in[i]];
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[o++] = (unsigned char)((v >> bits) & 0xFF);
+        }
+    }
+    return o;
+}
+
+static int __write_all(int fd, const void* data, size_t length)
+{
+    const char* p = data;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int __read_all(int fd, void* data, size_t length)
+{
+    char* p = data;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int __session_start(const char* path, struct bench_session* session)
+{
+    posix_spawn_file_actions_t actions;
+    int                        in[2], out[2];
+    char* const                argv[] = { (char*)path, NULL };
+    int                        status;
+
+    if (pipe(in) || pipe(out)) {
+        return -1;
+    }
+
+    // keep our ends out of later sessions, otherwise pid1d never sees EOF
+    fcntl(in[1], F_SETFD, FD_CLOEXEC);
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    status = posix_spawn(&session->pid, path, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    close(out[1]);
+    if (status) {
+        close(in[1]);
+        close(out[0]);
+        errno = status;
+        return -1;
+    }
+
+    session->in_fd = in[1];
+    session->out_fd = out[0];
+    session->next_tag = 1;
+    session->line_length = 0;
+    session->rpos = 0;
+    session->rlen = 0;
+    return 0;
+}
+
+static void __session_stop(struct bench_session* session)
+{
+    close(session->in_fd);
+    close(session->out_fd);
+    while (waitpid(session->pid, NULL, 0) < 0 && errno == EINTR);
+}
+
+// Reads a single byte through the read-ahead buffer. pid1d only writes in
+// response to a request, so nothing is buffered past the hello response when
+// the session switches to frames.
+static int __json_getc(struct bench_session* session, char* ch)
+{
+    if (session->rpos == session->rlen) {
+        ssize_t n;
+        do {
+            n = read(session->out_fd, session->rbuf, sizeof(session->rbuf));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return -1;
+        }
+        session->rpos = 0;
+        session->rlen = (size_t)n;
+    }
+    *ch = session->rbuf[session->rpos++];
+    return 0;
+}
+
+// Sends a JSON request and reads the response line into session->line
+static int __json_rpc(struct bench_session* session, const char* request, size_t length)
+{
+    if (__write_all(session->in_fd, request, length) || __write_all(session->in_fd, "\n", 1)) {
+        return -1;
+    }
+
+    session->line_length = 0;
+    for (;;) {
+        char ch;
+        if (__json_getc(session, &ch)) {
+            return -1;
+        }
+        if (ch == '\n') {
+            break;
+        }
+        if (session->line_length + 1 >= sizeof(session->line)) {
+            return -1;
+        }
+        session->line[session->line_length++] = ch;
+    }
+    session->line[session->line_length] = '\0';
+    return strstr(session->line, "\"ok\":true") != NULL ? 0 : -1;
+}
+
+static int __frame_send(struct bench_session* session, pid1d_op_t op, pid1d_buffer_t* payload)
+{
+    uint8_t raw[PID1D_FRAME_HEADER_SIZE];
+
+    pid1d_frame_header_encode(&(pid1d_frame_header_t) {
+        .op = (uint8_t)op,
+        .tag = session->next_tag++,
+        .length = (uint32_t)payload->length
+    }, raw);
+    if (__write_all(session->in_fd, raw, sizeof(raw))) {
+        return -1;
+    }
+    return payload->length ? __write_all(session->in_fd, payload->data, payload->length) : 0;
+}
+
+static int __frame_recv(struct bench_session* session, pid1d_buffer_t* payload)
+{
+    uint8_t              raw[PID1D_FRAME_HEADER_SIZE];
+    pid1d_frame_header_t header;
+    void*                data;
+
+    if (__read_all(session->out_fd, raw, sizeof(raw)) || pid1d_frame_header_decode(raw, &header)) {
+        return -1;
+    }
+
+    pid1d_buffer_reset(payload);
+    data = pid1d_buffer_extend(payload, header.length);
+    if (header.length && (data == NULL || __read_all(session->out_fd, data, header.length))) {
+        return -1;
+    }
+    if (header.flags & PID1D_FRAME_ERROR) {
+        fprintf(stderr, "bench: pid1d error %d: %.*s\n", header.status, (int)header.length, (char*)payload->data);
+        return -1;
+    }
+    return 0;
+}
+
+static int __frame_rpc(struct bench_session* session, pid1d_op_t op, pid1d_buffer_t* request, pid1d_buffer_t* response)
+{
+    if (__frame_send(session, op, request)) {
+        return -1;
+    }
+    return __frame_recv(session, response);
+}
+
+static int __negotiate_binary(struct bench_session* session)
+{
+    static const char hello[] = "{\"op\":\"hello\",\"protocol\":\"binary\",\"version\":1}";
+    if (__json_rpc(session, hello, sizeof(hello) - 1)) {
+        return -1;
+    }
+    return strstr(session->line, "\"protocol\":\"binary\"") != NULL ? 0 : -1;
+}
+
+static void __report_latency(const char* name, double* samples, int runs)
+{
+    double total = 0.0;
+    for (int i = 0; i < runs; i++) {
+        total += samples[i];
+    }
+    qsort(samples, (size_t)runs, sizeof(double), __compare_double);
+    printf("%-24s %6i runs, mean %8.1f us, p50 %8.1f us, p99 %8.1f us\n",
+        name, runs, total / runs, samples[runs / 2], samples[(runs * 99) / 100]);
+}
+
+static void __report_throughput(const char* name, size_t bytes, double us)
+{
+    printf("%-24s %8.1f MB/s (%zu MB in %.1f ms)\n",
+        name, ((double)bytes / (1024.0 * 1024.0)) / (us / 1000000.0), bytes / (1024 * 1024), us / 1000.0);
+}
+
+static int __bench_spawn_json(struct bench_session* session, int runs)
+{
+    static const char spawn[] = "{\"op\":\"spawn\",\"command\":\"/bin/true\"}";
+    double*           samples = calloc((size_t)runs, sizeof(double));
+    char              wait[128];
+
+    if (samples == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < runs; i++) {
+        double start = __now_us();
+        const char* id;
+        if (__json_rpc(session, spawn, sizeof(spawn) - 1) || (id = strstr(session->line, "\"id\":")) == NULL) {
+            free(samples);
+            return -1;
+        }
+        snprintf(wait, sizeof(wait), "{\"op\":\"wait\",\"id\":%llu}", strtoull(id + 5, NULL, 10));
+        if (__json_rpc(session, wait, strlen(wait))) {
+            free(samples);
+            return -1;
+        }
+        samples[i] = __now_us() - start;
+    }
+    __report_latency("json spawn+wait", samples, runs);
+    free(samples);
+    return 0;
+}
+
+static int __bench_spawn_binary(struct bench_session* session, int runs)
+{
+    pid1d_buffer_t request, response;
+    double*        samples = calloc((size_t)runs, sizeof(double));
+    int            status = 0;
+
+    if (samples == NULL) {
+        return -1;
+    }
+    pid1d_buffer_init(&request);
+    pid1d_buffer_init(&response);
+    for (int i = 0; i < runs && status == 0; i++) {
+        double   start = __now_us();
+        uint64_t id;
+
+        pid1d_buffer_reset(&request);
+        pid1d_put_string(&request, "/bin/true");
+        pid1d_put_string(&request, NULL);
+        pid1d_put_u8(&request, 0);
+        pid1d_put_u32(&request, 0);
+        pid1d_put_u32(&request, 0);
+        if (__frame_rpc(session, PID1D_OP_SPAWN, &request, &response)) {
+            status = -1;
+            break;
+        }
+        id = pid1d_get_u64(&response);
+
+        pid1d_buffer_reset(&request);
+        pid1d_put_u64(&request, id);
+        if (__frame_rpc(session, PID1D_OP_WAIT, &request, &response)) {
+            status = -1;
+            break;
+        }
+        samples[i] = __now_us() - start;
+    }
+    if (status == 0) {
+        __report_latency("binary spawn+wait", samples, runs);
+    }
+    pid1d_buffer_free(&request);
+    pid1d_buffer_free(&response);
+    free(samples);
+    return status;
+}
+
+static int __bench_ping_json(struct bench_session* session, int runs)
+{
+    static const char ping[] = "{\"op\":\"ping\"}";
+    double            start = __now_us();
+
+    for (int i = 0; i < runs; i++) {
+        if (__json_rpc(session, ping, sizeof(ping) - 1)) {
+            return -1;
+        }
+    }
+    printf("%-24s %8.0f RPC/s\n", "json ping", runs / ((__now_us() - start) / 1000000.0));
+    return 0;
+}
+
+static int __bench_ping_binary(struct bench_session* session, int runs)
+{
+    pid1d_buffer_t request, response;
+    double         start = __now_us();
+    int            sent = 0, received = 0;
+
+    pid1d_buffer_init(&request);
+    pid1d_buffer_init(&response);
+    while (received < runs) {
+        while (sent < runs && sent - received < BENCH_PIPELINE_DEPTH) {
+            if (__frame_send(session, PID1D_OP_PING, &request)) {
+                goto error;
+            }
+            sent++;
+        }
+        if (__frame_recv(session, &response)) {
+            goto error;
+        }
+        received++;
+    }
+    printf("%-24s %8.0f RPC/s (pipelined, depth %i)\n", "binary ping",
+        runs / ((__now_us() - start) / 1000000.0), BENCH_PIPELINE_DEPTH);
+    pid1d_buffer_free(&request);
+    pid1d_buffer_free(&response);
+    return 0;
+
+error:
+    pid1d_buffer_free(&request);
+    pid1d_buffer_free(&response);
+    return -1;
+}
+
+static int __bench_files_json(struct bench_session* session, const char* path, const unsigned char* data, size_t size)
+{
+    char*          request = malloc(BENCH_JSON_CHUNK_SIZE * 2 + 4096);
+    unsigned char* chunk = malloc(BENCH_JSON_READ_SIZE);
+    double         start;
+    size_t         offset;
+    int            status = -1;
+
+    if (request == NULL || chunk == NULL) {
+        goto cleanup;
+    }
+
+    start = __now_us();
+    for (offset = 0; offset < size; offset += BENCH_JSON_CHUNK_SIZE) {
+        size_t length = size - offset < BENCH_JSON_CHUNK_SIZE ? size - offset : BENCH_JSON_CHUNK_SIZE;
+        int    n = snprintf(request, 4096, "{\"op\":\"file_write_b64\",\"path\":\"%s\",\"append\":%s,\"data\":\"",
+            path, offset ? "true" : "false");
+        n += (int)__b64_encode(&data[offset], length, &request[n]);
+        n += snprintf(&request[n], 8, "\"}");
+        if (__json_rpc(session, request, (size_t)n)) {
+            goto cleanup;
+        }
+    }
+    __report_throughput("json file write", size, __now_us() - start);
+
+    start = __now_us();
+    for (offset = 0; offset < size; ) {
+        const char* b64;
+        const char* end;
+        size_t      length;
+
+        snprintf(request, 4096, "{\"op\":\"file_read_b64\",\"path\":\"%s\",\"offset\":%zu,\"max_bytes\":%d}",
+            path, offset, BENCH_JSON_READ_SIZE);
+        if (__json_rpc(session, request, strlen(request)) ||
+            (b64 = strstr(session->line, "\"data\":\"")) == NULL ||
+            (end = strchr(b64 + 8, '"')) == NULL) {
+            goto cleanup;
+        }
+        length = __b64_decode(b64 + 8, (size_t)(end - (b64 + 8)), chunk);
+        if (length == 0) {
+            break;
+        }
+        offset += length;
+    }
+    __report_throughput("json file read", offset, __now_us() - start);
+    status = 0;
+
+cleanup:
+    free(request);
+    free(chunk);
+    return status;
+}
+
+static int __bench_files_binary(struct bench_session* session, const char* path, const unsigned char* data, size_t size)
+{
+    pid1d_buffer_t request, response;
+    size_t         chunks = (size + PID1D_FILE_CHUNK_SIZE - 1) / PID1D_FILE_CHUNK_SIZE;
+    size_t         sent = 0, received = 0, bytes = 0;
+    double         start;
+    int            status = -1;
+
+    pid1d_buffer_init(&request);
+    pid1d_buffer_init(&response);
+
+    // the first chunk truncates the file, so it has to complete before the
+    // appends are pipelined behind it
+    start = __now_us();
+    while (received < chunks) {
+        while (sent < chunks && sent - received < BENCH_PIPELINE_DEPTH && (sent == 0 || received > 0)) {
+            size_t offset = sent * PID1D_FILE_CHUNK_SIZE;
+            size_t length = size - offset < PID1D_FILE_CHUNK_SIZE ? size - offset : PID1D_FILE_CHUNK_SIZE;
+
+            pid1d_buffer_reset(&request);
+            pid1d_put_string(&request, path);
+            pid1d_put_u8(&request, sent ? PID1D_FILE_APPEND : 0);
+            pid1d_put_bytes(&request, &data[offset], length);
+            if (__frame_send(session, PID1D_OP_FILE_WRITE, &request)) {
+                goto cleanup;
+            }
+            sent++;
+        }
+        if (__frame_recv(session, &response)) {
+            goto cleanup;
+        }
+        received++;
+    }
+    __report_throughput("binary file write", size, __now_us() - start);
+
+    start = __now_us();
+    sent = received = 0;
+    while (received < chunks) {
+        while (sent < chunks && sent - received < BENCH_PIPELINE_DEPTH) {
+            pid1d_buffer_reset(&request);
+            pid1d_put_string(&request, path);
+            pid1d_put_u64(&request, (uint64_t)sent * PID1D_FILE_CHUNK_SIZE);
+            pid1d_put_u32(&request, PID1D_FILE_CHUNK_SIZE);
+            if (__frame_send(session, PID1D_OP_FILE_READ, &request)) {
+                goto cleanup;
+            }
+            sent++;
+        }
+        if (__frame_recv(session, &response)) {
+            goto cleanup;
+        }
+        bytes += response.length - 1;
+        received++;
+    }
+    __report_throughput("binary file read", bytes, __now_us() - start);
+    status = 0;
+
+cleanup:
+    pid1d_buffer_free(&request);
+    pid1d_buffer_free(&response);
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    struct bench_session* json;
+    struct bench_session* binary;
+    const char*           pid1d = NULL;
+    const char*           dir = "/tmp";
+    int                   runs = BENCH_DEFAULT_RUNS;
+    size_t                sizeMb = BENCH_DEFAULT_SIZE_MB;
+    unsigned char*        data;
+    char                  path[512];
+    int                   status = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "--pid1d")) {
+            pid1d = argv[++i];
+        } else if (i + 1 < argc && !strcmp(argv[i], "--dir")) {
+            dir = argv[++i];
+        } else if (i + 1 < argc && !strcmp(argv[i], "--runs")) {
+            runs = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "--size-mb")) {
+            sizeMb = (size_t)atoi(argv[++i]);
+        } else {
+            printf("Usage: pid1d_bench --pid1d PATH [--dir DIR] [--runs N] [--size-mb N]\n");
+            return !strcmp(argv[i], "--help") ? 0 : 1;
+        }
+    }
+
+    if (pid1d == NULL || runs <= 0 || sizeMb == 0) {
+        fprintf(stderr, "bench: --pid1d is required, and runs and size must be positive\n");
+        return 1;
+    }
+
+    json = calloc(1, sizeof(struct bench_session));
+    binary = calloc(1, sizeof(struct bench_session));
+    data = malloc(sizeMb * 1024 * 1024);
+    if (json == NULL || binary == NULL || data == NULL) {
+        fprintf(stderr, "bench: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeMb * 1024 * 1024; i++) {
+        data[i] = (unsigned char)(rand() & 0xFF);
+    }
+    snprintf(path, sizeof(path), "%s/pid1d-bench-%d.bin", dir, (int)getpid());
+
+    if (__session_start(pid1d, json) || __session_start(pid1d, binary)) {
+        fprintf(stderr, "bench: failed to start %s: %s\n", pid1d, strerror(errno));
+        return 1;
+    }
+    if (__negotiate_binary(binary)) {
+        fprintf(stderr, "bench: pid1d did not accept the binary protocol\n");
+        goto cleanup;
+    }
+
+    if (__bench_ping_json(json, runs * 10) || __bench_ping_binary(binary, runs * 10) ||
+        __bench_spawn_json(json, runs) || __bench_spawn_binary(binary, runs) ||
+        __bench_files_json(json, path, data, sizeMb * 1024 * 1024) ||
+        __bench_files_binary(binary, path, data, sizeMb * 1024 * 1024)) {
+        fprintf(stderr, "bench: a request to pid1d failed\n");
+        goto cleanup;
+    }
+    status = 0;
+
+cleanup:
+    __session_stop(json);
+    __session_stop(binary);
+    unlink(path);
+    free(json);
+    free(binary);
+    free(data);
+    return status;
+}
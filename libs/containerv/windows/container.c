@@ -37,6 +37,7 @@
 #include "json-util.h"
 
 #include <pid1_windows.h>
+#include <pid1d_protocol.h>
 
 #include "private.h"
 
@@ -45,6 +46,13 @@
 
 #define MIN_REMAINING_PATH_LENGTH 20  // Minimum space needed for "containerv-XXXXXX" + null
 
+// pid1d reads JSON requests into a 64K line buffer, so base64 file chunks must
+// stay well below that
+#define __PID1D_JSON_CHUNK_SIZE (32 * 1024)
+
+// Number of binary file chunks that may be in flight at once
+#define __PID1D_PIPELINE_DEPTH 8
+
 // PID1 is currently implemented as a process-global service. We reference count
 // active containers so we can init/cleanup once.
 static volatile LONG g_pid1_container_refcount = 0;
@@ -412,6 +420,109 @@ static int __pid1d_rpc(struct containerv_container* container, const char* reqLi
     return 0;
 }
 
+// Read exactly len bytes from a pid1d pipe handle.
+static int __pid1d_read_exact(HANDLE handle, void* data, size_t len)
+{
+    size_t readTotal;
+    DWORD  read;
+
+    readTotal = 0;
+    while (readTotal < len) {
+        read = 0;
+        if (!ReadFile(handle, (char*)data + readTotal, (DWORD)(len - readTotal), &read, NULL) || read == 0) {
+            return -1;
+        }
+        readTotal += (size_t)read;
+    }
+    return 0;
+}
+
+// Send a binary request frame to pid1d. The payload is the encoded fields of the
+// request followed by optional raw data, which is written as-is without copying.
+static int __pid1d_frame_send(
+    struct containerv_container* container,
+    pid1d_op_t                   op,
+    const pid1d_buffer_t*        payload,
+    const void*                  data,
+    size_t                       dataLen,
+    uint32_t*                    tagOut)
+{
+    uint8_t              raw[PID1D_FRAME_HEADER_SIZE];
+    pid1d_frame_header_t header;
+    size_t               length;
+
+    length = payload->length + dataLen;
+    if (payload->error || length > PID1D_FRAME_MAX_PAYLOAD) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.op = (uint8_t)op;
+    header.tag = container->pid1d_next_tag++;
+    header.length = (uint32_t)length;
+    pid1d_frame_header_encode(&header, raw);
+
+    if (__pid1d_write_all(container->pid1d_stdin, (const char*)raw, sizeof(raw)) != 0) {
+        return -1;
+    }
+    if (payload->length && __pid1d_write_all(container->pid1d_stdin, (const char*)payload->data, payload->length) != 0) {
+        return -1;
+    }
+    if (dataLen && __pid1d_write_all(container->pid1d_stdin, (const char*)data, dataLen) != 0) {
+        return -1;
+    }
+    if (tagOut != NULL) {
+        *tagOut = header.tag;
+    }
+    return 0;
+}
+
+// Read the response frame for the request with the given tag into response. pid1d
+// answers in request order, so any other tag means the session is out of sync.
+static int __pid1d_frame_recv(struct containerv_container* container, uint32_t tag, pid1d_buffer_t* response)
+{
+    uint8_t              raw[PID1D_FRAME_HEADER_SIZE];
+    pid1d_frame_header_t header;
+    void*                data;
+
+    if (__pid1d_read_exact(container->pid1d_stdout, raw, sizeof(raw)) != 0 ||
+        pid1d_frame_header_decode(raw, &header) != 0) {
+        return -1;
+    }
+    if (header.tag != tag || !(header.flags & PID1D_FRAME_RESPONSE)) {
+        VLOG_ERROR("containerv", "pid1d: unexpected frame (tag %u, expected %u)\n", header.tag, tag);
+        return -1;
+    }
+
+    pid1d_buffer_reset(response);
+    data = pid1d_buffer_extend(response, header.length);
+    if (header.length && (data == NULL || __pid1d_read_exact(container->pid1d_stdout, data, header.length) != 0)) {
+        return -1;
+    }
+
+    if (header.flags & PID1D_FRAME_ERROR) {
+        VLOG_ERROR("containerv", "pid1d: request failed: %.*s\n", (int)response->length, (const char*)response->data);
+        errno = header.status;
+        return -1;
+    }
+    return 0;
+}
+
+// Send a binary request and wait for its response.
+static int __pid1d_frame_call(
+    struct containerv_container* container,
+    pid1d_op_t                   op,
+    const pid1d_buffer_t*        payload,
+    pid1d_buffer_t*              response)
+{
+    uint32_t tag;
+
+    if (__pid1d_frame_send(container, op, payload, NULL, 0, &tag) != 0) {
+        return -1;
+    }
+    return __pid1d_frame_recv(container, tag, response);
+}
+
 // Write file contents to pid1d using base64 payloads.
 static int __pid1d_file_write_b64(
     struct containerv_container* container,
@@ -535,6 +646,250 @@ static int __pid1d_file_read_b64(
     return 0;
 }
 
+// Write file contents to pid1d. Binary sessions send raw chunks and keep up to
+// __PID1D_PIPELINE_DEPTH requests in flight, JSON sessions fall back to base64
+// chunks small enough for the pid1d line limit.
+static int __pid1d_file_write(
+    struct containerv_container* container,
+    const char*                  path,
+    const unsigned char*         data,
+    size_t                       dataLen,
+    int                          appendMode,
+    int                          makeDirs)
+{
+    pid1d_buffer_t payload;
+    pid1d_buffer_t response;
+    uint32_t       tags[__PID1D_PIPELINE_DEPTH];
+    size_t         offset;
+    size_t         chunk;
+    int            sent;
+    int            received;
+    int            status;
+
+    if (container == NULL || path == NULL) {
+        return -1;
+    }
+    if (__pid1d_ensure(container) != 0) {
+        return -1;
+    }
+
+    if (!container->pid1d_binary) {
+        offset = 0;
+        do {
+            chunk = dataLen - offset < __PID1D_JSON_CHUNK_SIZE ? dataLen - offset : __PID1D_JSON_CHUNK_SIZE;
+            if (__pid1d_file_write_b64(container, path, data + offset, chunk, appendMode || offset != 0, makeDirs) != 0) {
+                return -1;
+            }
+            offset += chunk;
+        } while (offset < dataLen);
+        return 0;
+    }
+
+    pid1d_buffer_init(&payload);
+    pid1d_buffer_init(&response);
+
+    status = 0;
+    offset = 0;
+    sent = 0;
+    received = 0;
+    do {
+        chunk = dataLen - offset < PID1D_FILE_CHUNK_SIZE ? dataLen - offset : PID1D_FILE_CHUNK_SIZE;
+
+        // A truncating first chunk must complete before any of the appends
+        // behind it are sent
+        if (sent - received == __PID1D_PIPELINE_DEPTH || (!appendMode && sent == 1 && received == 0)) {
+            if (__pid1d_frame_recv(container, tags[received % __PID1D_PIPELINE_DEPTH], &response) != 0) {
+                status = -1;
+                break;
+            }
+            received++;
+        }
+
+        pid1d_buffer_reset(&payload);
+        pid1d_put_string(&payload, path);
+        pid1d_put_u8(&payload, (uint8_t)((appendMode || offset != 0 ? PID1D_FILE_APPEND : 0) | (makeDirs ? PID1D_FILE_MKDIRS : 0)));
+        if (__pid1d_frame_send(container, PID1D_OP_FILE_WRITE, &payload, data + offset, chunk,
+                &tags[sent % __PID1D_PIPELINE_DEPTH]) != 0) {
+            status = -1;
+            break;
+        }
+        sent++;
+        offset += chunk;
+    } while (offset < dataLen);
+
+    // Drain the responses still in flight, also after an error, so the session
+    // stays in sync
+    while (received < sent) {
+        if (__pid1d_frame_recv(container, tags[received % __PID1D_PIPELINE_DEPTH], &response) != 0) {
+            status = -1;
+        }
+        received++;
+    }
+
+    pid1d_buffer_free(&payload);
+    pid1d_buffer_free(&response);
+    return status;
+}
+
+// Read up to maxBytes from a file in the guest into buffer, starting at offset.
+static int __pid1d_file_read(
+    struct containerv_container* container,
+    const char*                  path,
+    uint64_t                     offset,
+    void*                        buffer,
+    size_t                       maxBytes,
+    size_t*                      bytesOut,
+    int*                         eofOut)
+{
+    pid1d_buffer_t payload;
+    pid1d_buffer_t response;
+    const uint8_t* data;
+    size_t         length;
+    int            status;
+
+    if (container == NULL || path == NULL || buffer == NULL || bytesOut == NULL || eofOut == NULL) {
+        return -1;
+    }
+    *bytesOut = 0;
+    *eofOut = 0;
+
+    if (__pid1d_ensure(container) != 0) {
+        return -1;
+    }
+
+    if (!container->pid1d_binary) {
+        char*          b64;
+        unsigned char* decoded;
+        uint64_t       bytes;
+
+        if (maxBytes > __PID1D_JSON_CHUNK_SIZE) {
+            maxBytes = __PID1D_JSON_CHUNK_SIZE;
+        }
+        if (__pid1d_file_read_b64(container, path, offset, maxBytes, &b64, &bytes, eofOut) != 0) {
+            return -1;
+        }
+        if (b64[0] == '\0') {
+            free(b64);
+            return 0;
+        }
+        decoded = __base64_decode_alloc(b64, &length);
+        free(b64);
+        if (decoded == NULL || length != bytes || length > maxBytes) {
+            free(decoded);
+            return -1;
+        }
+        memcpy(buffer, decoded, length);
+        free(decoded);
+        *bytesOut = length;
+        return 0;
+    }
+
+    if (maxBytes > PID1D_FILE_CHUNK_SIZE) {
+        maxBytes = PID1D_FILE_CHUNK_SIZE;
+    }
+
+    pid1d_buffer_init(&payload);
+    pid1d_buffer_init(&response);
+    pid1d_put_string(&payload, path);
+    pid1d_put_u64(&payload, offset);
+    pid1d_put_u32(&payload, (uint32_t)maxBytes);
+
+    status = __pid1d_frame_call(container, PID1D_OP_FILE_READ, &payload, &response);
+    if (status == 0) {
+        *eofOut = pid1d_get_u8(&response);
+        data = pid1d_get_remaining(&response, &length);
+        if (response.error || length > maxBytes) {
+            status = -1;
+        } else {
+            memcpy(buffer, data, length);
+            *bytesOut = length;
+        }
+    }
+
+    pid1d_buffer_free(&payload);
+    pid1d_buffer_free(&response);
+    return status;
+}
+
+// Copy a host file into the guest through the pid1d session.
+static int __pid1d_upload_file(struct containerv_container* container, const char* hostPath, const char* guestPath)
+{
+    FILE*          file;
+    unsigned char* block;
+    size_t         blockSize;
+    size_t         n;
+    int            appendMode;
+    int            status;
+
+    file = fopen(hostPath, "rb");
+    if (file == NULL) {
+        VLOG_ERROR("containerv", "containerv_upload: failed to open %s\n", hostPath);
+        return -1;
+    }
+
+    // Hand the writer enough data to fill the pipeline
+    blockSize = (size_t)PID1D_FILE_CHUNK_SIZE * __PID1D_PIPELINE_DEPTH;
+    block = malloc(blockSize);
+    if (block == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    status = 0;
+    appendMode = 0;
+    do {
+        n = fread(block, 1, blockSize, file);
+        if (ferror(file)) {
+            status = -1;
+            break;
+        }
+        status = __pid1d_file_write(container, guestPath, block, n, appendMode, 1);
+        appendMode = 1;
+    } while (status == 0 && n == blockSize);
+
+    free(block);
+    fclose(file);
+    return status;
+}
+
+// Copy a guest file to the host through the pid1d session.
+static int __pid1d_download_file(struct containerv_container* container, const char* guestPath, const char* hostPath)
+{
+    FILE*          file;
+    unsigned char* chunk;
+    uint64_t       offset;
+    size_t         n;
+    int            eof;
+    int            status;
+
+    chunk = malloc(PID1D_FILE_CHUNK_SIZE);
+    if (chunk == NULL) {
+        return -1;
+    }
+
+    file = fopen(hostPath, "wb");
+    if (file == NULL) {
+        VLOG_ERROR("containerv", "containerv_download: failed to create %s\n", hostPath);
+        free(chunk);
+        return -1;
+    }
+
+    status = 0;
+    offset = 0;
+    do {
+        if (__pid1d_file_read(container, guestPath, offset, chunk, PID1D_FILE_CHUNK_SIZE, &n, &eof) != 0 ||
+            (n > 0 && fwrite(chunk, 1, n, file) != n)) {
+            status = -1;
+            break;
+        }
+        offset += n;
+    } while (!eof && n > 0);
+
+    fclose(file);
+    free(chunk);
+    return status;
+}
+
 // Close the pid1d session and release stdio/process handles.
 static void __pid1d_close_session(struct containerv_container* container)
 {
@@ -565,6 +920,35 @@ static void __pid1d_close_session(struct containerv_container* container)
     }
 
     container->pid1d_started = 0;
+    container->pid1d_binary = 0;
+}
+
+// Ask pid1d to switch the session to binary frames. pid1d versions without the
+// hello op answer with an error, and the session stays on JSON.
+static void __pid1d_negotiate(struct containerv_container* container)
+{
+    json_t* request;
+    char    resp[8192];
+    char*   protocol;
+
+    container->pid1d_binary = 0;
+    container->pid1d_next_tag = 1;
+
+    request = json_object();
+    if (request == NULL ||
+        containerv_json_object_set_string(request, "op", "hello") != 0 ||
+        containerv_json_object_set_string(request, "protocol", "binary") != 0 ||
+        containerv_json_object_set_uint64(request, "version", PID1D_PROTOCOL_VERSION) != 0) {
+        json_decref(request);
+        return;
+    }
+
+    if (__pid1d_rpc_json(container, request, resp, sizeof(resp)) == 0 && __pid1d_resp_ok(resp)) {
+        protocol = __pid1d_parse_string_field_alloc(resp, "protocol");
+        container->pid1d_binary = protocol != NULL && strcmp(protocol, "binary") == 0;
+        free(protocol);
+    }
+    json_decref(request);
 }
 
 // Ensure pid1d is running in the guest VM and ready to accept requests.
@@ -637,10 +1021,53 @@ static int __pid1d_ensure(struct containerv_container* container)
         return -1;
     }
 
-    VLOG_DEBUG("containerv", "pid1d: session established\n");
+    __pid1d_negotiate(container);
+    VLOG_DEBUG("containerv", "pid1d: session established (%s)\n", container->pid1d_binary ? "binary" : "json");
     return 0;
 }
 
+static void __pid1d_put_string_array(pid1d_buffer_t* payload, const char* const* values)
+{
+    uint32_t count;
+
+    count = 0;
+    while (values != NULL && values[count] != NULL) {
+        count++;
+    }
+    pid1d_put_u32(payload, count);
+    for (uint32_t i = 0; i < count; ++i) {
+        pid1d_put_string(payload, values[i]);
+    }
+}
+
+static int __pid1d_spawn_frame(struct containerv_container* container, struct __containerv_spawn_options* options, uint64_t* idOut)
+{
+    pid1d_buffer_t payload;
+    pid1d_buffer_t response;
+    int            status;
+
+    pid1d_buffer_init(&payload);
+    pid1d_buffer_init(&response);
+    pid1d_put_string(&payload, options->path);
+    pid1d_put_string(&payload, NULL);
+    pid1d_put_u8(&payload, (options->flags & CV_SPAWN_WAIT) != 0);
+    __pid1d_put_string_array(&payload, options->argv);
+    __pid1d_put_string_array(&payload, options->envv);
+
+    status = __pid1d_frame_call(container, PID1D_OP_SPAWN, &payload, &response);
+    if (status == 0) {
+        *idOut = pid1d_get_u64(&response);
+        status = response.error ? -1 : 0;
+    }
+    if (status != 0) {
+        VLOG_ERROR("containerv", "pid1d: spawn of %s failed\n", options->path);
+    }
+
+    pid1d_buffer_free(&payload);
+    pid1d_buffer_free(&response);
+    return status;
+}
+
 // Spawn a process in the guest through pid1d.
 static int __pid1d_spawn(struct containerv_container* container, struct __containerv_spawn_options* options, uint64_t* idOut)
 {
@@ -658,6 +1085,10 @@ static int __pid1d_spawn(struct containerv_container* container, struct __contai
         return -1;
     }
 
+    if (container->pid1d_binary) {
+        return __pid1d_spawn_frame(container, options, idOut);
+    }
+
     req = json_object();
     if (req == NULL ||
         containerv_json_object_set_string(req, "op", "spawn") != 0 ||
@@ -726,6 +1157,27 @@ static int __pid1d_wait(struct containerv_container* container, uint64_t id, int
         return -1;
     }
 
+    if (container->pid1d_binary) {
+        pid1d_buffer_t payload;
+        pid1d_buffer_t response;
+        int            status;
+
+        pid1d_buffer_init(&payload);
+        pid1d_buffer_init(&response);
+        pid1d_put_u64(&payload, id);
+        status = __pid1d_frame_call(container, PID1D_OP_WAIT, &payload, &response);
+        if (status == 0) {
+            exitCode = (int)pid1d_get_u32(&response);
+            status = response.error ? -1 : 0;
+        }
+        pid1d_buffer_free(&payload);
+        pid1d_buffer_free(&response);
+        if (status == 0 && exitCodeOut != NULL) {
+            *exitCodeOut = exitCode;
+        }
+        return status;
+    }
+
     req = json_object();
     if (req == NULL ||
         containerv_json_object_set_string(req, "op", "wait") != 0 ||
@@ -761,6 +1213,21 @@ static int __pid1d_kill_reap(struct containerv_container* container, uint64_t id
         return -1;
     }
 
+    if (container->pid1d_binary) {
+        pid1d_buffer_t payload;
+        pid1d_buffer_t response;
+        int            status;
+
+        pid1d_buffer_init(&payload);
+        pid1d_buffer_init(&response);
+        pid1d_put_u64(&payload, id);
+        pid1d_put_u8(&payload, 1);
+        status = __pid1d_frame_call(container, PID1D_OP_KILL, &payload, &response);
+        pid1d_buffer_free(&payload);
+        pid1d_buffer_free(&response);
+        return status;
+    }
+
     req = json_object();
     if (req == NULL ||
         containerv_json_object_set_string(req, "op", "kill") != 0 ||
@@ -1055,6 +1522,7 @@ static struct containerv_container* __container_new(void)
     container->pid1d_stdout = NULL;
     container->pid1d_stderr = NULL;
     container->pid1d_started = 0;
+    container->pid1d_binary = 0;
     container->pid1_acquired = 0;
 
     return container;
@@ -2536,7 +3004,12 @@ int containerv_upload(
     for (int i = 0; i < count; i++) {
         VLOG_DEBUG("containerv", "uploading: %s -> %s\n", hostPaths[i], containerPaths[i]);
         
-        if (container->hcs_system) {
+        if (container->hcs_system && container->pid1d_started) {
+            // VM with a live pid1d session: stream the file through it.
+            if (__pid1d_upload_file(container, hostPaths[i], containerPaths[i]) != 0) {
+                return -1;
+            }
+        } else if (container->hcs_system) {
             // HCS container: use mapped staging folder + in-container copy.
             char stageHost[MAX_PATH];
             char stageGuest[MAX_PATH];
@@ -2630,7 +3103,13 @@ int containerv_download(
     for (int i = 0; i < count; i++) {
         VLOG_DEBUG("containerv", "downloading: %s -> %s\n", containerPaths[i], hostPaths[i]);
         
-        if (container->hcs_system) {
+        if (container->hcs_system && container->pid1d_started) {
+            // VM with a live pid1d session: stream the file through it.
+            (void)__ensure_parent_dir_hostpath(hostPaths[i]);
+            if (__pid1d_download_file(container, containerPaths[i], hostPaths[i]) != 0) {
+                return -1;
+            }
+        } else if (container->hcs_system) {
             // HCS container: stage in guest then copy out from host staging directory.
             (void)__ensure_parent_dir_hostpath(hostPaths[i]);
 
@@ -1119,6 +1119,15 @@ const char* containerv_layers_get_rootfs(struct containerv_layer_context* contex
     return context->composed_rootfs;
 }
 
+const char* containerv_layers_get_upperdir(struct containerv_layer_context* context)
+{
+    // HCS containers do not support OVERLAY layers, so there is never
+    // a writable layer to expose.
+    (void)context;
+    errno = ENOTSUP;
+    return NULL;
+}
+
 void containerv_layers_destroy(struct containerv_layer_context* context)
 {
     if (context == NULL) {
@@ -310,6 +310,8 @@ struct containerv_container {
     HANDLE       pid1d_stdout;
     HANDLE       pid1d_stderr;
     int          pid1d_started;
+    int          pid1d_binary;    // session negotiated the binary frame protocol
+    uint32_t     pid1d_next_tag;
 
     // PID1 integration
     int          pid1_acquired;
@@ -0,0 +1,139 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/config.h>
+#include <chef/cvd.h>
+#include <chef/dirs.h>
+#include <chef/platform.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlog.h>
+
+static int __ccache_enabled(void)
+{
+    struct chef_config* config;
+    void*               section;
+    const char*         value;
+    int                 enabled = 1;
+
+    config = chef_config_load(chef_dirs_config());
+    if (config == NULL) {
+        // no configuration, use the default
+        return 1;
+    }
+
+    section = chef_config_section(config, "compiler-cache");
+    value = chef_config_get_string(config, section, "enabled");
+    if (value != NULL && (strcmp(value, "false") == 0 || strcmp(value, "0") == 0)) {
+        enabled = 0;
+    }
+    chef_config_destroy(config);
+    return enabled;
+}
+
+// Toolchain identifiers are in the format of 'publisher/package=channel', reduce
+// it to something that can safely be used as a directory name.
+static void __sanitize_name(char* name)
+{
+    for (char* p = name; *p != '\0'; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_' && *p != '.') {
+            *p = '-';
+        }
+    }
+}
+
+int build_ccache_initialize(struct __bake_build_context* bctx)
+{
+    const char* toolchain;
+    char*       name;
+    char        buffer[PATH_MAX];
+    VLOG_DEBUG("bake", "build_ccache_initialize()\n");
+
+    // ccache is only supported for linux build containers
+    if (strcmp(bctx->target_platform, "windows") == 0 || !__ccache_enabled()) {
+        return 0;
+    }
+
+    toolchain = recipe_find_platform_toolchain(bctx->recipe, bctx->target_platform);
+    name = platform_strdup(toolchain != NULL ? toolchain : "host");
+    if (name == NULL) {
+        return -1;
+    }
+    __sanitize_name(name);
+
+    // cache is shared by all builds using the same (toolchain, architecture)
+    bctx->ccache_path = strpathjoin(chef_dirs_cache(), "ccache", name, bctx->target_architecture, NULL);
+    free(name);
+    if (bctx->ccache_path == NULL) {
+        return -1;
+    }
+
+    // builds log their statistics to a per-project file in the shared cache,
+    // start every build from a clean log so the report only covers this build
+    snprintf(&buffer[0], sizeof(buffer), "stats/%s.log", build_cache_uuid(bctx->build_cache));
+    bctx->ccache_stats_path = strpathcombine(bctx->ccache_path, &buffer[0]);
+    if (bctx->ccache_stats_path == NULL) {
+        return -1;
+    }
+
+    snprintf(&buffer[0], sizeof(buffer), "%s/stats", bctx->ccache_path);
+    if (platform_mkdir(&buffer[0])) {
+        VLOG_ERROR("bake", "build_ccache_initialize: failed to create %s\n", &buffer[0]);
+        return -1;
+    }
+
+    if (platform_unlink(bctx->ccache_stats_path) && errno != ENOENT) {
+        VLOG_WARNING("bake", "build_ccache_initialize: failed to reset %s\n", bctx->ccache_stats_path);
+    }
+    return 0;
+}
+
+int build_ccache_stats(struct __bake_build_context* bctx, struct build_ccache_stats* statsOut)
+{
+    FILE* file;
+    char  line[256];
+
+    if (bctx->ccache_stats_path == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    memset(statsOut, 0, sizeof(struct build_ccache_stats));
+
+    // the stats log is only created if ccache was invoked at least once
+    file = fopen(bctx->ccache_stats_path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    // The log consists of a '# <timestamp>' header per invocation, followed
+    // by the counters that were incremented by it, one per line.
+    while (fgets(&line[0], sizeof(line), file) != NULL) {
+        line[strcspn(&line[0], "\r\n")] = '\0';
+        if (strcmp(&line[0], "direct_cache_hit") == 0 || strcmp(&line[0], "preprocessed_cache_hit") == 0) {
+            statsOut->hits++;
+        } else if (strcmp(&line[0], "cache_miss") == 0) {
+            statsOut->misses++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
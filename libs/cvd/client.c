@@ -401,43 +401,86 @@ static void __initialize_layers(
     struct chef_layer_descriptor* layer;
     const char*                   project_target;
     const char*                   store_target;
-    const uint32_t                layer_count = guest_type == CHEF_GUEST_TYPE_WINDOWS ? 3U : 4U;
+    uint32_t                      layer_count = guest_type == CHEF_GUEST_TYPE_WINDOWS ? 3U : 4U;
+    uint32_t                      index = 0;
     VLOG_DEBUG("cvd", "__initialize_layers(rootfs=%s, guest=%s)\n", rootfs, guest_type == CHEF_GUEST_TYPE_WINDOWS ? "windows" : "linux");
 
+    if (bctx->snapshot_path != NULL) {
+        layer_count++;
+    }
+    if (bctx->ccache_path != NULL && guest_type == CHEF_GUEST_TYPE_LINUX) {
+        layer_count++;
+    }
     chef_create_parameters_layers_add(params, layer_count);
 
     project_target = guest_type == CHEF_GUEST_TYPE_WINDOWS ? "C:\\chef\\project" : "/chef/project";
     store_target = guest_type == CHEF_GUEST_TYPE_WINDOWS ? "C:\\chef\\store" : "/chef/store";
 
+    // setup the initialized rootfs snapshot, this already contains everything
+    // 'bakectl init' would have produced. The overlay lower layers are stacked
+    // in the order they are provided with the first one on top, so it must come
+    // before the base rootfs to shadow the files that init modified.
+    if (bctx->snapshot_path != NULL) {
+        layer = chef_create_parameters_layers_get(params, index++);
+        layer->type = CHEF_LAYER_TYPE_VAFS_PACKAGE;
+        layer->source = platform_strdup(bctx->snapshot_path);
+        layer->target = platform_strdup("/");
+        layer->options = CHEF_MOUNT_OPTIONS_READONLY;
+    }
+
     // setup the base rootfs
-    layer = chef_create_parameters_layers_get(params, 0);
+    layer = chef_create_parameters_layers_get(params, index++);
     layer->type = CHEF_LAYER_TYPE_BASE_ROOTFS;
     layer->source = platform_strdup(rootfs);
     layer->target = platform_strdup("/");
     layer->options = 0;
 
     // setup the project mount
-    layer = chef_create_parameters_layers_get(params, 1);
+    layer = chef_create_parameters_layers_get(params, index++);
     layer->type = CHEF_LAYER_TYPE_HOST_DIRECTORY;
     layer->source = platform_strdup(bctx->host_cwd);
     layer->target = platform_strdup(project_target);
     layer->options = CHEF_MOUNT_OPTIONS_READONLY;
 
     // setup the store mount
-    layer = chef_create_parameters_layers_get(params, 2);
+    layer = chef_create_parameters_layers_get(params, index++);
     layer->type = CHEF_LAYER_TYPE_HOST_DIRECTORY;
     layer->source = platform_strdup(chef_dirs_store());
     layer->target = platform_strdup(store_target);
     layer->options = CHEF_MOUNT_OPTIONS_READONLY;
 
+    // setup the compiler cache mount, this is shared between all builds
+    // using the same toolchain and architecture, and must be writable
+    if (bctx->ccache_path != NULL && guest_type == CHEF_GUEST_TYPE_LINUX) {
+        layer = chef_create_parameters_layers_get(params, index++);
+        layer->type = CHEF_LAYER_TYPE_HOST_DIRECTORY;
+        layer->source = platform_strdup(bctx->ccache_path);
+        layer->target = platform_strdup("/chef/ccache");
+        layer->options = 0;
+    }
+
     if (guest_type == CHEF_GUEST_TYPE_LINUX) {
         // initialize the overlay layer, this is an writable layer
         // to capture all the changes
-        layer = chef_create_parameters_layers_get(params, 3);
+        layer = chef_create_parameters_layers_get(params, index++);
         layer->type = CHEF_LAYER_TYPE_OVERLAY;
     }
 }
 
+static char* __strdup_safe(const char* string)
+{
+    return string != NULL ? platform_strdup(string) : NULL;
+}
+
+static void __initialize_limits(struct chef_create_parameters* params, struct __bake_build_context* bctx)
+{
+    params->limits.cpuset_cpus = __strdup_safe(bctx->limits.cpuset_cpus);
+    params->limits.cpuset_mems = __strdup_safe(bctx->limits.cpuset_mems);
+    params->limits.cpu_max = __strdup_safe(bctx->limits.cpu_max);
+    params->limits.memory_high = __strdup_safe(bctx->limits.memory_high);
+    params->limits.memory_max = __strdup_safe(bctx->limits.memory_max);
+}
+
 // Initialize the base rootfs for the build container if, and only if, it's not already
 // initialized. We use the build cache, and check key "rootfs-initialized" to see if we've
 // already done this.
@@ -635,6 +678,7 @@ enum chef_status bake_client_create_container(struct __bake_build_context* bctx)
     }
 
     __initialize_layers(&params, rootfs, bctx, params.gtype);
+    __initialize_limits(&params, bctx);
     
     status = chef_cvd_create(bctx->cvd_client, &context, &params);
     
@@ -751,3 +795,20 @@ enum chef_status bake_client_destroy_container(struct __bake_build_context* bctx
     }
     return chstatus;
 }
+
+enum chef_status bake_client_snapshot(struct __bake_build_context* bctx, const char* key)
+{
+    struct gracht_message_context context;
+    int                           status;
+    enum chef_status              chstatus;
+    VLOG_DEBUG("bake", "bake_client_snapshot(key=%s)\n", key);
+
+    status = chef_cvd_snapshot(bctx->cvd_client, &context, bctx->cvd_id, key);
+    if (status != 0) {
+        VLOG_ERROR("bake", "bake_client_snapshot: failed to invoke snapshot\n");
+        return status;
+    }
+    gracht_client_wait_message(bctx->cvd_client, &context, GRACHT_MESSAGE_BLOCK);
+    chef_cvd_snapshot_result(bctx->cvd_client, &context, &chstatus);
+    return chstatus;
+}
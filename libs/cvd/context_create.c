@@ -77,10 +77,11 @@ static char* __fmt_env_option(const char* name, const char* value)
     return result;
 }
 
-static char** __initialize_env(struct __bake_build_options* options)
+static char** __initialize_env(struct __bake_build_options* options, struct __bake_build_context* bctx)
 {
     char*  username;
     char** env;
+    char   tmp[128];
     
     username = __get_username();
     if (username == NULL) {
@@ -88,7 +89,7 @@ static char** __initialize_env(struct __bake_build_options* options)
         return NULL;
     }
 
-    env = calloc(8, sizeof(char*));
+    env = calloc(10, sizeof(char*));
     if (env == NULL) {
         VLOG_FATAL("kitchen", "failed to allocate memory for environment\n");
         free(username);
@@ -102,12 +103,35 @@ static char** __initialize_env(struct __bake_build_options* options)
     env[4] = __fmt_env_option("LD_LIBRARY_PATH", "/usr/local/lib");
     env[5] = __fmt_env_option("CHEF_TARGET_ARCH", options->target_architecture);
     env[6] = __fmt_env_option("CHEF_TARGET_PLATFORM", options->target_platform);
-    // env[7] = NULL
+    if (bctx->ccache_path != NULL) {
+        // oven picks up the cache from these, see __initialize_layers for the mount
+        snprintf(&tmp[0], sizeof(tmp), "/chef/ccache/stats/%s.log", build_cache_uuid(bctx->build_cache));
+        env[7] = __fmt_env_option("CCACHE_DIR", "/chef/ccache");
+        env[8] = __fmt_env_option("CCACHE_STATSLOG", &tmp[0]);
+    }
+    // env[9] = NULL
 
     free(username);
     return env;
 }
 
+static const char* __strdup_safe(const char* string)
+{
+    return string != NULL ? platform_strdup(string) : NULL;
+}
+
+static void __copy_limits(struct __bake_resource_limits* dst, const struct __bake_resource_limits* src)
+{
+    if (src == NULL) {
+        return;
+    }
+    dst->cpuset_cpus = __strdup_safe(src->cpuset_cpus);
+    dst->cpuset_mems = __strdup_safe(src->cpuset_mems);
+    dst->cpu_max = __strdup_safe(src->cpu_max);
+    dst->memory_high = __strdup_safe(src->memory_high);
+    dst->memory_max = __strdup_safe(src->memory_max);
+}
+
 struct __bake_build_context* build_context_create(struct __bake_build_options* options)
 {
     struct __bake_build_context* bctx;
@@ -128,9 +152,18 @@ struct __bake_build_context* build_context_create(struct __bake_build_options* o
     if (options->cvd_address != NULL) {
         memcpy(&bctx->cvd_address, options->cvd_address, sizeof(struct chef_config_address));
     }
+    __copy_limits(&bctx->limits, options->limits);
+
+    if (build_ccache_initialize(bctx)) {
+        VLOG_WARNING("bake", "build_context_create: failed to initialize compiler cache, continuing without\n");
+        free(bctx->ccache_path);
+        free(bctx->ccache_stats_path);
+        bctx->ccache_path = NULL;
+        bctx->ccache_stats_path = NULL;
+    }
 
     // Before paths, but after all the other setup, setup base environment
-    bctx->base_environment = (const char* const*)__initialize_env(options);
+    bctx->base_environment = (const char* const*)__initialize_env(options, bctx);
 
     if (__construct_paths(bctx)) {
         VLOG_ERROR("bake", "build_context_create: failed to allocate memory for paths\n");
@@ -49,5 +49,14 @@ void build_context_destroy(struct __bake_build_context* bctx)
     free((void*)bctx->target_architecture);
     free((void*)bctx->target_platform);
     free((void*)bctx->cvd_id);
+    free((void*)bctx->limits.cpuset_cpus);
+    free((void*)bctx->limits.cpuset_mems);
+    free((void*)bctx->limits.cpu_max);
+    free((void*)bctx->limits.memory_high);
+    free((void*)bctx->limits.memory_max);
+    free(bctx->snapshot_key);
+    free(bctx->snapshot_path);
+    free(bctx->ccache_path);
+    free(bctx->ccache_stats_path);
     free(bctx);
 }
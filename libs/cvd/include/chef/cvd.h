@@ -33,6 +33,17 @@ struct __build_clean_options {
     const char* part_or_step;
 };
 
+// Resource limits for the build container, these use the format of the
+// corresponding cgroup v2 files and are ignored where not supported.
+// NULL means not specified.
+struct __bake_resource_limits {
+    const char* cpuset_cpus;
+    const char* cpuset_mems;
+    const char* cpu_max;
+    const char* memory_high;
+    const char* memory_max;
+};
+
 struct __bake_build_options {
     struct recipe*              recipe;
     const char*                 target_architecture;
@@ -42,6 +53,13 @@ struct __bake_build_options {
     const char*                 recipe_path;
     struct build_cache*         build_cache;
     struct chef_config_address* cvd_address;
+    // optional, NULL means no limits
+    const struct __bake_resource_limits* limits;
+};
+
+struct build_ccache_stats {
+    unsigned int hits;
+    unsigned int misses;
 };
 
 struct __bake_build_context {
@@ -60,6 +78,19 @@ struct __bake_build_context {
     struct chef_config_address cvd_address;
     gracht_client_t*           cvd_client;
     char*                      cvd_id;
+
+    // resource limits for the build container, these are owned
+    struct __bake_resource_limits limits;
+
+    // rootfs snapshot state, snapshot_key is set when the workspace
+    // is eligible for snapshots, snapshot_path is set on a cache hit
+    char*                      snapshot_key;
+    char*                      snapshot_path;
+
+    // compiler cache state, ccache_path is the host directory that is
+    // mounted into the build container, or NULL if disabled
+    char*                      ccache_path;
+    char*                      ccache_stats_path;
 };
 
 extern struct __bake_build_context* build_context_create(struct __bake_build_options* options);
@@ -88,6 +119,38 @@ extern enum chef_status bake_client_upload(struct __bake_build_context* bctx, co
 
 extern enum chef_status bake_client_destroy_container(struct __bake_build_context* bctx);
 
+extern enum chef_status bake_client_snapshot(struct __bake_build_context* bctx, const char* key);
+
+/**
+ * @brief Calculates the rootfs snapshot key from the inputs of 'bakectl init' (base,
+ * host packages, ingredient revisions and the setup hook) and looks up whether a
+ * snapshot for it exists. Snapshots are only considered when the writable layer of the
+ * workspace does not exist yet or is empty.
+ * @return 1 on a cache hit, 0 on a cache miss, -1 if snapshots are not applicable.
+ */
+extern int build_snapshot_lookup(struct __bake_build_context* bctx);
+
+/**
+ * @brief Freezes the writable layer of the build container into a snapshot for the
+ * key calculated by build_snapshot_lookup. Must be invoked right after initialization.
+ * @return 0 for success, non-zero for error.
+ */
+extern int build_snapshot_create(struct __bake_build_context* bctx);
+
+/**
+ * @brief Provisions the host compiler cache directory for the (toolchain, architecture)
+ * of the build, and resets the statistics log of the build. Does nothing if the compiler
+ * cache has been disabled in the configuration ('compiler-cache' section, 'enabled' key).
+ * @return 0 for success, non-zero for error.
+ */
+extern int build_ccache_initialize(struct __bake_build_context* bctx);
+
+/**
+ * @brief Reads the compiler cache statistics that have been logged during this build.
+ * @return 0 for success, -1 if no statistics are available.
+ */
+extern int build_ccache_stats(struct __bake_build_context* bctx, struct build_ccache_stats* statsOut);
+
 
 extern int         build_cache_create(struct recipe* current, const char* cwd, struct build_cache** cacheOut);
 extern int         build_cache_create_null(struct recipe* current, struct build_cache** cacheOut);
@@ -0,0 +1,237 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/cvd.h>
+#include <chef/list.h>
+#include <chef/platform.h>
+#include <chef/store.h>
+#ifdef CHEF_ON_LINUX
+#include <dirent.h>
+#endif
+#include <errno.h>
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlog.h>
+
+// Bump this whenever the layout of the snapshot or the inputs to
+// 'bakectl init' changes in a way that invalidates existing snapshots.
+#define __SNAPSHOT_FORMAT_VERSION "1"
+
+static void __digest_string(EVP_MD_CTX* ctx, const char* value)
+{
+    // include the terminator so that ("ab", "c") and ("a", "bc") differ
+    if (value == NULL) {
+        value = "";
+    }
+    EVP_DigestUpdate(ctx, value, strlen(value) + 1);
+}
+
+static int __digest_ingredients(EVP_MD_CTX* ctx, struct list* ingredients, const char* platform, const char* arch)
+{
+    struct list_item* i;
+    char              revision[16];
+
+    list_foreach(ingredients, i) {
+        struct recipe_ingredient* ri = (struct recipe_ingredient*)i;
+        int                       rev;
+
+        // The ingredients have already been fetched at this point, so this only
+        // resolves the revision from the local inventory.
+        rev = store_ensure_package(&(struct store_package) {
+            .name = ri->name,
+            .channel = ri->channel,
+            .platform = platform,
+            .arch = arch
+        }, NULL);
+        if (rev <= 0) {
+            VLOG_ERROR("bake", "__digest_ingredients: failed to resolve revision of %s\n", ri->name);
+            return -1;
+        }
+
+        snprintf(&revision[0], sizeof(revision), "%i", rev);
+        __digest_string(ctx, ri->name);
+        __digest_string(ctx, ri->channel);
+        __digest_string(ctx, &revision[0]);
+    }
+    return 0;
+}
+
+static char* __calculate_key(struct __bake_build_context* bctx)
+{
+    struct recipe*    recipe = bctx->recipe;
+    struct list_item* i;
+    EVP_MD_CTX*       ctx;
+    unsigned char     digest[EVP_MAX_MD_SIZE];
+    unsigned int      digestLength = 0;
+    char*             key = NULL;
+    int               status;
+
+    ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+        EVP_MD_CTX_free(ctx);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    __digest_string(ctx, __SNAPSHOT_FORMAT_VERSION);
+    __digest_string(ctx, bctx->target_platform);
+    __digest_string(ctx, bctx->target_architecture);
+    __digest_string(ctx, recipe_platform_base(recipe, bctx->target_platform));
+
+    list_foreach(&recipe->environment.host.packages, i) {
+        __digest_string(ctx, ((struct list_item_string*)i)->value);
+    }
+
+    // host ingredients are resolved for the host, the rest for the target
+    status = __digest_ingredients(ctx, &recipe->environment.host.ingredients, CHEF_PLATFORM_STR, CHEF_ARCHITECTURE_STR);
+    if (status == 0) {
+        status = __digest_ingredients(ctx, &recipe->environment.build.ingredients, bctx->target_platform, bctx->target_architecture);
+    }
+    if (status == 0) {
+        status = __digest_ingredients(ctx, &recipe->environment.runtime.ingredients, bctx->target_platform, bctx->target_architecture);
+    }
+    __digest_string(ctx, recipe->environment.hooks.setup);
+
+    if (status == 0 && EVP_DigestFinal_ex(ctx, &digest[0], &digestLength) == 1) {
+        key = calloc((digestLength * 2) + 1, 1);
+        if (key != NULL) {
+            for (unsigned int j = 0; j < digestLength; j++) {
+                snprintf(&key[j * 2], 3, "%02x", digest[j]);
+            }
+        }
+    }
+    EVP_MD_CTX_free(ctx);
+    return key;
+}
+
+#ifdef CHEF_ON_LINUX
+static char* __snapshot_path(const char* key)
+{
+    char buffer[PATH_MAX];
+    snprintf(&buffer[0], sizeof(buffer), "/var/chef/snapshots/%s.pack", key);
+    return platform_strdup(&buffer[0]);
+}
+
+// A workspace is only eligible for snapshots if its writable layer is about to
+// be created for this build, which is the case when the layer does not exist yet
+// or is empty. Any content means an earlier build (with or without a snapshot)
+// wrote to it, and that content would either shadow the snapshot or end up in it.
+static int __workspace_is_fresh(struct __bake_build_context* bctx)
+{
+    char           buffer[PATH_MAX];
+    DIR*           dir;
+    struct dirent* entry;
+    int            fresh = 1;
+
+    snprintf(&buffer[0], sizeof(buffer),
+        "/var/chef/layers/%s/contents",
+        build_cache_uuid(bctx->build_cache)
+    );
+
+    dir = opendir(&buffer[0]);
+    if (dir == NULL) {
+        return errno == ENOENT ? 1 : 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+            fresh = 0;
+            break;
+        }
+    }
+    closedir(dir);
+    return fresh;
+}
+#else
+static char* __snapshot_path(const char* key)
+{
+    // Windows build containers do not use overlays, so there is no
+    // writable layer that can be frozen.
+    (void)key;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+static int __workspace_is_fresh(struct __bake_build_context* bctx)
+{
+    (void)bctx;
+    return 0;
+}
+#endif
+
+int build_snapshot_lookup(struct __bake_build_context* bctx)
+{
+    struct platform_stat stats;
+    char*                key;
+    char*                path;
+    VLOG_DEBUG("bake", "build_snapshot_lookup()\n");
+
+    if (!__workspace_is_fresh(bctx)) {
+        VLOG_DEBUG("bake", "build_snapshot_lookup: workspace has been used before, not using snapshots\n");
+        return -1;
+    }
+
+    key = __calculate_key(bctx);
+    if (key == NULL) {
+        VLOG_ERROR("bake", "build_snapshot_lookup: failed to calculate snapshot key\n");
+        return -1;
+    }
+
+    path = __snapshot_path(key);
+    if (path == NULL) {
+        free(key);
+        return -1;
+    }
+
+    bctx->snapshot_key = key;
+    if (platform_stat(path, &stats) == 0 && stats.type == PLATFORM_FILETYPE_FILE) {
+        bctx->snapshot_path = path;
+        return 1;
+    }
+    free(path);
+    return 0;
+}
+
+int build_snapshot_create(struct __bake_build_context* bctx)
+{
+    enum chef_status status;
+    VLOG_DEBUG("bake", "build_snapshot_create()\n");
+
+    // the key is only set by build_snapshot_lookup when the writable layer was
+    // fresh, and without a snapshot mounted that layer now contains nothing but
+    // the result of this 'bakectl init'
+    if (bctx->snapshot_key == NULL || bctx->snapshot_path != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // the daemon derives the output path from the key
+    status = bake_client_snapshot(bctx, bctx->snapshot_key);
+    if (status != CHEF_STATUS_SUCCESS) {
+        VLOG_ERROR("bake", "build_snapshot_create: failed to snapshot build container: %u\n", status);
+        return -1;
+    }
+    return 0;
+}
@@ -129,6 +129,7 @@ static int __find_bakectl(char** resolvedOut)
 int bake_build_setup(struct __bake_build_context* bctx)
 {
     int          status;
+    int          snapshot;
     char*        bakectlPath;
     unsigned int pid;
     char         buffer[1024];
@@ -139,6 +140,13 @@ int bake_build_setup(struct __bake_build_context* bctx)
         return -1;
     }
 
+    snapshot = build_snapshot_lookup(bctx);
+    if (snapshot == 1) {
+        VLOG_TRACE("bake", "rootfs snapshot cache hit (%.12s)\n", bctx->snapshot_key);
+    } else if (snapshot == 0) {
+        VLOG_TRACE("bake", "rootfs snapshot cache miss (%.12s)\n", bctx->snapshot_key);
+    }
+
     status = bake_client_create_container(bctx);
     if (status) {
         VLOG_ERROR("bake", "bake_build_setup: failed to create build container: %u\n", status);
@@ -160,6 +168,11 @@ int bake_build_setup(struct __bake_build_context* bctx)
     }
     free(bakectlPath);
 
+    // the snapshot already contains the result of 'bakectl init'
+    if (snapshot == 1) {
+        return 0;
+    }
+
     snprintf(&buffer[0], sizeof(buffer),
         "%s init --recipe %s",
         bctx->bakectl_path, bctx->recipe_path
@@ -173,6 +186,17 @@ int bake_build_setup(struct __bake_build_context* bctx)
     );
     if (status) {
         VLOG_ERROR("bake", "failed to setup project inside the container\n");
+        return status;
     }
-    return status;
+
+    // freeze the freshly initialized rootfs for later builds, failing to
+    // do so only costs us the next build its shortcut
+    if (snapshot == 0) {
+        if (build_snapshot_create(bctx)) {
+            VLOG_WARNING("bake", "failed to store rootfs snapshot, continuing without\n");
+        } else {
+            VLOG_TRACE("bake", "rootfs snapshot stored (%.12s)\n", bctx->snapshot_key);
+        }
+    }
+    return 0;
 }
@@ -95,6 +95,12 @@ static void __chef_config_delete(struct chef_config* config)
     if (config == NULL) {
         return;
     }
+    json_decref(config->root_object);
+    free((void*)config->cvd.type);
+    free((void*)config->cvd.address);
+    free((void*)config->remote.type);
+    free((void*)config->remote.address);
+    free(config->path);
     free(config);
 }
 
@@ -195,6 +201,11 @@ struct chef_config* chef_config_load(const char* confdir)
     return config;
 }
 
+void chef_config_destroy(struct chef_config* config)
+{
+    __chef_config_delete(config);
+}
+
 int chef_config_save(struct chef_config* config)
 {
     VLOG_DEBUG("config", "chef_config_save(path=%s)\n", config->path);
@@ -35,6 +35,14 @@ struct chef_config;
  */
 extern struct chef_config* chef_config_load(const char* confdir);
 
+/**
+ * @brief Releases a configuration object returned by chef_config_load(). Any
+ * strings or sections retrieved from it are no longer valid afterwards.
+ * 
+ * @param config The configuration object, may be NULL
+ */
+extern void chef_config_destroy(struct chef_config* config);
+
 /**
  * @brief 
  * 
@@ -0,0 +1,202 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/list.h>
+#include <chef/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlog.h>
+
+#include "private.h"
+
+// The compiler cache is provisioned by the host, which sets CCACHE_DIR in the
+// build environment when a cache directory has been mounted into the container.
+// Oven is then responsible for making each backend actually use it.
+
+#if CHEF_ON_WINDOWS
+int oven_ccache_apply(struct oven_backend_data* data, const char* system)
+{
+    // ccache is not supported for windows build containers
+    (void)data;
+    (void)system;
+    return 0;
+}
+#else
+static const char* __find_environment(const char* const* envp, const char* key)
+{
+    size_t keyLength = strlen(key);
+
+    if (envp == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; envp[i] != NULL; i++) {
+        if (strncmp(envp[i], key, keyLength) == 0 && envp[i][keyLength] == '=') {
+            return &envp[i][keyLength + 1];
+        }
+    }
+    return NULL;
+}
+
+static char* __find_ccache(const char* const* envp)
+{
+    struct platform_stat stats;
+    const char*          path = __find_environment(envp, "PATH");
+    char*                paths;
+    char*                saveptr = NULL;
+    char*                token;
+    char*                result = NULL;
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    paths = platform_strdup(path);
+    if (paths == NULL) {
+        return NULL;
+    }
+
+    for (token = strtok_r(paths, ":", &saveptr); token != NULL; token = strtok_r(NULL, ":", &saveptr)) {
+        char* candidate = strpathcombine(token, "ccache");
+        if (candidate == NULL) {
+            break;
+        }
+
+        if (platform_stat(candidate, &stats) == 0 && stats.type == PLATFORM_FILETYPE_FILE) {
+            result = candidate;
+            break;
+        }
+        free(candidate);
+    }
+    free(paths);
+    return result;
+}
+
+static struct chef_keypair_item* __find_keypair(struct list* environment, const char* key)
+{
+    struct list_item* item;
+
+    list_foreach(environment, item) {
+        struct chef_keypair_item* keypair = (struct chef_keypair_item*)item;
+        if (strcmp(keypair->key, key) == 0) {
+            return keypair;
+        }
+    }
+    return NULL;
+}
+
+static int __add_keypair(struct list* environment, const char* key, const char* value)
+{
+    struct chef_keypair_item* keypair;
+
+    // never override anything the recipe provided
+    if (__find_keypair(environment, key) != NULL) {
+        return 0;
+    }
+
+    keypair = calloc(1, sizeof(struct chef_keypair_item));
+    if (keypair == NULL) {
+        return -1;
+    }
+
+    keypair->key = platform_strdup(key);
+    keypair->value = platform_strdup(value);
+    if (keypair->key == NULL || keypair->value == NULL) {
+        free((void*)keypair->key);
+        free((void*)keypair->value);
+        free(keypair);
+        return -1;
+    }
+    list_add(environment, &keypair->list_header);
+    return 0;
+}
+
+// Wraps the compiler in the environment with the launcher. If the recipe provided
+// the compiler, then it is prefixed, otherwise the default compiler is wrapped.
+static int __wrap_compiler(struct list* environment, const char* key, const char* defaultCompiler, const char* launcher)
+{
+    struct chef_keypair_item* keypair = __find_keypair(environment, key);
+    char                      buffer[512];
+    char*                     value;
+
+    if (keypair == NULL) {
+        snprintf(&buffer[0], sizeof(buffer), "%s %s", launcher, defaultCompiler);
+        return __add_keypair(environment, key, &buffer[0]);
+    }
+
+    // already wrapped by the recipe
+    if (strstr(keypair->value, "ccache") != NULL) {
+        return 0;
+    }
+
+    snprintf(&buffer[0], sizeof(buffer), "%s %s", launcher, keypair->value);
+    value = platform_strdup(&buffer[0]);
+    if (value == NULL) {
+        return -1;
+    }
+    free((void*)keypair->value);
+    keypair->value = value;
+    return 0;
+}
+
+int oven_ccache_apply(struct oven_backend_data* data, const char* system)
+{
+    const char* cacheDir;
+    char*       launcher;
+    int         status = 0;
+
+    cacheDir = __find_environment(data->process_environment, "CCACHE_DIR");
+    if (cacheDir == NULL) {
+        return 0;
+    }
+
+    launcher = __find_ccache(data->process_environment);
+    if (launcher == NULL) {
+        VLOG_DEBUG("oven", "oven_ccache_apply: compiler cache available at %s, but ccache is not installed\n", cacheDir);
+        return 0;
+    }
+    VLOG_DEBUG("oven", "oven_ccache_apply(system=%s, launcher=%s)\n", system, launcher);
+
+    // All sources are mounted at the same paths in every build container, so
+    // rewriting them relative to /chef allows hits across projects.
+    status = __add_keypair(data->environment, "CCACHE_BASEDIR", "/chef");
+    if (status) {
+        goto cleanup;
+    }
+
+    if (strcmp(system, "cmake") == 0) {
+        // CMake picks these up from the environment on the first configure
+        status = __add_keypair(data->environment, "CMAKE_C_COMPILER_LAUNCHER", launcher);
+        if (status == 0) {
+            status = __add_keypair(data->environment, "CMAKE_CXX_COMPILER_LAUNCHER", launcher);
+        }
+    } else if (strcmp(system, "autotools") == 0 || strcmp(system, "autoconf") == 0 || strcmp(system, "make") == 0) {
+        status = __wrap_compiler(data->environment, "CC", "cc", launcher);
+        if (status == 0) {
+            status = __wrap_compiler(data->environment, "CXX", "c++", launcher);
+        }
+    }
+    // Meson detects ccache in PATH by itself and ninja only executes what has
+    // already been generated, so for these only the cache environment is needed.
+
+cleanup:
+    free(launcher);
+    return status;
+}
+#endif
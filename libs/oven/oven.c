@@ -331,7 +331,7 @@ static int __append_or_update_environ_flags(struct list* environment, const char
     return 0;
 }
 
-static int __initialize_backend_data(struct oven_backend_data* data, const char* profile, struct list* arguments, struct list* environment)
+static int __initialize_backend_data(struct oven_backend_data* data, const char* system, const char* profile, struct list* arguments, struct list* environment)
 {
     // reset the datastructure
     memset(data, 0, sizeof(struct oven_backend_data));
@@ -359,6 +359,11 @@ static int __initialize_backend_data(struct oven_backend_data* data, const char*
         return -1;
     }
 
+    if (oven_ccache_apply(data, system)) {
+        __cleanup_backend_data(data);
+        return -1;
+    }
+
     //if (__append_or_update_environ_flags(data->environment)) {
     //    __cleanup_backend_data(data);
     //    return -1;
@@ -390,7 +395,7 @@ int oven_configure(struct oven_generate_options* options)
         return -1;
     }
 
-    status = __initialize_backend_data(&data, options->profile, options->arguments, options->environment);
+    status = __initialize_backend_data(&data, options->system, options->profile, options->arguments, options->environment);
     if (status) {
         return status;
     }
@@ -418,7 +423,7 @@ int oven_build(struct oven_build_options* options)
         return -1;
     }
 
-    status = __initialize_backend_data(&data, options->profile, options->arguments, options->environment);
+    status = __initialize_backend_data(&data, options->system, options->profile, options->arguments, options->environment);
     if (status) {
         return status;
     }
@@ -447,7 +452,7 @@ int oven_clean(struct oven_clean_options* options)
     }
 
     VLOG_TRACE("oven", "running step %s\n", options->name);
-    status = __initialize_backend_data(&data, options->profile, options->arguments, options->environment);
+    status = __initialize_backend_data(&data, options->system, options->profile, options->arguments, options->environment);
     if (status) {
         return status;
     }
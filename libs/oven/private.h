@@ -50,4 +50,12 @@ struct oven_backend {
 
 extern struct oven_context* __oven_instance();
 
+/**
+ * @brief Injects the compiler cache launcher into the backend environment if
+ * the host has provisioned a compiler cache (CCACHE_DIR is set) and ccache is
+ * installed in the build environment.
+ * @return 0 on success or when no cache is available, -1 on allocation failure.
+ */
+extern int oven_ccache_apply(struct oven_backend_data* data, const char* system);
+
 #endif //!__OVEN_PRIVATE_H__
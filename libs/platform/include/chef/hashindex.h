@@ -0,0 +1,123 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef __LIBPLATFORM_HASHINDEX_H__
+#define __LIBPLATFORM_HASHINDEX_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The smallest table allocated, the capacity is always a power of two
+#define HASHINDEX_MIN_CAPACITY 64
+
+/**
+ * @brief Open-addressed hash table with linear probing, that only stores values.
+ * Lookups walk the candidates for a hash with hashindex_foreach and compare the
+ * keys themselves. A zero value marks an empty slot, so stored values must never
+ * be zero. There is no removal, instead the index is reset and filled again.
+ */
+struct hashindex {
+    uintptr_t*   slots;
+    unsigned int capacity;
+};
+
+#define hashindex_foreach(index, hash, i) \
+    for (unsigned int i = (index)->capacity != 0 ? (hash) & ((index)->capacity - 1) : 0; \
+         (index)->capacity != 0 && (index)->slots[i] != 0; \
+         i = (i + 1) & ((index)->capacity - 1))
+
+/**
+ * @brief Empties the index and makes room for count entries at a load of at most
+ * one half. Memory is never released here, so resetting for the same or a lower
+ * count than before always succeeds.
+ */
+static inline int hashindex_reset(struct hashindex* index, int count)
+{
+    unsigned int capacity = HASHINDEX_MIN_CAPACITY;
+    uintptr_t*   slots;
+
+    while (capacity < (unsigned int)count * 2) {
+        capacity <<= 1;
+    }
+
+    if (capacity > index->capacity) {
+        slots = calloc(capacity, sizeof(uintptr_t));
+        if (slots == NULL) {
+            return -1;
+        }
+        free(index->slots);
+        index->slots = slots;
+        index->capacity = capacity;
+    } else {
+        memset(index->slots, 0, sizeof(uintptr_t) * index->capacity);
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns non-zero if the index must be reset before holding count entries.
+ */
+static inline int hashindex_full(const struct hashindex* index, int count)
+{
+    return (unsigned int)count * 2 > index->capacity;
+}
+
+/**
+ * @brief Stores a non-zero value, the index must not be full.
+ */
+static inline void hashindex_insert(struct hashindex* index, unsigned int hash, uintptr_t value)
+{
+    unsigned int mask = index->capacity - 1;
+    unsigned int i    = hash & mask;
+
+    while (index->slots[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    index->slots[i] = value;
+}
+
+static inline void hashindex_destroy(struct hashindex* index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+}
+
+/**
+ * @brief FNV-1a of a zero terminated string.
+ */
+static inline unsigned int hashindex_hash_string(const char* value)
+{
+    unsigned int hash = 2166136261u;
+    for (const char* p = value; *p != '\0'; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Spreads integer keys, such as sequential ids, over the table.
+ */
+static inline unsigned int hashindex_hash_uint(unsigned int value)
+{
+    return value * 2654435761u;
+}
+
+#endif //!__LIBPLATFORM_HASHINDEX_H__
@@ -41,4 +41,24 @@ extern int remote_upload(const char* path, char** downloadUrl);
  */
 extern int remote_download(const char* url, const char* path);
 
+/**
+ * @brief Prepares the sources at <path> for a remote build without uploading all of it. The
+ * sources are split into content-defined chunks, and only chunks that were not uploaded by
+ * an earlier sync are uploaded. The manifest written to <manifestPath> describes the tree and
+ * where each chunk can be fetched, and is what should be uploaded with remote_upload.
+ */
+extern int remote_sync_pack(const char* path, char** manifestPath);
+
+/**
+ * @brief Returns 1 if <path> is a manifest written by remote_sync_pack, 0 otherwise.
+ */
+extern int remote_sync_is_manifest(const char* path);
+
+/**
+ * @brief Restores the sources described by the manifest at <manifestPath> into <destination>.
+ * Chunks already in <cacheDirectory> are reused, and only the missing ones are downloaded and
+ * added to the cache.
+ */
+extern int remote_sync_unpack(const char* manifestPath, const char* cacheDirectory, const char* destination);
+
 #endif //!__CHEF_REMOTE_H__
@@ -0,0 +1,1161 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <chef/client.h>
+#include <chef/dirs.h>
+#include <chef/list.h>
+#include <chef/platform.h>
+#include <chef/storage/bashupload.h>
+#include <chef/storage/download.h>
+#include <jansson.h>
+#include <limits.h>
+#include <openssl/evp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <vlog.h>
+
+// Sources are synced as content-defined chunks instead of one archive of the
+// whole tree. The client remembers which chunks it has uploaded, and where, so
+// that only chunks that changed since the last build are uploaded again. The
+// manifest describes the tree and where every chunk can be fetched from, and
+// cookd keeps a cache of chunks it has seen, so it only downloads what it is
+// missing.
+#define __SYNC_MANIFEST_MAGIC   "{\"chef-sync\":"
+#define __SYNC_MANIFEST_VERSION 1
+
+// Chunk boundaries are chosen by a rolling gear hash over the content, so an
+// edit only changes the chunks around it and not every chunk after it.
+#define __CHUNK_MIN_SIZE (8 * 1024)
+#define __CHUNK_MAX_SIZE (128 * 1024)
+#define __CHUNK_MASK     0xFFFE000000000000ULL // 15 bits, ~40KiB chunks on average
+
+// The upload service keeps files for three days, chunks uploaded longer ago
+// than this are uploaded again rather than risk that they have expired.
+#define __CHUNK_UPLOAD_TTL (2 * 24 * 60 * 60)
+
+#define __DIGEST_HEX_SIZE 65
+
+static uint64_t             g_gear[256];
+static once_flag            g_gearOnce = ONCE_FLAG_INIT;
+static atomic_uint_fast32_t g_tmpIndex = 0;
+
+struct __ignore_rule {
+    struct list_item list_header;
+    char*            pattern;
+    int              directory; // only matches directories
+    int              anchored;  // matches against the path from the root
+};
+
+struct __sync_pack {
+    const char* root;
+    struct list ignores;
+    json_t*     index;     // hash => [url, offset, length, uploaded], chunks uploaded by earlier syncs
+    json_t*     blobs;     // urls of the blobs referenced by the manifest
+    json_t*     chunks;    // hash => [blob, offset, length]
+    json_t*     files;
+    json_t*     pending;   // hash => [offset, length], chunks written to the new blob
+    FILE*       blob;
+    char*       blobPath;
+    uint64_t    blobSize;
+    uint64_t    totalSize;
+    time_t      now;
+};
+
+static void __gear_initialize(void)
+{
+    uint64_t seed = 0x6368656673796e63ULL;
+    int      i;
+
+    // splitmix64, the table must be identical between versions as the chunk
+    // boundaries, and thus the hashes, depend on it
+    for (i = 0; i < 256; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        g_gear[i] = z ^ (z >> 31);
+    }
+}
+
+static size_t __chunk_boundary(const unsigned char* data, size_t length)
+{
+    uint64_t hash = 0;
+    size_t   i;
+
+    if (length <= __CHUNK_MIN_SIZE) {
+        return length;
+    }
+    if (length > __CHUNK_MAX_SIZE) {
+        length = __CHUNK_MAX_SIZE;
+    }
+
+    for (i = __CHUNK_MIN_SIZE; i < length; i++) {
+        hash = (hash << 1) + g_gear[data[i]];
+        if (!(hash & __CHUNK_MASK)) {
+            return i + 1;
+        }
+    }
+    return length;
+}
+
+static int __digest_hex(const void* data, size_t length, char hex[__DIGEST_HEX_SIZE])
+{
+    static const char* digits = "0123456789abcdef";
+    unsigned char      digest[EVP_MAX_MD_SIZE];
+    unsigned int       digestLength;
+    unsigned int       i;
+
+    if (EVP_Digest(data, length, &digest[0], &digestLength, EVP_sha256(), NULL) != 1) {
+        errno = EIO;
+        return -1;
+    }
+
+    for (i = 0; i < digestLength; i++) {
+        hex[i * 2]     = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xF];
+    }
+    hex[i * 2] = '\0';
+    return 0;
+}
+
+static int __is_digest(const char* hash)
+{
+    int i;
+
+    // hashes end up as file names in the chunk cache, so never trust them
+    for (i = 0; i < __DIGEST_HEX_SIZE - 1; i++) {
+        if (!((hash[i] >= '0' && hash[i] <= '9') || (hash[i] >= 'a' && hash[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return hash[i] == '\0';
+}
+
+static int __is_relative_path(const char* path)
+{
+    const char* component = path;
+
+    if (path[0] == '\0' || path[0] == '/' || path[0] == '\\' || strchr(path, ':') != NULL) {
+        return 0;
+    }
+
+    while (component != NULL) {
+        if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) {
+            return 0;
+        }
+        component = strchr(component, '/');
+        if (component != NULL) {
+            component++;
+        }
+    }
+    return 1;
+}
+
+// Resolves <target> relative to the directory of the link at <path>, both as
+// written, and returns 0 if it leaves the sources. Links in the manifest are not
+// followed, so any path that continues through one is rejected, as are links that
+// are themselves created inside another link.
+static int __is_contained_link(json_t* links, const char* path, const char* target)
+{
+    char        resolved[PATH_MAX];
+    size_t      length;
+    const char* component;
+    const char* separator;
+
+    if (target[0] == '\0' || target[0] == '/' || target[0] == '\\' || strlen(path) >= sizeof(resolved)) {
+        return 0;
+    }
+
+    // start out in the directory of the link, every parent of it must be a
+    // real directory
+    strcpy(&resolved[0], path);
+    separator = strrchr(&resolved[0], '/');
+    length = separator != NULL ? (size_t)(separator - &resolved[0]) : 0;
+    resolved[length] = '\0';
+    for (size_t i = 1; i <= length; i++) {
+        if (resolved[i] == '/' || resolved[i] == '\0') {
+            char saved = resolved[i];
+            resolved[i] = '\0';
+            if (json_object_get(links, &resolved[0]) != NULL) {
+                return 0;
+            }
+            resolved[i] = saved;
+        }
+    }
+
+    for (component = target; component != NULL; component = separator != NULL ? separator + 1 : NULL) {
+        size_t componentLength;
+
+        separator = strchr(component, '/');
+        componentLength = separator != NULL ? (size_t)(separator - component) : strlen(component);
+        if (componentLength == 0 || (componentLength == 1 && component[0] == '.')) {
+            continue;
+        }
+
+        // the path continues through a link, which may point anywhere
+        if (length > 0 && json_object_get(links, &resolved[0]) != NULL) {
+            return 0;
+        }
+
+        if (componentLength == 2 && component[0] == '.' && component[1] == '.') {
+            char* parent;
+            if (length == 0) {
+                return 0;
+            }
+            parent = strrchr(&resolved[0], '/');
+            length = parent != NULL ? (size_t)(parent - &resolved[0]) : 0;
+            resolved[length] = '\0';
+            continue;
+        }
+
+        if (length + componentLength + 2 > sizeof(resolved)) {
+            return 0;
+        }
+        if (length > 0) {
+            resolved[length++] = '/';
+        }
+        memcpy(&resolved[length], component, componentLength);
+        length += componentLength;
+        resolved[length] = '\0';
+    }
+
+    // the last component may be a link itself, which is checked on its own
+    return 1;
+}
+
+static json_t* __collect_links(json_t* files)
+{
+    json_t* links;
+    json_t* entry;
+    size_t  i;
+
+    links = json_object();
+    if (links == NULL) {
+        return NULL;
+    }
+
+    json_array_foreach(files, i, entry) {
+        const char* subPath = json_string_value(json_object_get(entry, "path"));
+        if (subPath != NULL && json_object_get(entry, "link") != NULL) {
+            if (json_object_set_new(links, subPath, json_true())) {
+                json_decref(links);
+                return NULL;
+            }
+        }
+    }
+    return links;
+}
+
+static void __ignore_rule_delete(void* item)
+{
+    struct __ignore_rule* rule = (struct __ignore_rule*)item;
+    free(rule->pattern);
+    free(rule);
+}
+
+static int __load_ignores(const char* root, struct list* ignores)
+{
+    char*  path;
+    char*  buffer = NULL;
+    size_t length;
+    char** lines;
+    int    status;
+    int    i;
+
+    path = strpathcombine(root, ".gitignore");
+    if (path == NULL) {
+        return -1;
+    }
+
+    status = platform_readfile(path, (void**)&buffer, &length);
+    free(path);
+    if (status) {
+        // no .gitignore, nothing to ignore
+        return 0;
+    }
+
+    // platform_readfile does not terminate the buffer
+    path = platform_strndup(buffer, length);
+    free(buffer);
+    if (path == NULL) {
+        return -1;
+    }
+
+    lines = strsplit(path, '\n');
+    free(path);
+    if (lines == NULL) {
+        return -1;
+    }
+
+    for (i = 0; lines[i] != NULL; i++) {
+        struct __ignore_rule* rule;
+        char*                 pattern = lines[i];
+        size_t                patternLength;
+
+        patternLength = strlen(pattern);
+        while (patternLength > 0 && (pattern[patternLength - 1] == '\r' || pattern[patternLength - 1] == ' ')) {
+            pattern[--patternLength] = '\0';
+        }
+
+        // negations are not supported, they only ever cause more files to be
+        // synced than mkvafs would, never fewer
+        if (patternLength == 0 || pattern[0] == '#' || pattern[0] == '!') {
+            continue;
+        }
+
+        rule = calloc(1, sizeof(struct __ignore_rule));
+        if (rule == NULL) {
+            strsplit_free(lines);
+            return -1;
+        }
+
+        if (pattern[patternLength - 1] == '/') {
+            pattern[--patternLength] = '\0';
+            rule->directory = 1;
+        }
+        if (pattern[0] == '/') {
+            pattern++;
+            rule->anchored = 1;
+        } else if (strchr(pattern, '/') != NULL) {
+            rule->anchored = 1;
+        }
+
+        rule->pattern = platform_strdup(pattern);
+        if (rule->pattern == NULL) {
+            free(rule);
+            strsplit_free(lines);
+            return -1;
+        }
+        list_add(ignores, &rule->list_header);
+    }
+    strsplit_free(lines);
+    return 0;
+}
+
+static int __is_ignored(struct list* ignores, struct platform_file_entry* entry, const char* subPath)
+{
+    struct list_item* i;
+
+    if (strcmp(entry->name, ".git") == 0) {
+        return 1;
+    }
+
+    list_foreach(ignores, i) {
+        struct __ignore_rule* rule = (struct __ignore_rule*)i;
+        if (rule->directory && entry->type != PLATFORM_FILETYPE_DIRECTORY) {
+            continue;
+        }
+        if (strfilter(rule->pattern, rule->anchored ? subPath : entry->name, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static json_t* __load_index(const char* path)
+{
+    json_error_t error;
+    json_t*      index;
+
+    index = json_load_file(path, 0, &error);
+    if (index == NULL || !json_is_object(index)) {
+        json_decref(index);
+        return json_object();
+    }
+    return index;
+}
+
+static char* __index_path(void)
+{
+    return strpathcombine(chef_dirs_cache(), "remote-sync.json");
+}
+
+static int __blob_index(struct __sync_pack* pack, const char* url)
+{
+    size_t  i;
+    json_t* value;
+
+    json_array_foreach(pack->blobs, i, value) {
+        if (strcmp(json_string_value(value), url) == 0) {
+            return (int)i;
+        }
+    }
+
+    if (json_array_append_new(pack->blobs, json_string(url))) {
+        return -1;
+    }
+    return (int)json_array_size(pack->blobs) - 1;
+}
+
+static int __add_chunk(struct __sync_pack* pack, const unsigned char* data, size_t length, json_t* fileChunks)
+{
+    char    hash[__DIGEST_HEX_SIZE];
+    json_t* known;
+
+    if (__digest_hex(data, length, hash)) {
+        return -1;
+    }
+
+    if (json_array_append_new(fileChunks, json_string(&hash[0]))) {
+        return -1;
+    }
+
+    // already referenced by this manifest, or written to the new blob
+    if (json_object_get(pack->chunks, &hash[0]) != NULL || json_object_get(pack->pending, &hash[0]) != NULL) {
+        return 0;
+    }
+
+    // uploaded by an earlier sync, and recent enough that it is still there
+    known = json_object_get(pack->index, &hash[0]);
+    if (json_is_array(known) && json_array_size(known) == 4 &&
+        (pack->now - (time_t)json_integer_value(json_array_get(known, 3))) < __CHUNK_UPLOAD_TTL) {
+        int blob = __blob_index(pack, json_string_value(json_array_get(known, 0)));
+        if (blob < 0) {
+            return -1;
+        }
+        return json_object_set_new(pack->chunks, &hash[0], json_pack("[iII]",
+            blob,
+            json_integer_value(json_array_get(known, 1)),
+            json_integer_value(json_array_get(known, 2))
+        ));
+    }
+
+    if (pack->blob == NULL) {
+        pack->blob = chef_dirs_open_temp_file("bake-chunks", "blob", &pack->blobPath);
+        if (pack->blob == NULL) {
+            VLOG_ERROR("remote", "failed to get a temporary path for source chunks\n");
+            return -1;
+        }
+    }
+
+    if (fwrite(data, 1, length, pack->blob) != length) {
+        VLOG_ERROR("remote", "failed to write source chunk to %s\n", pack->blobPath);
+        return -1;
+    }
+
+    if (json_object_set_new(pack->pending, &hash[0], json_pack("[II]", (json_int_t)pack->blobSize, (json_int_t)length))) {
+        return -1;
+    }
+    pack->blobSize += length;
+    return 0;
+}
+
+static int __pack_file(struct __sync_pack* pack, const char* path, const char* subPath, uint32_t permissions)
+{
+    unsigned char* buffer;
+    FILE*          file;
+    json_t*        fileChunks;
+    size_t         available = 0;
+    int            status = 0;
+
+    fileChunks = json_array();
+    if (fileChunks == NULL) {
+        return -1;
+    }
+
+    if (json_array_append_new(pack->files, json_pack("{sssiso}", "path", subPath, "mode", (int)permissions, "chunks", fileChunks))) {
+        return -1;
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        VLOG_ERROR("remote", "failed to open %s\n", path);
+        return -1;
+    }
+
+    buffer = malloc(__CHUNK_MAX_SIZE);
+    if (buffer == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    for (;;) {
+        size_t boundary;
+
+        // keep the window full, so the boundary does not depend on how the
+        // reads happened to line up
+        available += fread(&buffer[available], 1, __CHUNK_MAX_SIZE - available, file);
+        if (available == 0) {
+            break;
+        }
+
+        boundary = __chunk_boundary(buffer, available);
+        status = __add_chunk(pack, buffer, boundary, fileChunks);
+        if (status) {
+            break;
+        }
+
+        pack->totalSize += boundary;
+        available -= boundary;
+        memmove(&buffer[0], &buffer[boundary], available);
+    }
+
+    if (ferror(file)) {
+        VLOG_ERROR("remote", "failed to read %s\n", path);
+        status = -1;
+    }
+
+    free(buffer);
+    fclose(file);
+    return status;
+}
+
+static int __pack_directory(struct __sync_pack* pack, const char* path, const char* subPath)
+{
+    struct list       entries = { 0 };
+    struct list_item* i;
+    int               status;
+
+    status = platform_getfiles(path, 0, &entries);
+    if (status) {
+        VLOG_ERROR("remote", "failed to list %s\n", path);
+        return status;
+    }
+
+    list_foreach(&entries, i) {
+        struct platform_file_entry* entry = (struct platform_file_entry*)i;
+        struct platform_stat        stats;
+        char*                       entrySubPath;
+
+        entrySubPath = strpathcombine(subPath, entry->name);
+        if (entrySubPath == NULL) {
+            status = -1;
+            break;
+        }
+
+        if (__is_ignored(&pack->ignores, entry, entrySubPath)) {
+            free(entrySubPath);
+            continue;
+        }
+
+        switch (entry->type) {
+            case PLATFORM_FILETYPE_DIRECTORY: {
+                status = json_array_append_new(pack->files, json_pack("{sssb}", "path", entrySubPath, "dir", 1));
+                if (status == 0) {
+                    status = __pack_directory(pack, entry->path, entrySubPath);
+                }
+            } break;
+            case PLATFORM_FILETYPE_FILE: {
+                status = platform_stat(entry->path, &stats);
+                if (status == 0) {
+                    status = __pack_file(pack, entry->path, entrySubPath, stats.permissions);
+                }
+            } break;
+            case PLATFORM_FILETYPE_SYMLINK: {
+                char* target;
+                status = platform_readlink(entry->path, &target);
+                if (status == 0) {
+                    status = json_array_append_new(pack->files, json_pack("{ssss}", "path", entrySubPath, "link", target));
+                    free(target);
+                }
+            } break;
+            default:
+                break;
+        }
+
+        free(entrySubPath);
+        if (status) {
+            break;
+        }
+    }
+
+    platform_getfiles_destroy(&entries);
+    return status;
+}
+
+static int __upload_pending(struct __sync_pack* pack)
+{
+    const char* hash;
+    json_t*     value;
+    char*       url;
+    int         blob;
+    int         status;
+
+    if (pack->blob == NULL) {
+        return 0;
+    }
+
+    fclose(pack->blob);
+    pack->blob = NULL;
+
+    VLOG_TRACE("remote", "uploading %llu bytes of changed sources\n", (unsigned long long)pack->blobSize);
+    status = chef_client_bu_upload(pack->blobPath, &url);
+    if (status) {
+        VLOG_ERROR("remote", "failed to upload source chunks\n");
+        return status;
+    }
+
+    blob = __blob_index(pack, url);
+    if (blob < 0) {
+        free(url);
+        return -1;
+    }
+
+    json_object_foreach(pack->pending, hash, value) {
+        json_int_t offset = json_integer_value(json_array_get(value, 0));
+        json_int_t length = json_integer_value(json_array_get(value, 1));
+        status = json_object_set_new(pack->chunks, hash, json_pack("[iII]", blob, offset, length));
+        if (status == 0) {
+            status = json_object_set_new(pack->index, hash, json_pack("[sIII]", url, offset, length, (json_int_t)pack->now));
+        }
+        if (status) {
+            break;
+        }
+    }
+    free(url);
+    return status;
+}
+
+static void __prune_index(struct __sync_pack* pack)
+{
+    const char* hash;
+    json_t*     value;
+    void*       tmp;
+
+    // forget chunks that have expired, so the index does not grow forever
+    json_object_foreach_safe(pack->index, tmp, hash, value) {
+        if (!json_is_array(value) ||
+            (pack->now - (time_t)json_integer_value(json_array_get(value, 3))) >= __CHUNK_UPLOAD_TTL) {
+            json_object_del(pack->index, hash);
+        }
+    }
+}
+
+int remote_sync_pack(const char* path, char** manifestPath)
+{
+    struct __sync_pack pack = { 0 };
+    json_t*            manifest = NULL;
+    char*              indexPath = NULL;
+    FILE*              fp;
+    int                status = -1;
+    VLOG_DEBUG("remote", "remote_sync_pack(path=%s)\n", path);
+
+    if (path == NULL || manifestPath == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    call_once(&g_gearOnce, __gear_initialize);
+
+    pack.root    = path;
+    pack.now     = time(NULL);
+    pack.blobs   = json_array();
+    pack.chunks  = json_object();
+    pack.files   = json_array();
+    pack.pending = json_object();
+    if (pack.blobs == NULL || pack.chunks == NULL || pack.files == NULL || pack.pending == NULL) {
+        goto cleanup;
+    }
+
+    indexPath = __index_path();
+    if (indexPath == NULL) {
+        goto cleanup;
+    }
+    pack.index = __load_index(indexPath);
+
+    status = __load_ignores(path, &pack.ignores);
+    if (status) {
+        VLOG_ERROR("remote", "failed to read ignore rules from %s\n", path);
+        goto cleanup;
+    }
+
+    status = __pack_directory(&pack, path, NULL);
+    if (status) {
+        VLOG_ERROR("remote", "failed to chunk source directory %s\n", path);
+        goto cleanup;
+    }
+
+    VLOG_TRACE("remote", "%llu bytes of sources, %llu bytes changed\n",
+        (unsigned long long)pack.totalSize, (unsigned long long)pack.blobSize);
+
+    status = __upload_pending(&pack);
+    if (status) {
+        goto cleanup;
+    }
+
+    // Only save the index once the chunks have been uploaded. Losing it is harmless,
+    // it just means the next sync uploads everything again.
+    __prune_index(&pack);
+    if (json_dump_file(pack.index, indexPath, JSON_COMPACT)) {
+        VLOG_WARNING("remote", "failed to save the source sync index to %s\n", indexPath);
+    }
+
+    manifest = json_pack("{sisOsOsO}",
+        "chef-sync", __SYNC_MANIFEST_VERSION,
+        "blobs", pack.blobs,
+        "chunks", pack.chunks,
+        "files", pack.files
+    );
+    if (manifest == NULL) {
+        status = -1;
+        goto cleanup;
+    }
+
+    fp = chef_dirs_open_temp_file("bake-src", "json", manifestPath);
+    if (fp == NULL) {
+        VLOG_ERROR("remote", "failed to get a temporary path for source manifest\n");
+        status = -1;
+        goto cleanup;
+    }
+
+    // the magic must be the very first bytes, so keep the key order
+    status = json_dumpf(manifest, fp, JSON_COMPACT | JSON_PRESERVE_ORDER);
+    fclose(fp);
+    if (status) {
+        VLOG_ERROR("remote", "failed to write source manifest to %s\n", *manifestPath);
+        remove(*manifestPath);
+        free(*manifestPath);
+        *manifestPath = NULL;
+    }
+
+cleanup:
+    if (pack.blob != NULL) {
+        fclose(pack.blob);
+    }
+    if (pack.blobPath != NULL) {
+        remove(pack.blobPath);
+        free(pack.blobPath);
+    }
+    list_destroy(&pack.ignores, __ignore_rule_delete);
+    json_decref(manifest);
+    json_decref(pack.index);
+    json_decref(pack.blobs);
+    json_decref(pack.chunks);
+    json_decref(pack.files);
+    json_decref(pack.pending);
+    free(indexPath);
+    return status;
+}
+
+int remote_sync_is_manifest(const char* path)
+{
+    char   magic[sizeof(__SYNC_MANIFEST_MAGIC) - 1];
+    FILE*  fp;
+    size_t read;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+
+    read = fread(&magic[0], 1, sizeof(magic), fp);
+    fclose(fp);
+    return read == sizeof(magic) && memcmp(&magic[0], __SYNC_MANIFEST_MAGIC, sizeof(magic)) == 0;
+}
+
+static char* __chunk_path(const char* cacheDirectory, const char* hash)
+{
+    char prefix[3] = { hash[0], hash[1], '\0' };
+    return strpathjoin(cacheDirectory, &prefix[0], hash, NULL);
+}
+
+static int __store_chunk(const char* cacheDirectory, const char* hash, const void* data, size_t length)
+{
+    char  digest[__DIGEST_HEX_SIZE];
+    char  tmpName[__DIGEST_HEX_SIZE + 16];
+    char* path;
+    char* tmpPath;
+    FILE* fp;
+    int   status;
+
+    if (__digest_hex(data, length, digest)) {
+        return -1;
+    }
+
+    if (strcmp(&digest[0], hash) != 0) {
+        VLOG_ERROR("remote", "chunk %s failed verification\n", hash);
+        errno = EBADMSG;
+        return -1;
+    }
+
+    // builds restore sources in parallel, so they may store the same chunk
+    // at the same time
+    snprintf(&tmpName[0], sizeof(tmpName), "%s.%u", hash, (unsigned int)atomic_fetch_add(&g_tmpIndex, 1));
+
+    path = __chunk_path(cacheDirectory, hash);
+    tmpPath = path != NULL ? strpathjoin(cacheDirectory, "tmp", &tmpName[0], NULL) : NULL;
+    if (tmpPath == NULL) {
+        free(path);
+        return -1;
+    }
+
+    // write it next to the cache and rename it in, so a build that is reading
+    // the cache never sees a partial chunk
+    fp = fopen(tmpPath, "wb");
+    if (fp == NULL) {
+        VLOG_ERROR("remote", "failed to open %s\n", tmpPath);
+        free(path);
+        free(tmpPath);
+        return -1;
+    }
+    status = fwrite(data, 1, length, fp) == length ? 0 : -1;
+    status |= fclose(fp);
+
+    if (status == 0) {
+        status = rename(tmpPath, path);
+    }
+    if (status) {
+        VLOG_ERROR("remote", "failed to store chunk %s\n", hash);
+        remove(tmpPath);
+    }
+    free(path);
+    free(tmpPath);
+    return status;
+}
+
+static int __fetch_blob(json_t* chunks, const char* url, int blob, const char* cacheDirectory)
+{
+    struct platform_stat stats;
+    unsigned char*       buffer = NULL;
+    const char*          hash;
+    json_t*              value;
+    char*                blobPath;
+    FILE*                fp;
+    int                  status;
+
+    fp = chef_dirs_open_temp_file("remote-chunks", "blob", &blobPath);
+    if (fp == NULL) {
+        VLOG_ERROR("remote", "failed to get a temporary path for source chunks\n");
+        return -1;
+    }
+    fclose(fp);
+
+    status = chef_client_gen_download(url, blobPath);
+    if (status) {
+        VLOG_ERROR("remote", "failed to download source chunks from %s\n", url);
+        goto cleanup;
+    }
+
+    fp = fopen(blobPath, "rb");
+    if (fp == NULL) {
+        status = -1;
+        goto cleanup;
+    }
+
+    buffer = malloc(__CHUNK_MAX_SIZE);
+    if (buffer == NULL) {
+        status = -1;
+        goto close_blob;
+    }
+
+    json_object_foreach(chunks, hash, value) {
+        json_int_t offset = json_integer_value(json_array_get(value, 1));
+        json_int_t length = json_integer_value(json_array_get(value, 2));
+        char*      path;
+
+        if (json_integer_value(json_array_get(value, 0)) != blob) {
+            continue;
+        }
+
+        path = __chunk_path(cacheDirectory, hash);
+        if (path == NULL) {
+            status = -1;
+            break;
+        }
+        status = platform_stat(path, &stats);
+        free(path);
+        if (status == 0) {
+            continue;
+        }
+
+        if (offset < 0 || length < 0 || length > __CHUNK_MAX_SIZE ||
+            fseek(fp, (long)offset, SEEK_SET) || fread(buffer, 1, (size_t)length, fp) != (size_t)length) {
+            VLOG_ERROR("remote", "chunk %s is not in %s\n", hash, url);
+            status = -1;
+            break;
+        }
+
+        status = __store_chunk(cacheDirectory, hash, buffer, (size_t)length);
+        if (status) {
+            break;
+        }
+    }
+
+close_blob:
+    fclose(fp);
+cleanup:
+    remove(blobPath);
+    free(blobPath);
+    free(buffer);
+    return status;
+}
+
+static int __fetch_missing(json_t* manifest, const char* cacheDirectory)
+{
+    struct platform_stat stats;
+    json_t*              blobs  = json_object_get(manifest, "blobs");
+    json_t*              chunks = json_object_get(manifest, "chunks");
+    json_t*              value;
+    const char*          hash;
+    char*                missing;
+    size_t               blobCount;
+    size_t               total = 0;
+    size_t               cached = 0;
+    size_t               i;
+    int                  status = 0;
+
+    if (!json_is_array(blobs) || !json_is_object(chunks)) {
+        VLOG_ERROR("remote", "source manifest is malformed\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    blobCount = json_array_size(blobs);
+    missing = calloc(blobCount + 1, 1);
+    if (missing == NULL) {
+        return -1;
+    }
+
+    json_object_foreach(chunks, hash, value) {
+        json_int_t blob = json_integer_value(json_array_get(value, 0));
+        char*      path;
+
+        if (!__is_digest(hash) || !json_is_array(value) || blob < 0 || (size_t)blob >= blobCount) {
+            VLOG_ERROR("remote", "source manifest has an invalid chunk %s\n", hash);
+            errno = EINVAL;
+            status = -1;
+            break;
+        }
+
+        path = __chunk_path(cacheDirectory, hash);
+        if (path == NULL) {
+            status = -1;
+            break;
+        }
+
+        total++;
+        if (platform_stat(path, &stats) == 0) {
+            cached++;
+        } else {
+            missing[blob] = 1;
+        }
+        free(path);
+    }
+
+    if (status == 0) {
+        VLOG_TRACE("remote", "%zu of %zu source chunks are cached\n", cached, total);
+        for (i = 0; i < blobCount; i++) {
+            if (!missing[i]) {
+                continue;
+            }
+
+            status = __fetch_blob(chunks, json_string_value(json_array_get(blobs, i)), (int)i, cacheDirectory);
+            if (status) {
+                break;
+            }
+        }
+    }
+
+    free(missing);
+    return status;
+}
+
+static int __write_file(const char* cacheDirectory, const char* path, json_t* fileChunks, int mode)
+{
+    json_t* value;
+    size_t  i;
+    FILE*   fp;
+    int     status = 0;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        VLOG_ERROR("remote", "failed to create %s\n", path);
+        return -1;
+    }
+
+    json_array_foreach(fileChunks, i, value) {
+        const char* hash = json_string_value(value);
+        void*       buffer;
+        size_t      length;
+        char*       chunkPath;
+
+        if (hash == NULL || !__is_digest(hash)) {
+            VLOG_ERROR("remote", "source manifest has an invalid chunk for %s\n", path);
+            status = -1;
+            break;
+        }
+
+        chunkPath = __chunk_path(cacheDirectory, hash);
+        if (chunkPath == NULL) {
+            status = -1;
+            break;
+        }
+
+        status = platform_readfile(chunkPath, &buffer, &length);
+        free(chunkPath);
+        if (status) {
+            VLOG_ERROR("remote", "chunk %s for %s is missing\n", hash, path);
+            break;
+        }
+
+        if (fwrite(buffer, 1, length, fp) != length) {
+            VLOG_ERROR("remote", "failed to write %s\n", path);
+            status = -1;
+        }
+        free(buffer);
+        if (status) {
+            break;
+        }
+    }
+
+    // the manifest is not trusted, never restore setuid, setgid or sticky bits
+    status |= fclose(fp);
+    if (status == 0) {
+        status = platform_chmod(path, (uint32_t)mode & 0777);
+    }
+    return status;
+}
+
+static int __write_tree(json_t* manifest, json_t* linkPaths, const char* cacheDirectory, const char* destination, int links)
+{
+    json_t* files = json_object_get(manifest, "files");
+    json_t* entry;
+    size_t  i;
+    int     status = 0;
+
+    json_array_foreach(files, i, entry) {
+        const char* subPath = json_string_value(json_object_get(entry, "path"));
+        json_t*     link    = json_object_get(entry, "link");
+        char*       path;
+
+        if (subPath == NULL || !__is_relative_path(subPath)) {
+            VLOG_ERROR("remote", "source manifest has an invalid path %s\n", subPath ? subPath : "(null)");
+            errno = EINVAL;
+            return -1;
+        }
+
+        // links are created last, so they never create placeholder targets
+        // for files that are yet to be written
+        if ((link != NULL) != links) {
+            continue;
+        }
+
+        path = strpathcombine(destination, subPath);
+        if (path == NULL) {
+            return -1;
+        }
+
+        if (link != NULL) {
+            const char* target = json_string_value(link);
+            if (target == NULL || !__is_contained_link(linkPaths, subPath, target)) {
+                VLOG_WARNING("remote", "skipping link %s, it points outside the sources\n", subPath);
+            } else {
+                status = platform_symlink(path, target, 0);
+            }
+        } else if (json_is_true(json_object_get(entry, "dir"))) {
+            status = platform_mkdir(path);
+        } else {
+            status = __write_file(cacheDirectory, path,
+                json_object_get(entry, "chunks"),
+                (int)json_integer_value(json_object_get(entry, "mode"))
+            );
+        }
+
+        free(path);
+        if (status) {
+            VLOG_ERROR("remote", "failed to restore %s\n", subPath);
+            return status;
+        }
+    }
+    return 0;
+}
+
+int remote_sync_unpack(const char* manifestPath, const char* cacheDirectory, const char* destination)
+{
+    json_error_t error;
+    json_t*      manifest;
+    json_t*      links;
+    char*        tmpPath;
+    int          status;
+    VLOG_DEBUG("remote", "remote_sync_unpack(manifest=%s, cache=%s, dest=%s)\n", manifestPath, cacheDirectory, destination);
+
+    manifest = json_load_file(manifestPath, 0, &error);
+    if (manifest == NULL) {
+        VLOG_ERROR("remote", "failed to parse source manifest %s: %s\n", manifestPath, error.text);
+        return -1;
+    }
+
+    if (json_integer_value(json_object_get(manifest, "chef-sync")) != __SYNC_MANIFEST_VERSION) {
+        VLOG_ERROR("remote", "source manifest %s has an unsupported version\n", manifestPath);
+        json_decref(manifest);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (!json_is_array(json_object_get(manifest, "files"))) {
+        VLOG_ERROR("remote", "source manifest %s is malformed\n", manifestPath);
+        json_decref(manifest);
+        errno = EINVAL;
+        return -1;
+    }
+
+    links = __collect_links(json_object_get(manifest, "files"));
+    if (links == NULL) {
+        json_decref(manifest);
+        return -1;
+    }
+
+    tmpPath = strpathcombine(cacheDirectory, "tmp");
+    if (tmpPath == NULL) {
+        json_decref(links);
+        json_decref(manifest);
+        return -1;
+    }
+
+    status = platform_mkdir(tmpPath);
+    free(tmpPath);
+    if (status) {
+        VLOG_ERROR("remote", "failed to create chunk cache in %s\n", cacheDirectory);
+        json_decref(links);
+        json_decref(manifest);
+        return status;
+    }
+
+    // make sure all the prefix directories exist before storing anything
+    for (int i = 0; i < 256 && status == 0; i++) {
+        char  prefix[3];
+        char* prefixPath;
+
+        snprintf(&prefix[0], sizeof(prefix), "%02x", i);
+        prefixPath = strpathcombine(cacheDirectory, &prefix[0]);
+        if (prefixPath == NULL) {
+            status = -1;
+            break;
+        }
+        status = platform_mkdir(prefixPath);
+        free(prefixPath);
+    }
+
+    if (status == 0) {
+        status = __fetch_missing(manifest, cacheDirectory);
+    }
+    if (status == 0) {
+        status = __write_tree(manifest, links, cacheDirectory, destination, 0);
+    }
+    if (status == 0) {
+        status = __write_tree(manifest, links, cacheDirectory, destination, 1);
+    }
+
+    json_decref(links);
+    json_decref(manifest);
+    return status;
+}
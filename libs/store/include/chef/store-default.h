@@ -84,6 +84,87 @@ static int store_default_resolve_package(struct store_package* package, const ch
     return status;
 }
 
+struct __store_default_batch {
+    store_request_completed_fn completed;
+    void*                      context;
+};
+
+static void __store_default_download_completed(struct chef_download_batch_item* item, void* context)
+{
+    struct __store_default_batch*  batch = context;
+    struct store_package_request*  request = item->user_data;
+
+    request->status = item->status;
+    request->transient = item->transient;
+    if (item->status == 0) {
+        request->revision = item->params.revision;
+        if (item->params.sha512_valid) {
+            memcpy(&request->digest[0], &item->params.sha512[0], STORE_PACKAGE_DIGEST_SIZE);
+            request->digest_valid = 1;
+        }
+    }
+    if (batch->completed != NULL) {
+        batch->completed(request, batch->context);
+    }
+}
+
+static int store_default_resolve_packages(struct store_package_request* requests, int count, int maxConcurrent, store_request_completed_fn completed, void* context)
+{
+    struct __store_default_batch     batch = { .completed = completed, .context = context };
+    struct chef_download_batch_item* items;
+    char***                          names;
+    int                              itemCount = 0;
+    int                              status;
+    VLOG_DEBUG("chef", "store_default_resolve_packages(count=%i)\n", count);
+
+    items = calloc(count, sizeof(struct chef_download_batch_item));
+    names = calloc(count, sizeof(char**));
+    if (items == NULL || names == NULL) {
+        free(items);
+        free(names);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        names[i] = __split_name(requests[i].package->name);
+        if (names[i] == NULL) {
+            VLOG_ERROR("chef", "store_default_resolve_packages: invalid package name '%s'\n",
+                requests[i].package->name);
+            requests[i].status = -1;
+            if (completed != NULL) {
+                completed(&requests[i], context);
+            }
+            continue;
+        }
+
+        items[itemCount].params.publisher = names[i][0];
+        items[itemCount].params.package   = names[i][1];
+        items[itemCount].params.platform  = requests[i].package->platform;
+        items[itemCount].params.arch      = requests[i].package->arch;
+        items[itemCount].params.channel   = requests[i].package->channel;
+        items[itemCount].params.revision  = requests[i].package->revision;
+        items[itemCount].params.observer  = requests[i].observer;
+        items[itemCount].path             = requests[i].path;
+        items[itemCount].user_data        = &requests[i];
+        itemCount++;
+    }
+
+    status = 0;
+    if (itemCount > 0) {
+        status = chefclient_pack_download_batch(items, itemCount, maxConcurrent,
+            __store_default_download_completed, &batch);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (names[i] != NULL) {
+            strsplit_free(names[i]);
+        }
+    }
+    free(names);
+    free(items);
+    return status;
+}
+
 static char** __split_package_key(const char* key)
 {
     // split the publisher/package/revision
@@ -308,6 +389,7 @@ static int store_default_resolve_proof(enum store_proof_type keyType, const char
 
 const static struct store_backend g_store_default_backend = {
     .resolve_package = store_default_resolve_package,
+    .resolve_packages = store_default_resolve_packages,
     .resolve_proof = store_default_resolve_proof
 };
 
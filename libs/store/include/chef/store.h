@@ -74,8 +74,33 @@ struct store_package {
     int         revision;
 };
 
+#define STORE_PACKAGE_DIGEST_SIZE 64
+
+/**
+ * @brief A single download in a batch of package downloads. The backend fills in
+ * the revision and status of the download, and invokes the completion callback for
+ * each request as soon as its download has finished.
+ */
+struct store_package_request {
+    struct store_package* package;
+    const char*           path;
+    // Optional, receives the progress of the download
+    struct chef_observer* observer;
+    int                   revision;
+    int                   status;
+    // Set by the backend on failure if retrying the download may succeed
+    int                   transient;
+    // SHA-512 of the downloaded package, if the backend calculated it while downloading
+    unsigned char         digest[STORE_PACKAGE_DIGEST_SIZE];
+    int                   digest_valid;
+};
+
+typedef void (*store_request_completed_fn)(struct store_package_request* request, void* context);
+
 struct store_backend {
     int (*resolve_package)(struct store_package* package, const char* path, struct chef_observer* observer, int* revisionDownloaded);
+    // Optional, if not provided the store will resolve the packages one at a time
+    int (*resolve_packages)(struct store_package_request* requests, int count, int maxConcurrent, store_request_completed_fn completed, void* context);
     int (*resolve_proof)(enum store_proof_type keyType, const char* key, struct chef_observer* observer, union store_proof* proof);
 };
 
@@ -109,6 +134,77 @@ extern void store_cleanup(void);
  */
 extern int store_ensure_package(struct store_package* package, struct chef_observer* observer);
 
+struct store_package_digest {
+    unsigned char digest[STORE_PACKAGE_DIGEST_SIZE];
+    int           valid;
+};
+
+enum store_package_failure {
+    STORE_PACKAGE_FAILURE_NONE,
+    // The download failed for a reason that may go away, like network or server errors
+    STORE_PACKAGE_FAILURE_TRANSIENT,
+    // The package could not be downloaded, verified or stored, retrying will not help
+    STORE_PACKAGE_FAILURE_PERMANENT
+};
+
+struct store_ensure_options {
+    // The maximum number of concurrent downloads, 0 selects the default.
+    int max_concurrent;
+    // Whether the store proof of each package must be fetched and verified
+    // before the package is added to the local store.
+    int verify_proofs;
+    // Optional, receives the progress of all downloads.
+    struct chef_observer* observer;
+    // Optional array of as many entries as there are packages, receives the SHA-512
+    // of each package that was hashed while it was downloaded. Packages that were
+    // already available in the local store are marked as not valid.
+    struct store_package_digest* digests;
+    // Optional array of as many entries as there are packages, receives why each
+    // package failed. Packages that are available are marked STORE_PACKAGE_FAILURE_NONE.
+    enum store_package_failure* failures;
+};
+
+/**
+ * @brief Batch version of store_ensure_package. All packages missing from the local
+ * store are downloaded concurrently, and each download is verified and added to the
+ * local store as soon as it has finished.
+ * 
+ * @param[In]  packages     Array of packages that should be available in the local store.
+ * @param[In]  count        Number of packages in the array.
+ * @param[In]  options      Optional options for the downloads, may be NULL.
+ * @param[Out] revisionsOut Optional array of count entries, receives the revision of each package.
+ * @return int 0 if all packages are available in the local store, -1 otherwise.
+ */
+extern int store_ensure_packages(struct store_package* packages, int count, struct store_ensure_options* options, int* revisionsOut);
+
+/**
+ * @brief A growable set of packages to pass to store_ensure_packages. The set does not
+ * copy the strings of the packages added, strings that must live as long as the set can
+ * be handed to it with store_package_set_own.
+ */
+struct store_package_set {
+    struct store_package* packages;
+    int                   count;
+    int                   capacity;
+    struct list           strings;
+};
+
+/**
+ * @brief Adds a package to the set, the strings must outlive the set.
+ */
+extern int store_package_set_add(struct store_package_set* set, const char* name, const char* channel, const char* platform, const char* arch);
+
+/**
+ * @brief Transfers ownership of an allocated string to the set, it is freed by
+ * store_package_set_destroy. The string is freed immediately if this fails.
+ */
+extern int store_package_set_own(struct store_package_set* set, char* value);
+
+/**
+ * @brief Frees the package array and all strings owned by the set.
+ */
+extern void store_package_set_destroy(struct store_package_set* set);
+
 /**
  * @brief Retrieves the path of an package based on it's parameters. It must be already
  * present in the local store.
@@ -140,4 +236,27 @@ extern int store_proof_ensure(enum store_proof_type keyType, const char* key, st
  */
 extern int store_proof_lookup(enum store_proof_type keyType, const char* key, void* proof);
 
+/**
+ * @brief Verifies the package file against the proof, by comparing the SHA-512 hash of
+ * the package with the proof, and verifying the signature of the hash.
+ * 
+ * @param[In]  proof          The proof of the package.
+ * @param[In]  packagePath    Path to the package file.
+ * @param[In]  expectedOrigin The origin the proof must have, or CHEF_PACKAGE_PROOF_ORIGIN_NONE for any.
+ * @return int                0 if the package matches the proof, -1 otherwise.
+ */
+extern int store_proof_verify_package(struct chef_package_proof* proof, const char* packagePath, enum chef_package_proof_origin expectedOrigin);
+
+/**
+ * @brief Same as store_proof_verify_package, but for a package whose SHA-512 has already
+ * been calculated, for instance while it was being downloaded.
+ * 
+ * @param[In]  proof          The proof of the package.
+ * @param[In]  digest         The SHA-512 digest of the package.
+ * @param[In]  digestLength   The length of the digest.
+ * @param[In]  expectedOrigin The origin the proof must have, or CHEF_PACKAGE_PROOF_ORIGIN_NONE for any.
+ * @return int                0 if the digest matches the proof, -1 otherwise.
+ */
+extern int store_proof_verify_digest(struct chef_package_proof* proof, const unsigned char* digest, size_t digestLength, enum chef_package_proof_origin expectedOrigin);
+
 #endif //!__LIBSTORE_H__
@@ -73,7 +73,7 @@ struct store_inventory {
     struct timespec              last_check;
     struct store_inventory_pack* packs;
     int                          packs_count;
-    union __proof*               proofs;
+    union __proof**              proofs; // proofs never move, lookups hand out pointers into them
     int                          proofs_count;
 };
 
@@ -250,7 +250,7 @@ static int __parse_proofs(struct store_inventory* inventory, json_t* proofs)
         return 0;
     }
     
-    inventory->proofs = (union __proof*)calloc(count, sizeof(union __proof));
+    inventory->proofs = (union __proof**)calloc(count, sizeof(union __proof*));
     if (inventory->proofs == NULL) {
         VLOG_ERROR("inventory", "__parse_proofs: failed to allocate memory for proofs\n");
         return -1;
@@ -271,17 +271,23 @@ static int __parse_proofs(struct store_inventory* inventory, json_t* proofs)
             return -1;
         }
 
-        inventory->proofs[i].header.type = (enum store_proof_type)json_integer_value(type);
-        memcpy(&inventory->proofs[i].header.key[0], json_string_value(key), strlen(json_string_value(key)));
-        switch (inventory->proofs[i].header.type) {
+        inventory->proofs[i] = (union __proof*)calloc(1, sizeof(union __proof));
+        if (inventory->proofs[i] == NULL) {
+            VLOG_ERROR("inventory", "__parse_proofs: failed to allocate memory for proof %i\n", i);
+            return -1;
+        }
+
+        inventory->proofs[i]->header.type = (enum store_proof_type)json_integer_value(type);
+        memcpy(&inventory->proofs[i]->header.key[0], json_string_value(key), strlen(json_string_value(key)));
+        switch (inventory->proofs[i]->header.type) {
             case STORE_PROOF_PUBLISHER:
-                if (__parse_publisher_proof(&inventory->proofs[i].publisher, proof)) {
+                if (__parse_publisher_proof(&inventory->proofs[i]->publisher, proof)) {
                     VLOG_ERROR("inventory", "__parse_proofs: failed to parse publisher proof (index %i) from inventory\n", i);
                     return -1;
                 };
                 break;
             case STORE_PROOF_PACKAGE:
-                if (__parse_package_proof(&inventory->proofs[i].package, proof)) {
+                if (__parse_package_proof(&inventory->proofs[i]->package, proof)) {
                     VLOG_ERROR("inventory", "__parse_proofs: failed to parse package proof (index %i) from inventory\n", i);
                     return -1;
                 };
@@ -502,8 +508,8 @@ int inventory_get_proof(struct store_inventory* inventory, enum store_proof_type
     }
 
     for (int i = 0; i < inventory->proofs_count; i++) {
-        if (inventory->proofs[i].header.type == keyType && strcmp(&inventory->proofs[i].header.key[0], key) == 0) {
-            __to_store_version(&inventory->proofs[i], proof);
+        if (inventory->proofs[i]->header.type == keyType && strcmp(&inventory->proofs[i]->header.key[0], key) == 0) {
+            __to_store_version(inventory->proofs[i], proof);
             return 0;
         }
     }
@@ -545,19 +551,26 @@ int inventory_add_proof(struct store_inventory* inventory, union store_proof* pr
         return -1;
     }
 
-    // extend the pack array by one
+    entry = calloc(1, sizeof(union __proof));
+    if (entry == NULL) {
+        return -1;
+    }
+
+    // extend the proof array by one, only the pointers are moved so any
+    // proof handed out by inventory_get_proof stays valid
     oldArray = inventory->proofs;
-    newArray = calloc(inventory->proofs_count + 1, sizeof(union __proof));
+    newArray = calloc(inventory->proofs_count + 1, sizeof(union __proof*));
     if (!newArray) {
+        free(entry);
         return -1;
     }
 
     if (inventory->proofs_count) {
-        memcpy(newArray, inventory->proofs, sizeof(union __proof) * inventory->proofs_count);
+        memcpy(newArray, inventory->proofs, sizeof(union __proof*) * inventory->proofs_count);
     }
 
-    entry = &((union __proof*)newArray)[inventory->proofs_count];
     __to_inventory_version(proof, entry);
+    ((union __proof**)newArray)[inventory->proofs_count] = entry;
 
     // Update the new array stored before we serialize the inventory to disk.
     inventory->proofs = newArray;
@@ -621,7 +634,7 @@ static int __serialize_package_proof(json_t* jsproof, struct __proof_package* pr
     return 0;
 }
 
-static json_t* __serialize_proofs(union __proof* proofs, int count)
+static json_t* __serialize_proofs(union __proof** proofs, int count)
 {
     json_t* jsproofs;
     VLOG_DEBUG("inventory", "__serialize_proofs(count=%i)\n", count);
@@ -637,17 +650,17 @@ static json_t* __serialize_proofs(union __proof* proofs, int count)
             return NULL;
         }
 
-        json_object_set_new(jsproof, "type", json_integer((long long)proofs[i].header.type));
-        json_object_set_new(jsproof, "key", json_string(&proofs[i].header.key[0]));
-        switch (proofs[i].header.type) {
+        json_object_set_new(jsproof, "type", json_integer((long long)proofs[i]->header.type));
+        json_object_set_new(jsproof, "key", json_string(&proofs[i]->header.key[0]));
+        switch (proofs[i]->header.type) {
             case STORE_PROOF_PUBLISHER:
-                if (__serialize_publisher_proof(jsproof, &proofs[i].publisher)) {
+                if (__serialize_publisher_proof(jsproof, &proofs[i]->publisher)) {
                     VLOG_ERROR("inventory", "__parse_proofs: failed to parse publisher proof (index %i) from inventory\n", i);
                     return NULL;
                 };
                 break;
             case STORE_PROOF_PACKAGE:
-                if (__serialize_package_proof(jsproof, &proofs[i].package)) {
+                if (__serialize_package_proof(jsproof, &proofs[i]->package)) {
                     VLOG_ERROR("inventory", "__parse_proofs: failed to parse package proof (index %i) from inventory\n", i);
                     return NULL;
                 };
@@ -735,6 +748,10 @@ void inventory_clear(struct store_inventory* inventory)
     inventory->packs_count = 0;
     inventory->packs = NULL;
 
+    for (int i = 0; i < inventory->proofs_count; i++) {
+        free(inventory->proofs[i]);
+    }
+
     free(inventory->proofs);
     inventory->proofs_count = 0;
     inventory->proofs = NULL;
@@ -0,0 +1,328 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/package.h>
+#include <chef/store.h>
+#include <errno.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlog.h>
+
+#define _SEGMENT_SIZE (1024 * 1024)
+
+static int __calculate_file_sha512(const char* path, unsigned char** hash, unsigned int* hashLength);
+
+static void __print_crypt_errors(const char* prefix)
+{
+    unsigned long status;
+    char          tmp[256];
+
+    while ((status = ERR_get_error()) != 0) {
+        ERR_error_string_n(status, tmp, sizeof(tmp));
+        VLOG_ERROR("store", "%s: %s\n", prefix, &tmp[0]);
+    }
+}
+
+static int __verify_signature(EVP_PKEY* key, const char* data, size_t dataLength, const unsigned char* signature, size_t signaturelength) {
+    EVP_MD_CTX* mdctx;
+    int         status, r;
+
+    mdctx = EVP_MD_CTX_create();
+    if (mdctx == NULL) {
+        VLOG_ERROR("store", "__verify_signature: failed to create digest context\n");
+        return -1;
+    }
+
+    status = EVP_DigestVerifyInit(mdctx, NULL, EVP_sha512(), NULL, key);
+    if (status != 1) {
+        VLOG_ERROR("store", "__verify_signature: failed to initialize digest context\n");
+        __print_crypt_errors("__verify_signature: digest init");
+        EVP_MD_CTX_free(mdctx);
+        return -1;
+    }
+
+    status = EVP_DigestVerifyUpdate(mdctx, data, dataLength);
+    if (status != 1) {
+        VLOG_ERROR("store", "__verify_signature: failed to process digest data\n");
+        __print_crypt_errors("__verify_signature: digest update");
+        EVP_MD_CTX_free(mdctx);
+        return -1;
+    }
+
+    r = EVP_DigestVerifyFinal(mdctx, signature, signaturelength);
+    if (r == 1) {
+        status = 0;
+    } else {
+        if (r == 0) {
+            VLOG_ERROR("store", "__verify_signature: proof signature did not match\n");
+        } else {
+            VLOG_ERROR("store", "__verify_signature: failed to verify proof signature\n");
+            __print_crypt_errors("__verify_signature: digest final");
+        }
+        status = -1;
+    }
+    EVP_MD_CTX_free(mdctx);
+    return status;
+}
+
+static int __base64_decode(const char* value, unsigned char** dataOut, size_t* dataLengthOut)
+{
+    size_t         valueLength;
+    unsigned char* buffer;
+    int            decodedLength;
+
+    if (value == NULL) {
+        VLOG_ERROR("store", "__base64_decode: cannot decode NULL value\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    valueLength = strlen(value);
+    buffer = calloc((valueLength * 3) / 4 + 4, 1);
+    if (buffer == NULL) {
+        VLOG_ERROR("store", "__base64_decode: failed to allocate decode buffer for %zu-byte input\n", valueLength);
+        return -1;
+    }
+
+    decodedLength = EVP_DecodeBlock(buffer, (const unsigned char*)value, (int)valueLength);
+    if (decodedLength < 0) {
+        VLOG_ERROR("store", "__base64_decode: failed to decode base64 payload\n");
+        free(buffer);
+        errno = EINVAL;
+        return -1;
+    }
+
+    while (valueLength > 0 && value[valueLength - 1] == '=') {
+        decodedLength--;
+        valueLength--;
+    }
+
+    *dataOut = buffer;
+    *dataLengthOut = (size_t)decodedLength;
+    return 0;
+}
+
+static int __parse_public_key_pem(const unsigned char* key, size_t keyLength, EVP_PKEY** keyOut)
+{
+    BIO* bio;
+
+    bio = BIO_new_mem_buf(key, (int)keyLength);
+    if (bio == NULL) {
+        VLOG_ERROR("store", "__parse_public_key_pem: failed to create BIO for %zu-byte public key\n", keyLength);
+        return -1;
+    }
+
+    *keyOut = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL);
+    BIO_free_all(bio);
+    if (*keyOut == NULL) {
+        VLOG_ERROR("store", "__parse_public_key_pem: failed to parse PEM public key\n");
+        __print_crypt_errors("__parse_public_key_pem");
+        errno = EINVAL;
+    }
+    return *keyOut == NULL ? -1 : 0;
+}
+
+int store_proof_verify_digest(
+    struct chef_package_proof*     proof,
+    const unsigned char*           digest,
+    size_t                         digestLength,
+    enum chef_package_proof_origin expectedOrigin)
+{
+    unsigned char* expectedHash = NULL;
+    size_t         expectedHashLength = 0;
+    unsigned char* publicKeyPem = NULL;
+    size_t         publicKeyPemLength = 0;
+    unsigned char* signature = NULL;
+    size_t         signatureLength = 0;
+    EVP_PKEY*      publicKey = NULL;
+    int            status = -1;
+
+    if (proof == NULL || proof->origin == CHEF_PACKAGE_PROOF_ORIGIN_NONE) {
+        VLOG_ERROR("store", "store_proof_verify_digest: invalid package proof\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (expectedOrigin != CHEF_PACKAGE_PROOF_ORIGIN_NONE && proof->origin != expectedOrigin) {
+        VLOG_ERROR("store", "store_proof_verify_digest: proof origin %d did not match expected %d\n", proof->origin, expectedOrigin);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (proof->hash_algorithm == NULL || strcmp(proof->hash_algorithm, "sha512") != 0) {
+        VLOG_ERROR(
+            "store",
+            "store_proof_verify_digest: unsupported hash algorithm %s\n",
+            proof->hash_algorithm != NULL ? proof->hash_algorithm : "<null>"
+        );
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    status = __base64_decode(proof->hash, &expectedHash, &expectedHashLength);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: failed to decode proof hash\n");
+        goto cleanup;
+    }
+
+    status = __base64_decode(proof->signature, &signature, &signatureLength);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: failed to decode proof signature\n");
+        goto cleanup;
+    }
+
+    if (expectedHashLength != digestLength || memcmp(expectedHash, digest, digestLength) != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: hash mismatch\n");
+        errno = EBADMSG;
+        status = -1;
+        goto cleanup;
+    }
+
+    status = __base64_decode(proof->public_key, &publicKeyPem, &publicKeyPemLength);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: failed to decode public key\n");
+        goto cleanup;
+    }
+
+    status = __parse_public_key_pem(publicKeyPem, publicKeyPemLength, &publicKey);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: failed to parse proof public key\n");
+        goto cleanup;
+    }
+
+    status = __verify_signature(publicKey, (const char*)digest, digestLength, signature, signatureLength);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_digest: signature verification failed\n");
+    }
+
+cleanup:
+    EVP_PKEY_free(publicKey);
+    free(expectedHash);
+    free(publicKeyPem);
+    free(signature);
+    return status;
+}
+
+int store_proof_verify_package(
+    struct chef_package_proof*     proof,
+    const char*                    packagePath,
+    enum chef_package_proof_origin expectedOrigin)
+{
+    unsigned char* actualHash = NULL;
+    unsigned int   actualHashLength = 0;
+    int            status;
+
+    status = __calculate_file_sha512(packagePath, &actualHash, &actualHashLength);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_package: failed to calculate package hash for %s\n", packagePath);
+        return status;
+    }
+
+    status = store_proof_verify_digest(proof, actualHash, actualHashLength, expectedOrigin);
+    if (status != 0) {
+        VLOG_ERROR("store", "store_proof_verify_package: failed to verify %s\n", packagePath);
+    }
+    OPENSSL_free(actualHash);
+    return status;
+}
+
+static int __calculate_file_sha512(const char* path, unsigned char** hash, unsigned int* hashLength)
+{
+    FILE*       file;
+    char*       buffer;
+    int         status;
+    EVP_MD_CTX* mdctx;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to open package path %s\n", path);
+        return -1;
+    }
+
+    buffer = (char*)malloc(_SEGMENT_SIZE);
+    if (buffer == NULL) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to allocate read buffer for %s\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    mdctx = EVP_MD_CTX_new();
+    if (mdctx == NULL) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to allocate SHA512 context for %s\n", path);
+        status = -1;
+        goto cleanup;
+    }
+    
+    status = EVP_DigestInit_ex(mdctx, EVP_sha512(), NULL);
+    if (status <= 0) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to initialize SHA512 state for %s\n", path);
+        __print_crypt_errors("__calculate_file_sha512: digest init");
+        status = -1;
+        goto cleanup;
+    }
+
+    for (;;) {
+        size_t read;
+
+        read = fread(buffer, 1, _SEGMENT_SIZE, file);
+        if (read == 0) {
+            break;
+        }
+
+        status = EVP_DigestUpdate(mdctx, buffer, read);
+        if (status <= 0) {
+            VLOG_ERROR("store", "__calculate_file_sha512: failed to update SHA512 digest for %s\n", path);
+            __print_crypt_errors("__calculate_file_sha512: digest update");
+            status = -1;
+            goto cleanup;
+        }
+
+        // was it last segment?
+        if (read < _SEGMENT_SIZE) {
+            break;
+        }
+    }
+
+    *hash = (unsigned char *)OPENSSL_malloc(EVP_MD_size(EVP_sha512()));
+    if(*hash == NULL) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to allocate checksum buffer for %s\n", path);
+        status = -1;
+        goto cleanup;
+    }
+
+    status = EVP_DigestFinal_ex(mdctx, *hash, hashLength);
+    if (status <= 0) {
+        VLOG_ERROR("store", "__calculate_file_sha512: failed to finalize SHA512 digest for %s\n", path);
+        __print_crypt_errors("__calculate_file_sha512: digest final");
+        status = -1;
+    }
+
+    // reset to 0 for success
+    status = 0;
+
+cleanup:
+    free(buffer);
+    fclose(file);
+    EVP_MD_CTX_free(mdctx);
+    return status;
+}
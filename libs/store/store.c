@@ -22,8 +22,10 @@
 #include <chef/store.h>
 #include <errno.h>
 #include "inventory.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <vlog.h>
 
 struct progress_context {
@@ -40,10 +42,17 @@ struct store_context {
     char*                   arch;
     struct store_backend    backend;
     struct store_inventory* inventory;
+
+    // Packages and proofs may be ensured from several threads at once, this
+    // protects the inventory, and the inventory file, against that.
+    mtx_t inventory_lock;
 };
 
 static struct store_context g_store = { 0 };
 
+// The default number of concurrent downloads when ensuring multiple packages
+#define __STORE_DEFAULT_CONCURRENCY 4
+
 static void __cleanup_resolved_proof(union store_proof* proof)
 {
     if (proof == NULL) {
@@ -80,6 +89,7 @@ int store_initialize(struct store_parameters* parameters)
     }
 
     memcpy(&g_store.backend, &parameters->backend, sizeof(struct store_backend));
+    mtx_init(&g_store.inventory_lock, mtx_plain);
     g_store.arch = platform_strdup(parameters->architecture);
     g_store.platform = platform_strdup(parameters->platform);
 
@@ -97,6 +107,7 @@ void store_cleanup(void)
 
     // Free memory allocated by the inventory
     inventory_free(g_store.inventory);
+    mtx_destroy(&g_store.inventory_lock);
     free(g_store.platform);
     free(g_store.arch);
 
@@ -159,7 +170,9 @@ static char** __split_name(const char* name)
     return names;
 }
 
-static int __find_package_in_inventory(struct store_package* package, struct store_inventory_pack** packOut)
+// The pack is looked up and its revision read under the inventory lock, as the
+// pack array is replaced whenever a package is added.
+static int __find_package_in_inventory(struct store_package* package, int* revisionOut)
 {
     struct store_inventory_pack* pack;
     char**                       names;
@@ -181,6 +194,7 @@ static int __find_package_in_inventory(struct store_package* package, struct sto
     // check if we have the requested package in store already, otherwise
     // download the package
     VLOG_DEBUG("store", "looking up path in inventory\n");
+    mtx_lock(&g_store.inventory_lock);
     status = inventory_get_pack(
         g_store.inventory,
         names[0], names[1],
@@ -190,6 +204,10 @@ static int __find_package_in_inventory(struct store_package* package, struct sto
         package->revision,
         &pack
     );
+    if (status == 0 && revisionOut != NULL) {
+        *revisionOut = inventory_pack_revision(pack);
+    }
+    mtx_unlock(&g_store.inventory_lock);
 
     strsplit_free(names);
     return status;
@@ -217,10 +235,9 @@ int store_ensure_package(struct store_package* package, struct chef_observer* ob
         return 0;
     }
 
-    status = __find_package_in_inventory(package, &pack);
+    status = __find_package_in_inventory(package, &revision);
     if (status == 0) {
         VLOG_DEBUG("store", "package %s has already been downloaded\n", package->name);
-        revision = inventory_pack_revision(pack);
         goto cleanup;
     }
 
@@ -248,6 +265,7 @@ int store_ensure_package(struct store_package* package, struct chef_observer* ob
         goto cleanup;
     }
 
+    mtx_lock(&g_store.inventory_lock);
     status = inventory_add(
         g_store.inventory,
         path,
@@ -258,29 +276,374 @@ int store_ensure_package(struct store_package* package, struct chef_observer* ob
         revision,
         &pack
     );
+    if (status == 0) {
+        status = inventory_save(g_store.inventory);
+    }
+    mtx_unlock(&g_store.inventory_lock);
     if (status) {
         revision = 0;
         goto cleanup;
     }
 
-    status = inventory_save(g_store.inventory);
+cleanup:
+    strsplit_free(names);
+    free(pathTmp);
+    free(path);
+    return revision;
+}
+
+struct __ensure_context {
+    struct store_ensure_options* options;
+    struct store_package_request* requests;
+    int*                          indices;
+    int*                          revisions;
+    int                           failures;
+};
+
+static int __verify_package(struct store_package_request* request, const char* publisher, const char* package)
+{
+    struct store_proof_package proof = { 0 };
+    char                       key[128];
+    int                        status;
+
+    proof_format_package_key(&key[0], sizeof(key), publisher, package, request->revision);
+
+    status = store_proof_ensure(STORE_PROOF_PACKAGE, &key[0], NULL);
     if (status) {
-        revision = 0;
+        VLOG_ERROR("store", "__verify_package: failed to ensure proof for package %s\n", &key[0]);
+        return status;
+    }
+
+    status = store_proof_lookup(STORE_PROOF_PACKAGE, &key[0], &proof);
+    if (status) {
+        VLOG_ERROR("store", "__verify_package: failed to load proof for package %s\n", &key[0]);
+        return status;
+    }
+
+    // avoid reading the package again if it was hashed while downloading
+    if (request->digest_valid) {
+        return store_proof_verify_digest(&proof.proof, &request->digest[0], STORE_PACKAGE_DIGEST_SIZE, CHEF_PACKAGE_PROOF_ORIGIN_STORE);
+    }
+    return store_proof_verify_package(&proof.proof, request->path, CHEF_PACKAGE_PROOF_ORIGIN_STORE);
+}
+
+// Invoked as each download finishes, while the remaining downloads are still
+// in progress. The inventory is saved once all downloads have completed.
+static void __ensure_request_completed(struct store_package_request* request, void* context)
+{
+    struct __ensure_context*     ensureContext = context;
+    struct store_inventory_pack* pack;
+    int                          index = ensureContext->indices[request - ensureContext->requests];
+    char**                       names;
+    char*                        path = NULL;
+    int                          moved = 0;
+    int                          status = request->status;
+    VLOG_DEBUG("store", "__ensure_request_completed(name=%s, status=%i)\n", request->package->name, status);
+
+    names = __split_name(request->package->name);
+    if (names == NULL) {
+        status = -1;
+        goto cleanup;
+    }
+
+    if (status) {
+        // keep the partial download around, so it can be resumed
+        VLOG_ERROR("store", "failed to download %s\n", request->package->name);
+        ensureContext->failures++;
+        if (ensureContext->options->failures != NULL) {
+            ensureContext->options->failures[index] = request->transient
+                ? STORE_PACKAGE_FAILURE_TRANSIENT : STORE_PACKAGE_FAILURE_PERMANENT;
+        }
+        strsplit_free(names);
+        return;
+    }
+
+    if (ensureContext->options->verify_proofs) {
+        status = __verify_package(request, names[0], names[1]);
+        if (status) {
+            VLOG_ERROR("store", "failed to verify %s revision %i\n", request->package->name, request->revision);
+            goto cleanup;
+        }
+    }
+
+    path = __format_package_path(names[0], names[1], request->revision);
+    if (path == NULL) {
+        status = -1;
+        goto cleanup;
+    }
+
+    status = rename(request->path, path);
+    if (status) {
+        VLOG_ERROR("store", "failed to move %s into the store\n", request->package->name);
         goto cleanup;
     }
+    moved = 1;
+
+    mtx_lock(&g_store.inventory_lock);
+    status = inventory_add(
+        g_store.inventory,
+        path,
+        names[0], names[1],
+        __get_package_platform(request->package),
+        __get_package_arch(request->package),
+        request->package->channel,
+        request->revision,
+        &pack
+    );
+    mtx_unlock(&g_store.inventory_lock);
+    if (status) {
+        VLOG_ERROR("store", "failed to add %s to the inventory\n", request->package->name);
+    }
 
 cleanup:
+    if (status) {
+        // the package is not tracked by the inventory, so don't leave it in the store
+        platform_unlink(moved ? path : request->path);
+        ensureContext->failures++;
+        if (ensureContext->options->failures != NULL) {
+            ensureContext->options->failures[index] = STORE_PACKAGE_FAILURE_PERMANENT;
+        }
+    } else {
+        if (ensureContext->revisions != NULL) {
+            ensureContext->revisions[index] = request->revision;
+        }
+        if (ensureContext->options->digests != NULL && request->digest_valid) {
+            memcpy(&ensureContext->options->digests[index].digest[0], &request->digest[0], STORE_PACKAGE_DIGEST_SIZE);
+            ensureContext->options->digests[index].valid = 1;
+        }
+    }
     strsplit_free(names);
-    free(pathTmp);
     free(path);
-    return revision;
+}
+
+static int __string_equals(const char* a, const char* b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+// Returns the index of an earlier package in the batch that is identical to the
+// package at the given index, or -1 if this is the first occurrence of it.
+static int __find_duplicate(struct store_package* packages, int index)
+{
+    struct store_package* package = &packages[index];
+    for (int i = 0; i < index; i++) {
+        if (__string_equals(packages[i].name, package->name) &&
+            __string_equals(packages[i].channel, package->channel) &&
+            __string_equals(__get_package_platform(&packages[i]), __get_package_platform(package)) &&
+            __string_equals(__get_package_arch(&packages[i]), __get_package_arch(package)) &&
+            packages[i].revision == package->revision) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int __resolve_requests_serial(struct store_package_request* requests, int count, struct __ensure_context* context)
+{
+    for (int i = 0; i < count; i++) {
+        requests[i].status = g_store.backend.resolve_package(
+            requests[i].package,
+            requests[i].path,
+            requests[i].observer,
+            &requests[i].revision
+        );
+        __ensure_request_completed(&requests[i], context);
+    }
+    return 0;
+}
+
+int store_ensure_packages(struct store_package* packages, int count, struct store_ensure_options* options, int* revisionsOut)
+{
+    struct store_ensure_options   defaultOptions = { 0 };
+    struct __ensure_context       context = { 0 };
+    struct store_package_request* requests;
+    int*                          indices;
+    int                           requestCount = 0;
+    int                           maxConcurrent;
+    int                           status = 0;
+    VLOG_DEBUG("store", "store_ensure_packages(count=%i)\n", count);
+
+    if (g_store.backend.resolve_package == NULL && g_store.backend.resolve_packages == NULL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    requests = calloc(count, sizeof(struct store_package_request));
+    indices = calloc(count, sizeof(int));
+    if (requests == NULL || indices == NULL) {
+        free(requests);
+        free(indices);
+        return -1;
+    }
+
+    context.options = options != NULL ? options : &defaultOptions;
+    context.requests = requests;
+    context.indices = indices;
+    context.revisions = revisionsOut;
+
+    // resolve what we already have locally, and queue up the rest
+    for (int i = 0; i < count; i++) {
+        char** names;
+        char   tmp[256];
+        char*  path;
+
+        if (revisionsOut != NULL) {
+            revisionsOut[i] = 0;
+        }
+        if (context.options->digests != NULL) {
+            context.options->digests[i].valid = 0;
+        }
+        if (context.options->failures != NULL) {
+            context.options->failures[i] = STORE_PACKAGE_FAILURE_NONE;
+        }
+
+        // the same ingredient is often listed both for build and runtime,
+        // only fetch it once
+        if (__find_duplicate(packages, i) != -1) {
+            continue;
+        }
+
+        if (__find_package_in_inventory(&packages[i], revisionsOut != NULL ? &revisionsOut[i] : NULL) == 0) {
+            VLOG_DEBUG("store", "package %s has already been downloaded\n", packages[i].name);
+            continue;
+        }
+
+        // the same package may be requested for different platforms, so the
+        // temporary paths must be unique for each of those. They must also be
+        // stable between runs, so an interrupted download can be resumed.
+        names = __split_name(packages[i].name);
+        if (names == NULL) {
+            status = -1;
+            break;
+        }
+
+        snprintf(&tmp[0], sizeof(tmp), "%s-%s-%s-%s",
+            names[1],
+            __get_package_platform(&packages[i]),
+            __get_package_arch(&packages[i]),
+            packages[i].channel != NULL ? packages[i].channel : "pinned"
+        );
+        path = __format_package_path(names[0], &tmp[0], 0);
+        strsplit_free(names);
+        if (path == NULL) {
+            status = -1;
+            break;
+        }
+
+        requests[requestCount].package = &packages[i];
+        requests[requestCount].path = path;
+        requests[requestCount].observer = context.options->observer;
+        indices[requestCount] = i;
+        requestCount++;
+    }
+
+    if (status == 0 && requestCount > 0) {
+        VLOG_TRACE("store", "downloading %i packages\n", requestCount);
+        maxConcurrent = context.options->max_concurrent > 0 ? context.options->max_concurrent : __STORE_DEFAULT_CONCURRENCY;
+        if (g_store.backend.resolve_packages != NULL) {
+            status = g_store.backend.resolve_packages(requests, requestCount, maxConcurrent, __ensure_request_completed, &context);
+        } else {
+            status = __resolve_requests_serial(requests, requestCount, &context);
+        }
+
+        if (status == 0 && context.failures != 0) {
+            status = -1;
+        }
+
+        // save whatever made it into the inventory, even on partial failures
+        mtx_lock(&g_store.inventory_lock);
+        if (inventory_save(g_store.inventory)) {
+            status = -1;
+        }
+        mtx_unlock(&g_store.inventory_lock);
+    }
+
+    for (int i = 0; i < count; i++) {
+        int original = __find_duplicate(packages, i);
+        if (original == -1) {
+            continue;
+        }
+        if (revisionsOut != NULL) {
+            revisionsOut[i] = revisionsOut[original];
+        }
+        if (context.options->digests != NULL) {
+            context.options->digests[i] = context.options->digests[original];
+        }
+        if (context.options->failures != NULL) {
+            context.options->failures[i] = context.options->failures[original];
+        }
+    }
+
+    for (int i = 0; i < requestCount; i++) {
+        free((void*)requests[i].path);
+    }
+    free(requests);
+    free(indices);
+    return status;
+}
+
+int store_package_set_add(struct store_package_set* set, const char* name, const char* channel, const char* platform, const char* arch)
+{
+    if (set->count == set->capacity) {
+        int                   capacity = set->capacity ? set->capacity * 2 : 16;
+        struct store_package* packages = realloc(set->packages, capacity * sizeof(struct store_package));
+        if (packages == NULL) {
+            return -1;
+        }
+        set->packages = packages;
+        set->capacity = capacity;
+    }
+
+    set->packages[set->count++] = (struct store_package) {
+        .name = name,
+        .channel = channel,
+        .platform = platform,
+        .arch = arch
+    };
+    return 0;
+}
+
+int store_package_set_own(struct store_package_set* set, char* value)
+{
+    struct list_item_string* item = calloc(1, sizeof(struct list_item_string));
+    if (item == NULL) {
+        free(value);
+        return -1;
+    }
+    item->value = value;
+    list_add(&set->strings, &item->list_header);
+    return 0;
+}
+
+static void __free_string_item(void* item)
+{
+    free((void*)((struct list_item_string*)item)->value);
+    free(item);
+}
+
+void store_package_set_destroy(struct store_package_set* set)
+{
+    if (set == NULL) {
+        return;
+    }
+    list_destroy(&set->strings, __free_string_item);
+    free(set->packages);
+    set->packages = NULL;
+    set->count = 0;
+    set->capacity = 0;
 }
 
 int store_package_path(struct store_package* package, const char** pathOut)
 {
-    struct store_inventory_pack* pack = NULL;
-    char**                       names;
-    int                          status;
+    char** names;
+    int    status;
     VLOG_DEBUG("store", "store_package_path(name=%s)\n", package->name);
 
     if (package->revision == 0) {
@@ -295,7 +658,7 @@ int store_package_path(struct store_package* package, const char** pathOut)
         return -1;
     }
 
-    status = __find_package_in_inventory(package, &pack);
+    status = __find_package_in_inventory(package, NULL);
     if (status) {
         VLOG_ERROR("store", "store_package_path: package '%s' was not found\n", package->name);
         goto cleanup;
@@ -333,12 +696,17 @@ int store_proof_ensure(enum store_proof_type keyType, const char* key, struct ch
         goto cleanup;
     }
 
-    status = inventory_add_proof(g_store.inventory, &proof);
-    if (status) {
-        goto cleanup;
+    // another thread may have resolved the same proof in the meantime
+    mtx_lock(&g_store.inventory_lock);
+    if (inventory_get_proof(g_store.inventory, keyType, key, &(union store_proof) { 0 }) == 0) {
+        status = 0;
+    } else {
+        status = inventory_add_proof(g_store.inventory, &proof);
+        if (status == 0) {
+            status = inventory_save(g_store.inventory);
+        }
     }
-
-    status = inventory_save(g_store.inventory);
+    mtx_unlock(&g_store.inventory_lock);
 
 cleanup:
     if (resolved) {
@@ -349,6 +717,12 @@ cleanup:
 
 int store_proof_lookup(enum store_proof_type keyType, const char* key, void* proof)
 {
+    int status;
     VLOG_DEBUG("store", "store_proof_lookup(key=%s)\n", key);
-    return inventory_get_proof(g_store.inventory, keyType, key, proof);
+
+    // proofs are never moved once added, so the pointers stay valid after unlocking
+    mtx_lock(&g_store.inventory_lock);
+    status = inventory_get_proof(g_store.inventory, keyType, key, proof);
+    mtx_unlock(&g_store.inventory_lock);
+    return status;
 }
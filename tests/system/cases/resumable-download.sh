@@ -0,0 +1,165 @@
+#!/usr/bin/env bash
+# resumable-download.sh — segmented package downloads survive failures
+#
+# Workflow:
+#   1. Start an isolated dummy store and seed a package large enough to be
+#      downloaded as multiple parallel ranges
+#   2. Download it while the store cuts the first ranged responses halfway;
+#      the failed segments must be retried and the result must be intact
+#   3. Download it while the store cuts every ranged response; the download
+#      must fail, but leave its progress file behind
+#   4. Download it again from a healthy store; it must resume from the
+#      progress file instead of starting over, and the result must be intact
+#
+# Exit codes:
+#   0  all assertions passed
+#   1  infrastructure or assertion failure
+
+set -euo pipefail
+
+TESTS_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+source "$TESTS_DIR/lib/env.sh"
+source "$TESTS_DIR/lib/cleanup.sh"
+source "$TESTS_DIR/lib/process.sh"
+source "$TESTS_DIR/lib/daemon.sh"
+source "$TESTS_DIR/lib/assert.sh"
+source "$TESTS_DIR/lib/store.sh"
+
+TEST_NAME="resumable-download"
+TEST_LOG_DIR="$(mktemp -d)"
+STORE_ROOT="$TEST_LOG_DIR/store-root"
+ORDER_ROOT="$TEST_LOG_DIR/order-root"
+ORDER_LOG="$TEST_LOG_DIR/order.log"
+DOWNLOAD_DIR="$TEST_LOG_DIR/downloads"
+STORE_PORT=19878
+
+mkdir -p "$STORE_ROOT" "$ORDER_ROOT" "$DOWNLOAD_DIR"
+
+register_tmpdir "$TEST_LOG_DIR"
+register_log    "$ORDER_LOG"
+trap 'teardown_test' EXIT
+
+echo "=== $TEST_NAME ==="
+
+# (Re)start the dummy store with the given extra arguments, logging to $1.
+restart_store() {
+    local log_file="$1"
+    shift
+    stop_daemon "dummy-store"
+    register_log "$log_file"
+    start_dummy_store "$STORE_PORT" "$STORE_ROOT" "$log_file" "$@"
+    if ! wait_for_dummy_store 40 0.25; then
+        echo "FAIL: dummy store did not become ready"
+        exit 1
+    fi
+}
+
+# Sum the bytes the store sent for package downloads, according to its log.
+bytes_sent() {
+    grep -o 'sent=[0-9]*' "$1" | cut -d= -f2 | awk '{ s += $1 } END { print s + 0 }'
+}
+
+# ── Preflight ─────────────────────────────────────────────────────────────────
+echo "[1/5] Checking prerequisites..."
+
+if [[ ! -x "$CMD_ORDER" ]]; then
+    echo "FAIL: order binary not found: $CMD_ORDER" >&2
+    echo "      Make sure the project is built before running system tests." >&2
+    exit 1
+fi
+
+for tool in curl python3 sha512sum; do
+    if ! command -v "$tool" >/dev/null 2>&1; then
+        echo "FAIL: $tool is required for this test" >&2
+        exit 1
+    fi
+done
+
+# ── Seed a large package ──────────────────────────────────────────────────────
+echo "[2/5] Seeding dummy store with a 40MB package..."
+restart_store "$TEST_LOG_DIR/dummy-store-seed.log"
+
+TEST_PACK="$TEST_LOG_DIR/large.pack"
+head -c $((40 * 1024 * 1024)) /dev/urandom > "$TEST_PACK"
+PACK_SIZE=$(wc -c < "$TEST_PACK")
+PACK_SHA=$(sha512sum "$TEST_PACK" | cut -d' ' -f1)
+
+revision=$(seed_dummy_store \
+    "testpub" "large-package" \
+    "linux" "amd64" "stable" \
+    1 0 0 \
+    "$TEST_PACK")
+if [[ $? -ne 0 || -z "$revision" ]]; then
+    echo "FAIL: failed to seed dummy store" >&2
+    exit 1
+fi
+echo "      Seeded testpub/large-package at revision $revision"
+
+download() {
+    local _outvar="$1"
+    local path="$2"
+    run_cmd "$_outvar" "$CMD_ORDER" --root "$ORDER_ROOT" download "testpub/large-package" \
+        --platform linux --arch amd64 --channel stable -o "$path"
+}
+
+# ── Segment failures are retried ──────────────────────────────────────────────
+echo "[3/5] Downloading while the first two segments are cut off..."
+STORE_LOG="$TEST_LOG_DIR/dummy-store-retry.log"
+restart_store "$STORE_LOG" --fault-ranges 2
+
+retry_rc=0
+retry_output=""
+download retry_output "$DOWNLOAD_DIR/retry.pack" || retry_rc=$?
+echo "$retry_output" >>"$ORDER_LOG"
+
+assert_success "$retry_rc" "'order download' with failing segments"
+assert_contains "$(cat "$STORE_LOG")" "fault" "store cut off at least one segment"
+if [[ "$(sha512sum "$DOWNLOAD_DIR/retry.pack" | cut -d' ' -f1)" != "$PACK_SHA" ]]; then
+    echo "FAIL: downloaded package does not match the seeded package" >&2
+    exit 1
+fi
+assert_contains "$retry_output" "$PACK_SHA" "reported SHA-512 matches the package"
+if [[ -e "$DOWNLOAD_DIR/retry.pack.progress" ]]; then
+    echo "FAIL: progress file was left behind after a successful download" >&2
+    exit 1
+fi
+echo "      Segments were retried and the package is intact"
+
+# ── Interrupted download keeps its progress ───────────────────────────────────
+echo "[4/5] Downloading while every segment is cut off..."
+restart_store "$TEST_LOG_DIR/dummy-store-broken.log" --fault-ranges 1000
+
+broken_rc=0
+broken_output=""
+download broken_output "$DOWNLOAD_DIR/resume.pack" || broken_rc=$?
+echo "$broken_output" >>"$ORDER_LOG"
+
+assert_failure "$broken_rc" "'order download' against a broken store"
+assert_file_nonempty "$DOWNLOAD_DIR/resume.pack.progress" "download progress file"
+echo "      Download failed and left its progress behind"
+
+# ── Resume ────────────────────────────────────────────────────────────────────
+echo "[5/5] Resuming the download from a healthy store..."
+STORE_LOG="$TEST_LOG_DIR/dummy-store-resume.log"
+restart_store "$STORE_LOG"
+
+resume_rc=0
+resume_output=""
+download resume_output "$DOWNLOAD_DIR/resume.pack" || resume_rc=$?
+echo "$resume_output" >>"$ORDER_LOG"
+
+assert_success "$resume_rc" "'order download' resume"
+if [[ "$(sha512sum "$DOWNLOAD_DIR/resume.pack" | cut -d' ' -f1)" != "$PACK_SHA" ]]; then
+    echo "FAIL: resumed package does not match the seeded package" >&2
+    exit 1
+fi
+
+sent=$(bytes_sent "$STORE_LOG")
+if [[ "$sent" -ge "$PACK_SIZE" ]]; then
+    echo "FAIL: resumed download transferred $sent bytes, expected less than $PACK_SIZE" >&2
+    exit 1
+fi
+echo "      Resumed download transferred $sent of $PACK_SIZE bytes"
+
+echo ""
+echo "PASS: $TEST_NAME"
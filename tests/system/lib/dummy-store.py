@@ -3,7 +3,10 @@
 dummy-store.py — minimal filesystem-backed fake Chef store for system tests
 
 Usage:
-    python3 dummy-store.py --port PORT --root DIR [--host HOST]
+    python3 dummy-store.py --port PORT --root DIR [--host HOST] [--fault-ranges N]
+
+    --fault-ranges N   cut the connection halfway through the first N ranged
+                       downloads, to exercise retry and resume of downloads
 
 The store exposes the subset of the Chef Store HTTP API needed by
 libs/chefclient and daemons/served:
@@ -11,7 +14,7 @@ libs/chefclient and daemons/served:
     GET  /package/find
     GET  /package/info
     GET  /package/revision
-    GET  /package/download
+    GET  /package/download     (supports HEAD and single Range requests)
     GET  /package/proof
     POST /package/publish/initiate
     POST /package/publish/upload
@@ -177,6 +180,15 @@ class StoreHandler(http.server.BaseHTTPRequestHandler):
         else:
             self._send_error(404, "not found")
 
+    def do_HEAD(self):
+        path = self._path()
+        q    = self._query()
+
+        if path == "/package/download":
+            self._handle_download(q, head=True)
+        else:
+            self._send_empty(404)
+
     def do_POST(self):
         path = self._path()
         q    = self._query()
@@ -279,7 +291,30 @@ class StoreHandler(http.server.BaseHTTPRequestHandler):
 
     # ---- GET /package/download ---------------------------------------------
 
-    def _handle_download(self, q):
+    def _parse_range(self, size):
+        """Parse a single 'bytes=start-end' range. Returns (start, end) or None."""
+        header = self.headers.get("Range")
+        if not header or not header.startswith("bytes=") or "," in header:
+            return None
+        start, _, end = header[len("bytes="):].partition("-")
+        try:
+            if start == "":
+                # suffix range, the last N bytes
+                return (max(size - int(end), 0), size - 1)
+            start = int(start)
+            end = int(end) if end else size - 1
+        except ValueError:
+            return None
+        return (start, min(end, size - 1))
+
+    def _take_fault(self):
+        with self.server.lock:
+            if self.server.fault_ranges > 0:
+                self.server.fault_ranges -= 1
+                return True
+        return False
+
+    def _handle_download(self, q, head=False):
         publisher = q.get("publisher", [None])[0]
         name      = q.get("name", [None])[0]
         revision  = q.get("revision", [None])[0]
@@ -293,9 +328,55 @@ class StoreHandler(http.server.BaseHTTPRequestHandler):
             self._send_error(404, "package revision not found")
             return
 
+        size = os.path.getsize(pack_path)
+        if head:
+            self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(size))
+            self.send_header("Accept-Ranges", "bytes")
+            self.end_headers()
+            return
+
+        byte_range = self._parse_range(size)
+        if byte_range is None:
+            with open(pack_path, "rb") as f:
+                data = f.read()
+            self._send_binary(200, data)
+            sys.stderr.write("[dummy-store] download %s/%s sent=%d\n" % (publisher, name, len(data)))
+            return
+
+        start, end = byte_range
+        if start >= size or start > end:
+            self.send_response(416)
+            self.send_header("Content-Range", "bytes */%d" % size)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
         with open(pack_path, "rb") as f:
-            data = f.read()
-        self._send_binary(200, data)
+            f.seek(start)
+            data = f.read(end - start + 1)
+
+        self.send_response(206)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+        self.send_header("Accept-Ranges", "bytes")
+        self.end_headers()
+
+        if self._take_fault():
+            # send half of the range, then drop the connection
+            sent = len(data) // 2
+            self.wfile.write(data[:sent])
+            self.wfile.flush()
+            self.close_connection = True
+            sys.stderr.write("[dummy-store] download %s/%s range=%d-%d sent=%d fault\n" %
+                             (publisher, name, start, end, sent))
+            return
+
+        self.wfile.write(data)
+        sys.stderr.write("[dummy-store] download %s/%s range=%d-%d sent=%d\n" %
+                         (publisher, name, start, end, len(data)))
 
     # ---- GET /package/proof ------------------------------------------------
 
@@ -571,9 +652,10 @@ class StoreHandler(http.server.BaseHTTPRequestHandler):
 # ---------------------------------------------------------------------------
 
 class StoreServer(http.server.ThreadingHTTPServer):
-    def __init__(self, server_address, handler, store_root):
+    def __init__(self, server_address, handler, store_root, fault_ranges=0):
         super().__init__(server_address, handler)
         self.store_root = store_root
+        self.fault_ranges = fault_ranges
         self.lock = threading.Lock()
 
 
@@ -582,11 +664,13 @@ def main():
     parser.add_argument("--port", type=int, default=9876, help="TCP port to listen on")
     parser.add_argument("--host", default="127.0.0.1", help="Host to bind to")
     parser.add_argument("--root", required=True, help="Filesystem root for store data")
+    parser.add_argument("--fault-ranges", type=int, default=0,
+                        help="Cut the connection halfway through the first N ranged downloads")
     args = parser.parse_args()
 
     os.makedirs(args.root, exist_ok=True)
 
-    server = StoreServer((args.host, args.port), StoreHandler, args.root)
+    server = StoreServer((args.host, args.port), StoreHandler, args.root, args.fault_ranges)
     sys.stderr.write("[dummy-store] listening on http://%s:%d  root=%s\n" %
                      (args.host, args.port, args.root))
     sys.stderr.flush()
@@ -14,11 +14,13 @@ STORE_LIB_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 DUMMY_STORE_SCRIPT="$STORE_LIB_DIR/dummy-store.py"
 
 # Start the dummy store in the background.
-# Usage: start_dummy_store PORT ROOT_DIR LOG_FILE
+# Usage: start_dummy_store PORT ROOT_DIR LOG_FILE [EXTRA_ARGS...]
+#   EXTRA_ARGS are passed on to dummy-store.py, e.g. --fault-ranges 2
 start_dummy_store() {
     local port="$1"
     local root_dir="$2"
     local log_file="$3"
+    shift 3
 
     if [[ ! -f "$DUMMY_STORE_SCRIPT" ]]; then
         echo "ERROR: dummy-store.py not found at $DUMMY_STORE_SCRIPT" >&2
@@ -32,7 +34,7 @@ start_dummy_store() {
 
     mkdir -p "$root_dir"
 
-    python3 "$DUMMY_STORE_SCRIPT" --port "$port" --root "$root_dir" >"$log_file" 2>&1 &
+    python3 "$DUMMY_STORE_SCRIPT" --port "$port" --root "$root_dir" "$@" >"$log_file" 2>&1 &
     local pid=$!
 
     _DUMMY_STORE_PID="$pid"
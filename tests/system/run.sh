@@ -36,6 +36,7 @@ DEFAULT_CASES=(
     hello-runtime
     dummy-store-roundtrip
     order-fetch-from-store
+    resumable-download
     served-install-from-store
 )
 
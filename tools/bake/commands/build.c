@@ -55,10 +55,27 @@ static void __print_help(void)
     printf("      Shows this help message\n");
 }
 
-static int __ensure_toolchains(struct list* platforms)
+static void __report_ccache_stats(struct __bake_build_context* bctx)
+{
+    struct build_ccache_stats stats;
+    unsigned int              total;
+
+    if (build_ccache_stats(bctx, &stats)) {
+        return;
+    }
+
+    total = stats.hits + stats.misses;
+    if (total == 0) {
+        return;
+    }
+    VLOG_TRACE("bake", "compiler cache: %u hits, %u misses (%u%% hit rate)\n",
+        stats.hits, stats.misses, (stats.hits * 100) / total);
+}
+
+static int __ensure_toolchains(struct list* platforms, struct store_package_set* set)
 {
     struct list_item* item;
-    VLOG_DEBUG("bake", "__prep_toolchains()\n");
+    VLOG_DEBUG("bake", "__ensure_toolchains()\n");
 
     list_foreach(platforms, item) {
         struct recipe_platform* platform = (struct recipe_platform*)item;
@@ -72,45 +89,39 @@ static int __ensure_toolchains(struct list* platforms)
         
         status = recipe_parse_platform_toolchain(platform->toolchain, &name, &channel, &version);
         if (status) {
-            VLOG_ERROR("bake", "failed to parse toolchain %s for platform %s", platform->toolchain, platform->name);
+            VLOG_ERROR("bake", "failed to parse toolchain %s for platform %s\n", platform->toolchain, platform->name);
             return status;
         }
+        free(version);
 
-        status = store_ensure_package(&(struct store_package) {
-            .name = name,
-            .channel = channel,
-            .arch = CHEF_ARCHITECTURE_STR,
-            .platform = CHEF_PLATFORM_STR
-        }, NULL);
-        if (status) {
-            free(name);
+        // keep the parsed strings alive until the packages have been fetched
+        status = store_package_set_own(set, name);
+        if (status == 0) {
+            status = store_package_set_own(set, channel);
+        } else {
             free(channel);
-            free(version);
-            VLOG_ERROR("bake", "failed to fetch ingredient %s\n", name);
+        }
+        if (status) {
+            return status;
+        }
+
+        status = store_package_set_add(set, name, channel, CHEF_PLATFORM_STR, CHEF_ARCHITECTURE_STR);
+        if (status) {
             return status;
         }
     }
     return 0;
 }
 
-static int __ensure_ingredient_list(struct list* list, const char* platform, const char* arch)
+static int __ensure_ingredient_list(struct list* list, const char* platform, const char* arch, struct store_package_set* set)
 {
     struct list_item* item;
-    int               status;
-    VLOG_DEBUG("bake", "__prep_ingredient_list(platform=%s, arch=%s)\n", platform, arch);
+    VLOG_DEBUG("bake", "__ensure_ingredient_list(platform=%s, arch=%s)\n", platform, arch);
 
     list_foreach(list, item) {
         struct recipe_ingredient* ingredient = (struct recipe_ingredient*)item;
-
-        status = store_ensure_package(&(struct store_package) {
-            .name = ingredient->name,
-            .channel = ingredient->channel,
-            .arch = arch,
-            .platform = platform
-        }, NULL);
-        if (status) {
-            VLOG_ERROR("bake", "failed to fetch ingredient %s\n", ingredient->name);
-            return status;
+        if (store_package_set_add(set, ingredient->name, ingredient->channel, platform, arch)) {
+            return -1;
         }
     }
     return 0;
@@ -118,52 +129,34 @@ static int __ensure_ingredient_list(struct list* list, const char* platform, con
 
 static int __ensure_ingredients(struct recipe* recipe, const char* platform, const char* arch)
 {
-    int status;
-
-    if (recipe->platforms.count > 0) {
-        VLOG_TRACE("bake", "preparing %i platforms\n", recipe->platforms.count);
-        status = __ensure_toolchains(&recipe->platforms);
-        if (status) {
-            return status;
-        }
+    struct store_package_set set = { 0 };
+    int                      status;
+
+    // Collect everything the recipe needs up front, so it can all be
+    // fetched concurrently instead of one package at a time.
+    status = __ensure_toolchains(&recipe->platforms, &set);
+    if (status == 0) {
+        status = __ensure_ingredient_list(&recipe->environment.host.ingredients, CHEF_PLATFORM_STR, CHEF_ARCHITECTURE_STR, &set);
     }
-
-    if (recipe->environment.host.ingredients.count > 0) {
-        VLOG_TRACE("bake", "preparing %i host ingredients\n", recipe->environment.host.ingredients.count);
-        status = __ensure_ingredient_list(
-            &recipe->environment.host.ingredients,
-            CHEF_PLATFORM_STR,
-            CHEF_ARCHITECTURE_STR
-        );
-        if (status) {
-            return status;
-        }
+    if (status == 0) {
+        status = __ensure_ingredient_list(&recipe->environment.build.ingredients, platform, arch, &set);
     }
-
-    if (recipe->environment.build.ingredients.count > 0) {
-        VLOG_TRACE("bake", "preparing %i build ingredients\n", recipe->environment.build.ingredients.count);
-        status = __ensure_ingredient_list(
-            &recipe->environment.build.ingredients,
-            platform,
-            arch
-        );
-        if (status) {
-            return status;
-        }
+    if (status == 0) {
+        status = __ensure_ingredient_list(&recipe->environment.runtime.ingredients, platform, arch, &set);
     }
 
-    if (recipe->environment.runtime.ingredients.count > 0) {
-        VLOG_TRACE("bake", "preparing %i runtime ingredients\n", recipe->environment.runtime.ingredients.count);
-        status = __ensure_ingredient_list(
-            &recipe->environment.runtime.ingredients,
-            platform,
-            arch
-        );
+    if (status == 0 && set.count > 0) {
+        VLOG_TRACE("bake", "preparing %i ingredients\n", set.count);
+        status = store_ensure_packages(set.packages, set.count, &(struct store_ensure_options) {
+            .verify_proofs = 1
+        }, NULL);
         if (status) {
-            return status;
+            VLOG_ERROR("bake", "failed to fetch ingredients\n");
         }
     }
-    return 0;
+
+    store_package_set_destroy(&set);
+    return status;
 }
 
 static void __cleanup_systems(int sig)
@@ -390,6 +383,7 @@ int run_main(int argc, char** argv, char** envp, struct bake_command_options* op
         goto cleanup;
     }
     vlog_step_end(&step_pack, status == 0);
+    __report_ccache_stats(g_context);
 
 cleanup:
     vlog_refresh(stdout);
@@ -98,6 +98,8 @@ static void __print_help(void)
     printf("  'bake build --help'\n\n");
     printf("\n");
     printf("Options:\n");
+    printf("  --batch\n");
+    printf("      Queue the builds behind interactive builds on the build-server\n");
     printf("  --version\n");
     printf("      Print the version of bake\n");
     printf("  -h,  --help\n");
@@ -135,7 +137,7 @@ static char* __format_footer(const char* waiterdAddress)
     return platform_strdup(&tmp[0]);
 }
 
-static int __queue_builds(int logIndexStart, gracht_client_t* client, const char* imageUrl, struct list* builds, struct bake_command_options* options)
+static int __queue_builds(int logIndexStart, gracht_client_t* client, const char* imageUrl, enum chef_build_priority priority, struct list* builds, struct bake_command_options* options)
 {
     struct {
         struct gracht_message_context msg;
@@ -159,7 +161,8 @@ static int __queue_builds(int logIndexStart, gracht_client_t* client, const char
                 .arch = __arch_string_to_build_arch(arch),
                 .platform = (char*)options->platform,
                 .url = (char*)imageUrl,
-                .recipe = (char*)options->recipe_path
+                .recipe = (char*)options->recipe_path,
+                .priority = priority
             }
         );
         if (status) {
@@ -214,14 +217,15 @@ static int __queue_builds(int logIndexStart, gracht_client_t* client, const char
 
 int remote_build_main(int argc, char** argv, char** envp, struct bake_command_options* options)
 {
-    gracht_client_t*  client = NULL;
-    struct list_item* li;
-    char*             imagePath = NULL;
-    char*             dlUrl = NULL;
-    char*             header;
-    char*             footer;
-    int               status;
-    int               i;
+    gracht_client_t*         client = NULL;
+    struct list_item*        li;
+    char*                    imagePath = NULL;
+    char*                    dlUrl = NULL;
+    char*                    header;
+    char*                    footer;
+    enum chef_build_priority priority = CHEF_BUILD_PRIORITY_INTERACTIVE;
+    int                      status;
+    int                      i;
 
     // catch CTRL-C
     signal(SIGINT, __cleanup_systems);
@@ -235,6 +239,10 @@ int remote_build_main(int argc, char** argv, char** envp, struct bake_command_op
             __print_help();
             return 0;
         }
+        if (!strcmp(argv[i], "--batch")) {
+            priority = CHEF_BUILD_PRIORITY_BATCH;
+            continue;
+        }
         parse_status = bake_command_parse_target_option(argc, argv, &i, options);
         if (parse_status == CLI_PARSE_RESULT_HANDLED) {
             continue;
@@ -310,13 +318,15 @@ int remote_build_main(int argc, char** argv, char** envp, struct bake_command_op
     vlog_content_set_index(1);
     vlog_content_set_status(VLOG_CONTENT_STATUS_WORKING);
 
-    VLOG_TRACE("bake", "packing source code for delivery\n");
-    status = remote_pack(options->cwd, (const char* const*)envp, &imagePath);
+    // only the chunks of the sources that changed since the last remote
+    // build are uploaded, the manifest tells cookd where to find the rest
+    VLOG_TRACE("bake", "syncing source code for delivery\n");
+    status = remote_sync_pack(options->cwd, &imagePath);
     if (status) {
         goto cleanup;
     }
 
-    VLOG_TRACE("bake", "uploading source code image\n");
+    VLOG_TRACE("bake", "uploading source code manifest\n");
     status = remote_upload(imagePath, &dlUrl);
     if (status) {
         goto cleanup;
@@ -326,7 +336,7 @@ int remote_build_main(int argc, char** argv, char** envp, struct bake_command_op
     vlog_content_set_status(VLOG_CONTENT_STATUS_DONE);
  
     // initiate all the build calls
-    status = __queue_builds(3, client, dlUrl, &g_builds, options);
+    status = __queue_builds(3, client, dlUrl, priority, &g_builds, options);
     if (status) {
         goto cleanup;
     }
@@ -17,6 +17,7 @@
  */
 
 #include <chef/platform.h>
+#include <errno.h>
 #include "resolvers.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,6 +52,7 @@ int __resolve_add_dependency(struct list* dependencies, const char* library)
     return 0;
 }
 
+#if defined(CHEF_ON_WINDOWS)
 int __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut)
 {
     FILE*  file;
@@ -85,3 +87,119 @@ int __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut)
     *sizeOut = size;
     return 0;
 }
+
+void __resolve_unload_file(void* buffer, size_t size)
+{
+    (void)size;
+    free(buffer);
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The file is mapped instead of read, the parsers only touch the headers, the
+// dynamic section and the string table, so only those pages are ever read in.
+int __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut)
+{
+    struct stat stats;
+    void*       buffer;
+    int         fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &stats) || stats.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    buffer = mmap(NULL, (size_t)stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED) {
+        return -1;
+    }
+
+    *bufferOut = buffer;
+    *sizeOut = (size_t)stats.st_size;
+    return 0;
+}
+
+void __resolve_unload_file(void* buffer, size_t size)
+{
+    munmap(buffer, size);
+}
+#endif
+
+struct bake_resolver_context* resolver_context_new(const char* sysroot)
+{
+    struct bake_resolver_context* context;
+
+    context = calloc(1, sizeof(struct bake_resolver_context));
+    if (context == NULL) {
+        return NULL;
+    }
+
+    context->sysroot = platform_strdup(sysroot != NULL ? sysroot : "");
+    if (context->sysroot == NULL) {
+        free(context);
+        return NULL;
+    }
+
+    if (mtx_init(&context->lock, mtx_plain) != thrd_success) {
+        free((void*)context->sysroot);
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
+static void __destroy_string_list(struct list* strings)
+{
+    struct list_item* item;
+
+    for (item = strings->head; item != NULL;) {
+        struct list_item_string* entry = (struct list_item_string*)item;
+        item = item->next;
+
+        free((void*)entry->value);
+        free(entry);
+    }
+    list_init(strings);
+}
+
+void resolver_context_delete(struct bake_resolver_context* context)
+{
+    struct list_item* item;
+
+    if (context == NULL) {
+        return;
+    }
+
+    for (item = context->search_paths.head; item != NULL;) {
+        struct bake_resolver_search_paths* entry = (struct bake_resolver_search_paths*)item;
+        item = item->next;
+
+        __destroy_string_list(&entry->paths);
+        free(entry);
+    }
+
+    for (int i = 0; i < BAKE_RESOLVER_MEMO_BUCKETS; i++) {
+        for (item = context->memo[i].head; item != NULL;) {
+            struct bake_resolver_memo_entry* entry = (struct bake_resolver_memo_entry*)item;
+            item = item->next;
+
+            free((void*)entry->name);
+            free((void*)entry->path);
+            free(entry);
+        }
+    }
+
+    mtx_destroy(&context->lock);
+    free((void*)context->sysroot);
+    free(context);
+}
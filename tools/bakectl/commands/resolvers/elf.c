@@ -24,7 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-extern int __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut);
+extern int  __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut);
+extern void __resolve_unload_file(void* buffer, size_t size);
 extern int __resolve_add_dependency(struct list* dependencies, const char* library);
 
 struct __elf_address_mapping {
@@ -34,8 +35,13 @@ struct __elf_address_mapping {
     int         valid;
 };
 
-static const char* __get_string_from_strtab32(const char* strTable, Elf32_Xword index)
+// The index comes straight from the file, so the string must start inside
+// the table and be terminated before its end.
+static const char* __get_string_from_strtab32(const char* strTable, size_t strTableSize, Elf32_Xword index)
 {
+    if (index >= strTableSize || memchr(strTable + index, '\0', strTableSize - index) == NULL) {
+        return NULL;
+    }
     return strTable + index;
 }
 
@@ -44,18 +50,21 @@ static int __parse_dynamic_section32(struct __elf_address_mapping* mappings, con
     Elf32_Dyn*  di;
     size_t      i;
     size_t      strTableOffset = 0;
+    size_t      strTableSize   = 0;
     const char* strTable       = NULL;
 
     for (i = 0, di = (Elf32_Dyn*)dynamicTable;
-         i < dynamicTableSize; i += sizeof(Elf32_Dyn), di++) {
+         i + sizeof(Elf32_Dyn) <= dynamicTableSize; i += sizeof(Elf32_Dyn), di++) {
         if (di->d_tag == DT_STRTAB) {
             strTableOffset = di->d_un.d_ptr;
+        } else if (di->d_tag == DT_STRSZ) {
+            strTableSize = di->d_un.d_val;
         } else if (di->d_tag == DT_NULL) {
             break;
         }
     }
 
-    if (strTableOffset == 0) {
+    if (strTableOffset == 0 || strTableSize == 0) {
         fprintf(stderr, "oven: could not find string table offset\n");
         return -1;
     }
@@ -63,7 +72,10 @@ static int __parse_dynamic_section32(struct __elf_address_mapping* mappings, con
     // find the correct file offset
     for (i = 0; mappings[i].valid; i++) {
         if (strTableOffset >= mappings[i].voffset && strTableOffset < (mappings[i].voffset + mappings[i].size)) {
-            strTable = mappings[i].data + (strTableOffset - mappings[i].voffset);
+            // the whole table must be inside the mapped file
+            if (strTableSize <= mappings[i].size - (strTableOffset - mappings[i].voffset)) {
+                strTable = mappings[i].data + (strTableOffset - mappings[i].voffset);
+            }
             break;
         }
     }
@@ -74,9 +86,15 @@ static int __parse_dynamic_section32(struct __elf_address_mapping* mappings, con
     }
     
     for (i = 0, di = (Elf32_Dyn*)dynamicTable;
-         i < dynamicTableSize; i += sizeof(Elf32_Dyn), di++) {
+         i + sizeof(Elf32_Dyn) <= dynamicTableSize; i += sizeof(Elf32_Dyn), di++) {
         if (di->d_tag == DT_NEEDED) {
-            if (__resolve_add_dependency(dependencies, __get_string_from_strtab32(strTable, di->d_un.d_val))) {
+            const char* library = __get_string_from_strtab32(strTable, strTableSize, di->d_un.d_val);
+            if (library == NULL) {
+                fprintf(stderr, "oven: invalid library name in dynamic section\n");
+                errno = EINVAL;
+                return -1;
+            }
+            if (__resolve_add_dependency(dependencies, library)) {
                 return -1;
             }
         } else if (di->d_tag == DT_NULL) {
@@ -107,6 +125,13 @@ static int __parse_dependencies_32(const char* buffer, size_t bufferSize, struct
         return 0;
     }
 
+    // the file is mapped, so anything pointing outside it must be rejected
+    // before it is dereferenced
+    if (header->e_phoff + ((size_t)header->e_phnum * sizeof(Elf32_Phdr)) > bufferSize) {
+        errno = EINVAL;
+        return -1;
+    }
+
     // allocate space to keep mappings
     mappings = calloc(sizeof(struct __elf_address_mapping), header->e_phnum + 1);
     if (mappings == NULL) {
@@ -116,6 +141,10 @@ static int __parse_dependencies_32(const char* buffer, size_t bufferSize, struct
 
     pi = (Elf32_Phdr*)(buffer + header->e_phoff);
     for (uint16_t i = 0; i < header->e_phnum; i++, pi++) {
+        if (pi->p_offset + pi->p_filesz > bufferSize) {
+            continue;
+        }
+
         if (pi->p_type == PT_DYNAMIC) {
             dynamic = pi;
         } else if (pi->p_type == PT_LOAD) {
@@ -139,8 +168,11 @@ static int __parse_dependencies_32(const char* buffer, size_t bufferSize, struct
     return status;
 }
 
-static const char* __get_string_from_strtab64(const char* strTable, Elf64_Xword index)
+static const char* __get_string_from_strtab64(const char* strTable, size_t strTableSize, Elf64_Xword index)
 {
+    if (index >= strTableSize || memchr(strTable + index, '\0', strTableSize - index) == NULL) {
+        return NULL;
+    }
     return strTable + index;
 }
 
@@ -149,18 +181,21 @@ static int __parse_dynamic_section64(struct __elf_address_mapping* mappings, con
     Elf64_Dyn*  di;
     size_t      i;
     size_t      strTableOffset = 0;
+    size_t      strTableSize   = 0;
     const char* strTable       = NULL;
 
     for (i = 0, di = (Elf64_Dyn*)dynamicTable;
-         i < dynamicTableSize; i += sizeof(Elf64_Dyn), di++) {
+         i + sizeof(Elf64_Dyn) <= dynamicTableSize; i += sizeof(Elf64_Dyn), di++) {
         if (di->d_tag == DT_STRTAB) {
             strTableOffset = di->d_un.d_ptr;
+        } else if (di->d_tag == DT_STRSZ) {
+            strTableSize = di->d_un.d_val;
         } else if (di->d_tag == DT_NULL) {
             break;
         }
     }
 
-    if (strTableOffset == 0) {
+    if (strTableOffset == 0 || strTableSize == 0) {
         fprintf(stderr, "oven: could not find string table offset\n");
         return -1;
     }
@@ -168,7 +203,10 @@ static int __parse_dynamic_section64(struct __elf_address_mapping* mappings, con
     // find the correct file offset
     for (i = 0; mappings[i].valid; i++) {
         if (strTableOffset >= mappings[i].voffset && strTableOffset < (mappings[i].voffset + mappings[i].size)) {
-            strTable = mappings[i].data + (strTableOffset - mappings[i].voffset);
+            // the whole table must be inside the mapped file
+            if (strTableSize <= mappings[i].size - (strTableOffset - mappings[i].voffset)) {
+                strTable = mappings[i].data + (strTableOffset - mappings[i].voffset);
+            }
             break;
         }
     }
@@ -179,9 +217,15 @@ static int __parse_dynamic_section64(struct __elf_address_mapping* mappings, con
     }
     
     for (i = 0, di = (Elf64_Dyn*)dynamicTable;
-         i < dynamicTableSize; i += sizeof(Elf64_Dyn), di++) {
+         i + sizeof(Elf64_Dyn) <= dynamicTableSize; i += sizeof(Elf64_Dyn), di++) {
         if (di->d_tag == DT_NEEDED) {
-            if (__resolve_add_dependency(dependencies, __get_string_from_strtab64(strTable, di->d_un.d_val))) {
+            const char* library = __get_string_from_strtab64(strTable, strTableSize, di->d_un.d_val);
+            if (library == NULL) {
+                fprintf(stderr, "oven: invalid library name in dynamic section\n");
+                errno = EINVAL;
+                return -1;
+            }
+            if (__resolve_add_dependency(dependencies, library)) {
                 return -1;
             }
         } else if (di->d_tag == DT_NULL) {
@@ -212,6 +256,13 @@ static int __parse_dependencies_64(const char* buffer, size_t bufferSize, struct
         return 0;
     }
 
+    // the file is mapped, so anything pointing outside it must be rejected
+    // before it is dereferenced
+    if (header->e_phoff + ((size_t)header->e_phnum * sizeof(Elf64_Phdr)) > bufferSize) {
+        errno = EINVAL;
+        return -1;
+    }
+
     // allocate space to keep mappings
     mappings = calloc(sizeof(struct __elf_address_mapping), header->e_phnum + 1);
     if (mappings == NULL) {
@@ -221,6 +272,10 @@ static int __parse_dependencies_64(const char* buffer, size_t bufferSize, struct
 
     pi = (Elf64_Phdr*)(buffer + header->e_phoff);
     for (uint16_t i = 0; i < header->e_phnum; i++, pi++) {
+        if (pi->p_offset + pi->p_filesz > bufferSize) {
+            continue;
+        }
+
         if (pi->p_type == PT_DYNAMIC) {
             dynamic = pi;
         } else if (pi->p_type == PT_LOAD) {
@@ -247,6 +302,11 @@ static int __parse_dependencies_64(const char* buffer, size_t bufferSize, struct
 static int __parse_dependencies(const char* buffer, size_t bufferSize, struct list* dependencies)
 {
     Elf32_Ehdr* header32 = (Elf32_Ehdr*)buffer;
+    if (bufferSize < sizeof(Elf64_Ehdr)) {
+        errno = EINVAL;
+        return -1;
+    }
+
     if (header32->e_ident[EI_DATA] != ELFDATA2LSB) {
         fprintf(stderr, "oven: only LSB formatted elf files are supported right now\n");
         errno = ENOSYS;
@@ -338,7 +398,7 @@ int elf_resolve_dependencies(const char* path, struct list* dependencies)
     }
 
     status = __parse_dependencies(buffer, bufferSize, dependencies);
-    free(buffer);
+    __resolve_unload_file(buffer, bufferSize);
     return 0;
 }
 
@@ -16,13 +16,15 @@
  * 
  */
 
+#include <errno.h>
 #include "pe.h"
 #include "resolvers.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-extern int __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut);
+extern int  __resolve_load_file(const char* path, void** bufferOut, size_t* sizeOut);
+extern void __resolve_unload_file(void* buffer, size_t size);
 extern int __resolve_add_dependency(struct list* dependencies, const char* library);
 
 struct __pe_address_mapping {
@@ -151,7 +153,16 @@ static int __parse_dependencies_32(const char* buffer, size_t bufferSize, struct
 
 static int __parse_dependencies(const char* buffer, size_t bufferSize, struct list* dependencies)
 {
-    PeOptionalHeader* optional = __get_optionalheader(buffer);
+    PeOptionalHeader* optional;
+
+    // the file is mapped, so make sure the headers are inside it
+    if (bufferSize < sizeof(MzHeader) ||
+        __get_mzheader(buffer)->PeHeaderAddress + sizeof(PeHeader) + sizeof(PeOptionalHeader) > bufferSize) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    optional = __get_optionalheader(buffer);
     if (optional->Architecture == PE_ARCHITECTURE_64) {
         return __parse_dependencies_64(buffer, bufferSize, dependencies);
     }
@@ -232,7 +243,7 @@ int pe_resolve_dependencies(const char* path, struct list* dependencies)
     }
 
     status = __parse_dependencies(buffer, bufferSize, dependencies);
-    free(buffer);
+    __resolve_unload_file(buffer, bufferSize);
     return 0;
 }
 
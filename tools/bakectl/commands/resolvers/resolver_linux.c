@@ -25,11 +25,6 @@
 #include <string.h>
 #include <vlog.h>
  
-struct __path_entry {
-    struct list_item list_header;
-    const char*      path;
-};
-
 // list of library paths on the systen
 static const char* g_systemPaths[] = {
     "/usr/local/lib",
@@ -54,8 +49,8 @@ static int __get_ld_conf_paths(const char* path, struct list* paths)
     }
     
     while (fgets(buffer, sizeof(buffer), file) != NULL) {
-        struct __path_entry* entry;
-        char*                line;
+        struct list_item_string* entry;
+        char*                    line;
 
         // skip comments
         if (buffer[0] == '#') {
@@ -74,13 +69,18 @@ static int __get_ld_conf_paths(const char* path, struct list* paths)
         }
         
         // add the path to the list
-        entry = calloc(1, sizeof(struct __path_entry));
+        entry = calloc(1, sizeof(struct list_item_string));
         if (entry == NULL) {
             result = -1;
             break;
         }
 
-        entry->path = platform_strdup(buffer);
+        entry->value = platform_strdup(buffer);
+        if (entry->value == NULL) {
+            free(entry);
+            result = -1;
+            break;
+        }
         list_add(paths, &entry->list_header);
     }
     
@@ -144,15 +144,49 @@ static int __load_ld_so_conf_for_platform(const char* sysroot, struct bake_resol
     return status;
 }
 
-const char* resolve_platform_dependency_linux(const char* sysroot, struct bake_resolve* resolve, const char* dependency)
+// The search paths are only parsed once per architecture during a stage, and
+// are never modified once added to the context.
+static struct list* __get_search_paths(struct bake_resolver_context* context, struct bake_resolve* resolve)
+{
+    struct bake_resolver_search_paths* entry;
+    struct list_item*                  item;
+    struct list*                       paths = NULL;
+
+    mtx_lock(&context->lock);
+    list_foreach(&context->search_paths, item) {
+        entry = (struct bake_resolver_search_paths*)item;
+        if (entry->arch == resolve->arch) {
+            paths = &entry->paths;
+            break;
+        }
+    }
+
+    if (paths == NULL) {
+        entry = calloc(1, sizeof(struct bake_resolver_search_paths));
+        if (entry != NULL) {
+            entry->arch = resolve->arch;
+
+            // on failure we keep the (maybe partial) list, so we do not retry
+            // loading the configuration for every dependency
+            if (__load_ld_so_conf_for_platform(context->sysroot, resolve, &entry->paths)) {
+                VLOG_DEBUG("resolve", "__get_search_paths: no ld.so.conf could be loaded\n");
+            }
+            list_add(&context->search_paths, &entry->list_header);
+            paths = &entry->paths;
+        }
+    }
+    mtx_unlock(&context->lock);
+    return paths;
+}
+
+const char* resolve_platform_dependency_linux(struct bake_resolver_context* context, struct bake_resolve* resolve, const char* dependency)
 {
-    struct list          libraryPaths = { 0 };
+    struct list*         libraryPaths;
     struct list_item*    item;
     struct platform_stat stats;
-    int                  status;
     char*                path;
     VLOG_DEBUG("resolve", "resolve_platform_dependency_linux(sysroot=%s, dep=%s)\n",
-        sysroot ? sysroot : "",
+        context->sysroot,
         dependency ? dependency : "(null)"
     );
 
@@ -165,12 +199,12 @@ const char* resolve_platform_dependency_linux(const char* sysroot, struct bake_r
     // Try to resolve the library using the traditional library paths on linux
     // we have to take into account whether paths like 'lib/x86_64-linux-gnu' exists
     // depending on the architecture we have built for.
-    status = __load_ld_so_conf_for_platform(sysroot, resolve, &libraryPaths);
-    if (status == 0) {
+    libraryPaths = __get_search_paths(context, resolve);
+    if (libraryPaths != NULL) {
         // Iterate over the library paths and try to resolve the dependency
-        list_foreach(&libraryPaths, item) {
-            struct __path_entry* entry = (struct __path_entry*)item;
-            snprintf(path, PATH_MAX, "%s%s/%s", sysroot, entry->path, dependency);
+        list_foreach(libraryPaths, item) {
+            struct list_item_string* entry = (struct list_item_string*)item;
+            snprintf(path, PATH_MAX, "%s%s/%s", context->sysroot, entry->value, dependency);
             if (platform_stat(path, &stats) == 0) {
                 return path;
             }
@@ -179,7 +213,7 @@ const char* resolve_platform_dependency_linux(const char* sysroot, struct bake_r
 
     // Iterate over the default system library paths and try to resolve the dependency
     for (int i = 0; g_systemPaths[i] != NULL; i++) {
-        snprintf(path, PATH_MAX, "%s%s/%s", sysroot, g_systemPaths[i], dependency);
+        snprintf(path, PATH_MAX, "%s%s/%s", context->sysroot, g_systemPaths[i], dependency);
         if (platform_stat(path, &stats) == 0) {
             return path;
         }
@@ -18,12 +18,13 @@
 
 #include <chef/platform.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <vlog.h>
 
 #include "resolvers.h"
 
-extern const char* resolve_platform_dependency_linux(const char* sysroot, struct bake_resolve* resolve, const char* dependency);
+extern const char* resolve_platform_dependency_linux(struct bake_resolver_context* context, struct bake_resolve* resolve, const char* dependency);
 extern int         resolve_is_system_library_linux(const char* base, const char* dependency);
 
 extern const char* resolve_platform_dependency_windows(const char* sysroot, struct bake_resolve* resolve, const char* dependency);
@@ -48,18 +49,103 @@ static int __is_windows_target(const char* platform, const char* dependency)
     return 0;
 }
 
-const char* resolve_platform_dependency(const char* sysroot, const char* platform, struct bake_resolve* resolve, const char* dependency)
+static unsigned int __memo_bucket(const char* dependency)
 {
+    // fnv-1a
+    unsigned int hash = 2166136261u;
+    for (const char* p = dependency; *p != '\0'; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619u;
+    }
+    return hash % BAKE_RESOLVER_MEMO_BUCKETS;
+}
+
+// Must be called with the context lock held
+static struct bake_resolver_memo_entry* __memo_find(struct list* bucket, enum bake_resolve_arch arch, const char* dependency)
+{
+    struct list_item* item;
+
+    list_foreach(bucket, item) {
+        struct bake_resolver_memo_entry* entry = (struct bake_resolver_memo_entry*)item;
+        if (entry->arch == arch && strcmp(entry->name, dependency) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static int __memo_lookup(struct bake_resolver_context* context, struct list* bucket, enum bake_resolve_arch arch, const char* dependency, const char** pathOut)
+{
+    struct bake_resolver_memo_entry* entry;
+    int                              found = 0;
+
+    mtx_lock(&context->lock);
+    entry = __memo_find(bucket, arch, dependency);
+    if (entry != NULL) {
+        *pathOut = entry->path != NULL ? platform_strdup(entry->path) : NULL;
+        found = 1;
+    }
+    mtx_unlock(&context->lock);
+    return found;
+}
+
+static void __memo_store(struct bake_resolver_context* context, struct list* bucket, enum bake_resolve_arch arch, const char* dependency, const char* path)
+{
+    struct bake_resolver_memo_entry* entry;
+
+    entry = calloc(1, sizeof(struct bake_resolver_memo_entry));
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->arch = arch;
+    entry->name = platform_strdup(dependency);
+    entry->path = path != NULL ? platform_strdup(path) : NULL;
+    if (entry->name == NULL || (path != NULL && entry->path == NULL)) {
+        free((void*)entry->name);
+        free((void*)entry->path);
+        free(entry);
+        return;
+    }
+
+    // another worker may have resolved the same library in the meantime
+    mtx_lock(&context->lock);
+    if (__memo_find(bucket, arch, dependency) == NULL) {
+        list_add(bucket, &entry->list_header);
+        entry = NULL;
+    }
+    mtx_unlock(&context->lock);
+
+    if (entry != NULL) {
+        free((void*)entry->name);
+        free((void*)entry->path);
+        free(entry);
+    }
+}
+
+const char* resolve_platform_dependency(struct bake_resolver_context* context, const char* platform, struct bake_resolve* resolve, const char* dependency)
+{
+    struct list* bucket;
+    const char*  path;
     VLOG_DEBUG("resolver", "resolve_platform_dependency(sysroot=%s, platform=%s, dep=%s)\n",
-        sysroot ? sysroot : "",
+        context->sysroot,
         platform ? platform : "(null)",
         dependency ? dependency : "(null)"
     );
+
+    bucket = &context->memo[__memo_bucket(dependency)];
+    if (__memo_lookup(context, bucket, resolve->arch, dependency, &path)) {
+        return path;
+    }
     
     if (__is_windows_target(platform, dependency)) {
-        return resolve_platform_dependency_windows(sysroot, resolve, dependency);
+        path = resolve_platform_dependency_windows(context->sysroot, resolve, dependency);
+    } else {
+        path = resolve_platform_dependency_linux(context, resolve, dependency);
     }
-    return resolve_platform_dependency_linux(sysroot, resolve, dependency);
+
+    __memo_store(context, bucket, resolve->arch, dependency, path);
+    return path;
 }
 
 int resolve_is_system_library(const char* base, const char* dependency)
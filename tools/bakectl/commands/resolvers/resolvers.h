@@ -20,6 +20,7 @@
 #define __RESOLVERS_H__
 
 #include <chef/list.h>
+#include <threads.h>
 
 enum bake_resolve_arch {
     BAKE_RESOLVE_ARCH_UNKNOWN,
@@ -79,15 +80,54 @@ extern int pe_is_valid(const char* path, enum bake_resolve_arch* arch);
 extern int elf_resolve_dependencies(const char* path, struct list* dependencies);
 extern int pe_resolve_dependencies(const char* path, struct list* dependencies);
 
+#define BAKE_RESOLVER_MEMO_BUCKETS 64
+
+/**
+ * @brief Shared state for resolving platform dependencies during a stage. The
+ * context caches the parsed library search paths and the results of previous
+ * lookups, and may be used by multiple threads at once.
+ */
+struct bake_resolver_context {
+    const char* sysroot;
+    mtx_t       lock;
+    struct list search_paths;                         // struct bake_resolver_search_paths
+    struct list memo[BAKE_RESOLVER_MEMO_BUCKETS];     // struct bake_resolver_memo_entry
+};
+
+struct bake_resolver_search_paths {
+    struct list_item       list_header;
+    enum bake_resolve_arch arch;
+    struct list            paths;                     // struct list_item_string
+};
+
+struct bake_resolver_memo_entry {
+    struct list_item       list_header;
+    enum bake_resolve_arch arch;
+    const char*            name;
+    const char*            path;                      // NULL if it could not be resolved
+};
+
+/**
+ * @brief Creates a new resolver context for the given sysroot.
+ */
+extern struct bake_resolver_context* resolver_context_new(const char* sysroot);
+
+/**
+ * @brief Cleans up the resolver context and all cached lookups.
+ */
+extern void resolver_context_delete(struct bake_resolver_context* context);
+
 /**
- * @brief Tries to resolve where the dependency is located on the system.
+ * @brief Tries to resolve where the dependency is located on the system. Lookups
+ * are memoized in the context, so resolving the same library again is cheap.
  * 
- * @param[In] sysroot    The root path of the system to use.
+ * @param[In] context    The resolver context of the stage.
+ * @param[In] platform   The platform the binary was built for.
  * @param[In] resolve    The primary binary that requires this dependency
  * @param[In] dependency The dependency to resolve
- * @return const char*   The full path of the resolved dependency
+ * @return const char*   The full path of the resolved dependency, must be freed by the caller
  */
-extern const char* resolve_platform_dependency(const char* sysroot, const char* platform, struct bake_resolve* resolve, const char* dependency);
+extern const char* resolve_platform_dependency(struct bake_resolver_context* context, const char* platform, struct bake_resolve* resolve, const char* dependency);
 
 /**
  * @brief Determines whether the library is marked as a system library
@@ -54,22 +54,23 @@ static void __cleanup_systems(int sig)
 }
 
 struct __pack_resolve_commands_options {
-    const char* sysroot;
-    const char* install_root;
-    const char* ingredients_root;
-    const char* platform;
-    const char* architecture;
-    const char* base;
-    int         cross_compiling;
+    struct bake_resolver_context* resolver;
+    struct list*                  install_files;
+    struct list*                  ingredient_files;
+    const char*                   install_root;
+    const char*                   platform;
+    const char*                   architecture;
+    const char*                   base;
+    int                           cross_compiling;
 };
 
 struct __resolve_options {
-    const char* sysroot;
-    const char* install_root;
-    const char* ingredients_root;
-    const char* platform;
-    const char* base;
-    int         cross_compiling;
+    struct bake_resolver_context* resolver;
+    struct list*                  install_files;
+    struct list*                  ingredient_files;
+    const char*                   platform;
+    const char*                   base;
+    int                           cross_compiling;
 };
 
 static int __ascii_equals_ignore_case(const char* a, const char* b)
@@ -134,11 +135,25 @@ static int __verify_commands(struct list* commands, const char* root)
     return 0;
 }
 
-static int __resolve_dependency_path(struct bake_resolve* resolve, struct bake_resolve_dependency* dependency, struct __resolve_options* options)
+// The file lists of the install and ingredient roots are collected once per stage,
+// neither changes while commands are being resolved.
+static int __find_dependency_file(struct list* files, struct bake_resolve_dependency* dependency, const char* platform)
 {
-    struct list       files = { 0 };
     struct list_item* item;
-    int               status;
+
+    list_foreach(files, item) {
+        struct platform_file_entry* file = (struct platform_file_entry*)item;
+        if (__dependency_name_equals(platform, file->name, dependency->name)) {
+            dependency->path = platform_strdup(file->path);
+            dependency->sub_path = platform_strdup(file->sub_path);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int __resolve_dependency_path(struct bake_resolve* resolve, struct bake_resolve_dependency* dependency, struct __resolve_options* options)
+{
     VLOG_DEBUG("commands", "__resolve_dependency_path(dep=%s, platform=%s, base=%s, cross=%d)\n",
         dependency && dependency->name ? dependency->name : "(null)",
         options && options->platform ? options->platform : "(null)",
@@ -147,40 +162,14 @@ static int __resolve_dependency_path(struct bake_resolve* resolve, struct bake_r
     );
 
     // priority 1 - check in install path
-    status = platform_getfiles(options->install_root, 1, &files);
-    if (status) {
-        VLOG_ERROR("commands", "resolve: failed to get install file list\n");
-        return -1;
-    }
-
-    list_foreach(&files, item) {
-        struct platform_file_entry* file = (struct platform_file_entry*)item;
-        if (__dependency_name_equals(options->platform, file->name, dependency->name)) {
-            dependency->path = platform_strdup(file->path);
-            dependency->sub_path = platform_strdup(file->sub_path);
-            platform_getfiles_destroy(&files);
-            return 0;
-        }
+    if (__find_dependency_file(options->install_files, dependency, options->platform) == 0) {
+        return 0;
     }
-    platform_getfiles_destroy(&files);
 
     // priority 2 - maybe it comes from build ingredients
-    status = platform_getfiles(options->ingredients_root, 1, &files);
-    if (status) {
-        VLOG_ERROR("commands", "resolve: failed to get install file list\n");
-        return -1;
-    }
-
-    list_foreach(&files, item) {
-        struct platform_file_entry* file = (struct platform_file_entry*)item;
-        if (__dependency_name_equals(options->platform, file->name, dependency->name)) {
-            dependency->path = platform_strdup(file->path);
-            dependency->sub_path = platform_strdup(file->sub_path);
-            platform_getfiles_destroy(&files);
-            return 0;
-        }
+    if (__find_dependency_file(options->ingredient_files, dependency, options->platform) == 0) {
+        return 0;
     }
-    platform_getfiles_destroy(&files);
     
     // priority 3 - invoke platform resolver (if allowed)
     // we cannot do this if we are cross-compiling - we do not
@@ -194,7 +183,7 @@ static int __resolve_dependency_path(struct bake_resolve* resolve, struct bake_r
             return 0;
         }
 
-        path = resolve_platform_dependency(options->sysroot, options->platform, resolve, dependency->name);
+        path = resolve_platform_dependency(options->resolver, options->platform, resolve, dependency->name);
         if (path) {
             dependency->path = path;
             dependency->system_library = 1;
@@ -313,9 +302,9 @@ static int __resolve_command(struct recipe_pack_command* command, struct list* r
         status = elf_resolve_dependencies(path, &resolve->dependencies);
         if (!status) {
             status = __resolve_elf_dependencies(resolve, &(struct __resolve_options) {
-                .sysroot = options->sysroot,
-                .install_root = options->install_root,
-                .ingredients_root = options->ingredients_root,
+                .resolver = options->resolver,
+                .install_files = options->install_files,
+                .ingredient_files = options->ingredient_files,
                 .platform = options->platform,
                 .base = options->base,
                 .cross_compiling = options->cross_compiling
@@ -325,9 +314,9 @@ static int __resolve_command(struct recipe_pack_command* command, struct list* r
         status = pe_resolve_dependencies(path, &resolve->dependencies);
         if (!status) {
             status = __resolve_pe_dependencies(resolve, &(struct __resolve_options) {
-                .sysroot = options->sysroot,
-                .install_root = options->install_root,
-                .ingredients_root = options->ingredients_root,
+                .resolver = options->resolver,
+                .install_files = options->install_files,
+                .ingredient_files = options->ingredient_files,
                 .platform = options->platform,
                 .base = options->base,
                 .cross_compiling = options->cross_compiling
@@ -347,10 +336,54 @@ static int __resolve_command(struct recipe_pack_command* command, struct list* r
     return 0;
 }
 
+struct __resolve_worker_context {
+    struct recipe_pack_command**            commands;
+    struct list*                            results;   // one list per command
+    int                                     count;
+    int                                     next;
+    int                                     status;
+    mtx_t                                   lock;
+    struct __pack_resolve_commands_options* options;
+};
+
+static int __resolve_worker(void* arg)
+{
+    struct __resolve_worker_context* context = arg;
+
+    while (1) {
+        int index;
+        int status;
+
+        mtx_lock(&context->lock);
+        index = context->next++;
+        if (context->status != 0) {
+            index = context->count;
+        }
+        mtx_unlock(&context->lock);
+
+        if (index >= context->count) {
+            break;
+        }
+
+        status = __resolve_command(context->commands[index], &context->results[index], context->options);
+        if (status) {
+            mtx_lock(&context->lock);
+            context->status = status;
+            mtx_unlock(&context->lock);
+            break;
+        }
+    }
+    return 0;
+}
+
 static int __resolve_commands(struct list* commands, struct list* resolves, struct __pack_resolve_commands_options* options)
 {
-    struct list_item* item;
-    int               status;
+    struct __resolve_worker_context context = { 0 };
+    struct list_item*               item;
+    thrd_t*                         workers;
+    int                             workerCount;
+    int                             started = 0;
+    int                             i = 0;
     VLOG_DEBUG("commands", "__resolve_commands(count=%d)\n", 
         commands ? (int)commands->count : -1
     );
@@ -359,15 +392,67 @@ static int __resolve_commands(struct list* commands, struct list* resolves, stru
         return 0;
     }
 
-    // Iterate over all commands and resolve their dependencies
+    context.count = commands->count;
+    context.options = options;
+    context.commands = calloc(commands->count, sizeof(struct recipe_pack_command*));
+    context.results = calloc(commands->count, sizeof(struct list));
+    if (context.commands == NULL || context.results == NULL) {
+        free(context.commands);
+        free(context.results);
+        return -1;
+    }
+
     list_foreach(commands, item) {
-        struct recipe_pack_command* command = (struct recipe_pack_command*)item;
-        status = __resolve_command(command, resolves, options);
-        if (status) {
-            return status;
+        context.commands[i++] = (struct recipe_pack_command*)item;
+    }
+
+    // Commands are resolved independently of each other, and share the resolver
+    // context for lookups, so spread them across a pool of workers.
+    workerCount = platform_cpucount();
+    if (workerCount <= 0) {
+        workerCount = 1;
+    }
+    if (workerCount > context.count) {
+        workerCount = context.count;
+    }
+
+    workers = calloc(workerCount, sizeof(thrd_t));
+    if (workers == NULL || mtx_init(&context.lock, mtx_plain) != thrd_success) {
+        free(workers);
+        free(context.commands);
+        free(context.results);
+        return -1;
+    }
+
+    for (i = 0; i < workerCount; i++) {
+        if (thrd_create(&workers[i], __resolve_worker, &context) != thrd_success) {
+            break;
         }
+        started++;
     }
-    return 0;
+
+    // if no workers could be started, resolve on this thread
+    if (started == 0) {
+        __resolve_worker(&context);
+    }
+
+    for (i = 0; i < started; i++) {
+        thrd_join(workers[i], NULL);
+    }
+
+    // keep the results in the order of the commands
+    for (i = 0; i < context.count; i++) {
+        struct list_item* result = context.results[i].head;
+        if (result != NULL) {
+            list_add(resolves, result);
+        }
+    }
+
+    mtx_destroy(&context.lock);
+    free(workers);
+    free(context.commands);
+    free(context.results);
+    return context.status;
 }
 
 int pack_resolve_commands(struct list* commands, struct list* resolves, struct __pack_resolve_commands_options* options)
@@ -583,9 +668,12 @@ static int __install_dependencies(struct list* files, const char* installRoot)
 
 int stage_main(int argc, char** argv, struct __bakelib_context* context, struct bakectl_command_options* options)
 {
-    int               status;
-    struct list       resolves = { 0 };
-    struct list_item* item;
+    int                           status;
+    struct list                   resolves = { 0 };
+    struct list                   installFiles = { 0 };
+    struct list                   ingredientFiles = { 0 };
+    struct bake_resolver_context* resolver = NULL;
+    struct list_item*             item;
     VLOG_DEBUG("bakectl", "stage_main(argc=%d, platform=%s, arch=%s)\n",
         argc,
         context && context->build_platform ? context->build_platform : "(null)",
@@ -620,13 +708,32 @@ int stage_main(int argc, char** argv, struct __bakelib_context* context, struct
         }
     }
 
+    resolver = resolver_context_new("/");
+    if (resolver == NULL) {
+        VLOG_ERROR("bakectl", "failed to allocate resolver context\n");
+        status = -1;
+        goto cleanup;
+    }
+
+    // collect the files that dependencies can be resolved from, after the
+    // runtime ingredients have been staged
+    status = platform_getfiles(context->install_directory, 1, &installFiles);
+    if (status == 0) {
+        status = platform_getfiles(context->build_ingredients_directory, 1, &ingredientFiles);
+    }
+    if (status) {
+        VLOG_ERROR("bakectl", "failed to get install file list\n");
+        goto cleanup;
+    }
+
     list_foreach(&context->recipe->packs, item) {
         struct recipe_pack* pack = (struct recipe_pack*)item;
         
         status = pack_resolve_commands(&pack->commands, &resolves, &(struct __pack_resolve_commands_options) {
-            .sysroot = "/",
+            .resolver = resolver,
+            .install_files = &installFiles,
+            .ingredient_files = &ingredientFiles,
             .install_root = context->install_directory,
-            .ingredients_root = context->build_ingredients_directory,
             .platform = context->build_platform,
             .architecture = context->build_architecture,
             .base = recipe_platform_base(context->recipe, context->build_platform),
@@ -649,5 +756,8 @@ int stage_main(int argc, char** argv, struct __bakelib_context* context, struct
 
 cleanup:
     pack_resolve_destroy(&resolves);
+    platform_getfiles_destroy(&installFiles);
+    platform_getfiles_destroy(&ingredientFiles);
+    resolver_context_delete(resolver);
     return status;
 }
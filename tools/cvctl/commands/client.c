@@ -0,0 +1,176 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <chef/dirs.h>
+#include <chef/platform.h>
+#include <gracht/link/socket.h>
+#include <gracht/client.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chef_cvd_service_client.h"
+#include "commands.h"
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define __DEFAULT_CVD_TYPE    "local"
+#define __DEFAULT_CVD_ADDRESS "@/chef/cvd/api"
+#define __DEFAULT_CVD_PORT    0
+
+static int __configure_local(struct gracht_link_socket* link, const char* address)
+{
+    struct sockaddr_storage storage = { 0 };
+    struct sockaddr_un*     local = (struct sockaddr_un*)&storage;
+    socklen_t               size = sizeof(struct sockaddr_un);
+
+    if (strlen(address) >= sizeof(local->sun_path)) {
+        fprintf(stderr, "cvctl: address too long for local socket: %s\n", address);
+        return -1;
+    }
+
+    // abstract socket paths are not null-terminated
+    local->sun_family = AF_LOCAL;
+    if (address[0] == '@') {
+        strncpy(local->sun_path + 1, address + 1, sizeof(local->sun_path) - 1);
+        size = offsetof(struct sockaddr_un, sun_path) + strlen(address);
+    } else {
+        strncpy(local->sun_path, address, sizeof(local->sun_path));
+    }
+    gracht_link_socket_set_connect_address(link, &storage, size);
+    gracht_link_socket_set_domain(link, AF_LOCAL);
+
+    // packet based links must be bound, so cvd can respond
+    memset(&storage, 0, sizeof(storage));
+    local->sun_family = AF_LOCAL;
+    snprintf(&local->sun_path[1], sizeof(local->sun_path) - 2, "/chef/cvd/clients/%u", getpid());
+    gracht_link_socket_set_bind_address(link, &storage,
+        offsetof(struct sockaddr_un, sun_path) + 1 + strlen(&local->sun_path[1]));
+    return 0;
+}
+#elif defined(_WIN32)
+#include <windows.h>
+
+#define __DEFAULT_CVD_TYPE    "inet4"
+#define __DEFAULT_CVD_ADDRESS "127.0.0.1"
+#define __DEFAULT_CVD_PORT    51003
+
+static int __configure_local(struct gracht_link_socket* link, const char* address)
+{
+    (void)link;
+    fprintf(stderr, "cvctl: local sockets are not supported: %s\n", address);
+    return -1;
+}
+#endif
+
+static void __configure_inet4(struct gracht_link_socket* link, const char* address, unsigned short port)
+{
+    struct sockaddr_storage storage = { 0 };
+    struct sockaddr_in*     inet4 = (struct sockaddr_in*)&storage;
+
+    inet4->sin_family = AF_INET;
+    inet4->sin_addr.s_addr = inet_addr(address);
+    inet4->sin_port = htons(port);
+    gracht_link_socket_set_connect_address(link, &storage, sizeof(struct sockaddr_in));
+    gracht_link_socket_set_domain(link, AF_INET);
+}
+
+// __configure_link connects to the api-address from cvd.json, or the
+// default address of cvd if it has not been configured.
+static int __configure_link(struct gracht_link_socket* link)
+{
+    const char*    type = __DEFAULT_CVD_TYPE;
+    const char*    address = __DEFAULT_CVD_ADDRESS;
+    unsigned short port = __DEFAULT_CVD_PORT;
+    json_t*        root = NULL;
+    json_t*        api;
+    char           path[PATH_MAX] = { 0 };
+    int            status;
+
+    if (chef_dirs_initialize(CHEF_DIR_SCOPE_DAEMON) != 0) {
+        fprintf(stderr, "cvctl: failed to initialize directory code\n");
+        return -1;
+    }
+
+    snprintf(&path[0], sizeof(path), "%s" CHEF_PATH_SEPARATOR_S "cvd.json", chef_dirs_config());
+    root = json_load_file(&path[0], 0, NULL);
+    api = root != NULL ? json_object_get(root, "api-address") : NULL;
+    if (api != NULL && json_string_value(json_object_get(api, "type")) != NULL &&
+        json_string_value(json_object_get(api, "address")) != NULL) {
+        type = json_string_value(json_object_get(api, "type"));
+        address = json_string_value(json_object_get(api, "address"));
+        port = (unsigned short)(json_integer_value(json_object_get(api, "port")) & 0xFFFF);
+    }
+
+    gracht_link_socket_set_type(link, gracht_link_packet_based);
+    if (!strcmp(type, "local")) {
+        status = __configure_local(link, address);
+    } else if (!strcmp(type, "inet4")) {
+        __configure_inet4(link, address, port);
+        status = 0;
+    } else {
+        fprintf(stderr, "cvctl: unsupported cvd address type %s\n", type);
+        status = -1;
+    }
+
+    json_decref(root);
+    return status;
+}
+
+int cvctl_cvd_client_create(gracht_client_t** clientOut)
+{
+    struct gracht_link_socket*         link;
+    struct gracht_client_configuration clientConfiguration;
+    gracht_client_t*                   client;
+    int                                status;
+
+    status = gracht_link_socket_create(&link);
+    if (status) {
+        fprintf(stderr, "cvctl: failed to initialize socket\n");
+        return status;
+    }
+
+    status = __configure_link(link);
+    if (status) {
+        return status;
+    }
+
+    gracht_client_configuration_init(&clientConfiguration);
+    gracht_client_configuration_set_link(&clientConfiguration, (struct gracht_link*)link);
+
+    status = gracht_client_create(&clientConfiguration, &client);
+    if (status) {
+        fprintf(stderr, "cvctl: failed to initialize client: %s\n", strerror(errno));
+        return status;
+    }
+
+    status = gracht_client_connect(client);
+    if (status) {
+        fprintf(stderr, "cvctl: failed to connect to cvd: %s\n", strerror(errno));
+        gracht_client_shutdown(client);
+        return status;
+    }
+
+    *clientOut = client;
+    return 0;
+}
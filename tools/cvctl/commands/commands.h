@@ -19,8 +19,17 @@
 #ifndef __CVCTL_COMMANDS_H__
 #define __CVCTL_COMMANDS_H__
 
+#include <gracht/client.h>
+
 struct cvctl_command_options {
     int dummy;
 };
 
+/**
+ * @brief Connects to the cvd instance of this machine, using the api-address
+ * configured in cvd.json, or the default address of cvd.
+ * @return 0 on success, non-zero on error. An error has already been printed.
+ */
+extern int cvctl_cvd_client_create(gracht_client_t** clientOut);
+
 #endif //!__CVCTL_COMMANDS_H__
@@ -0,0 +1,158 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chef/platform.h>
+#include <errno.h>
+#include <gracht/client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chef_cvd_service_client.h"
+#include "commands.h"
+
+// how often cvd is asked for new lines when following
+#define __FOLLOW_INTERVAL_MS 500
+
+static void __print_help(void)
+{
+    printf("Usage: cvctl logs <container-id> [options]\n");
+    printf("  Shows the output of the processes running in the container. cvd keeps\n");
+    printf("  a limited number of lines per container, see the log-lines option.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -n, --lines <count>\n");
+    printf("      Only show the last <count> lines\n");
+    printf("  -f, --follow\n");
+    printf("      Keep printing new lines as they are produced\n");
+    printf("  -h, --help\n");
+    printf("      Print this help message\n");
+}
+
+static int __fetch_logs(gracht_client_t* client, const char* containerId, unsigned long long since, unsigned int max, struct chef_log_chunk* chunk)
+{
+    struct gracht_message_context context;
+    enum chef_status              status;
+    int                           result;
+
+    result = chef_cvd_logs(client, &context, containerId, since, max);
+    if (result) {
+        fprintf(stderr, "cvctl: failed to request logs: %s\n", strerror(errno));
+        return result;
+    }
+    gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+
+    memset(chunk, 0, sizeof(struct chef_log_chunk));
+    chef_cvd_logs_result(client, &context, chunk, &status);
+    if (status != CHEF_STATUS_SUCCESS) {
+        fprintf(stderr, "cvctl: failed to get logs of %s: %i\n", containerId, status);
+        chef_log_chunk_destroy(chunk);
+        return -1;
+    }
+    return 0;
+}
+
+static void __print_chunk(struct chef_log_chunk* chunk)
+{
+    for (uint32_t i = 0; i < chunk->lines_count; i++) {
+        FILE* stream = chunk->lines[i].stream == CHEF_LOG_STREAM_STDERR ? stderr : stdout;
+        fprintf(stream, "%s\n", chunk->lines[i].text);
+    }
+    fflush(stdout);
+}
+
+int logs_main(int argc, char** argv, char** envp, struct cvctl_command_options* options)
+{
+    gracht_client_t*      client;
+    struct chef_log_chunk chunk;
+    const char*           containerId = NULL;
+    unsigned long long    since = 0;
+    unsigned int          tail = 0;
+    int                   follow = 0;
+    int                   result;
+
+    (void)envp;
+    (void)options;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            __print_help();
+            return 0;
+        } else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--follow")) {
+            follow = 1;
+        } else if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--lines")) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "cvctl: %s requires a value\n", argv[i]);
+                return -1;
+            }
+            tail = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "cvctl: unknown option '%s'\n", argv[i]);
+            __print_help();
+            return -1;
+        } else if (containerId == NULL) {
+            containerId = argv[i];
+        } else {
+            fprintf(stderr, "cvctl: too many arguments\n");
+            return -1;
+        }
+    }
+
+    if (containerId == NULL) {
+        fprintf(stderr, "cvctl: missing container id\n");
+        __print_help();
+        return -1;
+    }
+
+    result = cvctl_cvd_client_create(&client);
+    if (result) {
+        return result;
+    }
+
+    // cvd returns the oldest lines first, so to show the last <count> lines the
+    // full backlog is fetched and only the end of it is printed
+    result = __fetch_logs(client, containerId, 0, 0, &chunk);
+    if (result) {
+        goto cleanup;
+    }
+    if (tail > 0 && chunk.lines_count > tail) {
+        for (uint32_t i = 0; i < chunk.lines_count - tail; i++) {
+            free(chunk.lines[i].text);
+        }
+        memmove(&chunk.lines[0], &chunk.lines[chunk.lines_count - tail], tail * sizeof(struct chef_log_line));
+        chunk.lines_count = tail;
+    }
+    __print_chunk(&chunk);
+    since = chunk.next;
+    chef_log_chunk_destroy(&chunk);
+
+    while (follow) {
+        platform_sleep(__FOLLOW_INTERVAL_MS);
+        result = __fetch_logs(client, containerId, since, 0, &chunk);
+        if (result) {
+            break;
+        }
+        __print_chunk(&chunk);
+        since = chunk.next;
+        chef_log_chunk_destroy(&chunk);
+    }
+
+cleanup:
+    gracht_client_shutdown(client);
+    return result;
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <gracht/client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chef_cvd_service_client.h"
+#include "commands.h"
+
+static void __print_help(void)
+{
+    printf("Usage: cvctl timing <container-id> [options]\n");
+    printf("  Shows how long cvd took to start the container, broken down\n");
+    printf("  per phase of the container setup.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help\n");
+    printf("      Print this help message\n");
+}
+
+static void __print_duration(const char* name, unsigned long long durationUs, unsigned long long totalUs)
+{
+    unsigned long long percent = totalUs ? (durationUs * 100) / totalUs : 0;
+    printf("%12s %8llu.%03llu ms %4llu%%\n", name, durationUs / 1000, durationUs % 1000, percent);
+}
+
+int timing_main(int argc, char** argv, char** envp, struct cvctl_command_options* options)
+{
+    gracht_client_t*              client;
+    struct gracht_message_context context;
+    struct chef_create_timing     timing;
+    enum chef_status              status;
+    const char*                   containerId = NULL;
+    int                           result;
+
+    (void)envp;
+    (void)options;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            __print_help();
+            return 0;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "cvctl: unknown option '%s'\n", argv[i]);
+            __print_help();
+            return -1;
+        } else if (containerId == NULL) {
+            containerId = argv[i];
+        } else {
+            fprintf(stderr, "cvctl: too many arguments\n");
+            return -1;
+        }
+    }
+
+    if (containerId == NULL) {
+        fprintf(stderr, "cvctl: missing container id\n");
+        __print_help();
+        return -1;
+    }
+
+    result = cvctl_cvd_client_create(&client);
+    if (result) {
+        return result;
+    }
+
+    result = chef_cvd_timing(client, &context, containerId);
+    if (result) {
+        fprintf(stderr, "cvctl: failed to request timing: %s\n", strerror(errno));
+        goto cleanup;
+    }
+    gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+
+    memset(&timing, 0, sizeof(timing));
+    chef_cvd_timing_result(client, &context, &timing, &status);
+    if (status != CHEF_STATUS_SUCCESS) {
+        fprintf(stderr, "cvctl: failed to get timing of %s: %i\n", containerId, status);
+        chef_create_timing_destroy(&timing);
+        result = -1;
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < timing.phases_count; i++) {
+        __print_duration(timing.phases[i].name, timing.phases[i].duration_us, timing.total_us);
+    }
+    __print_duration("total", timing.total_us, timing.total_us);
+    chef_create_timing_destroy(&timing);
+
+cleanup:
+    gracht_client_shutdown(client);
+    return result;
+}
@@ -33,6 +33,8 @@ extern int start_main(int argc, char** argv, char** envp, struct cvctl_command_o
 extern int exec_main(int argc, char** argv, char** envp, struct cvctl_command_options* options);
 extern int config_main(int argc, char** argv, char** envp, struct cvctl_command_options* options);
 extern int uvm_main(int argc, char** argv, char** envp, struct cvctl_command_options* options);
+extern int timing_main(int argc, char** argv, char** envp, struct cvctl_command_options* options);
+extern int logs_main(int argc, char** argv, char** envp, struct cvctl_command_options* options);
 
 struct command_handler {
     char* name;
@@ -43,7 +45,9 @@ static struct command_handler g_commands[] = {
     { "start", start_main },
     { "exec",  exec_main },
     { "config", config_main },
-    { "uvm", uvm_main }
+    { "uvm", uvm_main },
+    { "timing", timing_main },
+    { "logs", logs_main }
 };
 
 enum cvctl_global_action {
@@ -65,6 +69,8 @@ static void __print_help(void)
     printf("  exec       executes a command inside an existing container\n");
     printf("  config     view or change cvd configuration values\n");
     printf("  uvm        fetch or import LCOW UVM assets\n");
+    printf("  timing     shows how long cvd took to start a container\n");
+    printf("  logs       shows the output of a container\n");
     printf("\n");
     printf("Global Options:\n");
     printf("  -h, --help\n");
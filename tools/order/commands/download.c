@@ -0,0 +1,166 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <chef/api/package.h>
+#include <chef/client.h>
+#include <chef/platform.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static void __print_help(void)
+{
+    printf("Usage: order download <publisher/pack> [options]\n");
+    printf("  Downloads a pack without installing it. Interrupted downloads are\n");
+    printf("  resumed when the same command is run again.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -p, --platform <platform>\n");
+    printf("      The platform of the pack, defaults to the host platform\n");
+    printf("  -a, --arch <arch>\n");
+    printf("      The architecture of the pack, defaults to the host architecture\n");
+    printf("  -c, --channel <channel>\n");
+    printf("      The channel to download from, defaults to stable\n");
+    printf("  -r, --revision <revision>\n");
+    printf("      Download a specific revision instead of the latest in the channel\n");
+    printf("  -o, --output <path>\n");
+    printf("      Where to save the pack, defaults to <pack>.pack\n");
+    printf("  -h, --help\n");
+    printf("      Print this help message\n");
+}
+
+static int __parse_packname(char* pack, struct chef_download_params* params)
+{
+    // pack names are in the form of publisher/name, we need to seperate those
+    char* slash = strchr(pack, '/');
+    if (!slash) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *slash = '\0';
+
+    params->publisher = pack;
+    params->package   = slash + 1;
+    return 0;
+}
+
+static void __print_progress(unsigned long long bytesCurrent, unsigned long long bytesTotal, void* userData)
+{
+    (void)userData;
+    if (bytesTotal == 0) {
+        return;
+    }
+    printf("\rdownloading... %3llu%%", (bytesCurrent * 100) / bytesTotal);
+    fflush(stdout);
+}
+
+int download_main(int argc, char** argv)
+{
+    struct chef_observer        observer = { .report = __print_progress, .userData = NULL };
+    struct chef_download_params params   = { 0 };
+    const char*                 output   = NULL;
+    char*                       packCopy = NULL;
+    char                        defaultOutput[256];
+    int                         status;
+
+    params.platform = CHEF_PLATFORM_STR;
+    params.arch     = CHEF_ARCHITECTURE_STR;
+    params.channel  = "stable";
+    params.observer = &observer;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            __print_help();
+            free(packCopy);
+            return 0;
+        } else if (argv[i][0] == '-' && i + 1 >= argc) {
+            fprintf(stderr, "order: missing value for option '%s'\n", argv[i]);
+            free(packCopy);
+            return -1;
+        } else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--platform")) {
+            params.platform = argv[++i];
+        } else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--arch")) {
+            params.arch = argv[++i];
+        } else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--channel")) {
+            params.channel = argv[++i];
+        } else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--revision")) {
+            params.revision = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            output = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "order: unknown option '%s' for 'download'\n", argv[i]);
+            free(packCopy);
+            return -1;
+        } else if (params.publisher == NULL) {
+            packCopy = platform_strdup(argv[i]);
+            status   = __parse_packname(packCopy, &params);
+            if (status) {
+                free(packCopy);
+                fprintf(stderr, "order: failed to parse pack name: %s\n", strerror(errno));
+                return status;
+            }
+        } else {
+            free(packCopy);
+            fprintf(stderr, "order: too many arguments\n");
+            __print_help();
+            return -1;
+        }
+    }
+
+    if (params.publisher == NULL) {
+        fprintf(stderr, "order: missing pack name\n");
+        __print_help();
+        return -1;
+    }
+
+    if (output == NULL) {
+        snprintf(&defaultOutput[0], sizeof(defaultOutput), "%s.pack", params.package);
+        output = &defaultOutput[0];
+    }
+
+    // initialize chefclient
+    status = chefclient_initialize();
+    if (status != 0) {
+        free(packCopy);
+        fprintf(stderr, "order: failed to initialize chefclient: %s\n", strerror(errno));
+        return -1;
+    }
+    atexit(chefclient_cleanup);
+
+    status = chefclient_pack_download(&params, output);
+    printf("\n");
+    if (status != 0) {
+        fprintf(stderr, "order: failed to download %s/%s: %s\n", params.publisher, params.package, strerror(errno));
+        goto cleanup;
+    }
+
+    printf("downloaded %s/%s revision %i to %s\n", params.publisher, params.package, params.revision, output);
+    if (params.sha512_valid) {
+        printf("sha512: ");
+        for (int i = 0; i < CHEF_DOWNLOAD_SHA512_SIZE; i++) {
+            printf("%02x", params.sha512[i]);
+        }
+        printf("\n");
+    }
+
+cleanup:
+    free(packCopy);
+    return status;
+}
@@ -28,6 +28,7 @@ extern int account_main(int argc, char** argv);
 extern int config_main(int argc, char** argv);
 extern int package_main(int argc, char** argv);
 extern int info_main(int argc, char** argv);
+extern int download_main(int argc, char** argv);
 extern int find_main(int argc, char** argv);
 extern int publish_main(int argc, char** argv);
 
@@ -41,6 +42,7 @@ static struct command_handler g_commands[] = {
     { "config",   config_main },
     { "package",  package_main },
     { "info",     info_main },
+    { "download", download_main },
     { "find",     find_main },
     { "publish",  publish_main }
 };
@@ -64,6 +66,7 @@ static void __print_help(void)
     printf("  config      view or change configuration values for order\n");
     printf("  package     view or manage your published packages\n");
     printf("  info        retrieves information about a specific pack\n");
+    printf("  download    downloads a specific pack without installing it\n");
     printf("  find        find packages by publisher or by name\n");
     printf("  publish     publish a new pack to chef\n");
     printf("\n");
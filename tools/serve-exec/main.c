@@ -24,6 +24,17 @@
 #include <stdlib.h>
 #include "chef-config.h"
 
+#if defined(__linux__)
+#include <gracht/client.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern int  serve_exec_session_begin(const char* containerName, gracht_client_t** clientOut);
+extern void serve_exec_session_detach(gracht_client_t* client);
+extern void serve_exec_session_end(gracht_client_t* client, const char* containerName);
+#endif
+
 static void __print_help(void)
 {
     printf("Usage: serve-exec --container <container-name> --path <path-inside-container> --wdir <working-directory> [command-args...]\n");
@@ -39,6 +50,8 @@ static void __print_help(void)
     printf("      Command path to execute inside the container\n");
     printf("  --wdir <working-directory>\n");
     printf("      Working directory for the in-container process\n");
+    printf("  --join\n");
+    printf("      Join the container instead of using its exec helper\n");
 }
 
 static char** __rebuild_args(int argc, char** argv, const char* arg0, int argIndex)
@@ -97,6 +110,103 @@ static int __spawn_command(int argc, char** argv, char** envp, const char* conta
     return status;
 }
 
+#if defined(__linux__)
+// Hands the command to the exec helper in the container, which saves joining
+// the container namespaces for every command.
+static int __exec_command(int argc, char** argv, char** envp, const char* containerName, const char* commandPath, const char* workingDirectory, int argIndex, int* exitCodeOut)
+{
+    char** rebuildArgv;
+    int    status;
+
+    rebuildArgv = __rebuild_args(argc, argv, NULL, argIndex);
+    if (rebuildArgv == NULL) {
+        return -1;
+    }
+
+    status = containerv_exec(containerName, commandPath,
+        &(struct containerv_join_options){
+            .cwd  = workingDirectory,
+            .argv = (const char* const*)rebuildArgv,
+            .envp = (const char* const*)envp
+        },
+        exitCodeOut
+    );
+    if (status && errno != ENOTSUP) {
+        fprintf(stderr, "serve-exec: %s: %s\n", commandPath, strerror(errno));
+    }
+    free(rebuildArgv);
+    return status;
+}
+
+// Runs the command in a child process, so the session can be ended when it exits
+// and served knows the container is no longer in use.
+static int __spawn_session(int argc, char** argv, char** envp, const char* containerName, const char* commandPath, const char* workingDirectory, int argIndex, int useHelper)
+{
+    gracht_client_t* client = NULL;
+    pid_t            pid;
+    int              status;
+
+    if (commandPath == NULL || strlen(commandPath) == 0) {
+        fprintf(stderr, "serve-exec: cannot be invoked directly\n");
+        return -1;
+    }
+
+    // served is not running or does not know the container if this fails, in
+    // which case it must already exist for the command to run
+    if (serve_exec_session_begin(containerName, &client)) {
+        client = NULL;
+    }
+
+    // the helper waits for the command, so there is nothing to fork here
+    if (useHelper) {
+        int exitCode;
+
+        status = __exec_command(argc, argv, envp, containerName, commandPath, workingDirectory, argIndex, &exitCode);
+        if (status == 0 || errno != ENOTSUP) {
+            if (client != NULL) {
+                serve_exec_session_end(client, containerName);
+            }
+            return status == 0 ? exitCode : -1;
+        }
+    }
+
+    if (client == NULL) {
+        return __spawn_command(argc, argv, envp, containerName, commandPath, workingDirectory, argIndex);
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "serve-exec: failed to start %s: %s\n", commandPath, strerror(errno));
+        serve_exec_session_end(client, containerName);
+        return -1;
+    } else if (pid == 0) {
+        serve_exec_session_detach(client);
+        exit(__spawn_command(argc, argv, envp, containerName, commandPath, workingDirectory, argIndex));
+    }
+
+    // let the command handle interrupts from the terminal, the session
+    // must stay open until it has exited
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    serve_exec_session_end(client, containerName);
+
+    if (status == -1) {
+        return -1;
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+#endif
+
 // invoked as <serve-exec-path> --container <container-name> --path <path-inside-container> --wdir <working-directory> <arguments-for-internal-command>
 int main(int argc, char** argv, char** envp)
 {
@@ -104,6 +214,7 @@ int main(int argc, char** argv, char** envp)
     const char* commandPath   = NULL;
     const char* workingDirectory = NULL;
     int         argIndex      = 1;
+    int         useHelper     = 1;
     int         status;
 
     if (argc > 1) {
@@ -127,6 +238,9 @@ int main(int argc, char** argv, char** envp)
         } else if (strcmp(argv[argIndex], "--wdir") == 0 && argIndex + 1 < argc) {
             workingDirectory = argv[argIndex + 1];
             argIndex += 2;
+        } else if (strcmp(argv[argIndex], "--join") == 0) {
+            useHelper = 0;
+            argIndex++;
         } else {
             break;
         }
@@ -146,6 +260,11 @@ int main(int argc, char** argv, char** envp)
     // So we use argv[0] to retrieve command information, together with application information
     // and then setup the environment for the command, and pass argv[1+] to it
 
+#if defined(__linux__)
+    status = __spawn_session(argc, argv, envp, containerName, commandPath, workingDirectory, argIndex, useHelper);
+#else
+    (void)useHelper;
     status = __spawn_command(argc, argv, envp, containerName, commandPath, workingDirectory, argIndex);
+#endif
     return status;
 }
@@ -0,0 +1,152 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <gracht/link/socket.h>
+#include <gracht/client.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/un.h>
+
+#include "chef_served_service_client.h"
+
+// Commands of applications without services run in containers that served creates
+// on first use and reaps when idle, so each command is run as a session that keeps
+// its container alive while it is running.
+
+static const char* g_servedPath = "/tmp/served";
+
+static void __init_socket_config(struct gracht_link_socket* link)
+{
+    struct sockaddr_un addr = { 0 };
+
+    addr.sun_family = AF_LOCAL;
+    strncpy(addr.sun_path, g_servedPath, sizeof(addr.sun_path));
+    addr.sun_path[sizeof(addr.sun_path) - 1] = '\0';
+
+    gracht_link_socket_set_type(link, gracht_link_stream_based);
+    gracht_link_socket_set_connect_address(link, (const struct sockaddr_storage*)&addr, sizeof(struct sockaddr_un));
+    gracht_link_socket_set_domain(link, AF_LOCAL);
+}
+
+static int __connect(gracht_client_t** clientOut)
+{
+    struct gracht_link_socket*         link;
+    struct gracht_client_configuration clientConfiguration;
+    gracht_client_t*                   client = NULL;
+    int                                code;
+
+    gracht_client_configuration_init(&clientConfiguration);
+
+    code = gracht_link_socket_create(&link);
+    if (code) {
+        return code;
+    }
+    __init_socket_config(link);
+
+    gracht_client_configuration_set_link(&clientConfiguration, (struct gracht_link*)link);
+    code = gracht_client_create(&clientConfiguration, &client);
+    if (code) {
+        return code;
+    }
+
+    code = gracht_client_connect(client);
+    if (code) {
+        gracht_client_shutdown(client);
+        return code;
+    }
+
+    *clientOut = client;
+    return 0;
+}
+
+int serve_exec_session_begin(const char* containerName, gracht_client_t** clientOut)
+{
+    struct gracht_message_context context;
+    gracht_client_t*              client;
+    int                           status;
+    int                           result = 0;
+
+    if (__connect(&client)) {
+        return -1;
+    }
+
+    status = chef_served_activate(client, &context, containerName);
+    if (status == 0) {
+        status = gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+    }
+    if (status == 0) {
+        status = chef_served_activate_result(client, &context, &result);
+    }
+    if (status || result) {
+        gracht_client_shutdown(client);
+        errno = result ? result : EPIPE;
+        return -1;
+    }
+
+    *clientOut = client;
+    return 0;
+}
+
+void serve_exec_session_detach(gracht_client_t* client)
+{
+    // the command must not inherit the connection to served
+    gracht_client_shutdown(client);
+}
+
+void serve_exec_session_end(gracht_client_t* client, const char* containerName)
+{
+    struct gracht_message_context context;
+
+    if (chef_served_deactivate(client, &context, containerName) == 0) {
+        gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+    }
+    gracht_client_shutdown(client);
+}
+
+// The protocol is only used for the session calls, but its events must be
+// implemented for the generated client code to link
+void chef_served_event_transaction_started_invocation(gracht_client_t* client, const struct chef_transaction_started* info)
+{
+    (void)client;
+    (void)info;
+}
+
+void chef_served_event_transaction_state_changed_invocation(gracht_client_t* client, const struct chef_transaction_state_changed* info)
+{
+    (void)client;
+    (void)info;
+}
+
+void chef_served_event_transaction_completed_invocation(gracht_client_t* client, const struct chef_transaction_completed* info)
+{
+    (void)client;
+    (void)info;
+}
+
+void chef_served_event_transaction_io_progress_invocation(gracht_client_t* client, const struct chef_transaction_io_progress* info)
+{
+    (void)client;
+    (void)info;
+}
+
+void chef_served_event_transaction_log_invocation(gracht_client_t* client, const struct chef_transaction_log* info)
+{
+    (void)client;
+    (void)info;
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Measures how long serve-exec takes to run a command in a container, both
+// through the exec helper of the container and by joining the container.
+// The container must already be running, e.g. one created by served for an
+// installed package (publisher.package), with the helper enabled.
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_RUNS 500
+
+extern char** environ;
+
+static double __elapsed_us(struct timespec* start, struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1000000.0 +
+           (double)(end->tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+static int __compare_double(const void* a, const void* b)
+{
+    double lhs = *(const double*)a;
+    double rhs = *(const double*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static int __run(char* const* argv)
+{
+    pid_t pid;
+    int   status;
+
+    status = posix_spawn(&pid, argv[0], NULL, NULL, argv, environ);
+    if (status) {
+        errno = status;
+        return -1;
+    }
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+static int __bench_path(const char* name, char* const* argv, int runs)
+{
+    struct timespec start, end;
+    double*         samples;
+    double          total = 0.0;
+
+    samples = calloc((size_t)runs, sizeof(double));
+    if (samples == NULL) {
+        return -1;
+    }
+
+    // the first run pays for activating the container and warming caches
+    if (__run(argv)) {
+        fprintf(stderr, "bench: %s: serve-exec failed\n", name);
+        free(samples);
+        return -1;
+    }
+
+    for (int i = 0; i < runs; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (__run(argv)) {
+            fprintf(stderr, "bench: %s: serve-exec failed on run %i\n", name, i);
+            free(samples);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = __elapsed_us(&start, &end);
+        total += samples[i];
+    }
+
+    qsort(samples, (size_t)runs, sizeof(double), __compare_double);
+    printf("%s: %i runs, mean %.1f us, p50 %.1f us, p99 %.1f us\n",
+        name, runs, total / runs, samples[runs / 2], samples[(runs * 99) / 100]);
+    free(samples);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* serveExec = NULL;
+    const char* container = NULL;
+    const char* command = "/bin/true";
+    int         runs = BENCH_DEFAULT_RUNS;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "--serve-exec")) {
+            serveExec = argv[++i];
+        } else if (i + 1 < argc && !strcmp(argv[i], "--container")) {
+            container = argv[++i];
+        } else if (i + 1 < argc && !strcmp(argv[i], "--command")) {
+            command = argv[++i];
+        } else if (i + 1 < argc && !strcmp(argv[i], "--runs")) {
+            runs = atoi(argv[++i]);
+        } else {
+            printf("Usage: serve_exec_bench --serve-exec PATH --container ID [--command PATH] [--runs N]\n");
+            return !strcmp(argv[i], "--help") ? 0 : 1;
+        }
+    }
+
+    if (serveExec == NULL || container == NULL || runs <= 0) {
+        fprintf(stderr, "bench: --serve-exec and --container are required, and runs must be positive\n");
+        return 1;
+    }
+
+    char* const helperArgv[] = {
+        (char*)serveExec, "--container", (char*)container, "--path", (char*)command, "--wdir", "/", NULL
+    };
+    char* const joinArgv[] = {
+        (char*)serveExec, "--container", (char*)container, "--path", (char*)command, "--wdir", "/", "--join", NULL
+    };
+
+    if (__bench_path("exec helper", helperArgv, runs) || __bench_path("join", joinArgv, runs)) {
+        return 1;
+    }
+    return 0;
+}
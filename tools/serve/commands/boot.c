@@ -0,0 +1,102 @@
+/**
+ * Copyright, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <gracht/client.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "chef_served_service_client.h"
+
+extern int __chef_client_initialize(gracht_client_t** clientOut);
+
+static void __print_help(void)
+{
+    printf("Usage: serve boot [options]\n");
+    printf("  Shows how long it took to bring up the containers of the installed\n");
+    printf("  packages when served last started.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help\n");
+    printf("      Print this help message\n");
+}
+
+int boot_main(int argc, char** argv)
+{
+    gracht_client_t*               client;
+    struct gracht_message_context  context;
+    struct chef_served_boot_report report;
+    char                           timestamp[64];
+    time_t                         started;
+    int                            status;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+                __print_help();
+                return 0;
+            } else {
+                printf("serve: unknown option: %s\n", argv[i]);
+                __print_help();
+                return -1;
+            }
+        }
+    }
+
+    status = __chef_client_initialize(&client);
+    if (status != 0) {
+        printf("serve: failed to initialize client: %s\n", strerror(status));
+        return status;
+    }
+
+    status = chef_served_boot_report(client, &context);
+    if (status != 0) {
+        printf("serve: failed to get the boot report: %s\n", strerror(status));
+        goto cleanup;
+    }
+    gracht_client_wait_message(client, &context, GRACHT_MESSAGE_BLOCK);
+
+    memset(&report, 0, sizeof(report));
+    chef_served_boot_report_result(client, &context, &report);
+
+    if (report.started == 0) {
+        printf("serve: served has not finished loading packages yet\n");
+        chef_served_boot_report_destroy(&report);
+        goto cleanup;
+    }
+
+    started = (time_t)report.started;
+    strftime(&timestamp[0], sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&started));
+    printf("loaded %u packages in %u ms (started %s)\n", report.entries_count, report.duration_ms, &timestamp[0]);
+
+    for (uint32_t i = 0; i < report.entries_count; i++) {
+        struct chef_served_boot_entry* entry = &report.entries[i];
+        printf("%30.30s %8u ms %8u ms  %s%s\n",
+            entry->package, entry->queued_ms, entry->duration_ms,
+            entry->status == 0 ? "ok" : strerror(entry->status),
+            entry->services ? " (services)" : ""
+        );
+    }
+    chef_served_boot_report_destroy(&report);
+
+cleanup:
+    gracht_client_shutdown(client);
+    return status;
+}
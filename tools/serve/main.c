@@ -26,6 +26,7 @@ extern int remove_main(int argc, char** argv);
 extern int update_main(int argc, char** argv);
 extern int list_main(int argc, char** argv);
 extern int config_main(int argc, char** argv);
+extern int boot_main(int argc, char** argv);
 
 struct command_handler {
     char* name;
@@ -37,7 +38,8 @@ static struct command_handler g_commands[] = {
     { "remove",  remove_main },
     { "update",  update_main },
     { "list",    list_main },
-    { "config",  config_main }
+    { "config",  config_main },
+    { "boot",    boot_main }
 };
 
 enum serve_global_action {
@@ -60,6 +62,7 @@ static void __print_help(void)
     printf("  update      update an installed package or do a full update\n");
     printf("  list        list all installed packages\n");
     printf("  config      view or change served configuration values\n");
+    printf("  boot        show how long loading the packages took at startup\n");
     printf("\n");
     printf("Global Options:\n");
     printf("  -h, --help\n");